@@ -0,0 +1,90 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "net.h"
+#include "netbase.h"
+
+#ifndef WIN32
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+// Peers connected through local socket pairs. Kept below FD_SETSIZE / 2 so
+// the select() backend can be measured with the same number of peers.
+static const int PEERS = 400;
+// Out of 100 peers, the ones sending a message per round in the chatty case
+static const int CHATTY_PERCENT = 10;
+
+// One round of the socket handler: wait for every peer to be readable, then
+// read what the ready ones sent.
+static void SocketEventsRound(CSocketEvents& socketEvents, const std::vector<SOCKET>& vServer)
+{
+    std::set<SOCKET> recv_set(vServer.begin(), vServer.end());
+    std::set<SOCKET> send_set;
+    std::set<SOCKET> error_set(vServer.begin(), vServer.end());
+    socketEvents.Wait(recv_set, send_set, error_set, std::chrono::milliseconds(0));
+
+    char pchBuf[0x10000];
+    for (SOCKET hSocket : recv_set) {
+        ssize_t nBytes = recv(hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes < (ssize_t)sizeof(pchBuf))
+            socketEvents.SetRecvDrained(hSocket);
+    }
+}
+
+static void SocketEvents(benchmark::State& state, SocketEventsMode mode, bool fChatty)
+{
+    CSocketEvents socketEvents(mode);
+    std::vector<SOCKET> vServer, vClient;
+    for (int i = 0; i < PEERS; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            break;
+        SetSocketNonBlocking(fds[0], true);
+        SetSocketNonBlocking(fds[1], true);
+        vServer.push_back(fds[0]);
+        vClient.push_back(fds[1]);
+        socketEvents.Register(fds[0]);
+    }
+
+    const char msg[24] = {};
+    size_t nNext = 0;
+    while (state.KeepRunning()) {
+        if (fChatty) {
+            for (size_t i = 0; i < vClient.size() * CHATTY_PERCENT / 100; i++) {
+                send(vClient[nNext], msg, sizeof(msg), MSG_DONTWAIT);
+                nNext = (nNext + 1) % vClient.size();
+            }
+        }
+        SocketEventsRound(socketEvents, vServer);
+    }
+
+    for (SOCKET hSocket : vServer)
+        CloseSocket(hSocket);
+    for (SOCKET hSocket : vClient)
+        CloseSocket(hSocket);
+}
+
+static void SocketEventsSelectIdle(benchmark::State& state) { SocketEvents(state, SocketEventsMode::SELECT, false); }
+static void SocketEventsSelectChatty(benchmark::State& state) { SocketEvents(state, SocketEventsMode::SELECT, true); }
+static void SocketEventsPollIdle(benchmark::State& state) { SocketEvents(state, SocketEventsMode::POLL, false); }
+static void SocketEventsPollChatty(benchmark::State& state) { SocketEvents(state, SocketEventsMode::POLL, true); }
+
+BENCHMARK(SocketEventsSelectIdle);
+BENCHMARK(SocketEventsSelectChatty);
+BENCHMARK(SocketEventsPollIdle);
+BENCHMARK(SocketEventsPollChatty);
+
+#ifdef __linux__
+static void SocketEventsEpollIdle(benchmark::State& state) { SocketEvents(state, SocketEventsMode::EPOLL, false); }
+static void SocketEventsEpollChatty(benchmark::State& state) { SocketEvents(state, SocketEventsMode::EPOLL, true); }
+
+BENCHMARK(SocketEventsEpollIdle);
+BENCHMARK(SocketEventsEpollChatty);
+#endif
+
+#endif // WIN32
@@ -0,0 +1,77 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "validation.h"
+#include "wallet/db.h"
+#include "wallet/wallet.h"
+
+#include <vector>
+
+// Tickets bought per round, as many as fit in a block on main net. The
+// reported time divided by this is the latency of a single ticket.
+static const int TICKETS = 20;
+
+// Signs and commits a round of TICKETS transactions, each spending one
+// output of a fresh funding transaction of the wallet, either one by one as
+// PurchaseTicket used to or as a batch.
+static void TicketPurchase(benchmark::State& state, bool fBatch)
+{
+    bitdb.MakeMock();
+    {
+        CWallet wallet(std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, "wallet_bench.dat")));
+        bool fFirstRun;
+        wallet.LoadWallet(fFirstRun);
+
+        CKey key;
+        key.MakeNewKey(true);
+        wallet.LoadKey(key, key.GetPubKey());
+        const CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+        LOCK2(cs_main, wallet.cs_wallet);
+        uint32_t nLockTime = 0;
+        while (state.KeepRunning()) {
+            CMutableTransaction funding;
+            funding.nLockTime = nLockTime++;
+            funding.vout.assign(TICKETS, CTxOut(COIN, script));
+            wallet.LoadToWallet(CWalletTx(&wallet, MakeTransactionRef(funding)));
+            const uint256 fundingHash = funding.GetHash();
+
+            std::vector<CMutableTransaction> vtx(TICKETS);
+            for (int i = 0; i < TICKETS; i++) {
+                vtx[i].vin.emplace_back(fundingHash, i);
+                vtx[i].vout.emplace_back(COIN - 1000, script);
+            }
+
+            if (fBatch) {
+                bool fSigned = wallet.SignTransactions(vtx);
+                assert(fSigned);
+                std::vector<CWalletTx> vwtx;
+                for (auto& mtx : vtx)
+                    vwtx.emplace_back(&wallet, MakeTransactionRef(std::move(mtx)));
+                std::vector<CValidationState> vState;
+                wallet.CommitTransactions(vwtx, nullptr, vState);
+            } else {
+                for (auto& mtx : vtx) {
+                    bool fSigned = wallet.SignTransaction(mtx);
+                    assert(fSigned);
+                    CWalletTx wtx(&wallet, MakeTransactionRef(std::move(mtx)));
+                    CReserveKey reservekey(&wallet);
+                    CValidationState validationState;
+                    wallet.CommitTransaction(wtx, reservekey, nullptr, validationState);
+                }
+            }
+        }
+    }
+    bitdb.Flush(true);
+    bitdb.Reset();
+}
+
+static void TicketPurchaseSerial(benchmark::State& state) { TicketPurchase(state, false); }
+static void TicketPurchaseBatch(benchmark::State& state) { TicketPurchase(state, true); }
+
+BENCHMARK(TicketPurchaseSerial);
+BENCHMARK(TicketPurchaseBatch);
@@ -0,0 +1,72 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fs.h"
+#include "random.h"
+#include "util.h"
+#include "wallet/db.h"
+#include "wallet/wallet.h"
+#include "wallet/walletdb.h"
+
+// Transactions in the wallet. Startup time grows linearly with it, raise it
+// to 500000 to time a wallet of a long running staker.
+static const int WALLET_TXS = 20000;
+
+// Writes WALLET_TXS transactions to a wallet file in a temporary directory,
+// then times loading the wallet from it, each round from a freshly opened
+// file as on startup.
+static void WalletLoad(benchmark::State& state, bool fLog)
+{
+    const fs::path pathTemp = fs::temp_directory_path() / strprintf("bench_bwscoin_%lu", (unsigned long)GetRand(1ULL << 32));
+    TryCreateDirectories(pathTemp);
+    if (!fLog)
+        bitdb.Open(pathTemp);
+    auto makeDBWrapper = [&]() {
+        return std::unique_ptr<CWalletDBWrapper>(fLog ? new CWalletDBWrapper(pathTemp / "wallet_bench.log", "wallet_bench.log")
+                                                      : new CWalletDBWrapper(&bitdb, "wallet_bench.dat"));
+    };
+
+    {
+        CWallet wallet(makeDBWrapper());
+        bool fFirstRun;
+        wallet.LoadWallet(fFirstRun);
+        CWalletDB walletdb(wallet.GetDBHandle(), "r+", false);
+        walletdb.TxnBegin();
+        for (int i = 0; i < WALLET_TXS; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(GetRandHash(), 0);
+            mtx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+            CWalletTx wtx(&wallet, MakeTransactionRef(std::move(mtx)));
+            wtx.nOrderPos = i;
+            walletdb.WriteTx(wtx);
+            if ((i + 1) % 1000 == 0) {
+                walletdb.TxnCommit();
+                walletdb.TxnBegin();
+            }
+        }
+        walletdb.TxnCommit();
+    }
+
+    while (state.KeepRunning()) {
+        if (!fLog)
+            bitdb.Flush(false);
+        CWallet wallet(makeDBWrapper());
+        bool fFirstRun;
+        wallet.LoadWallet(fFirstRun);
+        assert(wallet.mapWallet.size() == (size_t)WALLET_TXS);
+    }
+
+    if (!fLog) {
+        bitdb.Flush(true);
+        bitdb.Reset();
+    }
+    fs::remove_all(pathTemp);
+}
+
+static void WalletLoadBDB(benchmark::State& state) { WalletLoad(state, false); }
+static void WalletLoadLog(benchmark::State& state) { WalletLoad(state, true); }
+
+BENCHMARK(WalletLoadBDB);
+BENCHMARK(WalletLoadLog);
@@ -9,21 +9,64 @@
 #include "hash.h"
 #include "random.h"
 #include "streams.h"
+#include "sync.h"
 #include "txmempool.h"
 #include "validation.h"
 #include "util.h"
 
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
+static CCriticalSection cs_reconstruction_stats;
+static CompactBlockReconstructionStats reconstruction_stats;
+
+CompactBlockReconstructionStats GetCompactBlockReconstructionStats()
+{
+    LOCK(cs_reconstruction_stats);
+    return reconstruction_stats;
+}
+
+bool CompactBlockPrefillPolicy::ShouldPrefill(const CTransaction& tx, ETxClass txClass, const std::set<uint256>& setBlockTxids) const
+{
+    if (nClasses & (1 << txClass))
+        return true;
+
+    if (fFreshTickets && txClass == TX_BuyTicket) {
+        for (const CTxIn& txin : tx.vin)
+            if (setBlockTxids.count(txin.prevout.hash))
+                return true;
+    }
+
+    if (pool) {
+        TxMempoolInfo info = pool->info(tx.GetHash());
+        if (info.tx && info.nTime >= nRecentTime)
+            return true;
+    }
+    return false;
+}
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const CompactBlockPrefillPolicy& policy) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        prefilledtxn(1), header(block) {
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn[0] = {0, block.vtx[0]};
+    shorttxids.reserve(block.vtx.size() - 1);
+
+    std::set<uint256> setBlockTxids;
+    if (policy.fFreshTickets) {
+        for (const auto& ptx : block.vtx)
+            setBlockTxids.insert(ptx->GetHash());
+    }
+
+    size_t nLastPrefilled = 0;
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        if (policy.ShouldPrefill(tx, ParseTxClass(tx), setBlockTxids)) {
+            // indexes are differentially encoded
+            prefilledtxn.push_back({static_cast<uint16_t>(i - nLastPrefilled - 1), block.vtx[i]});
+            nLastPrefilled = i;
+        } else {
+            shorttxids.push_back(GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash()));
+        }
     }
 }
 
@@ -54,6 +97,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     assert(header.IsNull() && txn_available.empty());
     header = cmpctblock.header;
     txn_available.resize(cmpctblock.BlockTxCount());
+    txn_prefilled.assign(cmpctblock.BlockTxCount(), false);
 
     int32_t lastprefilledindex = -1;
     for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
@@ -70,6 +114,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
             return READ_STATUS_INVALID;
         }
         txn_available[lastprefilledindex] = cmpctblock.prefilledtxn[i].tx;
+        txn_prefilled[lastprefilledindex] = true;
     }
     prefilled_count = cmpctblock.prefilledtxn.size();
 
@@ -180,11 +225,13 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
     block.vtx.resize(txn_available.size());
 
     size_t tx_missing_offset = 0;
+    std::vector<bool> txn_requested(txn_available.size(), false);
     for (size_t i = 0; i < txn_available.size(); i++) {
         if (!txn_available[i]) {
             if (vtx_missing.size() <= tx_missing_offset)
                 return READ_STATUS_INVALID;
             block.vtx[i] = vtx_missing[tx_missing_offset++];
+            txn_requested[i] = true;
         } else
             block.vtx[i] = std::move(txn_available[i]);
     }
@@ -192,6 +239,8 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
     // Make sure we can't call FillBlock again.
     header.SetNull();
     txn_available.clear();
+    std::vector<bool> txn_prefilled_block;
+    txn_prefilled_block.swap(txn_prefilled);
 
     if (vtx_missing.size() != tx_missing_offset)
         return READ_STATUS_INVALID;
@@ -207,6 +256,21 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
         return READ_STATUS_CHECKBLOCK_FAILED;
     }
 
+    {
+        LOCK(cs_reconstruction_stats);
+        reconstruction_stats.nBlocks++;
+        // the coinbase is always prefilled, so it is left out
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            CompactBlockReconstructionStats::ClassStats& stats = reconstruction_stats.mapClasses[ParseTxClass(*block.vtx[i])];
+            if (txn_prefilled_block[i])
+                stats.nPrefilled++;
+            else if (txn_requested[i])
+                stats.nRequested++;
+            else
+                stats.nFromMempool++;
+        }
+    }
+
     LogPrint(BCLog::CMPCTBLOCK, "Successfully reconstructed block %s with %lu txn prefilled, %lu txn from mempool (incl at least %lu from extra pool) and %lu txn requested\n", hash.ToString(), prefilled_count, mempool_count, extra_count, vtx_missing.size());
     if (vtx_missing.size() < 5) {
         for (const auto& tx : vtx_missing) {
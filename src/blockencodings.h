@@ -6,11 +6,46 @@
 #define BWSCOIN_BLOCK_ENCODINGS_H
 
 #include "primitives/block.h"
+#include "stake/staketx.h"
 
+#include <map>
 #include <memory>
+#include <set>
 
 class CTxMemPool;
 
+/** Transaction classes always prefilled in compact blocks, as a bitmask of (1 << ETxClass).
+ *  Votes spend a stakebase specific to the block and revocations are rarely relayed ahead. */
+static const uint32_t DEFAULT_CMPCT_PREFILL_CLASSES = (1 << TX_Vote) | (1 << TX_RevokeTicket);
+
+/** Decides which transactions, besides the coinbase, are sent in full in a
+ *  compact block because the receiving peer is unlikely to have them yet. */
+struct CompactBlockPrefillPolicy {
+    //! Transaction classes always prefilled, as a bitmask of (1 << ETxClass)
+    uint32_t nClasses = DEFAULT_CMPCT_PREFILL_CLASSES;
+    //! Prefill the tickets spending an output created in the same block
+    bool fFreshTickets = true;
+    //! If set, the transactions which entered this mempool at or after nRecentTime are prefilled
+    const CTxMemPool* pool = nullptr;
+    int64_t nRecentTime = 0;
+
+    bool ShouldPrefill(const CTransaction& tx, ETxClass txClass, const std::set<uint256>& setBlockTxids) const;
+};
+
+/** How the transactions of the reconstructed compact blocks were obtained, per transaction class */
+struct CompactBlockReconstructionStats {
+    struct ClassStats {
+        uint64_t nPrefilled = 0;
+        uint64_t nFromMempool = 0;
+        uint64_t nRequested = 0;
+    };
+    uint64_t nBlocks = 0;
+    std::map<ETxClass, ClassStats> mapClasses;
+};
+
+/** Return the statistics of the compact blocks reconstructed since startup */
+CompactBlockReconstructionStats GetCompactBlockReconstructionStats();
+
 // Dumb helper to handle CTransaction compression at serialize-time
 struct TransactionCompressor {
 private:
@@ -148,7 +183,7 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const CompactBlockPrefillPolicy& policy = CompactBlockPrefillPolicy());
 
     uint64_t GetShortID(const uint256& txhash) const;
 
@@ -194,6 +229,7 @@ public:
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
+    std::vector<bool> txn_prefilled;
     size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
     CTxMemPool* pool;
 public:
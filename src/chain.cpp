@@ -149,6 +149,32 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+void CBlockIndex::BuildChainStakeCounts()
+{
+    const auto& unknown = pprev != nullptr && pprev->nChainFreshStake < 0;
+    nChainFreshStake = unknown ? -1 : (pprev ? pprev->nChainFreshStake : 0) + nFreshStake;
+    nChainVoters = unknown ? -1 : (pprev ? pprev->nChainVoters : 0) + nVoters;
+    nChainRevocations = unknown ? -1 : (pprev ? pprev->nChainRevocations : 0) + nRevocations;
+
+    // A version past MAX_TRACKED_STAKE_VERSION leaves the counts of this block
+    // and its descendants unknown.
+    vChainStakeVersions.clear();
+    if (nStakeVersion > MAX_TRACKED_STAKE_VERSION || (pprev != nullptr && pprev->vChainStakeVersions.empty()))
+        return;
+    if (pprev != nullptr)
+        vChainStakeVersions = pprev->vChainStakeVersions;
+    if (vChainStakeVersions.size() <= nStakeVersion)
+        vChainStakeVersions.resize(nStakeVersion + 1, 0);
+    vChainStakeVersions[nStakeVersion]++;
+}
+
+int64_t CBlockIndex::GetChainStakeVersionCount(uint32_t nVersion) const
+{
+    if (vChainStakeVersions.empty())
+        return -1;
+    return nVersion < vChainStakeVersions.size() ? vChainStakeVersions[nVersion] : 0;
+}
+
 void CBlockIndex::PopulateTicketInfo(const SpentTicketsInBlock& spentTicketsInBlock)
 {
     std::tie(ticketsVoted,ticketsRevoked,votes) = spentTicketsInBlock;
@@ -33,6 +33,12 @@ static const int64_t MAX_FUTURE_BLOCK_TIME = 2 * 60 * 60;
  */
 static const int64_t TIMESTAMP_WINDOW = MAX_FUTURE_BLOCK_TIME;
 
+/**
+ * Highest header stake version counted in the cumulative per-version counts
+ * of the block index. Blocks past it are tallied by walking the chain.
+ */
+static const uint32_t MAX_TRACKED_STAKE_VERSION = 255;
+
 class CBlockFileInfo
 {
 public:
@@ -249,6 +255,19 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    //! (memory only) Number of tickets purchased in the chain up to and including this block, -1 when unknown
+    int64_t nChainFreshStake;
+
+    //! (memory only) Number of votes in the chain up to and including this block, -1 when unknown
+    int64_t nChainVoters;
+
+    //! (memory only) Number of revocations in the chain up to and including this block, -1 when unknown
+    int64_t nChainRevocations;
+
+    //! (memory only) Number of blocks in the chain up to and including this block by header stake version,
+    //! indexed by version; empty when unknown
+    std::vector<int32_t> vChainStakeVersions;
+
     std::shared_ptr<StakeNode> pstakeNode;
     std::shared_ptr<HashVector> newTickets;
     HashVector ticketsVoted;
@@ -272,6 +291,10 @@ public:
         nStatus = 0;
         nSequenceId = 0;
         nTimeMax = 0;
+        nChainFreshStake = -1;
+        nChainVoters = -1;
+        nChainRevocations = -1;
+        vChainStakeVersions.clear();
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -438,6 +461,12 @@ public:
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
+    //! Build the cumulative stake counts of this entry from those of pprev.
+    void BuildChainStakeCounts();
+
+    //! Number of blocks up to and including this one with the given header stake version, -1 when unknown.
+    int64_t GetChainStakeVersionCount(uint32_t nVersion) const;
+
     //! Efficiently find an ancestor of this block.
     CBlockIndex* GetAncestor(int height);
     const CBlockIndex* GetAncestor(int height) const;
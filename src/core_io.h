@@ -16,8 +16,10 @@
 #include <map>
 
 class CBlock;
+class COutPoint;
 class CScript;
 class CTransaction;
+class CTxOut;
 struct CMutableTransaction;
 class uint256;
 class UniValue;
@@ -37,7 +39,8 @@ std::string FormatScript(const CScript& script);
 std::string EncodeHexTx(const CTransaction& tx, const int serializeFlags = 0);
 void ScriptPubKeyToUniv(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_stake, bool include_hex = true, int serialize_flags = 0
-, const std::map<uint256,std::shared_ptr<const CTransaction>>* const prevHashToTxMap = nullptr);
+, const std::map<uint256,std::shared_ptr<const CTransaction>>* const prevHashToTxMap = nullptr
+, const std::map<COutPoint,CTxOut>* const prevOutputs = nullptr);
 void StakingToUniv(const CTransaction& tx, UniValue& entry, bool fIncludeContrib = true);
 void StakeInfoToUniv(const CTransaction& tx, UniValue& entry
 , const std::map<uint256,std::shared_ptr<const CTransaction>>* const prevHashToTxMap = nullptr);
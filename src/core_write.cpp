@@ -214,8 +214,27 @@ void StakeInfoToUniv(const CTransaction& tx, UniValue& entry, const std::map<uin
     }
 }
 
+static void PrevOutToUniv(const CTxOut& txOut, UniValue& prevOut)
+{
+    txnouttype type;
+    std::vector<CTxDestination> addresses;
+    int nRequired;
+    if (ExtractDestinations(txOut.scriptPubKey, type, addresses, nRequired)) {
+        UniValue a(UniValue::VARR);
+        for (const CTxDestination& addr : addresses) {
+            a.push_back(EncodeDestination(addr));
+        }
+
+        UniValue vout(UniValue::VOBJ);
+        vout.pushKV("addresses", a);
+        vout.pushKV("value", ValueFromAmount(txOut.nValue));
+        prevOut.push_back(vout);
+    }
+}
+
 void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry, bool include_stake, bool include_hex, int serialize_flags
-            , const std::map<uint256,std::shared_ptr<const CTransaction>>* const prevHashToTxMap)
+            , const std::map<uint256,std::shared_ptr<const CTransaction>>* const prevHashToTxMap
+            , const std::map<COutPoint,CTxOut>* const prevOutputs)
 {
     entry.pushKV("txid", tx.GetHash().GetHex());
     if (tx.IsCoinBase())
@@ -251,26 +270,24 @@ void TxToUniv(const CTransaction& tx, const uint256& hashBlock, UniValue& entry,
                 }
                 in.pushKV("txinwitness", txinwitness);
             }
-            if( prevHashToTxMap != nullptr) {
+            // The spent output alone when it is known, otherwise every output of the previous transaction
+            const CTxOut* pSpentOut = nullptr;
+            if (prevOutputs != nullptr) {
+                const auto& it = prevOutputs->find(txin.prevout);
+                if (it != std::end(*prevOutputs))
+                    pSpentOut = &it->second;
+            }
+            if (pSpentOut != nullptr) {
+                UniValue prevOut(UniValue::VARR);
+                PrevOutToUniv(*pSpentOut, prevOut);
+                in.pushKV("prevOut", prevOut);
+            } else if( prevHashToTxMap != nullptr) {
                 const auto& it = prevHashToTxMap->find(txin.prevout.hash);
                 if (it != std::end(*prevHashToTxMap) ){
                     UniValue prevOut(UniValue::VARR);
                     const auto& prevTx = it->second;
                     for (const auto& txOut : prevTx->vout) {
-                        txnouttype type;
-                        std::vector<CTxDestination> addresses;
-                        int nRequired;
-                        if (ExtractDestinations(txOut.scriptPubKey, type, addresses, nRequired)) {
-                            UniValue a(UniValue::VARR);
-                            for (const CTxDestination& addr : addresses) {
-                                a.push_back(EncodeDestination(addr));
-                            }
-
-                            UniValue vout(UniValue::VOBJ);
-                            vout.pushKV("addresses", a);
-                            vout.pushKV("value", ValueFromAmount(txOut.nValue));
-                            prevOut.push_back(vout);
-                        }
+                        PrevOutToUniv(txOut, prevOut);
                     }
                     in.pushKV("prevOut", prevOut);
                 }
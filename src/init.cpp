@@ -371,6 +371,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-txvalthreads=<n>", strprintf(_("Set the number of threads checking the scripts of relayed transactions and votes ahead of the message handler (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        -GetNumCores(), MAX_TXVAL_THREADS, DEFAULT_TXVAL_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BWSCOIN_PID_FILENAME));
 #endif
@@ -384,6 +386,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
     strUsage += HelpMessageOpt("-addrindex", strprintf(_("Maintain a full address index, used by the searchrawtransactions rpc call (default: %u)"), DEFAULT_ADDRINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain an index of spent outputs, used to decode transaction inputs and fees without reading previous transactions (default: %u)"), DEFAULT_SPENTINDEX));
 
 
     strUsage += HelpMessageGroup(_("Connection options:"));
@@ -411,6 +414,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Wait for peer sockets with <mode>, one of: %s. With poll and epoll, connections are not limited by FD_SETSIZE (default: %s)"), SocketEventsModes(), DEFAULT_SOCKET_EVENTS));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -425,7 +429,11 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-whitelist=<IP address or network>", _("Whitelist peers connecting from the given IP address (e.g. 1.2.3.4) or CIDR notated network (e.g. 1.2.3.0/24). Can be specified multiple times.") +
         " " + _("Whitelisted peers cannot be DoS banned and their transactions are always relayed, even if they are already in the mempool, useful e.g. for a gateway"));
     strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-blockservecache=<n>", strprintf(_("Keep up to <n> MiB of recently requested blocks serialized, to serve them to other peers without reading them again (default: %u)"), DEFAULT_BLOCK_SERVE_CACHE));
+    strUsage += HelpMessageOpt("-cmpctprefillrecent=<n>", strprintf(_("Send in full, in the compact blocks we announce, the transactions which reached our mempool less than <n> seconds before the block (default: %u)"), DEFAULT_CMPCT_PREFILL_RECENT));
     strUsage += HelpMessageOpt("-handshaketipsdepth=<n>", strprintf(_("The maximum depth of chain tips to be sent on new connections. The actual height is calculated relative to the currently active chain tip. The chain tips are sent when the protocol handshake is done, but only if the initial block download is completed. A negative value means sending all chain tips. (default, %u)"), DEFAULT_HANDSHAKE_TIPS_DEPTH));
+    strUsage += HelpMessageOpt("-handshaketipsheaders", strprintf(_("Announce the chain tips sent on new connections by their headers only, letting the peer request the blocks it lacks. Peers on older protocol versions always receive the full blocks. (default: %u)"), DEFAULT_HANDSHAKE_TIPS_HEADERS));
+    strUsage += HelpMessageOpt("-votepush", strprintf(_("Ask peers to push the votes on the current chain tips as soon as they are received, instead of announcing them (default: %u)"), DEFAULT_VOTE_PUSH));
     strUsage += HelpMessageOpt("-handshaketipsinterval=<n>", strprintf(_("The time interval in seconds to consider the peer in sync. (default, %u)"), DEFAULT_HANDSHAKE_TIPS_INTERVAL));
 
 #ifdef ENABLE_WALLET
@@ -840,6 +848,7 @@ namespace { // Variables internal to initialization process only
 int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
+SocketEventsMode socketEventsMode = SocketEventsMode::SELECT;
 ServiceFlags nLocalServices = NODE_NETWORK;
 
 } // namespace
@@ -924,13 +933,20 @@ bool AppInitParameterInteraction()
         return InitError("Cannot set -bind or -whitebind together with -listen=0");
     }
 
+    std::string strSocketEvents = gArgs.GetArg("-socketevents", DEFAULT_SOCKET_EVENTS);
+    if (!SocketEventsModeFromString(strSocketEvents, socketEventsMode)) {
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), strSocketEvents, SocketEventsModes()));
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max(nUserBind, size_t(1));
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    if (socketEventsMode == SocketEventsMode::SELECT) {
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    }
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -1274,6 +1290,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // -txvalthreads=0 means autodetect, leaving a core to the message handler
+    int nTxValThreads = gArgs.GetArg("-txvalthreads", DEFAULT_TXVAL_THREADS);
+    if (nTxValThreads <= 0)
+        nTxValThreads += GetNumCores() - 1;
+    nTxValThreads = std::max(0, std::min(nTxValThreads, MAX_TXVAL_THREADS));
+    LogPrintf("Using %u threads for relayed transaction validation\n", nTxValThreads);
+    for (int i = 0; i < nTxValThreads; i++)
+        threadGroup.create_thread(&ThreadTxValidation);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1536,6 +1561,19 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Check for changed -spentindex state
+                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
+                // Address indexes built before balances and unspent outputs were kept have to be rebuilt
+                bool fAddrIndexBalances = false;
+                if (fAddrIndex && !(pblocktree->ReadFlag("addrindexbalances", fAddrIndexBalances) && fAddrIndexBalances)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to upgrade the address index");
+                    break;
+                }
+
                 if (!fReset) {
                     // Note that RewindBlockIndex MUST run even if we're about to -reindex-chainstate.
                     // It both disconnects blocks based on chainActive, and drops block data in
@@ -1715,6 +1753,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.m_msgproc = peerLogic.get();
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.socketEventsMode = socketEventsMode;
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
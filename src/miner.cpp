@@ -111,7 +111,45 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
+// Stake related header fields of the last assembled block. They only depend on
+// the previous block, so they are reused while it stays the same.
+// Protected by cs_main.
+namespace {
+struct StakeHeaderFields {
+    uint256 hashPrevBlock;
+    int32_t nVersion;
+    uint32_t nStakeVersion;
+    int64_t nStakeDifficulty;
+    uint48 ticketLotteryState;
+    uint32_t nTicketPoolSize;
+};
+std::unique_ptr<StakeHeaderFields> cachedStakeHeaderFields;
+} // namespace
+
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, CBlockIndex* pUsePrevIndex)
+{
+    return AssembleBlock(scriptPubKeyIn, fMineWitnessTx, pUsePrevIndex, nullptr);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::UpdateBlockTemplate(const CBlockTemplate& prevTemplate, bool fMineWitnessTx)
+{
+    LOCK2(cs_main, mempool.cs);
+    const auto& scriptPubKey = prevTemplate.block.vtx[0]->vout[0].scriptPubKey;
+    auto mi = mapBlockIndex.find(prevTemplate.block.hashPrevBlock);
+    if (mi == mapBlockIndex.end())
+        return CreateNewBlock(scriptPubKey, fMineWitnessTx);
+
+    // The template can only be extended if all of its transactions are still
+    // in the mempool.
+    for (size_t i = 1; i < prevTemplate.block.vtx.size(); ++i) {
+        if (!mempool.exists(prevTemplate.block.vtx[i]->GetHash()))
+            return AssembleBlock(scriptPubKey, fMineWitnessTx, mi->second, nullptr);
+    }
+
+    return AssembleBlock(scriptPubKey, fMineWitnessTx, mi->second, &prevTemplate);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::AssembleBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, CBlockIndex* pUsePrevIndex, const CBlockTemplate* pprevTemplate)
 {
     int64_t nTimeStart = GetTimeMicros();
 
@@ -133,19 +171,32 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     assert(pindexPrev != nullptr);
     nHeight = pindexPrev->nHeight + 1;
 
-    pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
-    const auto& hybridForkEnabled = IsHybridConsensusForkEnabled(pindexPrev,chainparams.GetConsensus());
-    if (hybridForkEnabled) {
-        pblock->nVersion |= HARDFORK_VERSION_BIT;
-    }
+    if (!cachedStakeHeaderFields || cachedStakeHeaderFields->hashPrevBlock != pindexPrev->GetBlockHash()) {
+        std::unique_ptr<StakeHeaderFields> fields(new StakeHeaderFields());
+        fields->hashPrevBlock = pindexPrev->GetBlockHash();
+        fields->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+        const auto& hybridForkEnabled = IsHybridConsensusForkEnabled(pindexPrev,chainparams.GetConsensus());
+        if (hybridForkEnabled) {
+            fields->nVersion |= HARDFORK_VERSION_BIT;
+        }
 
-    pblock->nStakeVersion = calcStakeVersion(pindexPrev, chainparams.GetConsensus());
-    pblock->nStakeDifficulty = CalculateNextRequiredStakeDifficulty(pindexPrev,chainparams.GetConsensus());
-    if (pindexPrev->pstakeNode != nullptr) {
-        pblock->ticketLotteryState = pindexPrev->pstakeNode->FinalState();
-        pblock->nTicketPoolSize = pindexPrev->pstakeNode->PoolSize();
+        fields->nStakeVersion = calcStakeVersion(pindexPrev, chainparams.GetConsensus());
+        fields->nStakeDifficulty = CalculateNextRequiredStakeDifficulty(pindexPrev,chainparams.GetConsensus());
+        fields->ticketLotteryState = pblock->ticketLotteryState;
+        fields->nTicketPoolSize = pblock->nTicketPoolSize;
+        if (pindexPrev->pstakeNode != nullptr) {
+            fields->ticketLotteryState = pindexPrev->pstakeNode->FinalState();
+            fields->nTicketPoolSize = pindexPrev->pstakeNode->PoolSize();
+        }
+        cachedStakeHeaderFields = std::move(fields);
     }
 
+    pblock->nVersion = cachedStakeHeaderFields->nVersion;
+    pblock->nStakeVersion = cachedStakeHeaderFields->nStakeVersion;
+    pblock->nStakeDifficulty = cachedStakeHeaderFields->nStakeDifficulty;
+    pblock->ticketLotteryState = cachedStakeHeaderFields->ticketLotteryState;
+    pblock->nTicketPoolSize = cachedStakeHeaderFields->nTicketPoolSize;
+
     // -regtest only: allow overriding block.nVersion with
     // -blockversion=N to test forking scenarios
     if (chainparams.MineBlocksOnDemand())
@@ -169,7 +220,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         // normally should not happen, except in case of constructing invalid block chains above StakeValidationHeight,
         // see miner_tests.cpp (search SetBestBlock)
         assert(pindexPrev->pstakeNode != nullptr);
-        auto winningHashes = pindexPrev->pstakeNode->Winners();
+        const auto& stakeNode = *pindexPrev->pstakeNode;
 
         int nNewVotes = 0;
         for (auto votetxiter = votesForBlockHash.first; votetxiter != votesForBlockHash.second; ++votetxiter) {
@@ -177,7 +228,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                 break;
 
             const auto& spentTicketHash = votetxiter->GetTx().vin[voteStakeInputIndex].prevout.hash;
-            if (std::find(winningHashes.begin(), winningHashes.end(), spentTicketHash) == winningHashes.end())
+            if (!stakeNode.ExistsWinner(spentTicketHash))
                 continue; //not a winner
 
             // tx must be included in the block
@@ -188,48 +239,27 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         pblock->nVoters = nNewVotes;
     }
 
-    // Get the newly purchased tickets
-    CTxMemPool::setEntries ticketAncestors;
-    if (nHeight >= chainparams.GetConsensus().nStakeEnabledHeight - chainparams.GetConsensus().nTicketMaturity)
-    {
-        auto& tx_class_index = mempool.mapTx.get<tx_class>();
-        auto existingTickets = tx_class_index.equal_range(ETxClass::TX_BuyTicket);
-        int nNewTickets = 0;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        for (auto tickettxiter = existingTickets.first; tickettxiter != existingTickets.second; ++tickettxiter) {
-            if (nNewTickets >= chainparams.GetConsensus().nMaxFreshStakePerBlock || nNewTickets >= 255) // new ticket purchases cannot exceed the maximum number allowed in block,
-                                                                                                        // including the size of the summary field (sizeof(uint8_t)-1)
-                break;
-
-            // skip tickets that were bought on a higher height which received too-few-votes
-            if (nHeight <= tickettxiter->GetHeight() + 1)
-                continue;
-
-            // do not include ticket transactions that are expired
-            if (IsExpiredTx(tickettxiter->GetTx(), nHeight))
-                continue;
-
-            auto stakedAmount = tickettxiter->GetSharedTx()->vout[ticketStakeOutputIndex].nValue;
-
-            // do not allow tickets with staked amounts lower than the block's stake difficulty
-            if (stakedAmount < pblock->nStakeDifficulty)
-                continue;
-
-            // do not allow tickets with staked amounts lower than the minimum stake difficulty
-            if (stakedAmount < chainparams.GetConsensus().nMinimumStakeDiff)
-                continue;
+    // Decide whether to include witness transactions
+    // This is only needed in case the witness softfork activation is reverted
+    // (which would require a very deep reorganization) or when
+    // -promiscuousmempoolflags is used.
+    // TODO: replace this with a call to main to assess validity of a mempool
+    // transaction (which in most cases can be a no-op).
+    fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
 
-            // tx must be included in the block
-            auto txiter = mempool.mapTx.project<0>(tickettxiter);
-            AddToBlock(txiter);
-            ++nNewTickets;
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
 
-            // store all unconfirmed ancestors in order to include them in this block
-            mempool.CalculateMemPoolAncestors(*txiter, ticketAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-            onlyUnconfirmed(ticketAncestors);
-        }
-        pblock->nFreshStake = nNewTickets;
+    // Get the newly purchased tickets, together with their unconfirmed
+    // (split transaction) ancestors, by ancestor fee rate.
+    if (nHeight >= chainparams.GetConsensus().nStakeEnabledHeight - chainparams.GetConsensus().nTicketMaturity)
+    {
+        // new ticket purchases cannot exceed the maximum number allowed in block,
+        // including the size of the summary field (sizeof(uint8_t)-1)
+        const int nMaxFreshStake = std::min<int>(chainparams.GetConsensus().nMaxFreshStakePerBlock, 255);
+        const int nPackagesBefore = nPackagesSelected;
+        addPackageTxs(nHeight, nPackagesSelected, nDescendantsUpdated, TX_BuyTicket, nMaxFreshStake);
+        pblock->nFreshStake = nPackagesSelected - nPackagesBefore;
     }
 
     // No revocation transaction should be present before this height
@@ -238,7 +268,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         auto revocations = tx_class_index.equal_range(ETxClass::TX_RevokeTicket);
 
         assert(pindexPrev->pstakeNode != nullptr);
-        auto missedTickets = pindexPrev->pstakeNode->MissedTickets();
+        const auto& stakeNode = *pindexPrev->pstakeNode;
 
         int nNewRevocations = 0;
         for (auto revocationtxiter = revocations.first; revocationtxiter != revocations.second; ++revocationtxiter) {
@@ -246,7 +276,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
                 break;
 
             const auto& ticketHash = revocationtxiter->GetTx().vin[revocationStakeInputIndex].prevout.hash;
-            if (std::find(missedTickets.begin(), missedTickets.end(), ticketHash) == missedTickets.end())
+            if (!stakeNode.ExistsMissedTicket(ticketHash))
                 continue; // Skip all missed tickets that we've never heard of
 
             // skip revocations that were added on a higher height which received too-few-votes
@@ -260,52 +290,16 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         pblock->nRevocations = nNewRevocations;
     }
 
-    // Add all the funding (ancestor) transactions that are in the mempool for the ticket just included.
-    // Make sure that the funding transactions are ordered themselves by ancestry, if needed.
-    // Normally, at this point no circular or multiple dependencies should be present.
-    // However, a watchdog monitoring is implemented.
-    // TODO: verify the case where a ticket is funded by other stake transaction spendable output
-    std::vector<CTxMemPool::txiter> reorderedTicketAncestors;
-    for (auto& ticketAncestorIter : ticketAncestors)
-        reorderedTicketAncestors.push_back(ticketAncestorIter);
-    const size_t reorderedTicketAncestorsSize = reorderedTicketAncestors.size();
-    if (reorderedTicketAncestorsSize > 0) {
-        int watchdog = static_cast<int>(std::pow(2, reorderedTicketAncestorsSize));
-        CTxMemPool::txiter b;
-        uint256 hash;
-        bool swapped;
-        do {
-            swapped = false;
-            for (size_t i = 0; (i < reorderedTicketAncestorsSize - 1) && (!swapped); ++i) {
-                for (size_t j = i + 1; (j < reorderedTicketAncestorsSize) && (!swapped); ++j) {
-                    hash = reorderedTicketAncestors[j]->GetTx().GetHash();
-                    for (size_t k = 0; (k < reorderedTicketAncestors[i]->GetTx().vin.size()) && (!swapped); ++k)
-                        if (reorderedTicketAncestors[i]->GetTx().vin[k].prevout.hash == hash) {
-                            std::swap(reorderedTicketAncestors[i], reorderedTicketAncestors[j]);
-                            swapped = true;
-                        }
-                }
-            }
-        } while (swapped && (--watchdog > 0));
-
-        if (watchdog == 0)
-            throw std::runtime_error(strprintf("%s: Split transaction reordering failed (%llu transactions)", __func__, reorderedTicketAncestorsSize));
-
-        for (auto& reorderedTicketAncestorIter : reorderedTicketAncestors)
-            AddToBlock(reorderedTicketAncestorIter);
-    }
+    // The ticket ancestors were added next to their tickets; move them
+    // behind the stake transactions.
+    MoveStakeTransactionsFirst();
 
-    // Decide whether to include witness transactions
-    // This is only needed in case the witness softfork activation is reverted
-    // (which would require a very deep reorganization) or when
-    // -promiscuousmempoolflags is used.
-    // TODO: replace this with a call to main to assess validity of a mempool
-    // transaction (which in most cases can be a no-op).
-    fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
+    // When extending a previous template, keep its regular transactions, in
+    // their (topological) order, before selecting the new ones.
+    if (pprevTemplate != nullptr)
+        addTemplateTxs(*pprevTemplate);
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nHeight ,nPackagesSelected, nDescendantsUpdated);
+    addPackageTxs(nHeight, nPackagesSelected, nDescendantsUpdated);
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -333,17 +327,70 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
+    // Extended templates are checked too: their stake section is selected
+    // again, and the vote selection above relies on this check.
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock()%s packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", pprevTemplate ? " (incremental)" : "", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
 
+void BlockAssembler::MoveStakeTransactionsFirst()
+{
+    // Stable partition of everything but the coinbase, so that both the stake
+    // transactions and the regular ones keep their relative (topological) order.
+    std::vector<size_t> order(pblock->vtx.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_partition(order.begin() + 1, order.end(), [this](size_t i) {
+        return ParseTxClass(*pblock->vtx[i]) != TX_Regular;
+    });
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOpsCost;
+    vtx.reserve(order.size());
+    vTxFees.reserve(order.size());
+    vTxSigOpsCost.reserve(order.size());
+    for (size_t i : order) {
+        vtx.push_back(std::move(pblock->vtx[i]));
+        vTxFees.push_back(pblocktemplate->vTxFees[i]);
+        vTxSigOpsCost.push_back(pblocktemplate->vTxSigOpsCost[i]);
+    }
+    pblock->vtx.swap(vtx);
+    pblocktemplate->vTxFees.swap(vTxFees);
+    pblocktemplate->vTxSigOpsCost.swap(vTxSigOpsCost);
+}
+
+void BlockAssembler::addTemplateTxs(const CBlockTemplate& prevTemplate)
+{
+    for (size_t i = 1; i < prevTemplate.block.vtx.size(); ++i) {
+        const auto& tx = *prevTemplate.block.vtx[i];
+        if (ParseTxClass(tx) != TX_Regular)
+            continue;
+
+        CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+        assert(it != mempool.mapTx.end());
+
+        // already added as the ancestor of a ticket
+        if (inBlock.count(it))
+            continue;
+
+        // Stop at the first transaction that no longer fits, so that every
+        // transaction added still follows its in-block ancestors; the rest
+        // is left to the package selection.
+        if (!TestPackage(it->GetTxSize(), it->GetSigOpCost()))
+            break;
+
+        AddToBlock(it);
+    }
+}
+
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
 {
     for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
@@ -357,6 +404,35 @@ void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
     }
 }
 
+bool BlockAssembler::IsPackageRoot(CTxMemPool::txiter it, ETxClass txClass) const
+{
+    if (it->GetTxClass() != txClass)
+        return false;
+
+    if (txClass != TX_BuyTicket)
+        return true;
+
+    // skip tickets that were bought on a higher height which received too-few-votes
+    if (nHeight <= static_cast<int>(it->GetHeight()) + 1)
+        return false;
+
+    // do not include ticket transactions that are expired
+    if (IsExpiredTx(it->GetTx(), nHeight))
+        return false;
+
+    const auto& stakedAmount = it->GetTx().vout[ticketStakeOutputIndex].nValue;
+
+    // do not allow tickets with staked amounts lower than the block's stake difficulty
+    if (stakedAmount < pblock->nStakeDifficulty)
+        return false;
+
+    // do not allow tickets with staked amounts lower than the minimum stake difficulty
+    if (stakedAmount < chainparams.GetConsensus().nMinimumStakeDiff)
+        return false;
+
+    return true;
+}
+
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
@@ -382,6 +458,17 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::TestPackageClasses(const CTxMemPool::setEntries& package, CTxMemPool::txiter root) const
+{
+    if (root->GetTxClass() == TX_Regular)
+        return true;
+    for (const CTxMemPool::txiter it : package) {
+        if (it != root && it->GetTxClass() != TX_Regular)
+            return false;
+    }
+    return true;
+}
+
 void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
 {
     pblock->vtx.emplace_back(iter->GetSharedTx());
@@ -464,7 +551,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDescendantsUpdated, ETxClass txClass, int nMaxPackages)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -484,13 +571,14 @@ void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDe
     // mempool has a lot of entries.
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
+    int nSelected = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
+    while ((mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty()) && nSelected < nMaxPackages)
     {
         // First try to find a new transaction in mapTx to evaluate.
         if (mi != mempool.mapTx.get<ancestor_score>().end() &&
             (SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx) ||
-                mi->GetTxClass() != TX_Regular || nHeight <= mi->GetHeight() + 1) //we only deal with non-stake tx in this loop, and skip txs that were added on a higher height
+                !IsPackageRoot(mempool.mapTx.project<0>(mi), txClass) || nHeight <= mi->GetHeight() + 1) //we only deal with txClass packages in this loop, and skip txs that were added on a higher height
         ) {
             ++mi;
             continue;
@@ -507,8 +595,8 @@ void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDe
             if (modit == mapModifiedTx.get<ancestor_score>().end())
                 break;
 
-            // We only deal with non-stake tx in this loop.
-            if (modit->iter->GetTxClass() != TX_Regular) {
+            // We only deal with txClass packages in this loop.
+            if (!IsPackageRoot(modit->iter, txClass)) {
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 continue;
             }
@@ -517,14 +605,14 @@ void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDe
             fUsingModified = true;
         } else {
             // Try to compare the mapTx entry to the mapModifiedTx entry,
-            // if it's not a stake.
+            // if it's of the selected class.
             iter = mempool.mapTx.project<0>(mi);
             if (modit != mapModifiedTx.get<ancestor_score>().end() &&
                     CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
                 // The best entry in mapModifiedTx has higher score
                 // than the one from mapTx.
-                // We only deal with non-stake tx in this loop.
-                if (modit->iter->GetTxClass() != TX_Regular) {
+                // We only deal with txClass packages in this loop.
+                if (!IsPackageRoot(modit->iter, txClass)) {
                     mapModifiedTx.get<ancestor_score>().erase(modit);
                     continue;
                 }
@@ -552,7 +640,9 @@ void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDe
             packageSigOpsCost = modit->nSigOpCostWithAncestors;
         }
 
-        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+        // Tickets compete for the fresh stake slots rather than for block
+        // space, so the minimum fee rate only applies to regular packages.
+        if (txClass == TX_Regular && packageFees < blockMinFeeRate.GetFee(packageSize)) {
             // Everything else we might consider has a lower fee rate
             return;
         }
@@ -584,8 +674,10 @@ void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDe
         onlyUnconfirmed(ancestors);
         ancestors.insert(iter);
 
-        // Test if all tx's are Final
-        if (!TestPackageTransactions(ancestors)) {
+        // Test if all tx's are Final, and that the package root is the only
+        // transaction of its class: ancestors of stake transactions must be
+        // regular, as they are placed behind the stake transactions
+        if (!TestPackageTransactions(ancestors) || !TestPackageClasses(ancestors, iter)) {
             if (fUsingModified) {
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
@@ -607,6 +699,7 @@ void BlockAssembler::addPackageTxs(int nHeight, int &nPackagesSelected, int &nDe
         }
 
         ++nPackagesSelected;
+        ++nSelected;
 
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
@@ -13,6 +13,7 @@
 #include "txmempool.h"
 
 #include <stdint.h>
+#include <limits>
 #include <memory>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -169,9 +170,17 @@ public:
 
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx = true, CBlockIndex* pUsePrevIndex = nullptr);
+    /** Construct a new block template on the same previous block as prevTemplate,
+      * keeping its transactions and adding the ones that entered the mempool since.
+      * Only valid while the mempool saw no change other than additions since prevTemplate
+      * was built (see CTxMemPool::GetNonAdditiveUpdates); falls back to a full
+      * CreateNewBlock if one of its transactions is gone. */
+    std::unique_ptr<CBlockTemplate> UpdateBlockTemplate(const CBlockTemplate& prevTemplate, bool fMineWitnessTx = true);
 
 private:
     // utility functions
+    /** Assemble a block template, extending pprevTemplate if not null */
+    std::unique_ptr<CBlockTemplate> AssembleBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, CBlockIndex* pUsePrevIndex, const CBlockTemplate* pprevTemplate);
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
     /** Add a tx to the block */
@@ -179,13 +188,23 @@ private:
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
+      * Only packages whose last transaction is of class txClass are selected,
+      * at most nMaxPackages of them.
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int nHeight, int &nPackagesSelected, int &nDescendantsUpdated);
+    void addPackageTxs(int nHeight, int &nPackagesSelected, int &nDescendantsUpdated,
+                       ETxClass txClass = TX_Regular, int nMaxPackages = std::numeric_limits<int>::max());
+    /** Add the regular transactions of a previous template, in order */
+    void addTemplateTxs(const CBlockTemplate& prevTemplate);
+    /** Move the stake transactions in front of the regular ones, keeping the
+      * relative order of both */
+    void MoveStakeTransactionsFirst();
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
     void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
+    /** Test if a mempool entry may be the last transaction of a txClass package */
+    bool IsPackageRoot(CTxMemPool::txiter it, ETxClass txClass) const;
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
     /** Perform checks on each transaction in a package:
@@ -193,6 +212,8 @@ private:
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Test that the ancestors of a stake package root are all regular transactions */
+    bool TestPackageClasses(const CTxMemPool::setEntries& package, CTxMemPool::txiter root) const;
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
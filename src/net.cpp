@@ -31,6 +31,11 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <poll.h>
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
 #endif
 
 #ifdef USE_UPNP
@@ -49,6 +54,14 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for sockets before polling pnode->vSend again
+static const std::chrono::milliseconds SOCKET_WAIT_TIMEOUT{50};
+
+#ifdef __linux__
+// Maximum number of epoll events handled per wait, any further ones are returned by the next wait
+static const int MAX_EPOLL_EVENTS = 256;
+#endif
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -438,7 +451,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         connected = ConnectThroughProxy(proxy, host, port, hSocket, nConnectTimeout, nullptr);
     }
     if (connected) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!socketEvents->IsUsableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return nullptr;
@@ -875,7 +888,7 @@ size_t CConnman::SocketSendData(CNode *pnode) const
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
+        const auto &data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = 0;
         {
@@ -1094,6 +1107,8 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         int nErr = WSAGetLastError();
         if (nErr != WSAEWOULDBLOCK)
             LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+        else
+            socketEvents->SetRecvDrained(hListenSocket.socket);
         return;
     }
 
@@ -1103,7 +1118,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (!socketEvents->IsUsableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1142,12 +1157,315 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    socketEvents->Register(hSocket);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
+bool SocketEventsModeFromString(const std::string& str, SocketEventsMode& mode)
+{
+    if (str == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#ifndef WIN32
+    if (str == "poll") {
+        mode = SocketEventsMode::POLL;
+        return true;
+    }
+#endif
+#ifdef __linux__
+    if (str == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SocketEventsModes()
+{
+    std::string modes = "select";
+#ifndef WIN32
+    modes += ", poll";
+#endif
+#ifdef __linux__
+    modes += ", epoll";
+#endif
+    return modes;
+}
+
+CSocketEvents::CSocketEvents(SocketEventsMode modeIn) : mode(modeIn)
+{
+#ifdef __linux__
+    epollFd = -1;
+    if (mode == SocketEventsMode::EPOLL) {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd == -1) {
+            LogPrintf("epoll_create1 failed: %s, waiting for sockets with poll instead\n", NetworkErrorString(WSAGetLastError()));
+            mode = SocketEventsMode::POLL;
+        }
+    }
+#endif
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#ifdef __linux__
+    if (epollFd != -1)
+        close(epollFd);
+#endif
+}
+
+bool CSocketEvents::IsUsableSocket(const SOCKET& hSocket) const
+{
+    return mode != SocketEventsMode::SELECT || IsSelectableSocket(hSocket);
+}
+
+bool CSocketEvents::Register(const SOCKET& hSocket)
+{
+#ifdef __linux__
+    if (mode == SocketEventsMode::EPOLL) {
+        {
+            // the descriptor may be a reused one, its readiness comes with the first edge
+            LOCK(cs);
+            mapReadiness.erase(hSocket);
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = hSocket;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, hSocket, &event) == -1 &&
+                (errno != EEXIST || epoll_ctl(epollFd, EPOLL_CTL_MOD, hSocket, &event) == -1)) {
+            LogPrintf("epoll_ctl failed for socket %d: %s\n", hSocket, NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+void CSocketEvents::SetRecvDrained(const SOCKET& hSocket)
+{
+#ifdef __linux__
+    if (mode == SocketEventsMode::EPOLL) {
+        LOCK(cs);
+        auto it = mapReadiness.find(hSocket);
+        if (it != mapReadiness.end())
+            it->second &= ~READY_RECV;
+    }
+#endif
+}
+
+void CSocketEvents::SetSendBlocked(const SOCKET& hSocket)
+{
+#ifdef __linux__
+    if (mode == SocketEventsMode::EPOLL) {
+        LOCK(cs);
+        auto it = mapReadiness.find(hSocket);
+        if (it != mapReadiness.end())
+            it->second &= ~READY_SEND;
+    }
+#endif
+}
+
+bool CSocketEvents::Wait(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout)
+{
+    switch (mode) {
+#ifdef __linux__
+    case SocketEventsMode::EPOLL:
+        return WaitEpoll(recv_set, send_set, error_set, timeout);
+#endif
+#ifndef WIN32
+    case SocketEventsMode::POLL:
+        return WaitPoll(recv_set, send_set, error_set, timeout);
+#endif
+    default:
+        return WaitSelect(recv_set, send_set, error_set, timeout);
+    }
+}
+
+bool CSocketEvents::WaitSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout)
+{
+    struct timeval tv = MillisToTimeval(timeout.count());
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (SOCKET hSocket : recv_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+    }
+    for (SOCKET hSocket : send_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+    }
+    for (SOCKET hSocket : error_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        have_fds = true;
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &tv);
+    if (nSelect == SOCKET_ERROR)
+        return false;
+
+    for (auto it = recv_set.begin(); it != recv_set.end(); )
+        it = FD_ISSET(*it, &fdsetRecv) ? std::next(it) : recv_set.erase(it);
+    for (auto it = send_set.begin(); it != send_set.end(); )
+        it = FD_ISSET(*it, &fdsetSend) ? std::next(it) : send_set.erase(it);
+    for (auto it = error_set.begin(); it != error_set.end(); )
+        it = FD_ISSET(*it, &fdsetError) ? std::next(it) : error_set.erase(it);
+    return true;
+}
+
+#ifndef WIN32
+bool CSocketEvents::WaitPoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout)
+{
+    std::map<SOCKET, struct pollfd> pollfds;
+    for (SOCKET hSocket : recv_set) {
+        pollfds[hSocket].fd = hSocket;
+        pollfds[hSocket].events |= POLLIN;
+    }
+    for (SOCKET hSocket : send_set) {
+        pollfds[hSocket].fd = hSocket;
+        pollfds[hSocket].events |= POLLOUT;
+    }
+    for (SOCKET hSocket : error_set) {
+        pollfds[hSocket].fd = hSocket;
+        // errors are always reported
+    }
+
+    std::vector<struct pollfd> vpollfds;
+    vpollfds.reserve(pollfds.size());
+    for (const auto& it : pollfds)
+        vpollfds.push_back(it.second);
+
+    if (poll(vpollfds.data(), vpollfds.size(), timeout.count()) == SOCKET_ERROR)
+        return false;
+
+    recv_set.clear();
+    send_set.clear();
+    error_set.clear();
+
+    for (const struct pollfd& pollfd_entry : vpollfds) {
+        if (pollfd_entry.revents & POLLIN)            recv_set.insert(pollfd_entry.fd);
+        if (pollfd_entry.revents & POLLOUT)           send_set.insert(pollfd_entry.fd);
+        if (pollfd_entry.revents & (POLLERR|POLLHUP)) error_set.insert(pollfd_entry.fd);
+    }
+    return true;
+}
+#endif
+
+#ifdef __linux__
+bool CSocketEvents::WaitEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout)
+{
+    // Sockets that still have readiness from earlier edges can be served right
+    // away, so only collect new edges without blocking then.
+    bool fReady = false;
+    {
+        LOCK(cs);
+        for (SOCKET hSocket : recv_set) {
+            auto it = mapReadiness.find(hSocket);
+            if (it != mapReadiness.end() && (it->second & READY_RECV)) {
+                fReady = true;
+                break;
+            }
+        }
+        for (SOCKET hSocket : send_set) {
+            if (fReady)
+                break;
+            auto it = mapReadiness.find(hSocket);
+            if (it != mapReadiness.end() && (it->second & READY_SEND))
+                fReady = true;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, fReady ? 0 : timeout.count());
+    if (nEvents == -1) {
+        if (errno != EINTR)
+            return false;
+        nEvents = 0;
+    }
+
+    LOCK(cs);
+    for (int i = 0; i < nEvents; i++) {
+        int& readiness = mapReadiness[events[i].data.fd];
+        // errors and hangups are found out by the next receive
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+            readiness |= READY_RECV;
+        if (events[i].events & EPOLLOUT)
+            readiness |= READY_SEND;
+    }
+
+    for (auto it = recv_set.begin(); it != recv_set.end(); ) {
+        auto readiness = mapReadiness.find(*it);
+        it = (readiness != mapReadiness.end() && (readiness->second & READY_RECV)) ? std::next(it) : recv_set.erase(it);
+    }
+    for (auto it = send_set.begin(); it != send_set.end(); ) {
+        auto readiness = mapReadiness.find(*it);
+        it = (readiness != mapReadiness.end() && (readiness->second & READY_SEND)) ? std::next(it) : send_set.erase(it);
+    }
+    error_set.clear();
+    return true;
+}
+#endif
+
+void CConnman::GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        recv_set.insert(hListenSocket.socket);
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            error_set.insert(pnode->hSocket);
+            if (select_send) {
+                send_set.insert(pnode->hSocket);
+                continue;
+            }
+            if (select_recv) {
+                recv_set.insert(pnode->hSocket);
+            }
+        }
+    }
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
@@ -1217,82 +1535,26 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
+        std::set<SOCKET> recv_set, send_set, error_set;
+        GenerateSelectSet(recv_set, send_set, error_set);
+        const bool fHaveSockets = !recv_set.empty() || !send_set.empty() || !error_set.empty();
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        bool fWaited = socketEvents->Wait(recv_set, send_set, error_set, SOCKET_WAIT_TIMEOUT);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
+        // Without any socket the wait may fail (select() does on Windows),
+        // which is not an error: just wait out the timeout.
+        if (!fWaited)
         {
-            if (have_fds)
-            {
+            // try receiving on all wanted sockets to find out the failing ones
+            if (fHaveSockets) {
                 int nErr = WSAGetLastError();
                 LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+            send_set.clear();
+            error_set.clear();
+            if (!interruptNet.sleep_for(SOCKET_WAIT_TIMEOUT))
                 return;
         }
 
@@ -1301,7 +1563,7 @@ void CConnman::ThreadSocketHandler()
         //
         for (const ListenSocket& hListenSocket : vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1332,9 +1594,9 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                recvSet = recv_set.count(pnode->hSocket) > 0;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
             if (recvSet || errorSet)
             {
@@ -1346,6 +1608,9 @@ void CConnman::ThreadSocketHandler()
                     if (pnode->hSocket == INVALID_SOCKET)
                         continue;
                     nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                    // a short read or one that would block left nothing to read
+                    if ((nBytes >= 0 && nBytes < (int)sizeof(pchBuf)) || (nBytes < 0 && WSAGetLastError() == WSAEWOULDBLOCK))
+                        socketEvents->SetRecvDrained(pnode->hSocket);
                 }
                 if (nBytes > 0)
                 {
@@ -1401,6 +1666,11 @@ void CConnman::ThreadSocketHandler()
                 if (nBytes) {
                     RecordBytesSent(nBytes);
                 }
+                if (!pnode->vSendMsg.empty()) {
+                    LOCK(pnode->cs_hSocket);
+                    if (pnode->hSocket != INVALID_SOCKET)
+                        socketEvents->SetSendBlocked(pnode->hSocket);
+                }
             }
 
             //
@@ -2006,6 +2276,10 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->m_manual_connection = true;
 
     m_msgproc->InitializeNode(pnode);
+    {
+        LOCK(pnode->cs_hSocket);
+        socketEvents->Register(pnode->hSocket);
+    }
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -2091,7 +2365,7 @@ bool CConnman::BindListenPort(const CService &addrBind, std::string& strError, b
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!socketEvents->IsUsableSocket(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
@@ -2161,6 +2435,7 @@ bool CConnman::BindListenPort(const CService &addrBind, std::string& strError, b
     }
 
     vhListenSocket.push_back(ListenSocket(hListenSocket, fWhitelisted));
+    socketEvents->Register(hListenSocket);
 
     if (addrBind.IsRoutable() && fDiscover && !fWhitelisted)
         AddLocal(addrBind, LOCAL_BIND);
@@ -2251,6 +2526,8 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     semOutbound = nullptr;
     semAddnode = nullptr;
     flagInterruptMsgProc = false;
+    socketEventsMode = SocketEventsMode::SELECT;
+    socketEvents.reset(new CSocketEvents(socketEventsMode));
 
     Options connOptions;
     Init(connOptions);
@@ -2307,6 +2584,8 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         nMaxOutboundCycleStartTime = 0;
     }
 
+    socketEvents.reset(new CSocketEvents(socketEventsMode));
+
     if (fListen && !InitBinds(connOptions.vBinds, connOptions.vWhiteBinds)) {
         if (clientInterface) {
             clientInterface->ThreadSafeMessageBox(
@@ -2849,13 +3128,14 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    const std::vector<unsigned char>& payload = msg.shared_data ? *msg.shared_data : msg.data;
+    size_t nMessageSize = payload.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    uint256 hash = Hash(payload.data(), payload.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
@@ -2872,9 +3152,15 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader)));
+        if (nMessageSize) {
+            // A shared payload is queued as is, the other peers it is sent
+            // to keep referencing the same buffer.
+            if (msg.shared_data)
+                pnode->vSendMsg.push_back(std::move(msg.shared_data));
+            else
+                pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(msg.data)));
+        }
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -27,7 +27,9 @@
 #include "primitives/block.h"
 
 #include <atomic>
+#include <chrono>
 #include <deque>
+#include <set>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -92,6 +94,79 @@ static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
+/** How the socket handler waits for sockets to become ready */
+enum class SocketEventsMode {
+    SELECT,
+    POLL,
+    EPOLL,
+};
+/** -socketevents default */
+static const char* const DEFAULT_SOCKET_EVENTS = "select";
+
+/** Parse a -socketevents value, failing for modes not available on this platform */
+bool SocketEventsModeFromString(const std::string& str, SocketEventsMode& mode);
+/** The -socketevents values available on this platform */
+std::string SocketEventsModes();
+
+/**
+ * Waits for sockets to become ready with select(), poll() or, on Linux,
+ * edge triggered epoll.
+ *
+ * With epoll, sockets are registered once and the readiness reported by
+ * each edge is remembered until the owner reports it used up, through
+ * SetRecvDrained() and SetSendBlocked(), so a socket that was only partly
+ * read is still reported as ready without the kernel being asked again.
+ * The other modes rescan the wanted sockets on every wait and ignore
+ * registration and readiness reports.
+ */
+class CSocketEvents
+{
+public:
+    explicit CSocketEvents(SocketEventsMode modeIn);
+    ~CSocketEvents();
+
+    SocketEventsMode GetMode() const { return mode; }
+
+    /** Whether the socket can be waited on at all (select() is bound by FD_SETSIZE) */
+    bool IsUsableSocket(const SOCKET& hSocket) const;
+
+    /** Start watching a new socket, forgetting about earlier sockets that had the same descriptor */
+    bool Register(const SOCKET& hSocket);
+
+    /**
+     * Wait up to timeout for the sockets in recv_set and send_set to become
+     * readable or writable, then leave only the ready sockets in the sets,
+     * and the sockets with pending errors in error_set. Returns false if the
+     * wait itself failed.
+     */
+    bool Wait(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout);
+
+    /** A receive or accept on the socket found nothing more to read */
+    void SetRecvDrained(const SOCKET& hSocket);
+    /** A send on the socket could not write everything */
+    void SetSendBlocked(const SOCKET& hSocket);
+
+private:
+    bool WaitSelect(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout);
+#ifndef WIN32
+    bool WaitPoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout);
+#endif
+#ifdef __linux__
+    bool WaitEpoll(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set, std::chrono::milliseconds timeout);
+
+    enum Readiness {
+        READY_RECV = (1U << 0),
+        READY_SEND = (1U << 1),
+    };
+
+    int epollFd;
+    CCriticalSection cs;
+    std::map<SOCKET, int> mapReadiness GUARDED_BY(cs);
+#endif
+
+    SocketEventsMode mode;
+};
+
 typedef int64_t NodeId;
 
 struct AddedNodeInfo
@@ -115,6 +190,8 @@ struct CSerializedNetMsg
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
     std::vector<unsigned char> data;
+    /** Payload shared with other messages, sent instead of data when set */
+    std::shared_ptr<const std::vector<unsigned char>> shared_data;
     std::string command;
 };
 
@@ -150,6 +227,7 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        SocketEventsMode socketEventsMode = SocketEventsMode::SELECT;
     };
 
     void Init(const Options& connOptions) {
@@ -163,6 +241,7 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        socketEventsMode = connOptions.socketEventsMode;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -323,6 +402,8 @@ private:
     void ThreadOpenConnections(std::vector<std::string> connect);
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket& hListenSocket);
+    /** Fill the sets of sockets to wait on for receiving, sending and errors */
+    void GenerateSelectSet(std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -378,6 +459,9 @@ private:
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
 
+    SocketEventsMode socketEventsMode;
+    std::unique_ptr<CSocketEvents> socketEvents;
+
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
@@ -602,7 +686,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -673,8 +757,10 @@ public:
 
     // chain tips prioritization
     // sending chain tips does not follow the usual inventory path,
-    // but a dedicated sending of the entire block
-    std::vector<CBlock> vChainTipsToSend;
+    // but a dedicated sending of the entire block, or only of its header
+    // to peers that can request the block themselves
+    std::vector<std::shared_ptr<const CBlock>> vChainTipsToSend;
+    std::vector<CBlockHeader> vChainTipHeadersToSend;
     CCriticalSection cs_chainTips;
     CRollingBloomFilter filterChainTipsKnown;
 
@@ -683,6 +769,9 @@ public:
     // Set of transaction ids we still have to announce.
     // They are sorted by the mempool before relay, so the order is not important.
     std::set<uint256> setInventoryTxToSend;
+    // Set of votes on the current chain tips we still have to relay.
+    // They bypass the trickle of setInventoryTxToSend.
+    std::set<uint256> setInventoryVoteToSend;
     // List of block ids we still have announce.
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
@@ -813,11 +902,18 @@ public:
         }
     }
 
-    void PushChainTip(const CBlock block)
+    void PushChainTip(const std::shared_ptr<const CBlock>& pblock)
     {
         LOCK(cs_chainTips);
-        if (!filterChainTipsKnown.contains(block.GetHash()))
-            vChainTipsToSend.push_back(block);
+        if (!filterChainTipsKnown.contains(pblock->GetHash()))
+            vChainTipsToSend.push_back(pblock);
+    }
+
+    void PushChainTipHeader(const CBlockHeader& header)
+    {
+        LOCK(cs_chainTips);
+        if (!filterChainTipsKnown.contains(header.GetHash()))
+            vChainTipHeadersToSend.push_back(header);
     }
 
     void AddInventoryKnown(const CInv& inv)
@@ -840,6 +936,13 @@ public:
         }
     }
 
+    void PushVoteInventory(const CInv& inv)
+    {
+        LOCK(cs_inventory);
+        if (!filterInventoryKnown.contains(inv.hash))
+            setInventoryVoteToSend.insert(inv.hash);
+    }
+
     void PushBlockHash(const uint256 &hash)
     {
         LOCK(cs_inventory);
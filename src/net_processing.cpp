@@ -35,6 +35,7 @@
 #include "utilstrencodings.h"
 #include "validationinterface.h"
 
+#include <functional>
 #include <iterator>
 
 #if defined(NDEBUG)
@@ -138,6 +139,9 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /** Time in microseconds at which recently received votes first arrived from any peer, protected by cs_main. */
+    limitedmap<uint256, int64_t> mapVoteFirstSeen(MAX_VOTES_FIRST_SEEN);
 } // namespace
 
 namespace {
@@ -209,6 +213,17 @@ struct CNodeState {
      * otherwise: whether this peer sends non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Whether this peer wants votes on the chain tips pushed via "vote" rather than announced via "inv".
+    bool fWantsVotePush;
+    //! Votes this peer may still push to us, and votes we may still push to it.
+    CVotePushBudget votePushRecvBudget;
+    CVotePushBudget votePushSendBudget;
+    //! Number of votes relayed to this peer outside of the inventory trickle.
+    uint64_t nVotesSent;
+    //! Number of votes received from this peer, and their total delay in microseconds
+    //! after the first arrival of the same vote from any peer.
+    uint64_t nVotesReceived;
+    int64_t nVoteRelayLagTotal;
 
     /** State used to enforce CHAIN_SYNC_TIMEOUT
       * Only in effect for outbound, non-manual connections, with
@@ -259,6 +274,10 @@ struct CNodeState {
         fHaveWitness = false;
         fWantsCmpctWitness = false;
         fSupportsDesiredCmpctVersion = false;
+        fWantsVotePush = false;
+        nVotesSent = 0;
+        nVotesReceived = 0;
+        nVoteRelayLagTotal = 0;
         m_chain_sync = { 0, nullptr, false, false };
     }
 };
@@ -544,6 +563,113 @@ bool IsOutboundDisconnectionCandidate(const CNode *node)
     return !(node->fInbound || node->m_manual_connection || node->fFeeler || node->fOneShot);
 }
 
+bool CTxValidationQueue::Push(NodeId nodeid, const std::string& strCommand, const CTransactionRef& tx, bool fCheck)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fCheck) {
+        auto it = mapPeerJobs.find(nodeid);
+        if (it == mapPeerJobs.end())
+            return false;
+        it->second.push_back(std::make_shared<Job>(Job{strCommand, tx, true}));
+        return true;
+    }
+    if (nThreads == 0 || queue.size() >= nMaxQueued)
+        return false;
+    std::shared_ptr<Job> job = std::make_shared<Job>(Job{strCommand, tx, false});
+    queue.push_back(job);
+    mapPeerJobs[nodeid].push_back(job);
+    cond.notify_one();
+    return true;
+}
+
+bool CTxValidationQueue::CanCheck()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nThreads > 0 && queue.size() < nMaxQueued;
+}
+
+bool CTxValidationQueue::HasPending(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return mapPeerJobs.count(nodeid) > 0;
+}
+
+size_t CTxValidationQueue::Size()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+std::vector<CTxValidationQueue::Job> CTxValidationQueue::PopChecked(NodeId nodeid)
+{
+    std::vector<Job> vJobs;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    auto it = mapPeerJobs.find(nodeid);
+    if (it == mapPeerJobs.end())
+        return vJobs;
+    std::deque<std::shared_ptr<Job>>& jobs = it->second;
+    while (!jobs.empty() && jobs.front()->fChecked) {
+        vJobs.push_back(std::move(*jobs.front()));
+        jobs.pop_front();
+    }
+    if (jobs.empty())
+        mapPeerJobs.erase(it);
+    return vJobs;
+}
+
+void CTxValidationQueue::RemovePeer(NodeId nodeid)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    mapPeerJobs.erase(nodeid);
+}
+
+void CTxValidationQueue::SetWakeup(std::function<void()> wakeupIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    wakeup = std::move(wakeupIn);
+}
+
+void CTxValidationQueue::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads++;
+    }
+    try {
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (queue.empty())
+                    cond.wait(lock);
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            PrevalidateTransaction(mempool, job->tx);
+            std::function<void()> wakeupCopy;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                job->fChecked = true;
+                wakeupCopy = wakeup;
+            }
+            if (wakeupCopy)
+                wakeupCopy();
+        }
+    } catch (const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nThreads--;
+        throw;
+    }
+}
+
+static CTxValidationQueue txValidationQueue(MAX_TXVAL_QUEUE);
+
+void ThreadTxValidation()
+{
+    RenameThread("bwscoin-txval");
+    txValidationQueue.Thread();
+}
+
 void PeerLogicValidation::InitializeNode(CNode *pnode) {
     CAddress addr = pnode->addr;
     std::string addrName = pnode->GetAddrName();
@@ -558,6 +684,7 @@ void PeerLogicValidation::InitializeNode(CNode *pnode) {
 
 void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     fUpdateConnectionTime = false;
+    txValidationQueue.RemovePeer(nodeid);
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
     assert(state != nullptr);
@@ -603,6 +730,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nVotesSent = state->nVotesSent;
+    stats.nVotesReceived = state->nVotesReceived;
+    stats.nVoteRelayLag = state->nVotesReceived > 0 ? state->nVoteRelayLagTotal / static_cast<int64_t>(state->nVotesReceived) : 0;
     return true;
 }
 
@@ -768,9 +898,75 @@ static bool StaleBlockRequestAllowed(const CBlockIndex* pindex, const Consensus:
         (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) < STALE_RELAY_AGE_LIMIT);
 }
 
+bool CVotePushBudget::Consume(int64_t nTime)
+{
+    if (nLastTime > 0 && nTime > nLastTime)
+        dTokens = std::min<double>(dTokens + (nTime - nLastTime) * VOTE_PUSH_RATE / (60 * 1000000.0), VOTE_PUSH_BURST);
+    nLastTime = std::max(nLastTime, nTime);
+    if (dTokens < 1)
+        return false;
+    dTokens -= 1;
+    return true;
+}
+
+size_t CSerializedBlockCache::Count() const
+{
+    LOCK(cs);
+    return mapBlocks.size();
+}
+
+size_t CSerializedBlockCache::Bytes() const
+{
+    LOCK(cs);
+    return nBytes;
+}
+
+CSerializedBlockCache::Data CSerializedBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return nullptr;
+    lruBlocks.splice(lruBlocks.begin(), lruBlocks, it->second);
+    return it->second->second;
+}
+
+void CSerializedBlockCache::Insert(const uint256& hash, const Data& data)
+{
+    LOCK(cs);
+    if (mapBlocks.count(hash) || data->size() > nMaxBytes)
+        return;
+    lruBlocks.emplace_front(hash, data);
+    mapBlocks.emplace(hash, lruBlocks.begin());
+    nBytes += data->size();
+    Trim();
+}
+
+void CSerializedBlockCache::SetMaxBytes(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+void CSerializedBlockCache::Trim()
+{
+    AssertLockHeld(cs);
+    while (nBytes > nMaxBytes) {
+        nBytes -= lruBlocks.back().second->size();
+        mapBlocks.erase(lruBlocks.back().first);
+        lruBlocks.pop_back();
+    }
+}
+
+/** Blocks recently served to peers, see -blockservecache */
+static CSerializedBlockCache servedBlockCache(DEFAULT_BLOCK_SERVE_CACHE << 20);
+
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) : connman(connmanIn) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    servedBlockCache.SetMaxBytes(std::max<int64_t>(0, gArgs.GetArg("-blockservecache", DEFAULT_BLOCK_SERVE_CACHE)) << 20);
+    txValidationQueue.SetWakeup([connmanIn] { connmanIn->WakeMessageHandler(); });
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
@@ -807,11 +1003,20 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
 static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
+static CSerializedBlockCache::Data most_recent_compact_block_data;
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
+    // Also prefill what reached our mempool just before the block, as the
+    // peers are unlikely to have it yet.
+    CompactBlockPrefillPolicy prefillPolicy;
+    prefillPolicy.pool = &mempool;
+    prefillPolicy.nRecentTime = GetTime() - gArgs.GetArg("-cmpctprefillrecent", DEFAULT_CMPCT_PREFILL_RECENT);
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true, prefillPolicy);
+    // Serialized once, every peer it is announced or served to shares the bytes
+    std::shared_ptr<std::vector<unsigned char>> pcmpctblockData = std::make_shared<std::vector<unsigned char>>();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *pcmpctblockData, 0, *pcmpctblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -831,11 +1036,11 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_data = pcmpctblockData;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
+    connman->ForEachNode([this, &pcmpctblockData, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -847,7 +1052,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, msgMaker.MakeSerialized(NetMsgType::CMPCTBLOCK, pcmpctblockData));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -955,19 +1160,57 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+// Votes on a block at the height of our tip or above are needed right away
+// to extend one of the chain tips, so they are relayed outside of the
+// inventory trickle.
+bool IsVoteOnChainTip(const CTransaction& tx)
+{
+    AssertLockHeld(cs_main);
+    VoteData vote;
+    if (ParseTxClass(tx) != TX_Vote || !ParseVote(tx, vote))
+        return false;
+    BlockMap::iterator mi = mapBlockIndex.find(vote.blockHash);
+    return mi != mapBlockIndex.end() && mi->second->nHeight >= chainActive.Height();
+}
+
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    connman->ForEachNode([&inv](CNode* pnode)
+    const bool fVote = IsVoteOnChainTip(tx);
+    connman->ForEachNode([&inv, fVote](CNode* pnode)
     {
-        pnode->PushInventory(inv);
+        if (fVote)
+            pnode->PushVoteInventory(inv);
+        else
+            pnode->PushInventory(inv);
     });
 }
 
 static void RelayTransaction(const CTransaction& tx, CNode* pnode)
 {
     CInv inv(MSG_TX, tx.GetHash());
-    pnode->PushInventory(inv);
+    if (IsVoteOnChainTip(tx))
+        pnode->PushVoteInventory(inv);
+    else
+        pnode->PushInventory(inv);
+}
+
+// Keep a transaction we announce around for 15 minutes, so that the peers
+// can still fetch it after it left the mempool.
+static void AddToRelayMap(const uint256& hash, CTransactionRef tx, int64_t nNow)
+{
+    AssertLockHeld(cs_main);
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
+    {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    auto ret = mapRelay.insert(std::make_pair(hash, std::move(tx)));
+    if (ret.second) {
+        vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+    }
 }
 
 static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connman)
@@ -1041,27 +1284,76 @@ void static RelayMempoolStakeTxs(CNode* pfrom)
     }
 }
 
-void static RelayChainTips(CNode* pfrom, const Consensus::Params& consensusParams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, const int maxDepth = DEFAULT_HANDSHAKE_TIPS_DEPTH, CBlock *pExcludeBlock = nullptr)
-{
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+// Blocks of the chain tips last relayed on handshake, keyed by hash. An entry
+// is loaded from disk on first use and kept only while the block is a tip, so
+// that concurrent handshakes (and the getdata requests that follow a header
+// announcement) share a single disk read per tip.
+static std::map<uint256, std::shared_ptr<const CBlock>> mapChainTipBlocks GUARDED_BY(cs_main);
 
-    LOCK(cs_main);
+std::shared_ptr<const CBlock> static GetChainTipBlock(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    auto it = mapChainTipBlocks.find(pindex->GetBlockHash());
+    if (it != mapChainTipBlocks.end() && it->second)
+        return it->second;
 
-    std::set<CBlockIndex*, CompareBlocksByHeight> setTips = GetChainTips();
-    std::set<CBlockIndex*, CompareBlocksByHeight> setLatestTips;
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+        return nullptr;
+    if (it != mapChainTipBlocks.end())
+        it->second = pblockRead;
+    return pblockRead;
+}
 
-    if (maxDepth >= 0) {
-        int minHeight = chainActive.Tip()->nHeight - maxDepth;
-        std::copy_if(std::begin(setTips), std::end(setTips),
-                     std::inserter(setLatestTips, std::end(setLatestTips)),
-                     [minHeight] (const CBlockIndex* pindex) -> bool { return pindex->nHeight >= minHeight; });
+/**
+ * Return the block serialized with witness data, ready to be sent to peers.
+ * Blocks at hand are serialized, the others are read from disk as is.
+ */
+static CSerializedBlockCache::Data GetSerializedBlock(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& a_recent_block)
+{
+    AssertLockHeld(cs_main);
+    const uint256 hash = pindex->GetBlockHash();
+    CSerializedBlockCache::Data data = servedBlockCache.Get(hash);
+    if (data)
+        return data;
+
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == hash) {
+        pblock = a_recent_block;
     } else {
-        setLatestTips = setTips;
+        auto it = mapChainTipBlocks.find(hash);
+        if (it != mapChainTipBlocks.end())
+            pblock = it->second;
     }
 
-    uint256 excludeHash;
-    if (pExcludeBlock)
-        excludeHash = pExcludeBlock->GetHash();
+    std::shared_ptr<std::vector<unsigned char>> pdata = std::make_shared<std::vector<unsigned char>>();
+    if (pblock) {
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, *pdata, 0, *pblock);
+    } else if (!ReadRawBlockFromDisk(*pdata, pindex, Params().MessageStart())) {
+        return nullptr;
+    }
+    servedBlockCache.Insert(hash, pdata);
+    return pdata;
+}
+
+void static RelayChainTips(CNode* pfrom, const Consensus::Params& consensusParams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, const int maxDepth = DEFAULT_HANDSHAKE_TIPS_DEPTH, const uint256& excludeHash = uint256())
+{
+    // Peers that understand "tipheaders" only get the headers and request the
+    // blocks they lack, the others get every tip as a full block.
+    const bool fHeadersOnly = pfrom->nVersion >= TIP_HEADERS_VERSION && gArgs.GetBoolArg("-handshaketipsheaders", DEFAULT_HANDSHAKE_TIPS_HEADERS);
+
+    LOCK(cs_main);
+
+    std::set<CBlockIndex*, CompareBlocksByHeight> setLatestTips = GetChainTips(maxDepth);
+
+    // Forget the blocks which are no longer tips, and register the new ones
+    // without loading them yet.
+    std::map<uint256, std::shared_ptr<const CBlock>> mapTipBlocks;
+    for (const CBlockIndex* pindex: setLatestTips) {
+        auto it = mapChainTipBlocks.find(pindex->GetBlockHash());
+        mapTipBlocks.emplace(pindex->GetBlockHash(), it != mapChainTipBlocks.end() ? it->second : nullptr);
+    }
+    mapChainTipBlocks.swap(mapTipBlocks);
 
     for (const CBlockIndex* pindex: setLatestTips) {
         if (pfrom->fPauseSend)
@@ -1073,21 +1365,23 @@ void static RelayChainTips(CNode* pfrom, const Consensus::Params& consensusParam
         if ((pindex->nStatus & BLOCK_HAVE_DATA) == 0)
             continue;
 
-        if (pExcludeBlock && (pindex->GetBlockHash() == excludeHash))
+        if (!excludeHash.IsNull() && (pindex->GetBlockHash() == excludeHash))
             continue;
 
-        // Send block from disk
-        std::shared_ptr<const CBlock> pblock;
-        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+        if (fHeadersOnly) {
+            pfrom->PushChainTipHeader(pindex->GetBlockHeader());
+            continue;
+        }
+
+        std::shared_ptr<const CBlock> pblock = GetChainTipBlock(pindex, consensusParams);
+        if (!pblock)
             continue;
-        pblock = pblockRead;
 
-        pfrom->PushChainTip(*pblock);
+        pfrom->PushChainTip(pblock);
     }
 }
 
-void static RelayStakeTxsAndChainTipsIfNeeded(CBlock block, CNode* pfrom, const Consensus::Params& consensusParams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, uint256 chainTipHash = uint256())
+void static RelayStakeTxsAndChainTipsIfNeeded(const uint256& hashBlock, CNode* pfrom, const Consensus::Params& consensusParams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, uint256 chainTipHash = uint256())
 {
     // send all the votes in mempool and the chain tips,
     // if not during the initial block download
@@ -1112,13 +1406,13 @@ void static RelayStakeTxsAndChainTipsIfNeeded(CBlock block, CNode* pfrom, const
     //if ((pfrom->nLastBlockTime < chainTipTime - tipsInterval) || (pfrom->nLastBlockTime > chainTipTime + tipsInterval))
     //    return;
 
-    if (block.GetHash() != chainTipHash)
+    if (hashBlock != chainTipHash)
         return;
 
     RelayMempoolStakeTxs(pfrom);
 
     int depth = static_cast<int>(gArgs.GetArg("-handshaketipsdepth", DEFAULT_HANDSHAKE_TIPS_DEPTH));
-    RelayChainTips(pfrom, consensusParams, connman, interruptMsgProc, depth, &block);
+    RelayChainTips(pfrom, consensusParams, connman, interruptMsgProc, depth, hashBlock);
 }
 
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
@@ -1146,11 +1440,13 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 std::shared_ptr<const CBlock> a_recent_block;
                 std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+                CSerializedBlockCache::Data a_recent_compact_block_data;
                 bool fWitnessesPresentInARecentCompactBlock;
                 {
                     LOCK(cs_most_recent_block);
                     a_recent_block = most_recent_block;
                     a_recent_compact_block = most_recent_compact_block;
+                    a_recent_compact_block_data = most_recent_compact_block_data;
                     fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
                 }
                 if (mi != mapBlockIndex.end())
@@ -1191,26 +1487,43 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    std::shared_ptr<const CBlock> pblock;
-                    if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
-                        pblock = a_recent_block;
-                    } else {
-                        // Send block from disk
-                        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-                        if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
+                    // Blocks sent with witness data are served from their
+                    // serialization, shared between the peers requesting them,
+                    // the other replies need the block itself.
+                    auto LoadBlock = [&]() {
+                        std::shared_ptr<const CBlock> pblock;
+                        if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
+                            pblock = a_recent_block;
+                        } else if (mapChainTipBlocks.count((*mi).second->GetBlockHash())) {
+                            pblock = GetChainTipBlock((*mi).second, consensusParams);
+                            if (!pblock)
+                                assert(!"cannot load block from disk");
+                        } else {
+                            // Send block from disk
+                            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                            if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
+                                assert(!"cannot load block from disk");
+                            pblock = pblockRead;
+                        }
+                        return pblock;
+                    };
+                    auto PushSerializedBlock = [&]() {
+                        CSerializedBlockCache::Data block_data = GetSerializedBlock((*mi).second, a_recent_block);
+                        if (!block_data)
                             assert(!"cannot load block from disk");
-                        pblock = pblockRead;
-                    }
+                        connman->PushMessage(pfrom, msgMaker.MakeSerialized(NetMsgType::BLOCK, std::move(block_data)));
+                    };
                     if (inv.type == MSG_BLOCK) {
-                        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-                        RelayStakeTxsAndChainTipsIfNeeded(*pblock, pfrom, consensusParams, connman, interruptMsgProc, chainActive.Tip()->GetBlockHash());
+                        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *LoadBlock()));
+                        RelayStakeTxsAndChainTipsIfNeeded(inv.hash, pfrom, consensusParams, connman, interruptMsgProc, chainActive.Tip()->GetBlockHash());
                     }
                     else if (inv.type == MSG_WITNESS_BLOCK) {
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-                        RelayStakeTxsAndChainTipsIfNeeded(*pblock, pfrom, consensusParams, connman, interruptMsgProc, chainActive.Tip()->GetBlockHash());
+                        PushSerializedBlock();
+                        RelayStakeTxsAndChainTipsIfNeeded(inv.hash, pfrom, consensusParams, connman, interruptMsgProc, chainActive.Tip()->GetBlockHash());
                     }
                     else if (inv.type == MSG_FILTERED_BLOCK)
                     {
+                        std::shared_ptr<const CBlock> pblock = LoadBlock();
                         bool sendMerkleBlock = false;
                         CMerkleBlock merkleBlock;
                         {
@@ -1245,14 +1558,20 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
                         if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
                             if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                                if (fPeerWantsWitness && a_recent_compact_block_data)
+                                    connman->PushMessage(pfrom, msgMaker.MakeSerialized(NetMsgType::CMPCTBLOCK, a_recent_compact_block_data));
+                                else
+                                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                             } else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                                CBlockHeaderAndShortTxIDs cmpctblock(*LoadBlock(), fPeerWantsWitness);
                                 connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                             }
                         } else {
-                            connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
-                            RelayStakeTxsAndChainTipsIfNeeded(*pblock, pfrom, consensusParams, connman, interruptMsgProc, chainActive.Tip()->GetBlockHash());
+                            if (fPeerWantsWitness)
+                                PushSerializedBlock();
+                            else
+                                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *LoadBlock()));
+                            RelayStakeTxsAndChainTipsIfNeeded(inv.hash, pfrom, consensusParams, connman, interruptMsgProc, chainActive.Tip()->GetBlockHash());
                         }
                     }
 
@@ -1339,6 +1658,199 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
+/**
+ * Process a transaction or vote relayed by a peer, once its checks ahead of
+ * AcceptToMemoryPool are done, see CTxValidationQueue.
+ */
+static bool ProcessTransaction(CNode* pfrom, const std::string& strCommand, const CTransactionRef& ptx, const CChainParams& chainparams, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    std::deque<COutPoint> vWorkQueue;
+    std::vector<uint256> vEraseQueue;
+    const CTransaction& tx = *ptx;
+    const CInv inv(MSG_TX, tx.GetHash());
+
+    LOCK(cs_main);
+
+    const bool fVote = ParseTxClass(tx) == TX_Vote;
+    if (fVote) {
+        const int64_t nNow = GetTimeMicros();
+        auto itFirstSeen = mapVoteFirstSeen.find(inv.hash);
+        CNodeState *nodestate = State(pfrom->GetId());
+        nodestate->nVotesReceived++;
+        if (itFirstSeen != mapVoteFirstSeen.end())
+            nodestate->nVoteRelayLagTotal += nNow - itFirstSeen->second;
+        else
+            mapVoteFirstSeen.insert(std::make_pair(inv.hash, nNow));
+    }
+
+    bool fMissingInputs = false;
+    CValidationState state;
+
+    pfrom->setAskFor.erase(inv.hash);
+    mapAlreadyAskedFor.erase(inv.hash);
+
+    std::list<CTransactionRef> lRemovedTxn;
+
+    if (!AlreadyHave(inv) &&
+        AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+        mempool.check(pcoinsTip, chainparams);
+        RelayTransaction(tx, connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            vWorkQueue.emplace_back(inv.hash, i);
+        }
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom->GetId(),
+            tx.GetHash().ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        std::set<NodeId> setMisbehaving;
+        while (!vWorkQueue.empty()) {
+            auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+            vWorkQueue.pop_front();
+            if (itByPrev == mapOrphanTransactionsByPrev.end())
+                continue;
+            for (auto mi = itByPrev->second.begin();
+                 mi != itByPrev->second.end();
+                 ++mi)
+            {
+                const CTransactionRef& porphanTx = (*mi)->second.tx;
+                const CTransaction& orphanTx = *porphanTx;
+                const uint256& orphanHash = orphanTx.GetHash();
+                NodeId fromPeer = (*mi)->second.fromPeer;
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if (setMisbehaving.count(fromPeer))
+                    continue;
+                if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, &fMissingInputs2, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+                    LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(orphanTx, connman);
+                    for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
+                        vWorkQueue.emplace_back(orphanHash, i);
+                    }
+                    vEraseQueue.push_back(orphanHash);
+                }
+                else if (!fMissingInputs2)
+                {
+                    int nDos = 0;
+                    if (stateDummy.IsInvalid(nDos) && nDos > 0)
+                    {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee
+                    LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+                    vEraseQueue.push_back(orphanHash);
+                    if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
+                        // Do not use rejection cache for witness transactions or
+                        // witness-stripped transactions, as they can have been malleated.
+                        // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+                        assert(recentRejects);
+                        recentRejects->insert(orphanHash);
+                    }
+                }
+                mempool.check(pcoinsTip, chainparams);
+            }
+        }
+
+        for (uint256 hash : vEraseQueue)
+            EraseOrphanTx(hash);
+    }
+    else if (fMissingInputs)
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+        for (const CTxIn& txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.hash)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            uint32_t nFetchFlags = GetFetchFlags(pfrom);
+            for (const CTxIn& txin : tx.vin) {
+                CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+            }
+            AddOrphanTx(ptx, pfrom->GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetHash());
+        }
+    } else {
+        if (!tx.HasWitness() && !state.CorruptionPossible()) {
+            // Do not use rejection cache for witness transactions or
+            // witness-stripped transactions, as they can have been malleated.
+            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+            assert(recentRejects);
+            recentRejects->insert(tx.GetHash());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
+        }
+
+        if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+                RelayTransaction(tx, connman);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
+            }
+        }
+    }
+
+    for (const CTransactionRef& removedTx : lRemovedTxn)
+        AddToCompactExtraTransactions(removedTx);
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+            pfrom->GetId(),
+            FormatStateMessage(state));
+        if (state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+        if (nDoS > 0) {
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1593,6 +2105,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // nodes)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
         }
+        if (pfrom->nVersion >= VOTE_RELAY_VERSION && gArgs.GetBoolArg("-votepush", DEFAULT_VOTE_PUSH)) {
+            // Tell our peer we prefer to get the votes on the chain tips
+            // pushed rather than wait for an inv and getdata round trip
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDVOTES));
+        }
         if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
             // Tell our peer we are willing to provide version 1 or 2 cmpctblocks
             // However, we do not request new block announcements using
@@ -1689,6 +2206,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDVOTES)
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fWantsVotePush = true;
+    }
+
     else if (strCommand == NetMsgType::SENDCMPCT)
     {
         bool fAnnounceUsingCMPCTBLOCK = false;
@@ -1970,7 +2493,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
-    else if (strCommand == NetMsgType::TX)
+    else if (strCommand == NetMsgType::TX || strCommand == NetMsgType::VOTE)
     {
         // Stop processing the transaction early if
         // We are in blocks only mode and peer is either not whitelisted or whitelistrelay is off
@@ -1980,180 +2503,38 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
-        std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
         vRecv >> ptx;
-        const CTransaction& tx = *ptx;
-
-        CInv inv(MSG_TX, tx.GetHash());
-        pfrom->AddInventoryKnown(inv);
-
-        LOCK(cs_main);
-
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
-
-        std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv) &&
-            AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            mempool.check(pcoinsTip, chainparams);
-            RelayTransaction(tx, connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
+        pfrom->AddInventoryKnown(CInv(MSG_TX, ptx->GetHash()));
 
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->GetId(),
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            std::set<NodeId> setMisbehaving;
-            while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
-                vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const CTransactionRef& porphanTx = (*mi)->second.tx;
-                    const CTransaction& orphanTx = *porphanTx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if (setMisbehaving.count(fromPeer))
-                        continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, &fMissingInputs2, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-                        LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx, connman);
-                        for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
-                        vEraseQueue.push_back(orphanHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        int nDos = 0;
-                        if (stateDummy.IsInvalid(nDos) && nDos > 0)
-                        {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee
-                        LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
-                            // Do not use rejection cache for witness transactions or
-                            // witness-stripped transactions, as they can have been malleated.
-                            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                            assert(recentRejects);
-                            recentRejects->insert(orphanHash);
-                        }
-                    }
-                    mempool.check(pcoinsTip, chainparams);
-                }
-            }
-
-            for (uint256 hash : vEraseQueue)
-                EraseOrphanTx(hash);
-        }
-        else if (fMissingInputs)
-        {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom);
-                for (const CTxIn& txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetHash());
-            }
-        } else {
-            if (!tx.HasWitness() && !state.CorruptionPossible()) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
+        if (strCommand == NetMsgType::VOTE) {
+            LOCK(cs_main);
+            // Unrequested votes have their own budget, and anything else
+            // sent through this lane is a protocol violation.
+            if (ParseTxClass(*ptx) != TX_Vote) {
+                Misbehaving(pfrom->GetId(), 20);
+                return error("vote message with a non-vote transaction %s, peer=%d", ptx->GetHash().ToString(), pfrom->GetId());
             }
-
-            if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                    RelayTransaction(tx, connman);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
-                }
+            // Votes over the budget are dropped without penalty, the sender
+            // cannot tell exactly when they arrive.
+            if (!State(pfrom->GetId())->votePushRecvBudget.Consume(GetTimeMicros())) {
+                LogPrint(BCLog::NET, "vote push rate exceeded, ignoring %s peer=%d\n", ptx->GetHash().ToString(), pfrom->GetId());
+                return true;
             }
         }
 
-        for (const CTransactionRef& removedTx : lRemovedTxn)
-            AddToCompactExtraTransactions(removedTx);
-
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
+        // Leave the script checks to the validation threads when they are
+        // running, the transaction comes back to ProcessTransaction in the
+        // order the peer sent it. Those we already have or rejected need no
+        // check, they only wait for the earlier transactions of the peer.
+        bool fAlreadyHave;
         {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(),
-                FormatStateMessage(state));
-            if (state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
-                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-            if (nDoS > 0) {
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
+            LOCK(cs_main);
+            fAlreadyHave = AlreadyHave(CInv(MSG_TX, ptx->GetHash()));
         }
+        if (txValidationQueue.Push(pfrom->GetId(), strCommand, ptx, !fAlreadyHave))
+            return true;
+        return ProcessTransaction(pfrom, strCommand, ptx, chainparams, connman);
     }
 
 
@@ -2441,6 +2822,73 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
+    else if (strCommand == NetMsgType::TIPHEADERS && !fImporting && !fReindex) // Ignore tips received while importing
+    {
+        std::vector<CBlockHeader> headers;
+
+        unsigned int nCount = ReadCompactSize(vRecv);
+        if (nCount > MAX_HEADERS_RESULTS) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("tipheaders message size = %u", nCount);
+        }
+        headers.resize(nCount);
+        for (unsigned int n = 0; n < nCount; n++)
+            vRecv >> headers[n];
+
+        // The headers are the tips of competing chains, so they are accepted
+        // one by one. A tip whose parent we don't know is left to the regular
+        // headers sync, which we kick off with a single getheaders.
+        bool fSentGetHeaders = false;
+        std::vector<const CBlockIndex*> vTips;
+        for (const CBlockHeader& header : headers) {
+            {
+                LOCK(cs_main);
+                if (mapBlockIndex.find(header.hashPrevBlock) == mapBlockIndex.end()) {
+                    if (!fSentGetHeaders) {
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256()));
+                        fSentGetHeaders = true;
+                    }
+                    continue;
+                }
+            }
+
+            CValidationState state;
+            const CBlockIndex *pindex = nullptr;
+            if (!ProcessNewBlockHeaders({header}, state, chainparams, &pindex)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0) {
+                        LOCK(cs_main);
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    }
+                    return error("invalid tip header received");
+                }
+                continue;
+            }
+            vTips.push_back(pindex);
+        }
+
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+        std::vector<CInv> vGetData;
+        for (const CBlockIndex *pindex : vTips) {
+            UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+            if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER)
+                break;
+            if ((pindex->nStatus & BLOCK_HAVE_DATA) || mapBlocksInFlight.count(pindex->GetBlockHash()))
+                continue;
+            if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus()) && !nodestate->fHaveWitness)
+                continue;
+            vGetData.push_back(CInv(MSG_BLOCK | GetFetchFlags(pfrom), pindex->GetBlockHash()));
+            MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), pindex);
+            LogPrint(BCLog::NET, "Requesting chain tip %s (%d) from peer=%d\n",
+                    pindex->GetBlockHash().ToString(), pindex->nHeight, pfrom->GetId());
+        }
+        if (!vGetData.empty())
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+    }
+
     else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
@@ -2645,7 +3093,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
         if (fNewBlock) {
             pfrom->nLastBlockTime = GetTime();
-            RelayStakeTxsAndChainTipsIfNeeded(*pblock, pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
+            RelayStakeTxsAndChainTipsIfNeeded(hash, pfrom, chainparams.GetConsensus(), connman, interruptMsgProc);
         } else {
             LOCK(cs_main);
             mapBlockSource.erase(pblock->GetHash());
@@ -2919,11 +3367,28 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (pfrom->fPauseSend)
         return false;
 
+    // Transactions checked by the validation threads come first, they were
+    // received before the messages still waiting.
+    for (const CTxValidationQueue::Job& job : txValidationQueue.PopChecked(pfrom->GetId())) {
+        ProcessTransaction(pfrom, job.strCommand, job.tx, chainparams, connman);
+        if (pfrom->fDisconnect)
+            return false;
+    }
+
     std::list<CNetMessage> msgs;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
             return false;
+        // While transactions of the peer are being checked, only further
+        // transactions can be queued behind them. Anything else, including
+        // a transaction the threads have no room for, waits until they are
+        // processed, so that the messages are handled in order.
+        if (txValidationQueue.HasPending(pfrom->GetId())) {
+            const std::string strNextCommand = pfrom->vProcessMsg.front().hdr.GetCommand();
+            if ((strNextCommand != NetMsgType::TX && strNextCommand != NetMsgType::VOTE) || !txValidationQueue.CanCheck())
+                return false;
+        }
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
@@ -3169,14 +3634,26 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Send chain tips, if available
         {
             LOCK(pto->cs_chainTips);
-            for (auto& block : pto->vChainTipsToSend) {
-                const uint256& hash = block.GetHash();
+            for (const auto& pblock : pto->vChainTipsToSend) {
+                const uint256& hash = pblock->GetHash();
                 if (!pto->filterChainTipsKnown.contains(hash)) {
-                    connman->PushMessage(pto, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
+                    connman->PushMessage(pto, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
                     pto->filterChainTipsKnown.insert(hash);
                 }
             }
             pto->vChainTipsToSend.clear();
+
+            std::vector<CBlockHeader> vTipHeaders;
+            for (const CBlockHeader& header : pto->vChainTipHeadersToSend) {
+                const uint256 hash = header.GetHash();
+                if (!pto->filterChainTipsKnown.contains(hash)) {
+                    vTipHeaders.push_back(header);
+                    pto->filterChainTipsKnown.insert(hash);
+                }
+            }
+            pto->vChainTipHeadersToSend.clear();
+            if (!vTipHeaders.empty())
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::TIPHEADERS, vTipHeaders));
         }
 
         // Start block sync
@@ -3371,6 +3848,39 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             }
             pto->vInventoryBlockToSend.clear();
 
+            // Relay the votes on the chain tips right away: push them to the
+            // peers that asked for it while within their budget, announce
+            // them to the others.
+            if (!pto->setInventoryVoteToSend.empty()) {
+                LOCK(pto->cs_filter);
+                unsigned int nRelayedVotes = 0;
+                auto it = pto->setInventoryVoteToSend.begin();
+                while (pto->fRelayTxes && it != pto->setInventoryVoteToSend.end() && nRelayedVotes < MAX_VOTE_RELAY_PER_SEND) {
+                    const uint256 hash = *it;
+                    it = pto->setInventoryVoteToSend.erase(it);
+                    if (pto->filterInventoryKnown.contains(hash))
+                        continue;
+                    auto txinfo = mempool.info(hash);
+                    if (!txinfo.tx)
+                        continue;
+                    if (state.fWantsVotePush && state.votePushSendBudget.Consume(nNow)) {
+                        connman->PushMessage(pto, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::VOTE, *txinfo.tx));
+                    } else {
+                        vInv.push_back(CInv(MSG_TX, hash));
+                        AddToRelayMap(hash, std::move(txinfo.tx), nNow);
+                        if (vInv.size() == MAX_INV_SZ) {
+                            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                            vInv.clear();
+                        }
+                    }
+                    pto->filterInventoryKnown.insert(hash);
+                    state.nVotesSent++;
+                    nRelayedVotes++;
+                }
+                if (!pto->fRelayTxes)
+                    pto->setInventoryVoteToSend.clear();
+            }
+
             // Check whether periodic sends should happen
             bool fSendTrickle = pto->fWhitelisted;
             if (pto->nNextInvSend < nNow) {
@@ -3465,19 +3975,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
-                    {
-                        // Expire old relay messages
-                        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
-                        {
-                            mapRelay.erase(vRelayExpiration.front().second);
-                            vRelayExpiration.pop_front();
-                        }
-
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
-                        if (ret.second) {
-                            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
-                        }
-                    }
+                    AddToRelayMap(hash, std::move(txinfo.tx), nNow);
                     if (vInv.size() == MAX_INV_SZ) {
                         connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                         vInv.clear();
@@ -12,6 +12,11 @@
 #include "net.h"
 #include "validationinterface.h"
 
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Expiration time for orphan transactions in seconds */
@@ -24,6 +29,28 @@ static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const int DEFAULT_HANDSHAKE_TIPS_DEPTH = 0;
 /** Default time lag in seconds to consider the peer in sync */
 static const int DEFAULT_HANDSHAKE_TIPS_INTERVAL = 1*60;
+/** Default for -handshaketipsheaders, announce chain tips by header to peers that support it */
+static const bool DEFAULT_HANDSHAKE_TIPS_HEADERS = true;
+/** Default for -cmpctprefillrecent, transactions received less than this many seconds before a new block are prefilled in its compact block */
+static const int64_t DEFAULT_CMPCT_PREFILL_RECENT = 2;
+/** Default for -votepush, ask peers to push the votes on the chain tips instead of announcing them */
+static const bool DEFAULT_VOTE_PUSH = true;
+/** Maximum number of votes relayed to a peer per message handler iteration, outside of the inventory trickle */
+static const unsigned int MAX_VOTE_RELAY_PER_SEND = 50;
+/** Number of votes pushed to or by a peer in a burst before being rate limited */
+static const unsigned int VOTE_PUSH_BURST = 100;
+/** Sustained number of votes per minute pushed to or by a peer */
+static const unsigned int VOTE_PUSH_RATE = 60;
+/** Number of recently received votes whose first arrival time is kept for the relay lag metrics */
+static const unsigned int MAX_VOTES_FIRST_SEEN = 10000;
+/** Maximum number of threads checking relayed transactions */
+static const int MAX_TXVAL_THREADS = 16;
+/** Default for -txvalthreads, threads checking relayed transactions ahead of the message handler (0 = auto) */
+static const int DEFAULT_TXVAL_THREADS = 0;
+/** Maximum number of relayed transactions waiting for those threads, the message handler checks the others itself */
+static const unsigned int MAX_TXVAL_QUEUE = 1000;
+/** Default for -blockservecache, MiB of serialized blocks kept around for serving them to peers */
+static const unsigned int DEFAULT_BLOCK_SERVE_CACHE = 32;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -69,13 +96,122 @@ public:
     void ConsiderEviction(CNode *pto, int64_t time_in_seconds);
 };
 
+/**
+ * Blocks serialized for the network, with witness data, kept so that the
+ * peers requesting the same blocks are all served from one shared buffer.
+ * Evicts the least recently used blocks once their total size exceeds the limit.
+ */
+class CSerializedBlockCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char>> Data;
+
+    explicit CSerializedBlockCache(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nBytes(0) {}
+
+    /** Return the cached serialization of a block and mark it as recently used, or nullptr */
+    Data Get(const uint256& hash);
+    /** Cache the serialization of a block, evicting old blocks as needed */
+    void Insert(const uint256& hash, const Data& data);
+    void SetMaxBytes(size_t nMaxBytesIn);
+    size_t Count() const;
+    size_t Bytes() const;
+
+private:
+    typedef std::list<std::pair<uint256, Data>> LruList;
+
+    void Trim();
+
+    mutable CCriticalSection cs;
+    size_t nMaxBytes;
+    size_t nBytes;
+    LruList lruBlocks;
+    std::map<uint256, LruList::iterator> mapBlocks;
+};
+
+/**
+ * Token bucket for the votes pushed through "vote" messages, holding up to
+ * VOTE_PUSH_BURST votes and refilled at VOTE_PUSH_RATE votes per minute.
+ * Senders and receivers keep one per peer with the same limits, so that the
+ * votes we push stay within what the peer accepts.
+ */
+class CVotePushBudget
+{
+public:
+    CVotePushBudget() : dTokens(VOTE_PUSH_BURST), nLastTime(0) {}
+
+    /** Take one vote from the budget at nTime (in microseconds), return false if it is exhausted */
+    bool Consume(int64_t nTime);
+
+private:
+    double dTokens;
+    int64_t nLastTime;
+};
+
+/**
+ * Transactions and votes relayed by peers, waiting for the validation threads
+ * to run their checks ahead of AcceptToMemoryPool, see PrevalidateTransaction.
+ * The message handler then processes them in the order each peer sent them,
+ * with little left to do under cs_main.
+ */
+class CTxValidationQueue
+{
+public:
+    struct Job {
+        std::string strCommand;
+        CTransactionRef tx;
+        bool fChecked;
+    };
+
+    explicit CTxValidationQueue(size_t nMaxQueuedIn) : nMaxQueued(nMaxQueuedIn) {}
+
+    /**
+     * Queue a transaction behind the earlier ones of the peer, for a thread to
+     * check it if fCheck. Fails if no thread is running or nMaxQueued are
+     * waiting for one; a transaction needing no check is only queued behind
+     * unprocessed ones of the same peer.
+     */
+    bool Push(NodeId nodeid, const std::string& strCommand, const CTransactionRef& tx, bool fCheck = true);
+    /** Whether a transaction to check can be queued */
+    bool CanCheck();
+    /** Whether the peer has queued transactions which were not returned by PopChecked yet */
+    bool HasPending(NodeId nodeid);
+    /** Number of transactions waiting for a thread */
+    size_t Size();
+    /** Return the transactions of a peer which are checked, up to the first one which is not */
+    std::vector<Job> PopChecked(NodeId nodeid);
+    void RemovePeer(NodeId nodeid);
+    void SetWakeup(std::function<void()> wakeupIn);
+    /** Check the queued transactions, until interrupted */
+    void Thread();
+
+private:
+    const size_t nMaxQueued;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    int nThreads = 0;
+    //! Transactions not picked by a thread yet
+    std::deque<std::shared_ptr<Job>> queue;
+    //! Transactions of each peer, in the order they were received
+    std::map<NodeId, std::deque<std::shared_ptr<Job>>> mapPeerJobs;
+    std::function<void()> wakeup;
+};
+
 struct CNodeStateStats {
     int nMisbehavior;
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    uint64_t nVotesSent;
+    uint64_t nVotesReceived;
+    int64_t nVoteRelayLag;
 };
 
+/** Check the transactions and votes relayed by peers ahead of the message handler, until interrupted */
+void ThreadTxValidation();
+
+/** Whether a transaction is a vote on one of the chain tips, relayed outside of the inventory trickle */
+bool IsVoteOnChainTip(const CTransaction& tx);
+
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
@@ -529,9 +529,13 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     LOCK(cs_feeEstimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
-        feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
-        longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        if (IsStakeTx(pos->second.txClass)) {
+            stakeStats.at(pos->second.txClass)->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        } else {
+            feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+            shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+            longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        }
         mapMemPoolTxs.erase(hash);
         return true;
     } else {
@@ -555,6 +559,8 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE);
     shortStats = new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE);
     longStats = new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE);
+    for (ETxClass txClass : {TX_BuyTicket, TX_Vote, TX_RevokeTicket})
+        stakeStats[txClass] = new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE);
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -562,6 +568,8 @@ CBlockPolicyEstimator::~CBlockPolicyEstimator()
     delete feeStats;
     delete shortStats;
     delete longStats;
+    for (const auto& item : stakeStats)
+        delete item.second;
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
@@ -595,6 +603,11 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     CFeeRate feeRate(entry.GetFee(), entry.GetTxSize());
 
     mapMemPoolTxs[hash].blockHeight = txHeight;
+    mapMemPoolTxs[hash].txClass = entry.GetTxClass();
+    if (IsStakeTx(entry.GetTxClass())) {
+        mapMemPoolTxs[hash].bucketIndex = stakeStats.at(entry.GetTxClass())->NewTx(txHeight, (double)feeRate.GetFeePerK());
+        return;
+    }
     unsigned int bucketIndex = feeStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     mapMemPoolTxs[hash].bucketIndex = bucketIndex;
     unsigned int bucketIndex2 = shortStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
@@ -624,6 +637,11 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     // Feerates are stored and reported as BWS-per-kb:
     CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
 
+    if (IsStakeTx(entry->GetTxClass())) {
+        stakeStats.at(entry->GetTxClass())->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+        return true;
+    }
+
     feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
@@ -652,11 +670,15 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats->ClearCurrent(nBlockHeight);
     shortStats->ClearCurrent(nBlockHeight);
     longStats->ClearCurrent(nBlockHeight);
+    for (const auto& item : stakeStats)
+        item.second->ClearCurrent(nBlockHeight);
 
     // Decay all exponential averages
     feeStats->UpdateMovingAverages();
     shortStats->UpdateMovingAverages();
     longStats->UpdateMovingAverages();
+    for (const auto& item : stakeStats)
+        item.second->UpdateMovingAverages();
 
     unsigned int countedTxs = 0;
     // Update averages with data points from current block
@@ -914,6 +936,48 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
 }
 
 
+CFeeRate CBlockPolicyEstimator::estimateSmartStakeFee(ETxClass txClass, int confTarget, FeeCalculation *feeCalc) const
+{
+    LOCK(cs_feeEstimator);
+
+    if (feeCalc) {
+        feeCalc->desiredTarget = confTarget;
+        feeCalc->returnedTarget = confTarget;
+    }
+
+    auto it = stakeStats.find(txClass);
+    if (it == stakeStats.end())
+        return CFeeRate(0);
+    const TxConfirmStats* stats = it->second;
+
+    // Return failure if trying to analyze a target we're not tracking.
+    // Unlike for regular transactions, a target of 1 is meaningful: stake
+    // transactions are mined first, up to a fixed number per block.
+    if (confTarget <= 0 || (unsigned int)confTarget > stats->GetMaxConfirms())
+        return CFeeRate(0);
+
+    double median = -1;
+    EstimationResult tempResult;
+    for (unsigned int target = confTarget; median < 0 && target <= stats->GetMaxConfirms(); target++) {
+        median = stats->EstimateMedianVal(target, SUFFICIENT_TXS_SHORT, SUCCESS_PCT, true, nBestSeenHeight, &tempResult);
+        if (feeCalc) {
+            feeCalc->returnedTarget = target;
+            feeCalc->est = tempResult;
+            feeCalc->reason = FeeReason::FULL_ESTIMATE;
+        }
+    }
+
+    if (median < 0) return CFeeRate(0); // error condition
+
+    return CFeeRate(llround(median));
+}
+
+unsigned int CBlockPolicyEstimator::HighestStakeTargetTracked() const
+{
+    LOCK(cs_feeEstimator);
+    return SHORT_BLOCK_PERIODS * SHORT_SCALE;
+}
+
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
     try {
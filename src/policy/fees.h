@@ -9,6 +9,7 @@
 #include "feerate.h"
 #include "uint256.h"
 #include "random.h"
+#include "stake/staketx.h"
 #include "sync.h"
 
 #include <map>
@@ -210,6 +211,18 @@ public:
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
+    /** Estimate feerate needed for a stake transaction of class txClass to be
+     *  included in a block within confTarget blocks. Stake transactions are
+     *  tracked apart from the regular ones, on a short horizon only, since they
+     *  follow their own inclusion rules. If no answer can be given at
+     *  confTarget, return an estimate at the closest longer target where one
+     *  can be given.
+     */
+    CFeeRate estimateSmartStakeFee(ETxClass txClass, int confTarget, FeeCalculation *feeCalc) const;
+
+    /** Calculation of highest target that stake fee estimates are tracked for */
+    unsigned int HighestStakeTargetTracked() const;
+
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
      * calculation
@@ -238,7 +251,8 @@ private:
     {
         unsigned int blockHeight;
         unsigned int bucketIndex;
-        TxStatsInfo() : blockHeight(0), bucketIndex(0) {}
+        ETxClass txClass;
+        TxStatsInfo() : blockHeight(0), bucketIndex(0), txClass(TX_Regular) {}
     };
 
     // map of txids to information about that transaction
@@ -248,6 +262,8 @@ private:
     TxConfirmStats* feeStats;
     TxConfirmStats* shortStats;
     TxConfirmStats* longStats;
+    /** Short horizon confirmation data of each stake transaction class, not persisted */
+    std::map<ETxClass, TxConfirmStats*> stakeStats;
 
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
@@ -16,6 +16,11 @@
 #include "consensus/consensus.h"
 #include "validation.h"
 #include "ml/verification_client.h"
+#include "sync.h"
+
+#include <deque>
+#include <map>
+#include <tuple>
 
 /**
  * Compute the next required proof of work using the legacy Bitcoin difficulty
@@ -322,7 +327,72 @@ uint32_t GetNextCashWorkRequired(const CBlockIndex *pindexPrev,
     return nextTarget.GetCompact();
 }
 
+/**
+ * Stake difficulties computed for recent blocks, so that the tickets, the
+ * miner, the ticket buyer and the RPCs looking at the same tip share one
+ * calculation. A block hash commits to all of its ancestors, so an entry
+ * never goes stale: moving the tip simply leads to other entries, and the
+ * oldest are dropped.
+ */
+class CStakeDifficultyCache
+{
+public:
+    //! Next required stake difficulty, or estimate for a number of new tickets
+    enum Kind { REQUIRED, ESTIMATE, ESTIMATE_MAX };
+    typedef std::tuple<uint256, Kind, int> Key;
+
+    bool Get(const Key& key, int64_t& nDiff)
+    {
+        LOCK(cs);
+        auto it = mapDiffs.find(key);
+        if (it == mapDiffs.end())
+            return false;
+        nDiff = it->second;
+        return true;
+    }
+
+    void Insert(const Key& key, int64_t nDiff)
+    {
+        LOCK(cs);
+        if (!mapDiffs.emplace(key, nDiff).second)
+            return;
+        vKeys.push_back(key);
+        if (vKeys.size() > MAX_ENTRIES) {
+            mapDiffs.erase(vKeys.front());
+            vKeys.pop_front();
+        }
+    }
+
+private:
+    static const size_t MAX_ENTRIES = 64;
+
+    CCriticalSection cs;
+    std::map<Key, int64_t> mapDiffs;
+    std::deque<Key> vKeys;
+};
+
+static CStakeDifficultyCache stakeDifficultyCache;
+
+static int64_t ComputeNextRequiredStakeDifficulty(const CBlockIndex* pindexLast, const Consensus::Params& params);
+static int64_t ComputeEstimatedStakeDifficulty(const CBlockIndex* pindexLast, int newTickets, bool useMaxTickets, const Consensus::Params& params);
+
 int64_t CalculateNextRequiredStakeDifficulty(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    // Blocks outside of the block index, such as the ones being assembled,
+    // have no hash to be remembered by.
+    if (pindexLast == nullptr || pindexLast->phashBlock == nullptr)
+        return ComputeNextRequiredStakeDifficulty(pindexLast, params);
+
+    const CStakeDifficultyCache::Key key(pindexLast->GetBlockHash(), CStakeDifficultyCache::REQUIRED, 0);
+    int64_t nDiff;
+    if (!stakeDifficultyCache.Get(key, nDiff)) {
+        nDiff = ComputeNextRequiredStakeDifficulty(pindexLast, params);
+        stakeDifficultyCache.Insert(key, nDiff);
+    }
+    return nDiff;
+}
+
+static int64_t ComputeNextRequiredStakeDifficulty(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {
     // Stake difficulty before any tickets could possibly be purchased is
     // the minimum value.
@@ -379,6 +449,15 @@ int64_t CalculateNextRequiredStakeDifficulty(const CBlockIndex* pindexLast, cons
 
 int64_t SumPurchasedTickets(const CBlockIndex *pindexStart, int64_t numToSum)
 {
+    if (pindexStart == nullptr || numToSum <= 0)
+        return 0;
+
+    // The cumulative counts of the block index turn the sum into a difference.
+    const auto& pindexBefore = pindexStart->nHeight >= numToSum ? pindexStart->GetAncestor(pindexStart->nHeight - numToSum) : nullptr;
+    if (pindexStart->nChainFreshStake >= 0 && (pindexBefore == nullptr || pindexBefore->nChainFreshStake >= 0))
+        return pindexStart->nChainFreshStake - (pindexBefore != nullptr ? pindexBefore->nChainFreshStake : 0);
+
+    // Otherwise walk the blocks, which are not all in the block index.
     auto numPurchased = int64_t{0};
     auto numTraversed = int64_t{0};
     for (auto node = pindexStart; node != nullptr && numTraversed < numToSum; ++numTraversed)
@@ -501,6 +580,21 @@ CAmount GetTotalBlockSubsidy(int nHeight, const Consensus::Params& consensusPara
 //
 // This function MUST be called with the chain state lock held (for writes).
 int64_t EstimateNextStakeDifficulty(const CBlockIndex* pindexLast, int newTickets, bool useMaxTickets, const Consensus::Params& params)
+{
+    if (pindexLast == nullptr || pindexLast->phashBlock == nullptr)
+        return ComputeEstimatedStakeDifficulty(pindexLast, newTickets, useMaxTickets, params);
+
+    const CStakeDifficultyCache::Key key(pindexLast->GetBlockHash(),
+            useMaxTickets ? CStakeDifficultyCache::ESTIMATE_MAX : CStakeDifficultyCache::ESTIMATE, useMaxTickets ? 0 : newTickets);
+    int64_t nDiff;
+    if (!stakeDifficultyCache.Get(key, nDiff)) {
+        nDiff = ComputeEstimatedStakeDifficulty(pindexLast, newTickets, useMaxTickets, params);
+        stakeDifficultyCache.Insert(key, nDiff);
+    }
+    return nDiff;
+}
+
+static int64_t ComputeEstimatedStakeDifficulty(const CBlockIndex* pindexLast, int newTickets, bool useMaxTickets, const Consensus::Params& params)
 {
     // Calculate the next retarget interval height.
     auto curHeight = int64_t{0};
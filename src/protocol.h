@@ -243,6 +243,25 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a vector of block headers, one per chain tip of the sender.
+ * Unlike "headers", the headers need not form a chain, and the receiver
+ * requests the blocks it lacks even if they do not extend its best chain.
+ * @since protocol version 70016
+ */
+extern const char *TIPHEADERS;
+/**
+ * Indicates that a node prefers to receive the votes on the current chain
+ * tips pushed via "vote" messages rather than announced via "inv".
+ * @since protocol version 70017
+ */
+extern const char *SENDVOTES;
+/**
+ * Contains a vote transaction on one of the sender's chain tips, pushed
+ * without a prior "inv" to a node that sent "sendvotes".
+ * @since protocol version 70017
+ */
+extern const char *VOTE;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -1857,6 +1857,11 @@ CAmount computeTransactionFee(CTransaction const& tx)
 {
     auto valueIn = CAmount{0};
     for (const auto& input : tx.vin){
+        CTxOut prevOut;
+        if (GetSpentOutput(input.prevout, prevOut)) {
+            valueIn += prevOut.nValue;
+            continue;
+        }
         CTransactionRef input_tx;
         uint256 hashBlock;
         if (!GetTransaction(input.prevout.hash, input_tx, Params().GetConsensus(), hashBlock, false, false))
@@ -99,6 +99,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "createrawtransaction", 3, "replaceable" },
     { "signrawtransaction", 1, "prevtxs" },
     { "signrawtransaction", 2, "privkeys" },
+    { "getaddresstxids", 1, "count"},
+    { "getaddresstxids", 3, "reverse"},
     { "searchrawtransactions", 1, "verbose"},
     { "searchrawtransactions", 2, "skip"},
     { "searchrawtransactions", 3, "count"},
@@ -128,6 +130,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getrawmempool", 0, "verbose" },
     { "estimatefee", 0, "nblocks" },
     { "estimatesmartfee", 0, "conf_target" },
+    { "estimatesmartticketfee", 0, "conf_target" },
     { "estimaterawfee", 0, "conf_target" },
     { "estimaterawfee", 1, "threshold" },
     { "prioritisetransaction", 1, "dummy" },
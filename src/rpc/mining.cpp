@@ -538,6 +538,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     static unsigned int nTransactionsUpdatedLast;
+    static unsigned int nNonAdditiveUpdatesLast;
 
     if (!lpval.isNull())
     {
@@ -604,15 +605,23 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     const Consensus::Params& consensusParams = Params().GetConsensus();
     auto bTooFewVotes = false;
 
+    // While the previous block is unchanged and transactions were only added
+    // to the mempool, the cached template is extended instead of rebuilt.
+    const auto fCanExtendTemplate = pblocktemplate && pindexPrev != nullptr
+        && mempool.GetNonAdditiveUpdates() == nNonAdditiveUpdatesLast
+        && fLastTemplateSupportsSegwit == fSupportsSegwit;
+
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && nTimeElapsed > 5) ||
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && (nTimeElapsed > 5 || fCanExtendTemplate)) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
+        const CBlockIndex* const pindexPrevLast = pindexPrev;
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = nullptr;
 
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        nNonAdditiveUpdatesLast = mempool.GetNonAdditiveUpdates();
         CBlockIndex* pindexPrevNew = nullptr;
         fLastTemplateSupportsSegwit = fSupportsSegwit;
 
@@ -621,7 +630,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         const auto& majority = (consensusParams.nTicketsPerBlock / 2) + 1;
         if (tipHeight >= Params().GetConsensus().nStakeValidationHeight - 1) {
             CBlockIndex* selectedIndex = nullptr;
-            const auto& setTips = GetChainTips();
+            const auto& setTips = GetChainTips(0);
             if (setTips.size() == 0)
                 throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Blockchain has no tips!");
 
@@ -724,9 +733,14 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             if (pindexPrevNew == nullptr)
                 throw JSONRPCError(RPCErrorCode::OUT_OF_MEMORY, "Previous block index is not specified!");
 
-            nStart = GetTime(); // reinitialize Start
-            CScript scriptDummy = CScript() << OP_TRUE;
-            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit, pindexPrevNew);
+            if (fCanExtendTemplate && pindexPrevNew == pindexPrevLast) {
+                // Same previous block: keep Start, as we keep waiting for its votes
+                pblocktemplate = BlockAssembler(Params()).UpdateBlockTemplate(*pblocktemplate, fSupportsSegwit);
+            } else {
+                nStart = GetTime(); // reinitialize Start
+                CScript scriptDummy = CScript() << OP_TRUE;
+                pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit, pindexPrevNew);
+            }
         }
 
         if (!pblocktemplate)
@@ -1298,7 +1312,7 @@ UniValue winningtickets(const JSONRPCRequest& request)
 
     LOCK(cs_main);
 
-    const auto& setTips = GetChainTips();
+    const auto& setTips = GetChainTips(chainActive.Height() - nHeight);
     auto result = UniValue{UniValue::VARR};
     for (const auto& block : setTips) {
         if (block->pstakeNode == nullptr)
@@ -1796,6 +1810,53 @@ UniValue estimatesmartfee(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue estimatesmartticketfee(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error{
+            "estimatesmartticketfee conf_target\n"
+            "\nEstimates the approximate fee per kilobyte needed for a ticket purchase to be\n"
+            "mined within conf_target blocks if possible and return the number of blocks\n"
+            "for which the estimate is valid. Ticket purchases are tracked apart from\n"
+            "regular transactions since they compete for a limited number of fresh stake\n"
+            "slots per block.\n"
+            "\nArguments:\n"
+            "1. conf_target     (numeric) Confirmation target in blocks (1 - "
+            + std::to_string(::feeEstimator.HighestStakeTargetTracked()) + ")\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"feerate\" : x.x,     (numeric, optional) estimate fee rate in " + CURRENCY_UNIT + "/kB\n"
+            "  \"errors\": [ str... ] (json array of strings, optional) Errors encountered during processing\n"
+            "  \"blocks\" : n         (numeric) block number where estimate was found\n"
+            "}\n"
+            "\n"
+            "An error is returned if not enough ticket purchases and blocks\n"
+            "have been observed to make an estimate for any number of blocks.\n"
+            "\nExample:\n"
+            + HelpExampleCli("estimatesmartticketfee", "2")
+        };
+
+    RPCTypeCheck(request.params, {UniValue::VNUM});
+    const auto max_target = static_cast<int>(::feeEstimator.HighestStakeTargetTracked());
+    const auto conf_target = request.params[0].get_int();
+    if (conf_target < 1 || conf_target > max_target) {
+        throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, strprintf("Invalid conf_target, must be between %u - %u", 1, max_target));
+    }
+
+    UniValue result{UniValue::VOBJ};
+    UniValue errors{UniValue::VARR};
+    FeeCalculation feeCalc;
+    const auto feeRate = ::feeEstimator.estimateSmartStakeFee(TX_BuyTicket, conf_target, &feeCalc);
+    if (feeRate != CFeeRate(0)) {
+        result.push_back(Pair("feerate", ValueFromAmount(feeRate.GetFeePerK())));
+    } else {
+        errors.push_back("Insufficient data or no feerate found");
+        result.push_back(Pair("errors", errors));
+    }
+    result.push_back(Pair("blocks", feeCalc.returnedTarget));
+    return result;
+}
+
 UniValue estimaterawfee(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -1925,6 +1986,7 @@ static const CRPCCommand commands[] =
 
     { "util",               "estimatefee",                  &estimatefee,                   {"nblocks"} },
     { "util",               "estimatesmartfee",             &estimatesmartfee,              {"conf_target", "estimate_mode"} },
+    { "util",               "estimatesmartticketfee",       &estimatesmartticketfee,        {"conf_target"} },
 
     { "hidden",             "estimaterawfee",               &estimaterawfee,                {"conf_target", "threshold"} },
 };
@@ -153,6 +153,173 @@ UniValue existsaddresses(const JSONRPCRequest& request)
     return ret;
 }
 
+static CTxDestination ParseIndexedAddress(const UniValue& param)
+{
+    if (!fAddrIndex)
+        throw JSONRPCError(RPCErrorCode::MISC_ERROR, "Address index not enabled");
+
+    CTxDestination destination = DecodeDestination(param.get_str());
+    if (!IsValidDestination(destination))
+        throw JSONRPCError(RPCErrorCode::INVALID_ADDRESS_OR_KEY, std::string("Invalid BWScoin address: ") + param.get_str());
+    return destination;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error{
+            "getaddressbalance \"address\"\n"
+            "\nReturns the amounts received and spent by an address in the active chain.\n"
+            "Requires the -addrindex flag.\n"
+            "\nArguments:\n"
+            "1. \"address\"     (string, required) The bwscoin address\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"received\": x.xxx,   (numeric) Total received by the address in " + CURRENCY_UNIT + "\n"
+            "  \"spent\": x.xxx,      (numeric) Total spent by the address in " + CURRENCY_UNIT + "\n"
+            "  \"balance\": x.xxx,    (numeric) Received less spent in " + CURRENCY_UNIT + "\n"
+            "  \"txcount\": n         (numeric) Number of transactions involving the address\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressbalance", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+        };
+
+    const CTxDestination destination = ParseIndexedAddress(request.params[0]);
+
+    CAddrIndexBalance balance;
+    if (!GetAddressBalance(destination, balance))
+        throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Cannot search for address");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("received", ValueFromAmount(balance.nReceived)));
+    ret.push_back(Pair("spent", ValueFromAmount(balance.nSpent)));
+    ret.push_back(Pair("balance", ValueFromAmount(balance.GetBalance())));
+    ret.push_back(Pair("txcount", balance.nTxCount));
+    return ret;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error{
+            "getaddressutxos \"address\"\n"
+            "\nReturns the unspent outputs of an address in the active chain.\n"
+            "Requires the -addrindex flag.\n"
+            "\nArguments:\n"
+            "1. \"address\"     (string, required) The bwscoin address\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\": \"hash\",   (string) The transaction id\n"
+            "    \"vout\": n,        (numeric) The output number\n"
+            "    \"amount\": x.xxx,  (numeric) The output value in " + CURRENCY_UNIT + "\n"
+            "    \"height\": n       (numeric) The height of the block containing the output\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressutxos", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+        };
+
+    const CTxDestination destination = ParseIndexedAddress(request.params[0]);
+
+    std::vector<std::pair<COutPoint, CAddrIndexUnspent> > vUnspent;
+    if (!GetAddressUnspent(destination, vUnspent))
+        throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Cannot search for address");
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& it : vUnspent) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", it.first.hash.GetHex()));
+        entry.push_back(Pair("vout", (int)it.first.n));
+        entry.push_back(Pair("amount", ValueFromAmount(it.second.nValue)));
+        entry.push_back(Pair("height", (int)it.second.nHeight));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+        throw std::runtime_error{
+            "getaddresstxids \"address\" ( count \"cursor\" reverse )\n"
+            "\nReturns a page of the transactions involving an address, in chain order.\n"
+            "Requires the -addrindex flag.\n"
+            "\nArguments:\n"
+            "1. \"address\"     (string, required) The bwscoin address\n"
+            "2. count           (numeric, optional, default=100) The maximum number of transactions to return\n"
+            "3. \"cursor\"      (string, optional) The cursor returned with the previous page, to continue after it\n"
+            "4. reverse         (boolean, optional, default=false) List the newest transactions first\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"transactions\": [\n"
+            "    {\n"
+            "      \"txid\": \"hash\",   (string) The transaction id\n"
+            "      \"height\": n       (numeric) The height of the block containing the transaction\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"cursor\": \"xxx\"      (string) Where the next page starts, null after the last page\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" 10")
+            + HelpExampleRpc("getaddresstxids", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 10")
+        };
+
+    const CTxDestination destination = ParseIndexedAddress(request.params[0]);
+
+    int nCount = 100;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nCount = request.params[1].get_int();
+    if (nCount < 0)
+        throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Negative count");
+
+    // The cursor is the height and block offset of the last transaction returned
+    CExtDiskTxPos after;
+    bool fAfter = false;
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        const std::string strCursor = request.params[2].get_str();
+        const size_t nSep = strCursor.find(':');
+        uint32_t nHeight, nTxOffset;
+        if (nSep == std::string::npos || !ParseUInt32(strCursor.substr(0, nSep), &nHeight) || !ParseUInt32(strCursor.substr(nSep + 1), &nTxOffset))
+            throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Invalid cursor");
+        after.nHeight = nHeight;
+        after.nTxOffset = nTxOffset;
+        fAfter = true;
+    }
+
+    bool fReverse = false;
+    if (request.params.size() > 3 && !request.params[3].isNull())
+        fReverse = request.params[3].get_bool();
+
+    std::vector<CExtDiskTxPos> vPos;
+    if (!FindTransactionsByDestination(destination, vPos, 0, nCount, fAfter ? &after : nullptr, fReverse))
+        throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Cannot search for address");
+
+    UniValue transactions(UniValue::VARR);
+    for (const CExtDiskTxPos& pos : vPos) {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        if (!ReadTransaction(tx, pos, hashBlock))
+            throw JSONRPCError(RPCErrorCode::DESERIALIZATION_ERROR, "Cannot read transaction from disk");
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", tx->GetHash().GetHex()));
+        entry.push_back(Pair("height", (int)pos.nHeight));
+        transactions.push_back(entry);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("transactions", transactions));
+    if (nCount > 0 && vPos.size() == (size_t)nCount)
+        ret.push_back(Pair("cursor", strprintf("%u:%u", vPos.back().nHeight, vPos.back().nTxOffset)));
+    else
+        ret.push_back(Pair("cursor", NullUniValue));
+    return ret;
+}
+
 UniValue existsmempooltxs(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -680,6 +847,9 @@ static const CRPCCommand commands[] =
     { "util",               "validateaddress",        &validateaddress,        {"address"} }, /* uses wallet if enabled */
     { "util",               "existsaddress",          &existsaddress,          {"address"} },
     { "util",               "existsaddresses",        &existsaddresses,        {"addresses"} },
+    { "util",               "getaddressbalance",      &getaddressbalance,      {"address"} },
+    { "util",               "getaddressutxos",        &getaddressutxos,        {"address"} },
+    { "util",               "getaddresstxids",        &getaddresstxids,        {"address","count","cursor","reverse"} },
     { "util",               "existsmempooltxs",       &existsmempooltxs,       {"txhashes"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys"} },
     { "util",               "verifymessage",          &verifymessage,          {"address","signature","message"} },
@@ -8,6 +8,7 @@
 
 #include "rpc/server.h"
 
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "clientversion.h"
 #include "core_io.h"
@@ -105,6 +106,9 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"votessent\": n,           (numeric) The number of votes on the chain tips relayed to this peer outside of the inventory trickle\n"
+            "    \"votesreceived\": n,       (numeric) The number of votes received from this peer\n"
+            "    \"voterelaylag\": n,        (numeric) The average time in microseconds by which this peer's votes trailed their first arrival from any peer\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -171,6 +175,9 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("votessent", statestats.nVotesSent));
+            obj.push_back(Pair("votesreceived", statestats.nVotesReceived));
+            obj.push_back(Pair("voterelaylag", statestats.nVoteRelayLag));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
@@ -469,6 +476,51 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getcompactblockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || !request.params.empty())
+        throw std::runtime_error{
+            "getcompactblockstats\n"
+            "\nReturns how the transactions of the compact blocks reconstructed since startup\n"
+            "were obtained, per transaction class.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": n,             (numeric) The number of reconstructed compact blocks\n"
+            "  \"classes\": {\n"
+            "    \"class\": {             (string) The transaction class, such as \"vote\"\n"
+            "      \"prefilled\": n,      (numeric) Transactions sent in full by the peer\n"
+            "      \"mempool\": n,        (numeric) Transactions found in our mempool or extra pool\n"
+            "      \"requested\": n,      (numeric) Transactions requested with getblocktxn\n"
+            "      \"hitrate\": x.xxx     (numeric) The share of the transactions we did not have to request\n"
+            "    },\n"
+            "    ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcompactblockstats", "")
+            + HelpExampleRpc("getcompactblockstats", "")
+        };
+
+    const CompactBlockReconstructionStats stats = GetCompactBlockReconstructionStats();
+
+    UniValue classes{UniValue::VOBJ};
+    for (const auto& item : stats.mapClasses) {
+        const CompactBlockReconstructionStats::ClassStats& classStats = item.second;
+        const uint64_t nTotal = classStats.nPrefilled + classStats.nFromMempool + classStats.nRequested;
+        UniValue entry{UniValue::VOBJ};
+        entry.push_back(Pair("prefilled", classStats.nPrefilled));
+        entry.push_back(Pair("mempool", classStats.nFromMempool));
+        entry.push_back(Pair("requested", classStats.nRequested));
+        entry.push_back(Pair("hitrate", nTotal > 0 ? double(nTotal - classStats.nRequested) / nTotal : 0.0));
+        classes.push_back(Pair(TxClassToString(item.first), entry));
+    }
+
+    UniValue obj{UniValue::VOBJ};
+    obj.push_back(Pair("blocks", stats.nBlocks));
+    obj.push_back(Pair("classes", classes));
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks{UniValue::VARR};
@@ -715,6 +767,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       {"node"} },
     { "network",            "getnettotals",           &getnettotals,           {} },
+    { "network",            "getcompactblockstats",   &getcompactblockstats,   {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         {} },
     { "network",            "setban",                 &setban,                 {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             {} },
@@ -34,6 +34,7 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <univalue.h>
@@ -41,14 +42,45 @@
 
 typedef std::set<CTxDestination> lt_DestinationSet;
 typedef std::map<uint256, CTransactionRef> lt_HashToTransactionMap;
+typedef std::map<COutPoint, CTxOut> lt_OutPointToOutputMap;
 
-bool CheckFilterAgainstVinTxs(const CTransaction& tx, bool bVinExtra, const lt_DestinationSet& filterAddress, lt_HashToTransactionMap& prevOutMap)
+static bool OutputMatchesFilter(const CTxOut& txOut, const lt_DestinationSet& filterAddress)
+{
+    txnouttype type;
+    std::vector<CTxDestination> addresses;
+    int nRequired;
+    if (ExtractDestinations(txOut.scriptPubKey, type, addresses, nRequired)) {
+        for (const CTxDestination& addr : addresses) {
+            if (filterAddress.count(addr) > 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool CheckFilterAgainstVinTxs(const CTransaction& tx, bool bVinExtra, const lt_DestinationSet& filterAddress, lt_HashToTransactionMap& prevOutMap, lt_OutPointToOutputMap& prevOutputs)
 {
     bool passesFilter = (filterAddress.size() == 0);
 
     if (!tx.IsCoinBase()) {
         if ( bVinExtra || !passesFilter ) {
             for (const auto& txIn : tx.vin) {
+                // The stakebase of a vote spends nothing
+                if (txIn.prevout.IsNull())
+                    continue;
+
+                // With the spent index only the spent output is looked up
+                CTxOut spentOut;
+                if (GetSpentOutput(txIn.prevout, spentOut)) {
+                    if (bVinExtra)
+                        prevOutputs[txIn.prevout] = spentOut;
+                    if (!passesFilter)
+                        passesFilter = OutputMatchesFilter(spentOut, filterAddress);
+                    if (passesFilter && !bVinExtra)
+                        break;
+                    continue;
+                }
+
                 // Get each transaction in vin for investigation
                 uint256 hashBlock;
                 CTransactionRef prevTxVin;
@@ -67,18 +99,9 @@ bool CheckFilterAgainstVinTxs(const CTransaction& tx, bool bVinExtra, const lt_D
 
                 // extract the addresses for each vout transaction to check against the filter set
                 for (const auto& txOut : prevTxVin->vout) {
-                    txnouttype type;
-                    std::vector<CTxDestination> addresses;
-                    int nRequired;
-                    if (ExtractDestinations(txOut.scriptPubKey, type, addresses, nRequired)) {
-                        for (const CTxDestination& addr : addresses) {
-                            if (filterAddress.count(addr) > 0) {
-                                passesFilter = true;
-                                break;
-                            }
-                        }
-                        if (passesFilter)
-                            break;
+                    if (OutputMatchesFilter(txOut, filterAddress)) {
+                        passesFilter = true;
+                        break;
                     }
                 }
             }
@@ -115,14 +138,14 @@ bool CheckFilterAgainstVoutTxs(const CTransaction& tx, const lt_DestinationSet&
 }
 
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, bool includeStake, const lt_HashToTransactionMap * const pHashToTransactionMap = nullptr)
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, bool includeStake, const lt_HashToTransactionMap * const pHashToTransactionMap = nullptr, const lt_OutPointToOutputMap * const pPrevOutputs = nullptr)
 {
     // Call into TxToUniv() in bwscoin-common to decode the transaction hex.
     //
     // Blockchain contextual information (confirmations and blocktime) is not
     // available to code in bwscoin-common, so we query them here and push the
     // data into the returned UniValue.
-    TxToUniv(tx, uint256(), entry, includeStake, true, RPCSerializationFlags(), pHashToTransactionMap);
+    TxToUniv(tx, uint256(), entry, includeStake, true, RPCSerializationFlags(), pHashToTransactionMap, pPrevOutputs);
 
     if (!hashBlock.IsNull()) {
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
@@ -285,9 +308,9 @@ UniValue searchrawtransactions(const JSONRPCRequest& request)
             "\nArguments:\n"
             "1. \"address\"      (string, required) The BWScoin address to search for\n"
             "2. \"verbose\"= 0|1 (integer, optional, default=\"0\") Specifies the transaction is returned as a JSON object instead of hex-encoded string\n"
-            "3. \"skip\"         (integer, optional) The number of leading transactions to leave out of the final response\n"
+            "3. \"skip\"         (integer, optional) The number of leading transactions to leave out of the final response, a negative value counts back from the newest transaction\n"
             "4. \"count\"        (integer, optional) The maximum number of transactions to return\n"
-            "5. \"vinextra\"     (boolean, optional) Specify that extra data from previous output will be returned in vin (--txindex is required)\n"
+            "5. \"vinextra\"     (boolean, optional) Specify that extra data from previous output will be returned in vin (--txindex or --spentindex is required)\n"
             "6. \"reverse\"      (boolean, optional) Specifies that the transactions should be returned in reverse chronological order\n"
             "7. \"filteraddrs\"  (array, optional) Address list. Only inputs or outputs with matching address will be returned\n"
 
@@ -334,7 +357,7 @@ UniValue searchrawtransactions(const JSONRPCRequest& request)
         }
     }
     
-    if ((fVinExtra || setFilterAddrs.size() > 0 ) && !fTxIndex)
+    if ((fVinExtra || setFilterAddrs.size() > 0 ) && !fTxIndex && !fSpentIndex)
         throw JSONRPCError(RPCErrorCode::MISC_ERROR, "Transaction index not enabled");
 
     const auto& name_ = request.params[0].get_str();
@@ -342,28 +365,30 @@ UniValue searchrawtransactions(const JSONRPCRequest& request)
     if (!IsValidDestination(destination))
         throw JSONRPCError(RPCErrorCode::INVALID_ADDRESS_OR_KEY, std::string("Invalid BWScoin address: ") + name_);
 
-    std::set<CExtDiskTxPos> setpos;
-    if (!FindTransactionsByDestination(destination, setpos))
-        throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Cannot search for address");
-
-    if (nSkip < 0)
-        nSkip += setpos.size();
-    if (nSkip < 0)
-        nSkip = 0;
     if (nCount < 0)
         nCount = 0;
-    
-    auto it = setpos.cbegin();
 
-    while (it != setpos.end() && nSkip--) ++it;
+    // The index lists the transactions of an address in chain order, so only
+    // the requested page is read, from the newest end for a negative skip
+    std::vector<CExtDiskTxPos> vPos;
+    if (nSkip >= 0) {
+        if (!FindTransactionsByDestination(destination, vPos, nSkip, nCount))
+            throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Cannot search for address");
+    } else {
+        if (!FindTransactionsByDestination(destination, vPos, 0, -(int64_t)nSkip, nullptr, true))
+            throw JSONRPCError(RPCErrorCode::DATABASE_ERROR, "Cannot search for address");
+        std::reverse(vPos.begin(), vPos.end());
+        if (vPos.size() > (size_t)nCount)
+            vPos.resize(nCount);
+    }
 
     bool isTestnet = gArgs.GetBoolArg("-testnet", false);
 
     UniValue result(UniValue::VARR);
-    while (it != setpos.end() && nCount--) {
+    for (const CExtDiskTxPos& pos : vPos) {
         CTransactionRef tx;
         uint256 hashBlock;
-        if (!ReadTransaction(tx, *it, hashBlock))
+        if (!ReadTransaction(tx, pos, hashBlock))
             throw JSONRPCError(RPCErrorCode::DESERIALIZATION_ERROR, "Cannot read transaction from disk");
         
 
@@ -372,16 +397,16 @@ UniValue searchrawtransactions(const JSONRPCRequest& request)
         std::string strHex = HexStr(ssTx.begin(), ssTx.end());
         if (fVerbose) {
             lt_HashToTransactionMap prevOutMap;
-            if (! ( CheckFilterAgainstVinTxs(*tx, fVinExtra, setFilterAddrs, prevOutMap) || CheckFilterAgainstVoutTxs(*tx, setFilterAddrs)) )
+            lt_OutPointToOutputMap prevOutputs;
+            if (! ( CheckFilterAgainstVinTxs(*tx, fVinExtra, setFilterAddrs, prevOutMap, prevOutputs) || CheckFilterAgainstVoutTxs(*tx, setFilterAddrs)) )
                 continue;
             UniValue object(UniValue::VOBJ);
-            TxToJSON(*tx, hashBlock, object, (!isTestnet) || IsBlockAfterHybridConsensusFork(hashBlock), &prevOutMap);
+            TxToJSON(*tx, hashBlock, object, (!isTestnet) || IsBlockAfterHybridConsensusFork(hashBlock), &prevOutMap, &prevOutputs);
             object.push_back(Pair("hex", strHex));
             result.push_back(object);
         } else {
             result.push_back(strHex);
         }
-        ++it;
     }
 
     if (fReverse){
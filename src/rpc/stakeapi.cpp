@@ -107,12 +107,8 @@ UniValue estimatestakediff(const JSONRPCRequest& request)
     const auto& bestHeight = chainActive.Tip()->nHeight;
     const auto& lastAdjustment = (bestHeight / params.nStakeDiffWindowSize) * params.nStakeDiffWindowSize;
     const auto& nextAdjustment = ((bestHeight / params.nStakeDiffWindowSize) + 1) * params.nStakeDiffWindowSize;
-    auto totalTickets = 0;
-    for (auto i = lastAdjustment; i <= bestHeight; i++) {
-        const auto& bh = chainActive.Tip()->GetAncestor(i)->GetBlockHeader();
-        totalTickets += bh.nFreshStake;
-    }
     const auto& blocksSince = bestHeight - lastAdjustment + 1;
+    const auto& totalTickets = SumPurchasedTickets(chainActive.Tip(), blocksSince);
     const auto& remaining = nextAdjustment - bestHeight - 1;
     const auto& averagePerBlock = double(totalTickets) / blocksSince;
     const auto& expectedTickets = floor(averagePerBlock * remaining);
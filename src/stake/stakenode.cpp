@@ -9,6 +9,8 @@
 #include "hash.h"
 #include "tinyformat.h"
 
+#include <algorithm>
+
 std::string StakeStateToString(const StakeState& stakeState)
 {
     std::string str;
@@ -135,11 +137,22 @@ bool StakeNode::ExistsExpiredTicket(const uint256& ticket) const
     return false;
 }
 
-HashVector StakeNode::Winners() const
+const HashVector& StakeNode::Winners() const
 {
     return nextWinners;
 }
 
+bool StakeNode::ExistsWinner(const uint256& ticket) const
+{
+    return std::binary_search(sortedWinners.begin(), sortedWinners.end(), ticket);
+}
+
+void StakeNode::sortWinners()
+{
+    sortedWinners.assign(nextWinners.begin(), nextWinners.end());
+    std::sort(sortedWinners.begin(), sortedWinners.end());
+}
+
 StakeState StakeNode::FinalState() const
 {
     return finalState;
@@ -172,7 +185,7 @@ std::shared_ptr<StakeNode> StakeNode::ConnectNode(const uint256& lotteryIV, cons
     if (connectedNode->height >= connectedNode->params.nStakeEnabledHeight) {
         // Basic sanity check.
         for (const auto& it : ticketsVoted) {
-            if (end(nextWinners) == std::find(begin(nextWinners),end(nextWinners),it))
+            if (!ExistsWinner(it))
                 assert("unknown ticket spent in block");
         }
 
@@ -295,6 +308,7 @@ std::shared_ptr<StakeNode> StakeNode::ConnectNode(const uint256& lotteryIV, cons
             connectedNode->nextWinners.push_back(it);
             stateBuffer.push_back(it);
         }
+        connectedNode->sortWinners();
 
         stateBuffer.push_back(prng.StateHash());
         const auto& hex = Hash(stateBuffer.begin(),stateBuffer.end()).GetHex();
@@ -406,6 +420,7 @@ std::shared_ptr<StakeNode> StakeNode::DisconnectNode(const uint256& parentLotter
             assert(!"unknown ticket state in undo data");
         }
     }
+    restoredNode->sortWinners();
 
     if (this->height >= this->params.nStakeValidationHeight) {
         auto prng = Hash256PRNG(parentLotteryIV);
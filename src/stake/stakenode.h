@@ -58,6 +58,11 @@ typedef std::vector<UndoTicketData> UndoTicketDataVector;
 // many blocks from the block in which they were included.
 typedef std::vector<uint256> HashVector;
 
+// WinnerSet is the sorted list of lottery winners of a node, kept inline
+// since there are only TicketsPerBlock of them.  It is used for membership
+// queries; the lottery order is preserved separately in nextWinners.
+typedef prevector<8, uint256> WinnerSet;
+
 // VoteVersionTuple contains the extracted vote bits and version from votes
 // (SSGen).
 struct VoteVersion {
@@ -91,9 +96,14 @@ private:
     UndoTicketDataVector        databaseUndoUpdate;
     HashVector                  databaseBlockTickets;
     HashVector                  nextWinners;
+    WinnerSet                   sortedWinners;
     StakeState                  finalState;
     const Consensus::Params&    params;
 
+    // sortWinners rebuilds the sorted winner set from nextWinners.  It must be
+    // called whenever nextWinners is modified.
+    void sortWinners();
+
 public:
 
 
@@ -105,6 +115,7 @@ public:
       databaseUndoUpdate(),
       databaseBlockTickets(),
       nextWinners(),
+      sortedWinners(),
       finalState(),
       params(consensus_params)
     {
@@ -119,6 +130,7 @@ public:
       databaseUndoUpdate(other.databaseUndoUpdate),
       databaseBlockTickets(other.databaseBlockTickets),
       nextWinners(other.nextWinners),
+      sortedWinners(other.sortedWinners),
       finalState(other.finalState),
       params(other.params)
     {
@@ -146,7 +158,7 @@ public:
     //   finalState(_finalState),
       params(_params)
     {
-        ;
+        sortWinners();
     }
 
     static std::unique_ptr<StakeNode> genesisNode(const Consensus::Params& params);
@@ -215,8 +227,12 @@ public:
     bool ExistsExpiredTicket(const uint256& ticket) const;
 
     // Winners returns the current list of winners for this stake node, which
-    // can vote on this node.
-    HashVector Winners() const;
+    // can vote on this node, in lottery order.
+    const HashVector& Winners() const;
+
+    // ExistsWinner returns whether or not a ticket is among the winners for
+    // this stake node.  It does not copy the winner list.
+    bool ExistsWinner(const uint256& ticket) const;
 
     // FinalState returns the final state lottery checksum of the node.
     StakeState FinalState() const;
@@ -70,6 +70,28 @@ const CBlockIndex* findStakeVersionPriorNode(const CBlockIndex *pprevIndex, cons
     return pprevIndex->GetAncestor(wantHeight);
 }
 
+// tallyStakeVersions counts the header stake versions of the numBlocks blocks
+// ending at pIndex into versions.  The cumulative counts of the block index
+// answer it without a walk whenever they are known at both ends of the window.
+void tallyStakeVersions(const CBlockIndex *pIndex, int64_t numBlocks, std::map<uint32_t,uint32_t>& versions)
+{
+    const CBlockIndex *pBefore = pIndex->nHeight >= numBlocks ? pIndex->GetAncestor(pIndex->nHeight - numBlocks) : nullptr;
+    if (!pIndex->vChainStakeVersions.empty() && (pBefore == nullptr || !pBefore->vChainStakeVersions.empty())) {
+        for (uint32_t version = 0; version < pIndex->vChainStakeVersions.size(); version++) {
+            auto count = pIndex->GetChainStakeVersionCount(version) - (pBefore != nullptr ? pBefore->GetChainStakeVersionCount(version) : 0);
+            if (count > 0)
+                versions[version] = count;
+        }
+        return;
+    }
+
+    const CBlockIndex *pIterNode = pIndex;
+    for (int64_t i = 0; i < numBlocks && pIterNode != nullptr; i++) {
+        versions[pIterNode->nStakeVersion]++;
+        pIterNode = pIterNode->pprev;
+    }
+}
+
 // isStakeMajorityVersion determines if minVer requirement is met based on
 // prevNode.  The function always uses the stake versions of the prior window.
 // For example, if StakeVersionInterval = 11 and StakeValidationHeight = 13 the
@@ -92,14 +114,11 @@ bool isStakeMajorityVersion(uint32_t minVer, const CBlockIndex* pprevIndex, cons
 
     // Tally how many of the block headers in the previous stake version validation interval
     // have their stake version set to at least the requested minimum version.
+    std::map<uint32_t,uint32_t> versions;
+    tallyStakeVersions(pIndex, params.nStakeVersionInterval, versions);
     int versionCount = 0;
-    const CBlockIndex *pIterIndex = pIndex;
-    for (int i = 0; i < params.nStakeVersionInterval && pIterIndex != nullptr; i++) {
-        if (pIterIndex->nStakeVersion >= minVer)
-            versionCount++;
-
-        pIterIndex = pIterIndex->pprev;
-    }
+    for (auto it = versions.lower_bound(minVer); it != versions.end(); ++it)
+        versionCount += it->second;
 
     // Determine the required amount of votes to reach supermajority.
     auto numRequired = params.nStakeVersionInterval * params.nStakeMajorityMultiplier / params.nStakeMajorityDivisor;
@@ -130,15 +149,7 @@ int calcPriorStakeVersion(const CBlockIndex *pprevIndex, const Consensus::Params
     // Tally how many of each stake version the block headers in the previous stake
     // version validation interval have.
     std::map<uint32_t,uint32_t> versions;
-    const CBlockIndex *pIterNode = pIndex;
-    for (int i = 0; i < params.nStakeVersionInterval && pIterNode != nullptr; i++) {
-        if (versions.find(pIterNode->nStakeVersion) == versions.end())
-            versions[pIterNode->nStakeVersion] = 1;
-        else
-            versions[pIterNode->nStakeVersion]++;
-
-        pIterNode = pIterNode->pprev;
-    }
+    tallyStakeVersions(pIndex, params.nStakeVersionInterval, versions);
 
     // Determine the required amount of votes to reach supermajority.
     auto numRequired = params.nStakeVersionInterval * params.nStakeMajorityMultiplier / params.nStakeMajorityDivisor;
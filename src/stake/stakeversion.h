@@ -9,9 +9,11 @@
 #include "consensus/params.h"
 #include "chain.h"
 
+#include <map>
 #include <stdint.h>
 
 uint32_t calcStakeVersion(const CBlockIndex *pprevIndex, const Consensus::Params& params);
 int64_t calcWantHeight(int64_t stakeValidationHeight, int64_t interval, int64_t height);
+void tallyStakeVersions(const CBlockIndex *pIndex, int64_t numBlocks, std::map<uint32_t,uint32_t>& versions);
 
 #endif // STAKEVERSION_H
@@ -9,9 +9,12 @@
 // Unit tests for denial-of-service detection/prevention code
 
 #include "chainparams.h"
+#include "hash.h"
 #include "keystore.h"
+#include "miner.h"
 #include "net.h"
 #include "net_processing.h"
+#include "netmessagemaker.h"
 #include "pow.h"
 #include "script/sign.h"
 #include "serialize.h"
@@ -44,6 +47,43 @@ CService ip(uint32_t i)
 
 static NodeId id = 0;
 
+// Queue a message as if the node had received it
+static void ReceiveMessage(CNode& node, CSerializedNetMsg&& msg)
+{
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<unsigned char> vHeader;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, vHeader, 0, hdr};
+
+    CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    netmsg.readHeader((const char*)vHeader.data(), vHeader.size());
+    netmsg.readData((const char*)msg.data.data(), msg.data.size());
+    BOOST_REQUIRE(netmsg.complete());
+
+    LOCK(node.cs_vProcessMsg);
+    node.nProcessQueueSize += netmsg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+    node.vProcessMsg.push_back(std::move(netmsg));
+}
+
+// Take the messages queued for sending to the node, with their payloads
+static std::vector<std::pair<std::string, CDataStream>> TakeSentMessages(CNode& node)
+{
+    std::vector<std::pair<std::string, CDataStream>> vMessages;
+    LOCK(node.cs_vSend);
+    for (size_t i = 0; i < node.vSendMsg.size(); i++) {
+        CMessageHeader hdr(Params().MessageStart());
+        CDataStream(*node.vSendMsg[i], SER_NETWORK, INIT_PROTO_VERSION) >> hdr;
+        CDataStream payload(SER_NETWORK, PROTOCOL_VERSION);
+        if (hdr.nMessageSize > 0)
+            payload.write((const char*)node.vSendMsg[++i]->data(), hdr.nMessageSize);
+        vMessages.emplace_back(hdr.GetCommand(), std::move(payload));
+    }
+    node.vSendMsg.clear();
+    node.nSendSize = 0;
+    return vMessages;
+}
+
 BOOST_FIXTURE_TEST_SUITE(DoS_tests, TestingSetup)
 
 // Test eviction of an outbound peer whose chain never advances
@@ -271,4 +311,178 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+BOOST_FIXTURE_TEST_CASE(DoS_tipheaders, TestChain100Setup)
+{
+    std::atomic<bool> interruptDummy(false);
+    const CChainParams& chainparams = Params();
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    CAddress addr1(ip(0xa0b0c001), NODE_NONE);
+    CNode dummyNode1(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr1, 4, 4, CAddress(), "", true);
+    dummyNode1.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode1);
+    dummyNode1.nVersion = PROTOCOL_VERSION;
+    dummyNode1.fSuccessfullyConnected = true;
+
+    auto CountSent = [&dummyNode1](const std::string& strCommand, std::vector<CInv>* pvInv) {
+        int nCount = 0;
+        for (auto& msg : TakeSentMessages(dummyNode1)) {
+            if (msg.first != strCommand)
+                continue;
+            nCount++;
+            if (pvInv)
+                msg.second >> *pvInv;
+        }
+        return nCount;
+    };
+    auto Misbehavior = [&dummyNode1]() {
+        CNodeStateStats stats;
+        BOOST_CHECK(GetNodeStateStats(dummyNode1.GetId(), stats));
+        return stats.nMisbehavior;
+    };
+
+    // Two competing tips on our tip, which we have not seen yet
+    std::vector<CBlockHeader> vTips;
+    for (int i = 0; i < 2; i++) {
+        CBlock block = BlockAssembler(chainparams).CreateNewBlock(CScript() << i << OP_TRUE)->block;
+        unsigned int extraNonce = 0;
+        IncrementExtraNonce(&block, chainActive.Tip(), extraNonce);
+        while (!CheckProofOfWork(block, chainparams.GetConsensus())) ++block.nNonce;
+        vTips.push_back(block.GetBlockHeader());
+    }
+    BOOST_CHECK(vTips[0].GetHash() != vTips[1].GetHash());
+
+    // Both headers are accepted, and both blocks requested with one getdata
+    ReceiveMessage(dummyNode1, msgMaker.Make(NetMsgType::TIPHEADERS, vTips));
+    peerLogic->ProcessMessages(&dummyNode1, interruptDummy);
+    {
+        LOCK(cs_main);
+        for (const CBlockHeader& header : vTips)
+            BOOST_CHECK(mapBlockIndex.count(header.GetHash()));
+    }
+    std::vector<CInv> vGetData;
+    BOOST_CHECK_EQUAL(CountSent(NetMsgType::GETDATA, &vGetData), 1);
+    BOOST_REQUIRE_EQUAL(vGetData.size(), 2U);
+    BOOST_CHECK(vGetData[0].hash == vTips[0].GetHash());
+    BOOST_CHECK(vGetData[1].hash == vTips[1].GetHash());
+    BOOST_CHECK_EQUAL(Misbehavior(), 0);
+
+    // Tips we already have are not requested again
+    ReceiveMessage(dummyNode1, msgMaker.Make(NetMsgType::TIPHEADERS, vTips));
+    peerLogic->ProcessMessages(&dummyNode1, interruptDummy);
+    BOOST_CHECK_EQUAL(CountSent(NetMsgType::GETDATA, nullptr), 0);
+
+    // Tips on unknown blocks are left to a single getheaders
+    std::vector<CBlockHeader> vOrphans(2, vTips[0]);
+    vOrphans[0].hashPrevBlock = uint256S("0x01");
+    vOrphans[1].hashPrevBlock = uint256S("0x02");
+    ReceiveMessage(dummyNode1, msgMaker.Make(NetMsgType::TIPHEADERS, vOrphans));
+    peerLogic->ProcessMessages(&dummyNode1, interruptDummy);
+    BOOST_CHECK_EQUAL(CountSent(NetMsgType::GETHEADERS, nullptr), 1);
+    BOOST_CHECK_EQUAL(Misbehavior(), 0);
+    {
+        LOCK(cs_main);
+        for (const CBlockHeader& header : vOrphans)
+            BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+    }
+
+    // A header failing its proof of work is punished, and stops the processing
+    CBlockHeader badHeader = vTips[0];
+    badHeader.nTime++;
+    while (CheckProofOfWork(badHeader, chainparams.GetConsensus())) ++badHeader.nNonce;
+    ReceiveMessage(dummyNode1, msgMaker.Make(NetMsgType::TIPHEADERS, std::vector<CBlockHeader>{badHeader, vTips[1]}));
+    peerLogic->ProcessMessages(&dummyNode1, interruptDummy);
+    BOOST_CHECK_EQUAL(Misbehavior(), 50);
+    BOOST_CHECK_EQUAL(CountSent(NetMsgType::GETDATA, nullptr), 0);
+
+    // So is a message with more headers than a headers message may carry
+    ReceiveMessage(dummyNode1, msgMaker.Make(NetMsgType::TIPHEADERS, std::vector<CBlockHeader>(MAX_HEADERS_RESULTS + 1, vTips[0])));
+    peerLogic->ProcessMessages(&dummyNode1, interruptDummy);
+    BOOST_CHECK_EQUAL(Misbehavior(), 70);
+
+    bool dummy;
+    peerLogic->FinalizeNode(dummyNode1.GetId(), dummy);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_vote_push)
+{
+    // The budget allows a burst, then refills at the sustained rate
+    CVotePushBudget budget;
+    const int64_t nStart = 1000000;
+    const int64_t nPerVote = 60 * 1000000 / VOTE_PUSH_RATE;
+    for (unsigned int i = 0; i < VOTE_PUSH_BURST; i++)
+        BOOST_CHECK(budget.Consume(nStart));
+    BOOST_CHECK(!budget.Consume(nStart));
+    BOOST_CHECK(budget.Consume(nStart + nPerVote));
+    BOOST_CHECK(!budget.Consume(nStart + nPerVote));
+    unsigned int nRefilled = 0;
+    while (budget.Consume(nStart + 3600 * 1000000LL))
+        nRefilled++;
+    BOOST_CHECK_EQUAL(nRefilled, VOTE_PUSH_BURST);
+
+    std::atomic<bool> interruptDummy(false);
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    CAddress addr1(ip(0xa0b0c001), NODE_NONE);
+    CNode dummyNode1(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr1, 5, 5, CAddress(), "", true);
+    dummyNode1.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode1);
+    dummyNode1.nVersion = PROTOCOL_VERSION;
+    dummyNode1.fSuccessfullyConnected = true;
+    dummyNode1.fRelayTxes = true;
+
+    ReceiveMessage(dummyNode1, msgMaker.Make(NetMsgType::SENDVOTES));
+    peerLogic->ProcessMessages(&dummyNode1, interruptDummy);
+
+    // More votes than the peer accepts in a burst
+    const unsigned int nVotes = VOTE_PUSH_BURST + 20;
+    TestMemPoolEntryHelper entry;
+    for (unsigned int i = 0; i < nVotes; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        mempool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+        dummyNode1.PushVoteInventory(CInv(MSG_TX, tx.GetHash()));
+    }
+
+    auto SendVotes = [&](unsigned int& nPushed, unsigned int& nAnnounced) {
+        peerLogic->SendMessages(&dummyNode1);
+        nPushed = nAnnounced = 0;
+        for (auto& msg : TakeSentMessages(dummyNode1)) {
+            if (msg.first == NetMsgType::VOTE) {
+                nPushed++;
+            } else if (msg.first == NetMsgType::INV) {
+                std::vector<CInv> vInv;
+                msg.second >> vInv;
+                for (const CInv& inv : vInv)
+                    nAnnounced += inv.type == MSG_TX;
+            }
+        }
+    };
+
+    // Each pass pushes up to MAX_VOTE_RELAY_PER_SEND votes
+    unsigned int nPushed, nAnnounced;
+    SendVotes(nPushed, nAnnounced);
+    BOOST_CHECK_EQUAL(nPushed, MAX_VOTE_RELAY_PER_SEND);
+    BOOST_CHECK_EQUAL(nAnnounced, 0U);
+    SendVotes(nPushed, nAnnounced);
+    BOOST_CHECK_EQUAL(nPushed, VOTE_PUSH_BURST - MAX_VOTE_RELAY_PER_SEND);
+    BOOST_CHECK_EQUAL(nAnnounced, 0U);
+
+    // Once the budget is spent, the remaining votes are announced instead
+    SendVotes(nPushed, nAnnounced);
+    BOOST_CHECK_EQUAL(nPushed + nAnnounced, nVotes - VOTE_PUSH_BURST);
+    BOOST_CHECK(nAnnounced > 0);
+
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(dummyNode1.GetId(), stats));
+    BOOST_CHECK_EQUAL(stats.nVotesSent, nVotes);
+
+    mempool.clear();
+    bool dummy;
+    peerLogic->FinalizeNode(dummyNode1.GetId(), dummy);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
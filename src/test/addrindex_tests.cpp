@@ -0,0 +1,227 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_bwscoin.h"
+#include "validation.h"
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addrindex_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(addrindex_balance_unspent_pages)
+{
+    const CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    const CTxDestination dest = coinbaseKey.GetPubKey().GetID();
+
+    // Only the blocks connected with the address index enabled are in it.
+    fAddrIndex = true;
+    std::vector<CBlock> vBlocks;
+    for (int i = 0; i < 3; i++)
+        vBlocks.push_back(CreateAndProcessBlock({}, scriptPubKey));
+    const int nFirstHeight = chainActive.Height() - 2;
+
+    // Coinbase outputs paying the key, per block
+    std::vector<CAmount> vMined(vBlocks.size(), 0);
+    size_t nOutputs = 0;
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        for (const CTxOut& txout : vBlocks[i].vtx[0]->vout) {
+            if (txout.scriptPubKey == scriptPubKey) {
+                vMined[i] += txout.nValue;
+                nOutputs++;
+            }
+        }
+    }
+    const CAmount nMined = vMined[0] + vMined[1] + vMined[2];
+    BOOST_CHECK(nMined > 0);
+
+    CAddrIndexBalance balance;
+    BOOST_CHECK(GetAddressBalance(dest, balance));
+    BOOST_CHECK_EQUAL(balance.nReceived, nMined);
+    BOOST_CHECK_EQUAL(balance.nSpent, 0);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 3U);
+
+    std::vector<std::pair<COutPoint, CAddrIndexUnspent> > vUnspent;
+    BOOST_CHECK(GetAddressUnspent(dest, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), nOutputs);
+
+    // Pages come in chain order, or newest first, and continue after a cursor.
+    std::vector<CExtDiskTxPos> vPos;
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPos));
+    BOOST_REQUIRE_EQUAL(vPos.size(), 3U);
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK_EQUAL(vPos[i].nHeight, (unsigned int)(nFirstHeight + i));
+
+    std::vector<CExtDiskTxPos> vPage;
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPage, 1, 1));
+    BOOST_REQUIRE_EQUAL(vPage.size(), 1U);
+    BOOST_CHECK(vPage[0] == vPos[1]);
+
+    vPage.clear();
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPage, 0, 2, nullptr, true));
+    BOOST_REQUIRE_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK(vPage[0] == vPos[2]);
+    BOOST_CHECK(vPage[1] == vPos[1]);
+
+    vPage.clear();
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPage, 0, 10, &vPos[0]));
+    BOOST_REQUIRE_EQUAL(vPage.size(), 2U);
+    BOOST_CHECK(vPage[0] == vPos[1]);
+
+    vPage.clear();
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPage, 0, 10, &vPos[1], true));
+    BOOST_REQUIRE_EQUAL(vPage.size(), 1U);
+    BOOST_CHECK(vPage[0] == vPos[0]);
+
+    // Disconnecting the tip takes its coinbase out of every part of the index.
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_CHECK(GetAddressBalance(dest, balance));
+    BOOST_CHECK_EQUAL(balance.nReceived, nMined - vMined[2]);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 2U);
+    vUnspent.clear();
+    BOOST_CHECK(GetAddressUnspent(dest, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), nOutputs * 2 / 3);
+    vPos.clear();
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPos));
+    BOOST_CHECK_EQUAL(vPos.size(), 2U);
+
+    fAddrIndex = false;
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_disapproved_block)
+{
+    const CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    const CTxDestination destCoinbase = coinbaseKey.GetPubKey().GetID();
+    const COutPoint prevout(coinbaseTxns[0].GetHash(), 0);
+    CKey key;
+    key.MakeNewKey(true);
+    const CTxDestination dest = key.GetPubKey().GetID();
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = prevout;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = GetScriptForDestination(dest);
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    fAddrIndex = true;
+    CreateAndProcessBlock({spend}, scriptPubKey);
+    const uint256 hashDisapproved = chainActive.Tip()->GetBlockHash();
+
+    CAddrIndexBalance balance;
+    BOOST_CHECK(GetAddressBalance(dest, balance));
+    BOOST_CHECK_EQUAL(balance.nReceived, 11*CENT);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 1U);
+    BOOST_CHECK(GetAddressBalance(destCoinbase, balance));
+    BOOST_CHECK_EQUAL(balance.nSpent, coinbaseTxns[0].vout[0].nValue);
+
+    // The next block disapproves the regular transactions of its parent.
+    // Blocks must approve their parent before the stake validation height,
+    // so connect an approving block, then connect it again disapproving:
+    // ConnectBlock goes by the vote bits of the block index.
+    CreateAndProcessBlock({}, scriptPubKey);
+    CBlockIndex* pindexDisapproving = chainActive.Tip();
+    BOOST_REQUIRE(pindexDisapproving->pprev->GetBlockHash() == hashDisapproved);
+    {
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), pindexDisapproving));
+    }
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == hashDisapproved);
+    {
+        LOCK(cs_main);
+        pindexDisapproving->nVoteBits.setRttAccepted(false);
+        ResetBlockFailureFlags(pindexDisapproving);
+    }
+    {
+        CValidationState state;
+        BOOST_CHECK(ActivateBestChain(state, Params()));
+    }
+    BOOST_REQUIRE(chainActive.Tip() == pindexDisapproving);
+
+    // The spend is out of the index, while the coinbases of both blocks are in.
+    BOOST_CHECK(GetAddressBalance(dest, balance));
+    BOOST_CHECK(balance.IsNull());
+    std::vector<std::pair<COutPoint, CAddrIndexUnspent> > vUnspent;
+    BOOST_CHECK(GetAddressUnspent(dest, vUnspent));
+    BOOST_CHECK(vUnspent.empty());
+    std::vector<CExtDiskTxPos> vPos;
+    BOOST_CHECK(FindTransactionsByDestination(dest, vPos));
+    BOOST_CHECK(vPos.empty());
+
+    BOOST_CHECK(GetAddressBalance(destCoinbase, balance));
+    BOOST_CHECK_EQUAL(balance.nSpent, 0);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 2U);
+    BOOST_CHECK(GetAddressUnspent(destCoinbase, vUnspent));
+    BOOST_CHECK(std::any_of(vUnspent.begin(), vUnspent.end(),
+        [&prevout](const std::pair<COutPoint, CAddrIndexUnspent>& unspent) { return unspent.first == prevout; }));
+
+    fAddrIndex = false;
+}
+
+BOOST_AUTO_TEST_CASE(spentindex_lookup)
+{
+    const CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    const COutPoint prevout(coinbaseTxns[0].GetHash(), 0);
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = prevout;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    fSpentIndex = true;
+    CreateAndProcessBlock({spend}, scriptPubKey);
+
+    // The spent output comes from the index, an unspent one from the UTXO set.
+    CSpentIndexValue spent;
+    BOOST_CHECK(GetSpentIndex(prevout, spent));
+    BOOST_CHECK(spent.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(spent.nInput, 0U);
+    BOOST_CHECK_EQUAL(spent.nHeight, (unsigned int)chainActive.Height());
+    BOOST_CHECK(spent.out == coinbaseTxns[0].vout[0]);
+
+    CTxOut out;
+    BOOST_CHECK(GetSpentOutput(prevout, out));
+    BOOST_CHECK(out == coinbaseTxns[0].vout[0]);
+    BOOST_CHECK(GetSpentOutput(COutPoint(spend.GetHash(), 0), out));
+    BOOST_CHECK(out == spend.vout[0]);
+
+    // Disconnecting the block forgets the spend.
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_CHECK(!GetSpentIndex(prevout, spent));
+
+    fSpentIndex = false;
+    BOOST_CHECK(!GetSpentOutput(prevout, out));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
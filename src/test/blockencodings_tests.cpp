@@ -316,6 +316,52 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(RecentTransactionPrefillTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // vtx[2] just reached the mempool, vtx[1] has been there for a while
+    const int64_t nNow = GetTime();
+    pool.addUnchecked(block.vtx[1]->GetHash(), entry.Time(nNow - 60).FromTx(*block.vtx[1]));
+    pool.addUnchecked(block.vtx[2]->GetHash(), entry.Time(nNow).FromTx(*block.vtx[2]));
+
+    CompactBlockPrefillPolicy policy;
+    policy.pool = &pool;
+    policy.nRecentTime = nNow - 2;
+    CBlockHeaderAndShortTxIDs shortIDs(block, true, policy);
+    BOOST_CHECK_EQUAL(shortIDs.BlockTxCount(), 3);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    // Reconstruct against an empty mempool: only the prefilled ones are there
+    CTxMemPool emptyPool;
+    PartiallyDownloadedBlock partialBlock(&emptyPool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK( partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+    BOOST_CHECK( partialBlock.IsTxAvailable(2));
+
+    const CompactBlockReconstructionStats statsBefore = GetCompactBlockReconstructionStats();
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx[1]}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+
+    CompactBlockReconstructionStats statsAfter = GetCompactBlockReconstructionStats();
+    CompactBlockReconstructionStats::ClassStats regularBefore;
+    if (statsBefore.mapClasses.count(TX_Regular))
+        regularBefore = statsBefore.mapClasses.at(TX_Regular);
+    BOOST_CHECK_EQUAL(statsAfter.nBlocks, statsBefore.nBlocks + 1);
+    BOOST_CHECK_EQUAL(statsAfter.mapClasses[TX_Regular].nPrefilled, regularBefore.nPrefilled + 1);
+    BOOST_CHECK_EQUAL(statsAfter.mapClasses[TX_Regular].nRequested, regularBefore.nRequested + 1);
+    BOOST_CHECK_EQUAL(statsAfter.mapClasses[TX_Regular].nFromMempool, regularBefore.nFromMempool);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -10,6 +10,8 @@
 #include "validation.h"
 #include "consensus/tx_verify.h"
 #include "net.h"
+#include "script/standard.h"
+#include "streams.h"
 
 #include "test/test_bwscoin.h"
 
@@ -104,4 +106,93 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+BOOST_AUTO_TEST_CASE(read_raw_block_from_disk)
+{
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+
+    std::vector<unsigned char> expected;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, expected, 0, block);
+    std::vector<unsigned char> raw;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, Params().MessageStart()));
+    BOOST_CHECK(raw == expected);
+
+    // The data is checked against the expected network magic
+    CMessageHeader::MessageStartChars wrong_start = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, pindex, wrong_start));
+}
+
+/** The chain tips found by scanning the whole block index: the active tip,
+ * plus the blocks outside the active chain that no other such block builds on */
+static std::set<CBlockIndex*, CompareBlocksByHeight> ScanChainTips()
+{
+    std::set<CBlockIndex*, CompareBlocksByHeight> setTips;
+    std::set<CBlockIndex*> setOrphans;
+    std::set<const CBlockIndex*> setPrevs;
+    for (const auto& item : mapBlockIndex) {
+        if (!chainActive.Contains(item.second)) {
+            setOrphans.insert(item.second);
+            setPrevs.insert(item.second->pprev);
+        }
+    }
+    for (CBlockIndex* pindex : setOrphans) {
+        if (setPrevs.count(pindex) == 0)
+            setTips.insert(pindex);
+    }
+    setTips.insert(chainActive.Tip());
+    return setTips;
+}
+
+BOOST_FIXTURE_TEST_CASE(chain_tips_leaves, TestChain100Setup)
+{
+    const CScript scriptPubKey = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    CValidationState state;
+    LOCK(cs_main);
+
+    BOOST_CHECK(GetChainTips() == ScanChainTips());
+    BOOST_CHECK_EQUAL(GetChainTips().size(), 1U);
+
+    // Invalidating the tip and mining two blocks on its parent leaves a fork
+    CBlockIndex* pindexOld = chainActive.Tip();
+    BOOST_CHECK(InvalidateBlock(state, Params(), pindexOld));
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    CreateAndProcessBlock({}, scriptPubKey);
+    CBlockIndex* pindexForkA = chainActive.Tip();
+    CreateAndProcessBlock({}, scriptPubKey);
+    CBlockIndex* pindexTipA = chainActive.Tip();
+    BOOST_CHECK(pindexForkA->pprev == pindexOld->pprev);
+    BOOST_CHECK(GetChainTips() == ScanChainTips());
+    BOOST_CHECK_EQUAL(GetChainTips().size(), 2U);
+    BOOST_CHECK_EQUAL(GetChainTips(0).size(), 1U);
+    BOOST_CHECK_EQUAL(GetChainTips(1).size(), 2U);
+
+    // Reorganize to the other branch and extend it
+    BOOST_CHECK(ResetBlockFailureFlags(pindexOld));
+    BOOST_CHECK(InvalidateBlock(state, Params(), pindexForkA));
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindexOld);
+    BOOST_CHECK(GetChainTips() == ScanChainTips());
+    CreateAndProcessBlock({}, scriptPubKey);
+    CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetAncestor(pindexOld->nHeight) == pindexOld);
+    BOOST_CHECK(GetChainTips() == ScanChainTips());
+    BOOST_CHECK_EQUAL(GetChainTips().size(), 2U);
+    BOOST_CHECK(GetChainTips().count(pindexTipA));
+
+    // Invalidating a block inside the active chain moves the tip back without
+    // changing the leaves
+    CBlockIndex* pindexTipB = chainActive.Tip();
+    BOOST_CHECK(InvalidateBlock(state, Params(), pindexTipB->pprev));
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindexOld);
+    BOOST_CHECK(GetChainTips() == ScanChainTips());
+    BOOST_CHECK_EQUAL(GetChainTips().size(), 3U);
+    BOOST_CHECK(GetChainTips().count(pindexTipB));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -165,7 +165,7 @@ CMutableTransaction CreateDummyBuyTicket(const CAmount& contribution, const CAmo
     return mtx;
 }
 
-CMutableTransaction CreateDummyVote(const uint256& blockHashToVoteOn)
+CMutableTransaction CreateDummyVote(const uint256& blockHashToVoteOn, const uint256& dummyBuyTicketTxHash = uint256())
 {
     CMutableTransaction mtx;
 
@@ -173,7 +173,6 @@ CMutableTransaction CreateDummyVote(const uint256& blockHashToVoteOn)
     mtx.vin.push_back(CTxIn(COutPoint()));
 
     // create an input from a dummy BuyTicket stake
-    uint256 dummyBuyTicketTxHash = uint256();
     mtx.vin.push_back(CTxIn(COutPoint(dummyBuyTicketTxHash, ticketStakeOutputIndex)));
 
     // create a structured OP_RETURN output containing tx declaration and dummy voting data
@@ -195,12 +194,11 @@ CMutableTransaction CreateDummyVote(const uint256& blockHashToVoteOn)
     return mtx;
 }
 
-CMutableTransaction CreateDummyRevokeTicket()
+CMutableTransaction CreateDummyRevokeTicket(const uint256& dummyBuyTicketTxHash = uint256())
 {
     CMutableTransaction mtx;
 
     // create an input from a dummy BuyTicket stake
-    uint256 dummyBuyTicketTxHash = uint256();
     mtx.vin.push_back(CTxIn(COutPoint(dummyBuyTicketTxHash, ticketStakeOutputIndex)));
 
     // create a structured OP_RETURN output containing tx declaration
@@ -292,6 +290,96 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingWithStakeTest)
     CheckSort<tx_class>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolStakeLookupTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txBuyTicket = CreateDummyBuyTicket(10000LL, 10000LL);
+    txBuyTicket.vin[0].prevout = COutPoint(uint256S("0x1234"), 0);
+    pool.addUnchecked(txBuyTicket.GetHash(), entry.Fee(10000LL).FromTx(txBuyTicket));
+
+    const uint256 votedTicketHash = uint256S("0x5678");
+    const uint256 revokedTicketHash = uint256S("0x9abc");
+    const auto& blockHashToVoteOn = uint256S("0xabcdef");
+    CMutableTransaction txVote = CreateDummyVote(blockHashToVoteOn, votedTicketHash);
+    pool.addUnchecked(txVote.GetHash(), entry.Fee(10000LL).FromTx(txVote));
+    CMutableTransaction txRevokeTicket = CreateDummyRevokeTicket(revokedTicketHash);
+    pool.addUnchecked(txRevokeTicket.GetHash(), entry.Fee(10000LL).FromTx(txRevokeTicket));
+
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txVote.GetHash())->GetVotedBlockHash().ToString(), blockHashToVoteOn.ToString());
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txVote.GetHash())->GetSpentTicketHash().ToString(), votedTicketHash.ToString());
+    BOOST_CHECK(pool.mapTx.find(txBuyTicket.GetHash())->GetSpentTicketHash().IsNull());
+
+    // votes and revocations by spent ticket
+    BOOST_CHECK(pool.existsTicketSpender(votedTicketHash, TX_Vote));
+    BOOST_CHECK(!pool.existsTicketSpender(votedTicketHash, TX_RevokeTicket));
+    BOOST_CHECK(pool.existsTicketSpender(revokedTicketHash, TX_RevokeTicket));
+    BOOST_CHECK(!pool.existsTicketSpender(revokedTicketHash, TX_Vote));
+    BOOST_CHECK(!pool.existsTicketSpender(uint256S("0xdef0"), TX_Vote));
+
+    // tickets by hash or by spent funding outpoint
+    BOOST_CHECK(pool.existsTicketOrConflict(txBuyTicket));
+    CMutableTransaction txConflictingTicket = CreateDummyBuyTicket(20000LL, 20000LL);
+    txConflictingTicket.vin[0].prevout = txBuyTicket.vin[0].prevout;
+    BOOST_CHECK(pool.existsTicketOrConflict(txConflictingTicket));
+    CMutableTransaction txOtherTicket = CreateDummyBuyTicket(20000LL, 20000LL);
+    txOtherTicket.vin[0].prevout = COutPoint(uint256S("0x1234"), 1);
+    BOOST_CHECK(!pool.existsTicketOrConflict(txOtherTicket));
+
+    pool.removeRecursive(txVote);
+    BOOST_CHECK(!pool.existsTicketSpender(votedTicketHash, TX_Vote));
+    BOOST_CHECK_EQUAL(pool.mapTx.get<voted_block_hash>().count(blockHashToVoteOn), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolStakeExpiryTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const auto& params = Params().GetConsensus();
+    const int height = params.nHybridConsensusHeight + nMempoolResidence;
+    const CAmount stakeDifficulty = 10000LL;
+
+    auto addTicket = [&](uint32_t n, const CAmount& stake, uint32_t expiry, unsigned int entryHeight) {
+        CMutableTransaction tx = CreateDummyBuyTicket(stake, stake);
+        tx.vin[0].prevout = COutPoint(uint256S("0x1234"), n);
+        tx.nExpiry = expiry;
+        pool.addUnchecked(tx.GetHash(), entry.Fee(10000LL).Height(entryHeight).FromTx(tx));
+        return tx.GetHash();
+    };
+
+    const uint256 expiredTicket = addTicket(0, stakeDifficulty, height + 1, height);
+    const uint256 residenceExpiredTicket = addTicket(1, stakeDifficulty, 0, height - nMempoolResidence);
+    const uint256 residentTicket = addTicket(2, stakeDifficulty, 0, height - nMempoolResidence + 1);
+    const uint256 mispricedTicket = addTicket(3, stakeDifficulty * 2, height + 2, height);
+    const uint256 liveTicket = addTicket(4, stakeDifficulty, height + 2, height);
+
+    // a child of an expiring ticket goes with it
+    CMutableTransaction txChild;
+    txChild.vin.push_back(CTxIn(COutPoint(expiredTicket, 3)));
+    txChild.vout.push_back(CTxOut(1000LL, CScript() << OP_TRUE));
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(1000LL).Height(height).FromTx(txChild));
+
+    CMutableTransaction txVote = CreateDummyVote(uint256S("0xabcdef"), uint256S("0x5678"));
+    pool.addUnchecked(txVote.GetHash(), entry.Fee(10000LL).Height(height).FromTx(txVote));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txVote.GetHash())->GetVotedBlockHeight(), 55U);
+    BOOST_CHECK_EQUAL(pool.size(), 7U);
+
+    pool.removeExpiredStake(height, stakeDifficulty, false, params);
+    BOOST_CHECK(!pool.exists(expiredTicket));
+    BOOST_CHECK(!pool.exists(txChild.GetHash()));
+    BOOST_CHECK(!pool.exists(residenceExpiredTicket));
+    BOOST_CHECK(!pool.exists(mispricedTicket));
+    BOOST_CHECK(pool.exists(residentTicket));
+    BOOST_CHECK(pool.exists(liveTicket));
+    BOOST_CHECK(pool.exists(txVote.GetHash()));
+
+    // the vote, on a block far below the tip, goes once votes are included
+    pool.removeExpiredStake(height, stakeDifficulty, true, params);
+    BOOST_CHECK(!pool.exists(txVote.GetHash()));
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 {
     CTxMemPool pool;
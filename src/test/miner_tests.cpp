@@ -202,6 +202,19 @@ void TestPackageSelection(const CChainParams& chainparams, CScript scriptPubKey,
     mempool.addUnchecked(tx.GetHash(), entry.Fee(10000).FromTx(tx));
     pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
+
+    // Test that extending a template keeps its transactions, in order, and
+    // adds the ones that entered the mempool since it was built.
+    tx.vin[0].prevout.hash = tx.GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout[0].nValue -= 10000; // 10k satoshi fee
+    uint256 hashExtendingTx = tx.GetHash();
+    mempool.addUnchecked(hashExtendingTx, entry.Fee(10000).FromTx(tx));
+    std::unique_ptr<CBlockTemplate> pextendedtemplate = AssemblerForTest(chainparams).UpdateBlockTemplate(*pblocktemplate);
+    BOOST_CHECK_EQUAL(pextendedtemplate->block.vtx.size(), pblocktemplate->block.vtx.size() + 1);
+    for (size_t i=1; i<pblocktemplate->block.vtx.size(); ++i)
+        BOOST_CHECK(pextendedtemplate->block.vtx[i]->GetHash() == pblocktemplate->block.vtx[i]->GetHash());
+    BOOST_CHECK(pextendedtemplate->block.vtx.back()->GetHash() == hashExtendingTx);
 }
 
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
@@ -1149,6 +1162,9 @@ BOOST_FIXTURE_TEST_CASE( CreateNewBlock_stake_REGTEST, TestChain100Setup_p2pkh)
         const auto& subsidy = GetVoterSubsidy(chainActive.Tip()->nHeight + 1/*spend Height*/, Params().GetConsensus());
         // create all needed transaction to obtain a block after stakeValidationHeight
         BOOST_CHECK_EQUAL(winningHashes.size(), WINNERS_PER_BLOCK);
+        for (const auto& winningHash : winningHashes)
+            BOOST_CHECK(chainActive.Tip()->pstakeNode->ExistsWinner(winningHash));
+        BOOST_CHECK(!chainActive.Tip()->pstakeNode->ExistsWinner(uint256()));
         // we will use 3 winners, thus 2 will be missed
         // add some good votes using the winning hashes and the hash of the tip
         for (auto i = 0; i < VOTES_PER_BLOCK; ++i) {
@@ -1235,6 +1251,101 @@ BOOST_FIXTURE_TEST_CASE( CreateNewBlock_stake_REGTEST, TestChain100Setup_p2pkh)
 
     fCheckpointsEnabled = true;
 }
+
+BOOST_FIXTURE_TEST_CASE( CreateNewBlock_ticket_packages_REGTEST, TestChain100Setup_p2pkh)
+{
+    const CChainParams& chainparams = Params();
+    const auto& consensus = chainparams.GetConsensus();
+
+    auto stakeKey = CKey();
+    stakeKey.MakeNewKey(true);
+    auto rewardKey = CKey();
+    rewardKey.MakeNewKey(false);
+    const auto& rewardAddr = rewardKey.GetPubKey().GetID();
+    auto changeKey = CKey();
+    changeKey.MakeNewKey(false);
+    const auto& changeAddr = changeKey.GetPubKey().GetID();
+
+    CScript scriptPubKeyCoinbase = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    CScript scriptPubKeyStake    = GetScriptForDestination(stakeKey.GetPubKey().GetID());
+    CScript scriptPubKeyChange   = GetScriptForDestination(changeAddr);
+
+    fCheckpointsEnabled = false;
+
+    // tickets are only selected from the height where they can mature by the stake enabled height
+    while (chainActive.Tip()->nHeight + 1 < consensus.nStakeEnabledHeight - consensus.nTicketMaturity)
+        CreateAndProcessBlock({}, scriptPubKeyCoinbase);
+
+    LOCK(cs_main);
+    LOCK(::mempool.cs);
+
+    auto SignTx =[](CMutableTransaction& tx,unsigned int nIn, const CScript& scriptCode, const CKey& key)
+    {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        key.Sign(hash, vchSig);
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[nIn].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+    };
+
+    const auto& ticketPrice = CalculateNextRequiredStakeDifficulty(chainActive.Tip(), consensus);
+    TestMemPoolEntryHelper entry;
+    entry.nHeight = 11;
+
+    // Add a ticket paying ticketFee, funded through a split transaction paying
+    // splitFee, or straight from a coinbase if there is no split fee
+    size_t spendCoinbaseIndex = 0;
+    auto AddTicketPackage = [&](const CAmount& splitFee, const CAmount& ticketFee, bool fSplit) {
+        const CTransaction& coinbaseTx = coinbaseTxns[spendCoinbaseIndex++];
+        CMutableTransaction txBuyTicket;
+        if (fSplit) {
+            CMutableTransaction txSplit;
+            txSplit.vin.push_back(CTxIn(coinbaseTx.GetHash(), 0));
+            txSplit.vout.push_back(CTxOut(coinbaseTx.vout[0].nValue - splitFee, scriptPubKeyChange));
+            SignTx(txSplit, 0, scriptPubKeyCoinbase, coinbaseKey);
+            mempool.addUnchecked(txSplit.GetHash(), entry.Fee(splitFee).SpendsCoinbase(true).FromTx(txSplit));
+
+            txBuyTicket = CreateDummyBuyTicket(txSplit, 0, ticketPrice, scriptPubKeyStake, ticketPrice + ticketFee, rewardAddr, changeAddr);
+            SignTx(txBuyTicket, 0, scriptPubKeyChange, changeKey);
+            mempool.addUnchecked(txBuyTicket.GetHash(), entry.Fee(ticketFee).SpendsCoinbase(false).FromTx(txBuyTicket));
+        } else {
+            txBuyTicket = CreateDummyBuyTicket(coinbaseTx, 0, ticketPrice, scriptPubKeyStake, ticketPrice + ticketFee, rewardAddr, changeAddr);
+            SignTx(txBuyTicket, 0, scriptPubKeyCoinbase, coinbaseKey);
+            mempool.addUnchecked(txBuyTicket.GetHash(), entry.Fee(ticketFee).SpendsCoinbase(true).FromTx(txBuyTicket));
+        }
+        return txBuyTicket.GetHash();
+    };
+
+    // The low fee split transactions pull the package fee rates of their
+    // tickets below the ticket fee rates: ticketD pays more than ticketB but
+    // its package pays less per byte.
+    const uint256 hashTicketC = AddTicketPackage(1000, 5000, true);
+    const uint256 hashTicketD = AddTicketPackage(0, 40000, true);
+    const uint256 hashTicketB = AddTicketPackage(0, 30000, false);
+    const uint256 hashTicketA = AddTicketPackage(0, 100000, true);
+    const uint256 hashSplitA = mempool.get(hashTicketA)->vin[0].prevout.hash;
+    const uint256 hashSplitC = mempool.get(hashTicketC)->vin[0].prevout.hash;
+    const uint256 hashSplitD = mempool.get(hashTicketD)->vin[0].prevout.hash;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    BOOST_CHECK(pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKeyCoinbase));
+    const CBlock& block = pblocktemplate->block;
+
+    // the tickets come first by package fee rate, followed by their split
+    // transactions in the order their packages were selected
+    BOOST_CHECK_EQUAL(static_cast<int>(block.nFreshStake), 4);
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 8U);
+    BOOST_CHECK(block.vtx[1]->GetHash() == hashTicketA);
+    BOOST_CHECK(block.vtx[2]->GetHash() == hashTicketB);
+    BOOST_CHECK(block.vtx[3]->GetHash() == hashTicketD);
+    BOOST_CHECK(block.vtx[4]->GetHash() == hashTicketC);
+    BOOST_CHECK(block.vtx[5]->GetHash() == hashSplitA);
+    BOOST_CHECK(block.vtx[6]->GetHash() == hashSplitD);
+    BOOST_CHECK(block.vtx[7]->GetHash() == hashSplitC);
+
+    mempool.clear();
+    fCheckpointsEnabled = true;
+}
 /*
 BOOST_FIXTURE_TEST_CASE( FakeChainGenerator_stake_REGTEST, Generator)
 {
@@ -10,8 +10,12 @@
 #include "streams.h"
 #include "net.h"
 #include "netbase.h"
+#include "net_processing.h"
 #include "chainparams.h"
 #include "util.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
 
 class CAddrManSerializationMock : public CAddrMan
 {
@@ -185,4 +189,110 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(serialized_block_cache)
+{
+    auto MakeData = [](size_t nSize) { return std::make_shared<const std::vector<unsigned char>>(nSize); };
+    const uint256 hash1 = uint256S("01"), hash2 = uint256S("02"), hash3 = uint256S("03");
+
+    CSerializedBlockCache cache(250);
+    CSerializedBlockCache::Data data1 = MakeData(100);
+    cache.Insert(hash1, data1);
+    cache.Insert(hash2, MakeData(100));
+    BOOST_CHECK_EQUAL(cache.Count(), 2U);
+    BOOST_CHECK_EQUAL(cache.Bytes(), 200U);
+    // The cached buffer is returned, not a copy
+    BOOST_CHECK(cache.Get(hash1) == data1);
+
+    // hash2 is now the least recently used one and goes first
+    cache.Insert(hash3, MakeData(100));
+    BOOST_CHECK_EQUAL(cache.Count(), 2U);
+    BOOST_CHECK(cache.Get(hash1));
+    BOOST_CHECK(!cache.Get(hash2));
+    BOOST_CHECK(cache.Get(hash3));
+
+    // Blocks larger than the whole cache are not kept
+    cache.Insert(hash2, MakeData(300));
+    BOOST_CHECK(!cache.Get(hash2));
+    BOOST_CHECK_EQUAL(cache.Bytes(), 200U);
+
+    cache.SetMaxBytes(150);
+    BOOST_CHECK_EQUAL(cache.Count(), 1U);
+    BOOST_CHECK(cache.Get(hash3));
+    cache.SetMaxBytes(0);
+    BOOST_CHECK_EQUAL(cache.Count(), 0U);
+    BOOST_CHECK_EQUAL(cache.Bytes(), 0U);
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_validation_queue, TestingSetup)
+{
+    const NodeId peer1 = 1, peer2 = 2;
+    auto MakeTx = [](uint32_t n) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(uint256S("01"), n);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        return MakeTransactionRef(std::move(tx));
+    };
+    auto Hashes = [](const std::vector<CTxValidationQueue::Job>& vJobs) {
+        std::vector<uint256> vHashes;
+        for (const CTxValidationQueue::Job& job : vJobs)
+            vHashes.push_back(job.tx->GetHash());
+        return vHashes;
+    };
+
+    // Without a thread, everything is left to the message handler
+    CTxValidationQueue queue(2);
+    BOOST_CHECK(!queue.CanCheck());
+    BOOST_CHECK(!queue.Push(peer1, NetMsgType::TX, MakeTx(0)));
+    BOOST_CHECK(!queue.Push(peer1, NetMsgType::TX, MakeTx(0), false));
+    BOOST_CHECK(!queue.HasPending(peer1));
+
+    boost::thread thread([&queue] { queue.Thread(); });
+    while (!queue.CanCheck())
+        MilliSleep(1);
+
+    std::vector<CTransactionRef> vTxs;
+    for (uint32_t n = 0; n < 6; n++)
+        vTxs.push_back(MakeTx(n));
+    {
+        // The thread is held on cs_main by the first transaction, while the
+        // others fill the queue up
+        LOCK(cs_main);
+        BOOST_CHECK(queue.Push(peer1, NetMsgType::TX, vTxs[0]));
+        while (queue.Size() > 0)
+            MilliSleep(1);
+        BOOST_CHECK(queue.Push(peer2, NetMsgType::TX, vTxs[1]));
+        BOOST_CHECK(queue.Push(peer1, NetMsgType::VOTE, vTxs[2]));
+        BOOST_CHECK_EQUAL(queue.Size(), 2U);
+        BOOST_CHECK(!queue.CanCheck());
+        BOOST_CHECK(!queue.Push(peer2, NetMsgType::TX, vTxs[3]));
+
+        // Transactions needing no check still wait behind those of their peer
+        BOOST_CHECK(queue.Push(peer1, NetMsgType::TX, vTxs[4], false));
+        BOOST_CHECK(!queue.Push(3, NetMsgType::TX, vTxs[5], false));
+        BOOST_CHECK(queue.HasPending(peer1));
+        BOOST_CHECK(queue.HasPending(peer2));
+        BOOST_CHECK(!queue.HasPending(3));
+        BOOST_CHECK(queue.PopChecked(peer1).empty());
+    }
+
+    // Each peer gets its transactions back in the order it sent them
+    std::vector<uint256> vPeer1, vPeer2;
+    while (queue.HasPending(peer1) || queue.HasPending(peer2)) {
+        for (const uint256& hash : Hashes(queue.PopChecked(peer1)))
+            vPeer1.push_back(hash);
+        for (const uint256& hash : Hashes(queue.PopChecked(peer2)))
+            vPeer2.push_back(hash);
+        MilliSleep(1);
+    }
+    BOOST_CHECK(vPeer1 == std::vector<uint256>({vTxs[0]->GetHash(), vTxs[2]->GetHash(), vTxs[4]->GetHash()}));
+    BOOST_CHECK(vPeer2 == std::vector<uint256>({vTxs[1]->GetHash()}));
+    BOOST_CHECK(queue.CanCheck());
+
+    thread.interrupt();
+    thread.join();
+    BOOST_CHECK(!queue.CanCheck());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
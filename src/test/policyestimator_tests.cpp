@@ -4,6 +4,8 @@
 
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "arith_uint256.h"
+#include "stake/staketx.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
@@ -179,4 +181,62 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(StakePolicyEstimates)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    TestMemPoolEntryHelper entry;
+    const CAmount lowFee(20000);
+    const CAmount highFee(40000);
+
+    // Votes on one block, made unique by the ticket they spend
+    const VoteData voteData = { 1, uint256S("0xabcdef"), 55, VoteBits::rttAccepted, defaultVoterStakeVersion, ExtendedVoteBits() };
+    CMutableTransaction vote;
+    vote.vin.push_back(CTxIn(COutPoint()));
+    vote.vin.push_back(CTxIn(COutPoint(uint256(), ticketStakeOutputIndex)));
+    vote.vout.push_back(CTxOut(0, GetScriptForVoteDecl(voteData)));
+    vote.vout.push_back(CTxOut(60, CScript() << OP_TRUE));
+
+    std::vector<CTransactionRef> block;
+    std::vector<uint256> highFeeVotes;
+    int blocknum = 0;
+    uint64_t ticketCount = 0;
+
+    // Only the high fee votes ever get mined
+    while (blocknum < 20) {
+        for (int k = 0; k < 4; k++) {
+            for (CAmount fee : {lowFee, highFee}) {
+                vote.vin[1].prevout.hash = ArithToUint256(arith_uint256(++ticketCount));
+                const uint256 hash = vote.GetHash();
+                mpool.addUnchecked(hash, entry.Fee(fee).Time(GetTime()).Height(blocknum).FromTx(vote));
+                if (fee == highFee)
+                    highFeeVotes.push_back(hash);
+            }
+        }
+        for (const uint256& hash : highFeeVotes) {
+            CTransactionRef ptx = mpool.get(hash);
+            if (ptx)
+                block.push_back(ptx);
+        }
+        highFeeVotes.clear();
+        mpool.removeForBlock(block, ++blocknum);
+        block.clear();
+    }
+
+    const CFeeRate lowRate(lowFee, GetVirtualTransactionSize(vote));
+    const CFeeRate highRate(highFee, GetVirtualTransactionSize(vote));
+
+    // Stake transactions can be estimated for the very next block
+    FeeCalculation feeCalc;
+    const CFeeRate voteEstimate = feeEst.estimateSmartStakeFee(TX_Vote, 1, &feeCalc);
+    BOOST_CHECK_EQUAL(feeCalc.returnedTarget, 1);
+    BOOST_CHECK(voteEstimate > lowRate);
+    BOOST_CHECK(voteEstimate.GetFeePerK() <= highRate.GetFeePerK() * 21 / 20);
+
+    // and are kept apart from the other classes and from the regular estimates
+    BOOST_CHECK(feeEst.estimateSmartStakeFee(TX_BuyTicket, 1, nullptr) == CFeeRate(0));
+    BOOST_CHECK(feeEst.estimateSmartStakeFee(TX_Vote, feeEst.HighestStakeTargetTracked() + 1, nullptr) == CFeeRate(0));
+    BOOST_CHECK(feeEst.estimateSmartFee(2, nullptr, false) == CFeeRate(0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -805,3 +805,39 @@ BOOST_FIXTURE_TEST_CASE(estimate_next_stake_diff_TEST, TestingSetup_TEST)
 
 BOOST_AUTO_TEST_SUITE_END()
  */
+
+BOOST_FIXTURE_TEST_SUITE(stake_difficulty_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sum_purchased_tickets)
+{
+    std::vector<CBlockIndex> blocks(100);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].nHeight = i;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nFreshStake = InsecureRandRange(20);
+        blocks[i].BuildSkip();
+    }
+
+    // Walking the blocks, as their cumulative counts are unknown
+    std::vector<std::pair<int, int64_t>> vQueries;
+    std::vector<int64_t> vSums;
+    for (int i = 0; i < 200; i++) {
+        const int nStart = InsecureRandRange(blocks.size());
+        const int64_t nToSum = InsecureRandRange(blocks.size() + 10);
+        int64_t nSum = 0;
+        for (int64_t j = nStart; j >= 0 && j > nStart - nToSum; j--)
+            nSum += blocks[j].nFreshStake;
+        BOOST_CHECK_EQUAL(SumPurchasedTickets(&blocks[nStart], nToSum), nSum);
+        vQueries.emplace_back(nStart, nToSum);
+        vSums.push_back(nSum);
+    }
+    BOOST_CHECK_EQUAL(SumPurchasedTickets(nullptr, 10), 0);
+
+    // Differences of the cumulative counts
+    for (size_t i = 0; i < blocks.size(); i++)
+        blocks[i].BuildChainStakeCounts();
+    for (size_t i = 0; i < vQueries.size(); i++)
+        BOOST_CHECK_EQUAL(SumPurchasedTickets(&blocks[vQueries[i].first], vQueries[i].second), vSums[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -171,6 +171,58 @@ void appendFakeVotes(CBlockIndex* node, uint16_t numVotes, uint32_t voteVersion,
     }
 }
 
+BOOST_AUTO_TEST_CASE(tally_stake_versions)
+{
+    std::vector<CBlockIndex> blocks(200);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].nHeight = i;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nStakeVersion = i / 40 + InsecureRandRange(3);
+        blocks[i].BuildSkip();
+    }
+
+    // Walking the blocks, as their cumulative counts are unknown
+    std::vector<std::pair<int, int64_t>> vQueries;
+    std::vector<std::map<uint32_t,uint32_t>> vTallies;
+    for (int i = 0; i < 100; i++) {
+        const int nStart = InsecureRandRange(blocks.size());
+        const int64_t nBlocks = InsecureRandRange(blocks.size() + 10);
+        std::map<uint32_t,uint32_t> expected;
+        for (int64_t j = nStart; j >= 0 && j > nStart - nBlocks; j--)
+            expected[blocks[j].nStakeVersion]++;
+        std::map<uint32_t,uint32_t> versions;
+        tallyStakeVersions(&blocks[nStart], nBlocks, versions);
+        BOOST_CHECK(versions == expected);
+        vQueries.emplace_back(nStart, nBlocks);
+        vTallies.push_back(expected);
+    }
+
+    // Differences of the cumulative counts
+    for (size_t i = 0; i < blocks.size(); i++)
+        blocks[i].BuildChainStakeCounts();
+    int64_t nCounted = 0;
+    for (uint32_t version = 0; version < blocks.back().vChainStakeVersions.size(); version++)
+        nCounted += blocks.back().GetChainStakeVersionCount(version);
+    BOOST_CHECK_EQUAL(nCounted, (int64_t)blocks.size());
+    BOOST_CHECK_EQUAL(blocks.back().GetChainStakeVersionCount(MAX_TRACKED_STAKE_VERSION), 0);
+    for (size_t i = 0; i < vQueries.size(); i++) {
+        std::map<uint32_t,uint32_t> versions;
+        tallyStakeVersions(&blocks[vQueries[i].first], vQueries[i].second, versions);
+        BOOST_CHECK(versions == vTallies[i]);
+    }
+
+    // A version out of the tracked range leaves the counts unknown from there on
+    blocks[150].nStakeVersion = MAX_TRACKED_STAKE_VERSION + 1;
+    for (size_t i = 0; i < blocks.size(); i++)
+        blocks[i].BuildChainStakeCounts();
+    BOOST_CHECK(blocks[149].GetChainStakeVersionCount(0) >= 0);
+    BOOST_CHECK_EQUAL(blocks[150].GetChainStakeVersionCount(0), -1);
+    BOOST_CHECK_EQUAL(blocks.back().GetChainStakeVersionCount(0), -1);
+    std::map<uint32_t,uint32_t> versions;
+    tallyStakeVersions(&blocks.back(), 60, versions);
+    BOOST_CHECK_EQUAL(versions[MAX_TRACKED_STAKE_VERSION + 1], 1U);
+}
+
 BOOST_FIXTURE_TEST_CASE(calc_stake_version_REG, TestingSetup_REG)
 {
     const auto& regparams = Params().GetConsensus();
@@ -111,6 +111,46 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_prevalidation_caches_scripts, TestChain100Setup)
+{
+    // A transaction checked ahead of AcceptToMemoryPool has its script
+    // executions cached, an invalid one has not.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    CMutableTransaction invalidSpend(spend);
+    invalidSpend.vin[0].scriptSig << std::vector<unsigned char>(72, 0);
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    const CTransactionRef txs[] = {MakeTransactionRef(spend), MakeTransactionRef(invalidSpend)};
+    for (const CTransactionRef& tx : txs)
+        PrevalidateTransaction(mempool, tx);
+
+    LOCK(cs_main);
+    for (size_t i = 0; i < 2; i++) {
+        CValidationState state;
+        PrecomputedTransactionData txdata(*txs[i]);
+        std::vector<CScriptCheck> vChecks;
+        // Cached script executions are not pushed as checks again
+        BOOST_CHECK(CheckInputs(*txs[i], state, *pcoinsTip, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, true, txdata, &vChecks));
+        BOOST_CHECK_EQUAL(vChecks.size(), i == 0 ? 0U : 1U);
+    }
+    BOOST_CHECK(ToMemPool(spend));
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
@@ -28,6 +28,10 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 static const char DB_ADDR_INDEX = 'a';
+static const char DB_ADDR_BALANCE = 'A';
+static const char DB_ADDR_UNSPENT = 'u';
+static const char DB_ADDR_INDEX_TIP = 'I';
+static const char DB_SPENT_INDEX = 'p';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
@@ -38,6 +42,47 @@ static const char DB_SALT = 'S';
 
 namespace {
 
+/** Key of a transaction in the address index. Height and offset are stored big
+ *  endian so that the transactions of an address are iterated in chain order. */
+struct AddrIndexTxKey {
+    char key;
+    uint64_t lookupid;
+    uint32_t nHeight;
+    uint32_t nTxOffset;
+    AddrIndexTxKey() : key(DB_ADDR_INDEX), lookupid(0), nHeight(0), nTxOffset(0) {}
+    AddrIndexTxKey(uint64_t lookupidIn, uint32_t nHeightIn, uint32_t nTxOffsetIn) : key(DB_ADDR_INDEX), lookupid(lookupidIn), nHeight(nHeightIn), nTxOffset(nTxOffsetIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        ser_writedata64(s, lookupid);
+        WriteBE32(s, nHeight);
+        WriteBE32(s, nTxOffset);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        lookupid = ser_readdata64(s);
+        nHeight = ReadBE32(s);
+        nTxOffset = ReadBE32(s);
+    }
+
+private:
+    template<typename Stream>
+    static void WriteBE32(Stream &s, uint32_t obj) {
+        obj = htobe32(obj);
+        s.write((char*)&obj, 4);
+    }
+
+    template<typename Stream>
+    static uint32_t ReadBE32(Stream &s) {
+        uint32_t obj;
+        s.read((char*)&obj, 4);
+        return be32toh(obj);
+    }
+};
+
 struct CoinEntry {
     COutPoint* outpoint;
     char key;
@@ -257,23 +302,65 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list) {
+uint64_t CBlockTreeDB::GetAddrLookupId(const uint160 &addrid) const {
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << salt;
+    ss << addrid;
+    return UintToArith256(ss.GetHash()).GetLow64();
+}
+
+bool CBlockTreeDB::ReadAddrIndex(const uint160 &addrid, std::vector<CExtDiskTxPos> &list, size_t nSkip, size_t nCount, const CExtDiskTxPos *pafter, bool fReverse) {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    uint64_t lookupid;
-    {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << addrid;
-        lookupid = UintToArith256(ss.GetHash()).GetLow64();
+    const uint64_t lookupid = GetAddrLookupId(addrid);
+    const uint32_t nBound = fReverse ? std::numeric_limits<uint32_t>::max() : 0;
+    pcursor->Seek(pafter ? AddrIndexTxKey(lookupid, pafter->nHeight, pafter->nTxOffset) : AddrIndexTxKey(lookupid, nBound, nBound));
+    if (fReverse) {
+        // Step back to the last entry before the bound
+        if (pcursor->Valid())
+            pcursor->Prev();
+        else
+            pcursor->SeekToLast();
+    }
+
+    for (; pcursor->Valid() && list.size() < nCount; fReverse ? pcursor->Prev() : pcursor->Next()) {
+        AddrIndexTxKey key;
+        if (!pcursor->GetKey(key) || key.key != DB_ADDR_INDEX || key.lookupid != lookupid)
+            break;
+        if (!fReverse && pafter && key.nHeight == pafter->nHeight && key.nTxOffset == pafter->nTxOffset)
+            continue;
+        if (nSkip > 0) {
+            nSkip--;
+            continue;
+        }
+        CDiskTxPos pos;
+        if (!pcursor->GetValue(pos))
+            return error("%s: failed to read value", __func__);
+        list.push_back(CExtDiskTxPos(pos, key.nHeight));
     }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddrIndexBalance(const uint160 &addrid, CAddrIndexBalance &balance) {
+    balance.SetNull();
+    if (!Exists(std::make_pair(DB_ADDR_BALANCE, GetAddrLookupId(addrid))))
+        return true;
+    return Read(std::make_pair(DB_ADDR_BALANCE, GetAddrLookupId(addrid)), balance);
+}
+
+bool CBlockTreeDB::ReadAddrIndexUnspent(const uint160 &addrid, std::vector<std::pair<COutPoint, CAddrIndexUnspent> > &list) {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_ADDR_INDEX, lookupid));
+    const uint64_t lookupid = GetAddrLookupId(addrid);
+    pcursor->Seek(std::make_pair(DB_ADDR_UNSPENT, lookupid));
 
     while (pcursor->Valid()) {
-        std::pair<std::pair<char, uint64_t>, CExtDiskTxPos> key;
-        if (pcursor->GetKey(key) && key.first.first == DB_ADDR_INDEX && key.first.second == lookupid) {
-            list.push_back(key.second);
+        std::pair<std::pair<char, uint64_t>, COutPoint> key;
+        if (pcursor->GetKey(key) && key.first.first == DB_ADDR_UNSPENT && key.first.second == lookupid) {
+            CAddrIndexUnspent unspent;
+            if (!pcursor->GetValue(unspent))
+                return error("%s: failed to read value", __func__);
+            list.push_back(std::make_pair(key.second, unspent));
         } else {
             break;
         }
@@ -282,18 +369,75 @@ bool CBlockTreeDB::ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &lis
     return true;
 }
 
-bool CBlockTreeDB::AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list) {
-    unsigned char foo[0];
+bool CBlockTreeDB::ReadAddrIndexTip(uint256 &hashBlock) {
+    hashBlock.SetNull();
+    if (!Exists(DB_ADDR_INDEX_TIP))
+        return true;
+    return Read(DB_ADDR_INDEX_TIP, hashBlock);
+}
+
+bool CBlockTreeDB::UpdateAddrIndex(const CAddrIndexDelta &delta, bool fConnect, const uint256 &hashTip) {
     CDBBatch batch(*this);
-    for (const auto& it : list ) {
-        CHashWriter ss(SER_GETHASH, 0);
-        ss << salt;
-        ss << it.first;
-        batch.Write(std::make_pair(std::make_pair(DB_ADDR_INDEX, UintToArith256(ss.GetHash()).GetLow64()), it.second), FLATDATA(foo));
+
+    std::map<uint64_t, CAddrIndexBalance> mapBalance;
+    for (const auto& it : delta.mapBalance) {
+        CAddrIndexBalance& change = mapBalance[GetAddrLookupId(it.first)];
+        change.nReceived += it.second.nReceived;
+        change.nSpent += it.second.nSpent;
+    }
+    for (const auto& it : delta.setTx) {
+        const uint64_t lookupid = GetAddrLookupId(it.first);
+        const AddrIndexTxKey key(lookupid, it.second.nHeight, it.second.nTxOffset);
+        if (fConnect)
+            batch.Write(key, static_cast<const CDiskTxPos&>(it.second));
+        else
+            batch.Erase(key);
+        mapBalance[lookupid].nTxCount++;
     }
+    for (const auto& it : mapBalance) {
+        const auto key = std::make_pair(DB_ADDR_BALANCE, it.first);
+        CAddrIndexBalance balance;
+        if (Exists(key) && !Read(key, balance))
+            return error("%s: failed to read balance", __func__);
+        if (fConnect) {
+            balance.nReceived += it.second.nReceived;
+            balance.nSpent += it.second.nSpent;
+            balance.nTxCount += it.second.nTxCount;
+        } else {
+            balance.nReceived -= it.second.nReceived;
+            balance.nSpent -= it.second.nSpent;
+            balance.nTxCount -= std::min(balance.nTxCount, it.second.nTxCount);
+        }
+        if (balance.IsNull())
+            batch.Erase(key);
+        else
+            batch.Write(key, balance);
+    }
+
+    for (const auto& it : fConnect ? delta.mapCreated : delta.mapSpent)
+        batch.Write(std::make_pair(std::make_pair(DB_ADDR_UNSPENT, GetAddrLookupId(it.first.first)), it.first.second), it.second);
+    for (const auto& it : fConnect ? delta.mapSpent : delta.mapCreated)
+        batch.Erase(std::make_pair(std::make_pair(DB_ADDR_UNSPENT, GetAddrLookupId(it.first.first)), it.first.second));
+
+    batch.Write(DB_ADDR_INDEX_TIP, hashTip);
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value) {
+    return Read(std::make_pair(DB_SPENT_INDEX, outpoint), value);
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> > &vect, bool fConnect) {
+    CDBBatch batch(*this);
+    for (const auto& it : vect) {
+        if (fConnect)
+            batch.Write(std::make_pair(DB_SPENT_INDEX, it.first), it.second);
+        else
+            batch.Erase(std::make_pair(DB_SPENT_INDEX, it.first));
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -13,7 +13,9 @@
 #include "dbwrapper.h"
 #include "chain.h"
 
+#include <limits>
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -112,6 +114,97 @@ struct CExtDiskTxPos : public CDiskTxPos
     }
 };
 
+/** Totals of the address index for one address, over the active chain */
+struct CAddrIndexBalance
+{
+    CAmount nReceived;
+    CAmount nSpent;
+    uint64_t nTxCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nReceived);
+        READWRITE(nSpent);
+        READWRITE(VARINT(nTxCount));
+    }
+
+    CAddrIndexBalance() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nReceived = 0;
+        nSpent = 0;
+        nTxCount = 0;
+    }
+
+    bool IsNull() const {
+        return nReceived == 0 && nSpent == 0 && nTxCount == 0;
+    }
+
+    CAmount GetBalance() const {
+        return nReceived - nSpent;
+    }
+};
+
+/** An unspent output listed by the address index */
+struct CAddrIndexUnspent
+{
+    CAmount nValue;
+    unsigned int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(VARINT(nHeight));
+    }
+
+    CAddrIndexUnspent() : nValue(0), nHeight(0) {}
+    CAddrIndexUnspent(CAmount nValueIn, unsigned int nHeightIn) : nValue(nValueIn), nHeight(nHeightIn) {}
+};
+
+/** Changes a block makes to the address index, applied when it is connected and reverted when it is disconnected */
+struct CAddrIndexDelta
+{
+    //! Transactions involving each address, without duplicates
+    std::set<std::pair<uint160, CExtDiskTxPos> > setTx;
+    //! Amounts received and spent by each address; transactions are counted from setTx
+    std::map<uint160, CAddrIndexBalance> mapBalance;
+    //! Outputs created by the block and not spent in it
+    std::map<std::pair<uint160, COutPoint>, CAddrIndexUnspent> mapCreated;
+    //! Outputs of earlier blocks spent by the block
+    std::map<std::pair<uint160, COutPoint>, CAddrIndexUnspent> mapSpent;
+};
+
+/** A spent output and where it was spent, as kept by the spent index */
+struct CSpentIndexValue
+{
+    //! Spending transaction and its input
+    uint256 txid;
+    uint32_t nInput;
+    //! Height of the block containing the spending transaction
+    unsigned int nHeight;
+    CTxOut out;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(VARINT(nInput));
+        READWRITE(VARINT(nHeight));
+        READWRITE(REF(CTxOutCompressor(REF(out))));
+    }
+
+    CSpentIndexValue() : nInput(0), nHeight(0) {}
+    CSpentIndexValue(const uint256& txidIn, uint32_t nInputIn, unsigned int nHeightIn, const CTxOut& outIn) :
+        txid(txidIn), nInput(nInputIn), nHeight(nHeightIn), out(outIn) {}
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
@@ -170,13 +263,27 @@ public:
     bool ReadReindexing(bool &fReindexing);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
-    bool ReadAddrIndex(uint160 addrid, std::vector<CExtDiskTxPos> &list);
-    bool AddAddrIndex(const std::vector<std::pair<uint160, CExtDiskTxPos> > &list);
+    /**
+     * Read the transactions of addrid in chain order, or newest first when fReverse.
+     * Listing starts past the position *pafter if given, leaves out the first nSkip
+     * entries and stops after nCount, so a page costs no more than its own size.
+     */
+    bool ReadAddrIndex(const uint160 &addrid, std::vector<CExtDiskTxPos> &list, size_t nSkip = 0, size_t nCount = std::numeric_limits<size_t>::max(), const CExtDiskTxPos *pafter = nullptr, bool fReverse = false);
+    bool ReadAddrIndexBalance(const uint160 &addrid, CAddrIndexBalance &balance);
+    bool ReadAddrIndexUnspent(const uint160 &addrid, std::vector<std::pair<COutPoint, CAddrIndexUnspent> > &list);
+    bool ReadAddrIndexTip(uint256 &hashBlock);
+    /** Apply (fConnect) or revert the changes of a block, and make hashTip the block the index is at */
+    bool UpdateAddrIndex(const CAddrIndexDelta &delta, bool fConnect, const uint256 &hashTip);
+    bool ReadSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value);
+    /** Write the given entries, or erase them when !fConnect */
+    bool UpdateSpentIndex(const std::vector<std::pair<COutPoint, CSpentIndexValue> > &vect, bool fConnect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 
 private:
+    uint64_t GetAddrLookupId(const uint160 &addrid) const;
+
     uint256 salt;
 };
 
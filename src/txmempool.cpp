@@ -37,6 +37,25 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
 
     feeDelta = 0;
     txClass = ParseTxClass(*tx);
+    votedBlockHeight = 0;
+    ticketPrice = 0;
+
+    std::string reason;
+    if (txClass == TX_Vote) {
+        VoteData vote;
+        if (ParseVote(*tx, vote)) {
+            votedBlockHash = vote.blockHash;
+            votedBlockHeight = vote.blockHeight;
+        }
+        if (ValidateVoteStructure(*tx, reason))
+            spentTicketHash = tx->vin[voteStakeInputIndex].prevout.hash;
+    } else if (txClass == TX_BuyTicket) {
+        if (tx->vout.size() > ticketStakeOutputIndex)
+            ticketPrice = tx->vout[ticketStakeOutputIndex].nValue;
+    } else if (txClass == TX_RevokeTicket) {
+        if (ValidateRevokeTicketStructure(*tx, reason))
+            spentTicketHash = tx->vin[revocationStakeInputIndex].prevout.hash;
+    }
 
     nCountWithAncestors = 1;
     nSizeWithAncestors = GetTxSize();
@@ -334,7 +353,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), nNonAdditiveUpdates(0), minerPolicyEstimator(estimator)
 {
     _clear(); //lock free clear
 
@@ -360,6 +379,13 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 {
     LOCK(cs);
     nTransactionsUpdated += n;
+    nNonAdditiveUpdates += n;
+}
+
+unsigned int CTxMemPool::GetNonAdditiveUpdates() const
+{
+    LOCK(cs);
+    return nNonAdditiveUpdates;
 }
 
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
@@ -445,6 +471,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    nNonAdditiveUpdates++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -602,73 +629,115 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     blockSinceLastRollingFeeBump = true;
 }
 
-void CTxMemPool::removeExpiredTickets(const int currentHeight, const CAmount currentStakeDifficulty, const Consensus::Params& params)
+void CTxMemPool::StageExpiredTickets(const int currentHeight, const CAmount currentStakeDifficulty, setEntries &stage)
 {
     // When a ticket transaction is expired, it is remmoved from the mempool.
     // This is a two sides process:
     // 1. Remove the tickets that are expired by the transaction's nExpiry value;
     // 2. Remove the tickets that have nExpiry set to zero and lingered in the mempool longer than acceptable.
     // 3. Remove the tickets that have low stake difficulty according to the current value.
+    // The indexes let each of these visit only the tickets being removed.
 
-    if (!IsHybridConsensusForkEnabled(currentHeight, params))
-        return;
-
-    LOCK(cs);
-
-    // get the tickets
-    auto& tx_class_index = mapTx.get<tx_class>();
-    auto tickets = tx_class_index.equal_range(ETxClass::TX_BuyTicket);
-
-    CTxMemPool::setEntries txToRemove;
-    for (auto tickettxiter = tickets.first; tickettxiter != tickets.second; ++tickettxiter) {
-        const CTransaction& tx = tickettxiter->GetTx();
-        if (IsExpiredTx(tx, currentHeight + 1)
-                || DidResidenceExpire(tx.nExpiry, static_cast<int>(tickettxiter->GetHeight()), currentHeight)
-                || (tx.vout[ticketStakeOutputIndex].nValue != currentStakeDifficulty)) {
-            auto txiter = mapTx.project<0>(tickettxiter);
-
-            txToRemove.insert(txiter);
+    AssertLockHeld(cs);
 
-            CalculateDescendants(txiter, txToRemove);
-        }
+    auto stageEntry = [&](txiter it) {
+        if (stage.count(it))
+            return;
+        stage.insert(it);
+        CalculateDescendants(it, stage);
+    };
+
+    // 1. tickets with 0 < nExpiry <= currentHeight + 1
+    auto& expiry_index = mapTx.get<stake_expiry>();
+    auto first = expiry_index.lower_bound(boost::make_tuple(TX_BuyTicket, 0u, 1u));
+    auto last = expiry_index.upper_bound(boost::make_tuple(TX_BuyTicket, 0u, static_cast<uint32_t>(currentHeight + 1)));
+    for (auto it = first; it != last; ++it)
+        stageEntry(mapTx.project<0>(it));
+
+    // 2. tickets without expiry that entered at most currentHeight - nMempoolResidence
+    if (nMempoolResidence >= 0 && currentHeight >= nMempoolResidence) {
+        first = expiry_index.lower_bound(boost::make_tuple(TX_BuyTicket, 0u, 0u));
+        last = expiry_index.upper_bound(boost::make_tuple(TX_BuyTicket, 0u, 0u, static_cast<unsigned int>(currentHeight - nMempoolResidence)));
+        for (auto it = first; it != last; ++it)
+            stageEntry(mapTx.project<0>(it));
     }
 
-    RemoveStaged(txToRemove, true, MemPoolRemovalReason::EXPIRY);
+    // 3. tickets priced below or above the current stake difficulty
+    auto& price_index = mapTx.get<ticket_price>();
+    const auto tickets = price_index.equal_range(TX_BuyTicket);
+    const auto current = price_index.equal_range(boost::make_tuple(TX_BuyTicket, currentStakeDifficulty));
+    for (auto it = tickets.first; it != current.first; ++it)
+        stageEntry(mapTx.project<0>(it));
+    for (auto it = current.second; it != tickets.second; ++it)
+        stageEntry(mapTx.project<0>(it));
 }
 
-void CTxMemPool::removeExpiredVotes(const int currentHeight, const Consensus::Params& params)
+void CTxMemPool::StageExpiredVotes(const int currentHeight, const Consensus::Params& params, setEntries &stage)
 {
     // When a vote is lingering in the mempool for longer that the specified delay,
     // it is removed as it cannot be useful anymore. All its mempool descendants are
     // also removed.
 
+    AssertLockHeld(cs);
+
+    // votes on blocks below currentHeight - nMempoolVoteExpiry
+    const uint32_t expiryHeight = static_cast<unsigned int>(currentHeight) - params.nMempoolVoteExpiry;
+    auto& expiry_index = mapTx.get<stake_expiry>();
+    auto first = expiry_index.lower_bound(boost::make_tuple(TX_Vote));
+    auto last = expiry_index.lower_bound(boost::make_tuple(TX_Vote, expiryHeight));
+    for (auto votetxiter = first; votetxiter != last; ++votetxiter) {
+        if (!IsHybridConsensusForkEnabled(static_cast<int>(votetxiter->GetHeight()), params))
+            continue;
+
+        // votes that could not be parsed have no voted block
+        if (votetxiter->GetVotedBlockHash().IsNull())
+            continue;
+
+        auto txiter = mapTx.project<0>(votetxiter);
+        if (stage.count(txiter))
+            continue;
+
+        stage.insert(txiter);
+
+        CalculateDescendants(txiter, stage);
+    }
+}
+
+void CTxMemPool::removeExpiredTickets(const int currentHeight, const CAmount currentStakeDifficulty, const Consensus::Params& params)
+{
     if (!IsHybridConsensusForkEnabled(currentHeight, params))
         return;
 
     LOCK(cs);
 
-    // get the votes
-    auto& tx_class_index = mapTx.get<tx_class>();
-    auto votes = tx_class_index.equal_range(ETxClass::TX_Vote);
-
     CTxMemPool::setEntries txToRemove;
-    for (auto votetxiter = votes.first; votetxiter != votes.second; ++votetxiter) {
-        if (!IsHybridConsensusForkEnabled(static_cast<int>(votetxiter->GetHeight()), params))
-            continue;
+    StageExpiredTickets(currentHeight, currentStakeDifficulty, txToRemove);
+    RemoveStaged(txToRemove, true, MemPoolRemovalReason::EXPIRY);
+}
 
-        VoteData voteData;
-        if (!ParseVote(votetxiter->GetTx(), voteData))
-            continue;
+void CTxMemPool::removeExpiredVotes(const int currentHeight, const Consensus::Params& params)
+{
+    if (!IsHybridConsensusForkEnabled(currentHeight, params))
+        return;
 
-        if (voteData.blockHeight < static_cast<unsigned int>(currentHeight) - params.nMempoolVoteExpiry) {
-            auto txiter = mapTx.project<0>(votetxiter);
+    LOCK(cs);
 
-            txToRemove.insert(txiter);
+    CTxMemPool::setEntries txToRemove;
+    StageExpiredVotes(currentHeight, params, txToRemove);
+    RemoveStaged(txToRemove, true, MemPoolRemovalReason::EXPIRY);
+}
 
-            CalculateDescendants(txiter, txToRemove);
-        }
-    }
+void CTxMemPool::removeExpiredStake(const int currentHeight, const CAmount currentStakeDifficulty, bool fVotes, const Consensus::Params& params)
+{
+    if (!IsHybridConsensusForkEnabled(currentHeight, params))
+        return;
+
+    LOCK(cs);
 
+    CTxMemPool::setEntries txToRemove;
+    StageExpiredTickets(currentHeight, currentStakeDifficulty, txToRemove);
+    if (fVotes)
+        StageExpiredVotes(currentHeight, params, txToRemove);
     RemoveStaged(txToRemove, true, MemPoolRemovalReason::EXPIRY);
 }
 
@@ -676,26 +745,20 @@ void CTxMemPool::removeVotesForBlock(const uint256& blockHash, const Consensus::
 {
     LOCK(cs);
 
-    // get the votes
-    auto& tx_class_index = mapTx.get<tx_class>();
-    auto votes = tx_class_index.equal_range(ETxClass::TX_Vote);
+    // get the votes on the block
+    auto& voted_hash_index = mapTx.get<voted_block_hash>();
+    auto votes = voted_hash_index.equal_range(blockHash);
 
     CTxMemPool::setEntries txToRemove;
     for (auto votetxiter = votes.first; votetxiter != votes.second; ++votetxiter) {
         if (!IsHybridConsensusForkEnabled(static_cast<int>(votetxiter->GetHeight()), params))
             continue;
 
-        VoteData voteData;
-        if (!ParseVote(votetxiter->GetTx(), voteData))
-            continue;
-
-        if (voteData.blockHash == blockHash) {
-            auto txiter = mapTx.project<0>(votetxiter);
+        auto txiter = mapTx.project<0>(votetxiter);
 
-            txToRemove.insert(txiter);
+        txToRemove.insert(txiter);
 
-            CalculateDescendants(txiter, txToRemove);
-        }
+        CalculateDescendants(txiter, txToRemove);
     }
 
     RemoveStaged(txToRemove, true, MemPoolRemovalReason::UNKNOWN);
@@ -714,11 +777,10 @@ void CTxMemPool::removeAllVotesExceptForBlock(const uint256& blockHash, const Co
         if (!IsHybridConsensusForkEnabled(static_cast<int>(votetxiter->GetHeight()), params))
             continue;
 
-        VoteData voteData;
-        if (!ParseVote(votetxiter->GetTx(), voteData))
+        if (votetxiter->GetVotedBlockHash().IsNull())
             continue;
 
-        if (voteData.blockHash != blockHash) {
+        if (votetxiter->GetVotedBlockHash() != blockHash) {
             auto txiter = mapTx.project<0>(votetxiter);
 
             txToRemove.insert(txiter);
@@ -730,6 +792,35 @@ void CTxMemPool::removeAllVotesExceptForBlock(const uint256& blockHash, const Co
     RemoveStaged(txToRemove, true, MemPoolRemovalReason::UNKNOWN);
 }
 
+bool CTxMemPool::existsTicketSpender(const uint256& ticketHash, ETxClass txClass) const
+{
+    LOCK(cs);
+    auto spenders = mapTx.get<spent_ticket_hash>().equal_range(ticketHash);
+    for (auto it = spenders.first; it != spenders.second; ++it)
+        if (it->GetTxClass() == txClass)
+            return true;
+    return false;
+}
+
+bool CTxMemPool::existsTicketOrConflict(const CTransaction& ticket) const
+{
+    LOCK(cs);
+    if (mapTx.count(ticket.GetHash()) != 0)
+        return true;
+
+    // spend same funding transaction?
+    std::string reason;
+    for (const CTxIn& txin : ticket.vin) {
+        auto it = mapNextTx.find(txin.prevout);
+        if (it == mapNextTx.end())
+            continue;
+        const CTransaction& spender = *it->second;
+        if (ParseTxClass(spender) == TX_BuyTicket && ValidateBuyTicketStructure(spender, reason))
+            return true;
+    }
+    return false;
+}
+
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
@@ -741,6 +832,7 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    ++nNonAdditiveUpdates;
 }
 
 void CTxMemPool::clear()
@@ -1005,6 +1097,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
+            ++nNonAdditiveUpdates;
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -1065,7 +1158,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 21 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -82,6 +82,10 @@ private:
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
     ETxClass txClass;
+    uint256 votedBlockHash;    //!< Block voted on, for votes
+    uint32_t votedBlockHeight; //!< Height of the block voted on, for votes
+    uint256 spentTicketHash;   //!< Ticket spent, for votes and revocations
+    CAmount ticketPrice;       //!< Stake paid, for tickets
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -114,6 +118,11 @@ public:
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
     ETxClass GetTxClass() const { return txClass; }
+    const uint256& GetVotedBlockHash() const { return votedBlockHash; }
+    uint32_t GetVotedBlockHeight() const { return votedBlockHeight; }
+    const uint256& GetSpentTicketHash() const { return spentTicketHash; }
+    CAmount GetTicketPrice() const { return ticketPrice; }
+    uint32_t GetExpiry() const { return tx->nExpiry; }
 
     // Adjusts the descendant state.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
@@ -213,11 +222,17 @@ struct mempoolentry_voted_blockHash
     typedef uint256 result_type;
     result_type operator() (const CTxMemPoolEntry &entry) const
     {
-        VoteData vote;
-        if (!ParseVote(entry.GetTx(), vote)) 
-            return uint256{};
+        return entry.GetVotedBlockHash();
+    }
+};
 
-        return vote.blockHash;
+// extracts the hash of the ticket spent by a vote or a revocation from CTxMempoolEntry
+struct mempoolentry_spent_ticketHash
+{
+    typedef uint256 result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        return entry.GetSpentTicketHash();
     }
 };
 
@@ -374,6 +389,9 @@ struct mining_score {};
 struct ancestor_score {};
 struct tx_class {};
 struct voted_block_hash {};
+struct spent_ticket_hash {};
+struct stake_expiry {};
+struct ticket_price {};
 
 class CBlockPolicyEstimator;
 
@@ -502,6 +520,7 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    unsigned int nNonAdditiveUpdates; //!< Counts changes other than additions; used by getblocktemplate to decide whether a template can be extended
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
@@ -552,6 +571,12 @@ public:
                 mempoolentry_voted_blockHash,
                 SaltedTxidHasher
             >,
+            // sorted by the ticket spent by votes and revocations
+            boost::multi_index::hashed_non_unique<
+                boost::multi_index::tag<spent_ticket_hash>,
+                mempoolentry_spent_ticketHash,
+                SaltedTxidHasher
+            >,
             // sorted by TxClass
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::tag<tx_class>,
@@ -564,6 +589,27 @@ public:
                     std::less<ETxClass>,
                     CallCompareTxMemPoolEntryByTxClass
                 >
+            >,
+            // sorted by what makes stake transactions expire: the voted block
+            // height for votes, the expiry or else the entry height for tickets
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<stake_expiry>,
+                boost::multi_index::composite_key<
+                    CTxMemPoolEntry,
+                    boost::multi_index::const_mem_fun<CTxMemPoolEntry,ETxClass,&CTxMemPoolEntry::GetTxClass>,
+                    boost::multi_index::const_mem_fun<CTxMemPoolEntry,uint32_t,&CTxMemPoolEntry::GetVotedBlockHeight>,
+                    boost::multi_index::const_mem_fun<CTxMemPoolEntry,uint32_t,&CTxMemPoolEntry::GetExpiry>,
+                    boost::multi_index::const_mem_fun<CTxMemPoolEntry,unsigned int,&CTxMemPoolEntry::GetHeight>
+                >
+            >,
+            // sorted by ticket price, for tickets
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<ticket_price>,
+                boost::multi_index::composite_key<
+                    CTxMemPoolEntry,
+                    boost::multi_index::const_mem_fun<CTxMemPoolEntry,ETxClass,&CTxMemPoolEntry::GetTxClass>,
+                    boost::multi_index::const_mem_fun<CTxMemPoolEntry,CAmount,&CTxMemPoolEntry::GetTicketPrice>
+                >
             >
         >
     > indexed_transaction_set;
@@ -629,6 +675,8 @@ public:
     void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight);
     void removeExpiredTickets(const int currentHeight, const CAmount currentStakeDifficulty, const Consensus::Params& params);
     void removeExpiredVotes(const int currentHeight, const Consensus::Params& params);
+    /** Remove expired tickets and, if fVotes, expired votes in a single pass over the expiring entries only */
+    void removeExpiredStake(const int currentHeight, const CAmount currentStakeDifficulty, bool fVotes, const Consensus::Params& params);
     void removeVotesForBlock(const uint256& blockHash, const Consensus::Params& params);
     void removeAllVotesExceptForBlock(const uint256& blockHash, const Consensus::Params& params);
 
@@ -637,8 +685,13 @@ public:
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
     void queryHashes(std::vector<uint256>& vtxid);
     bool isSpent(const COutPoint& outpoint);
+    /** Whether a transaction of class txClass (TX_Vote or TX_RevokeTicket) spending the ticket is in the pool */
+    bool existsTicketSpender(const uint256& ticketHash, ETxClass txClass) const;
+    /** Whether the ticket, or another ticket spending any of its inputs, is in the pool */
+    bool existsTicketOrConflict(const CTransaction& ticket) const;
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    unsigned int GetNonAdditiveUpdates() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -695,6 +748,12 @@ public:
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries &setDescendants);
 
+    /** Add the tickets that expire on top of currentHeight, or are priced
+     *  other than currentStakeDifficulty, and their descendants to stage. */
+    void StageExpiredTickets(const int currentHeight, const CAmount currentStakeDifficulty, setEntries &stage);
+    /** Add the votes that are too old on top of currentHeight, and their descendants to stage. */
+    void StageExpiredVotes(const int currentHeight, const Consensus::Params& params, setEntries &stage);
+
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
       *  The incrementalRelayFee policy variable is used to bound the time it
@@ -85,6 +85,7 @@ std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
 bool fAddrIndex = false;
+bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -151,6 +152,10 @@ namespace {
      * Pruned nodes may have entries where B is missing data.
      */
     std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
+    /** All CBlockIndex entries that no other entry builds on. Together with
+     * chainActive.Tip() these are the chain tips reported by GetChainTips.
+     */
+    std::set<CBlockIndex*> setBlockIndexLeaves;
 
     CCriticalSection cs_LastBlockFile;
     std::vector<CBlockFileInfo> vinfoBlockFile;
@@ -1029,8 +1034,76 @@ bool ReadTransaction(CTransactionRef& tx, const CDiskTxPos &pos, uint256 &hashBl
     return true;
 }
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos) {
-    uint160 addrid;
+bool ReadTransactionsAtOffsets(const CDiskBlockPos& pos, const std::set<unsigned int>& setTxOffsets, std::vector<std::pair<int, CTransactionRef>>& vtx, uint256& hashBlock) {
+    CAutoFile file(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    CBlockHeader header;
+    try {
+        file >> header;
+        // The offsets are relative to the end of the header, the transactions
+        // before the last wanted one are read to learn their positions.
+        uint64_t nTx = ReadCompactSize(file);
+        unsigned int nOffset = GetSizeOfCompactSize(nTx);
+        for (uint64_t i = 0; i < nTx && !setTxOffsets.empty() && nOffset <= *setTxOffsets.rbegin(); i++) {
+            CTransactionRef tx;
+            file >> tx;
+            if (setTxOffsets.count(nOffset))
+                vtx.emplace_back(i, tx);
+            nOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+        }
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
+// Index either: a) every data push >=8 bytes,  b) if no such pushes, the entire script
+static void GetAddrIndexIds(const CScript &script, std::vector<uint160> &vIds)
+{
+    CScript::const_iterator pc = script.begin();
+    CScript::const_iterator pend = script.end();
+    std::vector<unsigned char> data;
+    opcodetype opcode;
+    bool fHaveData = false;
+    while (pc < pend) {
+        script.GetOp(pc, opcode, data);
+        if (0 <= opcode && opcode <= OP_PUSHDATA4 && data.size() >= 8) { // data element
+            uint160 addrid;
+            if (data.size() <= 20) {
+                memcpy(&addrid, &data[0], data.size());
+            } else {
+                addrid = Hash160(data);
+            }
+            vIds.push_back(addrid);
+            fHaveData = true;
+        }
+    }
+    if (!fHaveData) {
+        uint160 addrid = Hash160(script);
+        vIds.push_back(addrid);
+    }
+}
+
+bool FindTransactionsByScript(const CScript& script, std::set<CExtDiskTxPos>& setpos) {
+    std::vector<uint160> vIds;
+    GetAddrIndexIds(script, vIds);
+
+    LOCK(cs_main);
+    if (!fAddrIndex)
+        return false;
+    for (const uint160& addrid : vIds) {
+        std::vector<CExtDiskTxPos> vPos;
+        if (!pblocktree->ReadAddrIndex(addrid, vPos))
+            return false;
+        setpos.insert(vPos.begin(), vPos.end());
+    }
+    return true;
+}
+
+static bool GetAddrIndexId(const CTxDestination &dest, uint160 &addrid) {
+    addrid.SetNull();
     const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
     if (pkeyid)
             addrid = static_cast<uint160>(*pkeyid);
@@ -1039,17 +1112,72 @@ bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDisk
         if (pscriptid)
             addrid = static_cast<uint160>(*pscriptid);
         }
-    if (addrid.IsNull())
+    return !addrid.IsNull();
+}
+
+bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos) {
+    std::vector<CExtDiskTxPos> vPos;
+    if (!FindTransactionsByDestination(dest, vPos))
+        return false;
+    setpos.insert(vPos.begin(), vPos.end());
+    return true;
+}
+
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<CExtDiskTxPos> &vPos, size_t nSkip, size_t nCount, const CExtDiskTxPos *pafter, bool fReverse) {
+    uint160 addrid;
+    if (!GetAddrIndexId(dest, addrid))
         return false;
 
     LOCK(cs_main);
     if (!fAddrIndex)
         return false;
-    std::vector<CExtDiskTxPos> vPos;
-    if (!pblocktree->ReadAddrIndex(addrid, vPos))
+    return pblocktree->ReadAddrIndex(addrid, vPos, nSkip, nCount, pafter, fReverse);
+}
+
+bool GetAddressBalance(const CTxDestination &dest, CAddrIndexBalance &balance) {
+    uint160 addrid;
+    if (!GetAddrIndexId(dest, addrid))
         return false;
-    setpos.insert(vPos.begin(), vPos.end());
-    return true;
+
+    LOCK(cs_main);
+    if (!fAddrIndex)
+        return false;
+    return pblocktree->ReadAddrIndexBalance(addrid, balance);
+}
+
+bool GetAddressUnspent(const CTxDestination &dest, std::vector<std::pair<COutPoint, CAddrIndexUnspent> > &vUnspent) {
+    uint160 addrid;
+    if (!GetAddrIndexId(dest, addrid))
+        return false;
+
+    LOCK(cs_main);
+    if (!fAddrIndex)
+        return false;
+    return pblocktree->ReadAddrIndexUnspent(addrid, vUnspent);
+}
+
+bool GetSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value) {
+    LOCK(cs_main);
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(outpoint, value);
+}
+
+bool GetSpentOutput(const COutPoint &outpoint, CTxOut &out) {
+    LOCK(cs_main);
+    if (!fSpentIndex)
+        return false;
+    CSpentIndexValue spent;
+    if (pblocktree->ReadSpentIndex(outpoint, spent)) {
+        out = spent.out;
+        return true;
+    }
+    Coin coin;
+    if (pcoinsTip->GetCoin(outpoint, coin)) {
+        out = coin.out;
+        return true;
+    }
+    return false;
 }
 
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
@@ -1188,6 +1316,55 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos hpos = pindex->GetBlockPos();
+    // Rewind to the start of the index header written by WriteBlockToDisk
+    if (hpos.nPos < 8)
+        return error("%s: Invalid block position %s", __func__, hpos.ToString());
+    hpos.nPos -= 8;
+
+    // Open history file to read
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, hpos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        unsigned int blk_size;
+
+        filein >> FLATDATA(blk_start) >> blk_size;
+
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s", __func__, pindex->GetBlockPos().ToString());
+        }
+
+        if (blk_size > MAX_BLOCK_SERIALIZED_SIZE) {
+            return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s",
+                    __func__, pindex->GetBlockPos().ToString(), blk_size, MAX_BLOCK_SERIALIZED_SIZE);
+        }
+
+        // Only the header is deserialized, to make sure the data is the
+        // requested block, then the whole block is read as is.
+        CBlockHeader header;
+        filein >> header;
+        if (header.GetHash() != pindex->GetBlockHash()) {
+            return error("%s: GetHash() doesn't match index for %s at %s", __func__,
+                    pindex->ToString(), pindex->GetBlockPos().ToString());
+        }
+        if (fseek(filein.Get(), pindex->GetBlockPos().nPos, SEEK_SET)) {
+            return error("%s: fseek failed for %s", __func__, pindex->GetBlockPos().ToString());
+        }
+
+        block.resize(blk_size);
+        filein.read((char*)block.data(), blk_size);
+    } catch (const std::exception& e) {
+        return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+    }
+
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1580,6 +1757,14 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+static void GetScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags, uint256& hashCacheEntry)
+{
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1617,10 +1802,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             // properly commits to the scriptPubKey in the inputs view of that
             // transaction).
             uint256 hashCacheEntry;
-            // We only use the first 19 bytes of nonce to avoid a second SHA
-            // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            GetScriptExecutionCacheEntry(tx, flags, hashCacheEntry);
             AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
             if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
                 return true;
@@ -1678,6 +1860,100 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     return true;
 }
 
+void PrevalidateTransaction(CTxMemPool& pool, const CTransactionRef& ptx)
+{
+    const CTransaction& tx = *ptx;
+    CValidationState state;
+    if (tx.IsCoinBase() || !CheckTransaction(tx, state))
+        return;
+
+    const ETxClass txClass = ParseTxClass(tx);
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+
+    // Copy the inputs, and find which of the script executions done by
+    // AcceptToMemoryPool are not cached yet.
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    std::vector<unsigned int> vFlags;
+    {
+        LOCK2(cs_main, pool.cs);
+        if (pool.exists(tx.GetHash()))
+            return;
+
+        // The policy checks of AcceptToMemoryPool are much cheaper than the
+        // scripts, don't verify those of a transaction it will reject anyway.
+        const bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus());
+        if (!gArgs.GetBoolArg("-prematurewitness", false) && tx.HasWitness() && !witnessEnabled)
+            return;
+        std::string reason;
+        if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
+            return;
+        if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
+            return;
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        view.SetBackend(viewMemPool);
+        std::vector<COutPoint> coins_to_uncache;
+        bool fHaveInputs = true;
+        for (size_t in = 0; in < tx.vin.size() && fHaveInputs; ++in) {
+            if (txClass == TX_Vote && in == voteSubsidyInputIndex)
+                continue; //skip the stakebase as coin doesn't exist
+
+            const COutPoint& prevout = tx.vin[in].prevout;
+            if (!pcoinsTip->HaveCoinInCache(prevout))
+                coins_to_uncache.push_back(prevout);
+            fHaveInputs = view.HaveCoin(prevout);
+        }
+        view.SetBackend(dummy);
+        // Leave the coins cache as it was, AcceptToMemoryPool accounts for
+        // the coins it brings in itself.
+        for (const COutPoint& prevout : coins_to_uncache)
+            pcoinsTip->Uncache(prevout);
+        if (!fHaveInputs)
+            return;
+        if (fRequireStandard && (!AreInputsStandard(tx, view) || (tx.HasWitness() && !IsWitnessStandard(tx, view))))
+            return;
+
+        for (unsigned int flags : {scriptVerifyFlags, GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus())}) {
+            uint256 hashCacheEntry;
+            GetScriptExecutionCacheEntry(tx, flags, hashCacheEntry);
+            if (!scriptExecutionCache.contains(hashCacheEntry, false) && std::find(vFlags.begin(), vFlags.end(), flags) == vFlags.end())
+                vFlags.push_back(flags);
+        }
+    }
+
+    // Verify the scripts without holding any lock, the signatures land in
+    // the signature cache as they are checked.
+    PrecomputedTransactionData txdata(tx);
+    const unsigned int startInput = txClass == TX_Vote ? voteStakeInputIndex : 0;
+    auto VerifyScripts = [&](unsigned int flags) {
+        for (unsigned int i = startInput; i < tx.vin.size(); i++) {
+            CScriptCheck check(view.AccessCoin(tx.vin[i].prevout).out, tx, i, flags, true, &txdata);
+            if (!check())
+                return false;
+        }
+        return true;
+    };
+    std::vector<unsigned int> vVerifiedFlags;
+    for (unsigned int flags : vFlags) {
+        if (!VerifyScripts(flags))
+            break;
+        vVerifiedFlags.push_back(flags);
+    }
+
+    if (vVerifiedFlags.empty())
+        return;
+    LOCK(cs_main);
+    for (unsigned int flags : vVerifiedFlags) {
+        uint256 hashCacheEntry;
+        GetScriptExecutionCacheEntry(tx, flags, hashCacheEntry);
+        scriptExecutionCache.insert(hashCacheEntry);
+    }
+}
+
 namespace {
 
 
@@ -1947,7 +2223,9 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-static bool DisconnectDisapprovedTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool)
+static bool DisconnectAddrIndex(const CBlock& block, const CBlockIndex* pindex, bool fOnlyRegularTxs = false);
+
+static bool DisconnectDisapprovedTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions *disconnectpool, bool fJustCheck)
 {
     CBlockIndex *pindexDisapproved = chainActive.Tip();
     assert(pindexDisapproved);
@@ -1963,6 +2241,9 @@ static bool DisconnectDisapprovedTip(CValidationState& state, const CChainParams
     bool flushed = view.Flush();
     assert(flushed);
 
+    if (fAddrIndex && !fJustCheck && !DisconnectAddrIndex(block, pindexDisapproved, true))
+        return AbortNode(state, "Failed to write address index");
+
     assert (disconnectpool != nullptr);
 
     for ( auto it = block.vtx.crbegin(); it != block.vtx.crend(); ++it ) {
@@ -2097,39 +2378,138 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
-// Index either: a) every data push >=8 bytes,  b) if no such pushes, the entire script
-void static BuildAddrIndex(const CScript &script, const CExtDiskTxPos &pos, std::vector<std::pair<uint160, CExtDiskTxPos> > &out)
+/**
+ * Collect the changes a block makes to the address index, reading the coins it spends from its undo data.
+ * With fOnlyRegularTxs, only those of its regular transaction tree are collected.
+ */
+static void BuildAddrIndexDelta(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, CAddrIndexDelta& delta, bool fOnlyRegularTxs = false)
 {
-    CScript::const_iterator pc = script.begin();
-    CScript::const_iterator pend = script.end();
-    std::vector<unsigned char> data;
-    opcodetype opcode;
-    bool fHaveData = false;
-    while (pc < pend) {
-        script.GetOp(pc, opcode, data);
-        if (0 <= opcode && opcode <= OP_PUSHDATA4 && data.size() >= 8) { // data element
-            uint160 addrid;
-            if (data.size() <= 20) {
-                memcpy(&addrid, &data[0], data.size());
-            } else {
-                addrid = Hash160(data);
+    CExtDiskTxPos pos(CDiskTxPos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())), pindex->nHeight);
+    std::vector<uint160> vIds;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *(block.vtx[i]);
+
+        if (fOnlyRegularTxs && (i == 0 || ParseTxClass(tx) != TX_Regular)) {
+            pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+            continue;
+        }
+
+        if (i > 0) {
+            // first vin of a vote is the stakebase, which has no undo data, see UpdateCoins
+            const unsigned int startInput = ParseTxClass(tx) == TX_Vote ? voteStakeInputIndex : 0;
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = startInput; j < tx.vin.size() && j - startInput < txundo.vprevout.size(); j++) {
+                const Coin& coin = txundo.vprevout[j - startInput];
+                vIds.clear();
+                GetAddrIndexIds(coin.out.scriptPubKey, vIds);
+                for (const uint160& addrid : vIds) {
+                    delta.setTx.insert(std::make_pair(addrid, pos));
+                    delta.mapBalance[addrid].nSpent += coin.out.nValue;
+                    delta.mapSpent[std::make_pair(addrid, tx.vin[j].prevout)] = CAddrIndexUnspent(coin.out.nValue, coin.nHeight);
+                }
             }
-            out.push_back(std::make_pair(addrid, pos));
-            fHaveData = true;
         }
+
+        for (unsigned int n = 0; n < tx.vout.size(); n++) {
+            const CTxOut &txout = tx.vout[n];
+            vIds.clear();
+            GetAddrIndexIds(txout.scriptPubKey, vIds);
+            for (const uint160& addrid : vIds) {
+                delta.setTx.insert(std::make_pair(addrid, pos));
+                delta.mapBalance[addrid].nReceived += txout.nValue;
+                if (!txout.scriptPubKey.IsUnspendable())
+                    delta.mapCreated[std::make_pair(addrid, COutPoint(tx.GetHash(), n))] = CAddrIndexUnspent(txout.nValue, pindex->nHeight);
+            }
+        }
+
+        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
-    if (!fHaveData) {
-        uint160 addrid = Hash160(script);
-        out.push_back(std::make_pair(addrid, pos));
+
+    // Ticket purchases may spend outputs of later transactions of the block,
+    // so outputs spent within the block are only netted out once all are known
+    for (auto it = delta.mapSpent.begin(); it != delta.mapSpent.end();) {
+        if (delta.mapCreated.erase(it->first))
+            it = delta.mapSpent.erase(it);
+        else
+            ++it;
+    }
+}
+
+/** Add a connected block to the address index, unless the index already has it */
+static bool ConnectAddrIndex(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo)
+{
+    uint256 hashTip;
+    if (!pblocktree->ReadAddrIndexTip(hashTip))
+        return false;
+    if (!hashTip.IsNull() && (pindex->pprev == nullptr || hashTip != pindex->pprev->GetBlockHash())) {
+        // The index is written directly while the chainstate is flushed lazily,
+        // so blocks connected again after a crash may be in the index already
+        BlockMap::const_iterator it = mapBlockIndex.find(hashTip);
+        if (it != mapBlockIndex.end() && it->second->GetAncestor(pindex->nHeight) == pindex)
+            return true;
+        return error("%s: address index at %s does not precede block %s, restart with -reindex", __func__, hashTip.ToString(), pindex->GetBlockHash().ToString());
     }
+
+    CAddrIndexDelta delta;
+    BuildAddrIndexDelta(block, pindex, blockundo, delta);
+    return pblocktree->UpdateAddrIndex(delta, true, pindex->GetBlockHash());
+}
+
+/**
+ * Remove a disconnected block from the address index, if the index has it at its tip.
+ * With fOnlyRegularTxs, only its regular transaction tree is removed, as when the next
+ * block disapproves it, and the block stays the tip of the index.
+ */
+static bool DisconnectAddrIndex(const CBlock& block, const CBlockIndex* pindex, bool fOnlyRegularTxs)
+{
+    uint256 hashTip;
+    if (!pblocktree->ReadAddrIndexTip(hashTip))
+        return false;
+    if (hashTip != pindex->GetBlockHash())
+        return true;
+
+    CBlockUndo blockundo;
+    if (!UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+        return error("%s: failure reading undo data", __func__);
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent", __func__);
+
+    CAddrIndexDelta delta;
+    BuildAddrIndexDelta(block, pindex, blockundo, delta, fOnlyRegularTxs);
+    return pblocktree->UpdateAddrIndex(delta, false, fOnlyRegularTxs ? pindex->GetBlockHash() : pindex->pprev->GetBlockHash());
+}
+
+/** Collect the outputs a block spends, read from its undo data, for the spent index */
+static void BuildSpentIndex(const CBlock& block, const CBlockIndex* pindex, const CBlockUndo& blockundo, std::vector<std::pair<COutPoint, CSpentIndexValue> >& vSpent)
+{
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *(block.vtx[i]);
+        const unsigned int startInput = ParseTxClass(tx) == TX_Vote ? voteStakeInputIndex : 0;
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (unsigned int j = startInput; j < tx.vin.size() && j - startInput < txundo.vprevout.size(); j++)
+            vSpent.push_back(std::make_pair(tx.vin[j].prevout, CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, txundo.vprevout[j - startInput].out)));
+    }
+}
+
+/** Remove the outputs spent by a disconnected block from the spent index */
+static bool DisconnectSpentIndex(const CBlock& block)
+{
+    std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *(block.vtx[i]);
+        const unsigned int startInput = ParseTxClass(tx) == TX_Vote ? voteStakeInputIndex : 0;
+        for (unsigned int j = startInput; j < tx.vin.size(); j++)
+            vSpent.push_back(std::make_pair(tx.vin[j].prevout, CSpentIndexValue()));
+    }
+    return pblocktree->UpdateSpentIndex(vSpent, false);
 }
 
 bool AddressExistsInIndex(const std::string& address)
 {
     CTxDestination addrAsDest = DecodeDestination(address);
 
-    std::set<CExtDiskTxPos> addressPositions;
-    auto addressFound = FindTransactionsByDestination(addrAsDest, addressPositions);
+    std::vector<CExtDiskTxPos> addressPositions;
+    auto addressFound = FindTransactionsByDestination(addrAsDest, addressPositions, 0, 1);
     return (addressFound && !addressPositions.empty());
 }
 
@@ -2243,7 +2623,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     if (pindex->nHeight > 1 && !pindex->nVoteBits.isRttAccepted()) {
         DisconnectedBlockTransactions disconnectedPool;
-        if (!DisconnectDisapprovedTip(state,chainparams, &disconnectedPool)){
+        if (!DisconnectDisapprovedTip(state,chainparams, &disconnectedPool, fJustCheck)){
             UpdateMempoolForReorg(disconnectedPool, false);
         }
         else {
@@ -2268,11 +2648,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     CExtDiskTxPos pos(CDiskTxPos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size())), pindex->nHeight);
     std::vector<std::pair<uint256, CDiskTxPos> > vPosTxid;
-    std::vector<std::pair<uint160, CExtDiskTxPos> > vPosAddrid;
     if (fTxIndex)
         vPosTxid.reserve(block.vtx.size());
-    if (fAddrIndex)
-        vPosAddrid.reserve(4*block.vtx.size());
 
     blockundo.vtxundo.resize(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
@@ -2351,22 +2728,11 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             UpdateCoins(tx, view, reorderedIndexes[i] == 0 ? undoDummy : blockundo.vtxundo[reorderedIndexes[i]-1], pindex->nHeight);
         }
         {
-            // while we may check inputs in a different order we need to keep the same order for saving txIndex and addrIndex
+            // while we may check inputs in a different order we need to keep the same order for saving txIndex
             const CTransaction &tx = *(block.vtx[i]);
 
             if (fTxIndex)
                 vPosTxid.push_back(std::make_pair(tx.GetHash(), pos));
-            if (fAddrIndex) {
-                if (!tx.IsCoinBase()) {
-                    for (const CTxIn &txin : tx.vin) {
-                        Coin coin;
-                        view.GetCoin(txin.prevout, coin);
-                        BuildAddrIndex(coin.out.scriptPubKey, pos, vPosAddrid);
-                    }
-                }
-                for (const CTxOut &txout : tx.vout)
-                BuildAddrIndex(txout.scriptPubKey, pos, vPosAddrid);
-            }
 
             pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
         }
@@ -2445,9 +2811,16 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             return AbortNode(state, "Failed to write transaction index");
 
     if (fAddrIndex)
-        if (!pblocktree->AddAddrIndex(vPosAddrid))
+        if (!ConnectAddrIndex(block, pindex, blockundo))
             return AbortNode(state, "Failed to write address index");
 
+    if (fSpentIndex) {
+        std::vector<std::pair<COutPoint, CSpentIndexValue> > vSpent;
+        BuildSpentIndex(block, pindex, blockundo, vSpent);
+        if (!pblocktree->UpdateSpentIndex(vSpent, true))
+            return AbortNode(state, "Failed to write spent index");
+    }
+
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2678,6 +3051,10 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
         if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        if (fAddrIndex && !DisconnectAddrIndex(block, pindexDelete))
+            return AbortNode(state, "Failed to write address index");
+        if (fSpentIndex && !DisconnectSpentIndex(block))
+            return AbortNode(state, "Failed to write spent index");
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -3121,12 +3498,8 @@ bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams,
         stakeDifficulty = CalculateNextRequiredStakeDifficulty(chainActive.Tip(), consensus);
     }
 
-    // remove expired ticket transactions
-    mempool.removeExpiredTickets(height, stakeDifficulty, consensus);
-
-    // remove expired mempool votes
-    if (fDiscardExpiredMempoolVotes)
-        mempool.removeExpiredVotes(height, consensus);
+    // remove expired ticket transactions and expired mempool votes
+    mempool.removeExpiredStake(height, stakeDifficulty, fDiscardExpiredMempoolVotes, consensus);
 
     // notify wallet and other interested listeners.
     // This should go after the mempool cleanup above, since the wallet
@@ -3341,9 +3714,12 @@ static CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
+        setBlockIndexLeaves.erase(pindexNew->pprev);
     }
+    setBlockIndexLeaves.insert(pindexNew);
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+    pindexNew->BuildChainStakeCounts();
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
@@ -3856,12 +4232,10 @@ static bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationSta
 // they spend tickets that are actually allowed to vote per the lottery.
 static bool checkAllowedVotes(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
-    auto winningHashes = pindexPrev->pstakeNode->Winners();
-
     for (const auto& tx : StakeSlice(block.vtx, TX_Vote))
     {
         const auto& ticketHash = tx->vin[voteStakeInputIndex].prevout.hash;
-        if (std::find(winningHashes.begin(), winningHashes.end(), ticketHash) == winningHashes.end())
+        if (!pindexPrev->pstakeNode->ExistsWinner(ticketHash))
             return false;
     }
 
@@ -4541,7 +4915,12 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        pindex->BuildChainStakeCounts();
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        // Parents come first, so they are removed from the leaves by their children
+        if (pindex->pprev)
+            setBlockIndexLeaves.erase(pindex->pprev);
+        setBlockIndexLeaves.insert(pindex);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -4650,6 +5029,9 @@ bool LoadChainTip(const CChainParams& chainparams)
     pblocktree->ReadFlag("addrindex", fAddrIndex);
     LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddrIndex ? "enabled" : "disabled");
 
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -4840,6 +5222,12 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view)
             if (res == DISCONNECT_FAILED) {
                 return error("RollbackBlock(): DisconnectBlock failed at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
             }
+            if (fAddrIndex && !DisconnectAddrIndex(block, pindexOld)) {
+                return error("RollbackBlock(): failed to update the address index at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+            }
+            if (fSpentIndex && !DisconnectSpentIndex(block)) {
+                return error("RollbackBlock(): failed to update the spent index at %d, hash=%s", pindexOld->nHeight, pindexOld->GetBlockHash().ToString());
+            }
             // If DISCONNECT_UNCLEAN is returned, it means a non-existing UTXO was deleted, or an existing UTXO was
             // overwritten. It corresponds to cases where the block-to-be-disconnect never had all its operations
             // applied to the UTXO set. However, as both writing a UTXO and deleting a UTXO are idempotent operations,
@@ -4967,6 +5355,7 @@ void UnloadBlockIndex()
     pindexBestHeader = nullptr;
     mempool.clear();
     mapBlocksUnlinked.clear();
+    setBlockIndexLeaves.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
@@ -5008,6 +5397,9 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         pblocktree->WriteFlag("txindex", fTxIndex);
         fAddrIndex = gArgs.GetBoolArg("-addrindex", DEFAULT_ADDRINDEX);
         pblocktree->WriteFlag("addrindex", fAddrIndex);
+        pblocktree->WriteFlag("addrindexbalances", fAddrIndex);
+        fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+        pblocktree->WriteFlag("spentindex", fSpentIndex);
     }
     return true;
 }
@@ -5701,32 +6093,23 @@ std::shared_ptr<StakeNode> FetchStakeNode(CBlockIndex* pindex, const Consensus::
     return pindex->pstakeNode;
 }
 
-std::set<CBlockIndex*, CompareBlocksByHeight> GetChainTips()
+std::set<CBlockIndex*, CompareBlocksByHeight> GetChainTips(int nMaxDepth)
 {
     /*
-     * Idea:  the set of chain tips is chainActive.tip, plus orphan blocks which do not have another orphan building off of them.
-     * Algorithm:
-     *  - Make one pass through mapBlockIndex, picking out the orphan blocks, and also storing a set of the orphan block's pprev pointers.
-     *  - Iterate through the orphan blocks. If the block isn't pointed to by another orphan, it is a chain tip.
-     *  - add chainActive.Tip()
+     * The set of chain tips is chainActive.tip, plus the blocks which do not
+     * have another block building off of them; the latter are maintained in
+     * setBlockIndexLeaves as headers are added to mapBlockIndex.
      */
     std::set<CBlockIndex*, CompareBlocksByHeight> setTips;
-    std::set<CBlockIndex*> setOrphans;
-    std::set<const CBlockIndex*> setPrevs;
 
-    for (const auto& item : mapBlockIndex)
-    {
-        if (!chainActive.Contains(item.second)) {
-            setOrphans.insert(item.second);
-            setPrevs.insert(item.second->pprev);
-        }
-    }
+    int nMinHeight = std::numeric_limits<int>::min();
+    if (nMaxDepth >= 0 && chainActive.Tip() != nullptr)
+        nMinHeight = chainActive.Height() - nMaxDepth;
 
-    for (auto it = setOrphans.begin(); it != setOrphans.end(); ++it)
+    for (CBlockIndex* pindex : setBlockIndexLeaves)
     {
-        if (setPrevs.erase(*it) == 0) {
-            setTips.insert(*it);
-        }
+        if (pindex->nHeight >= nMinHeight)
+            setTips.insert(pindex);
     }
 
     // Always report the currently active tip.
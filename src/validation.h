@@ -138,6 +138,7 @@ static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
 static const bool DEFAULT_ADDRINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -184,6 +185,7 @@ extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fAddrIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -345,6 +347,17 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/**
+ * Run the context free and script checks of a transaction ahead of
+ * AcceptToMemoryPool, holding cs_main only to look up its inputs and to
+ * record the results. The script executions are cached, so the following
+ * AcceptToMemoryPool call is left with the policy checks and the insertion.
+ * The scripts of transactions failing the standardness and finality checks
+ * are not run. Nothing is cached for invalid transactions, their rejection is
+ * left to AcceptToMemoryPool.
+ */
+void PrevalidateTransaction(CTxMemPool& pool, const CTransactionRef& tx);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -432,8 +445,24 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized block as stored on disk, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 bool ReadTransaction(CTransactionRef& tx, const CDiskTxPos &pos, uint256 &hashBlock);
+/** Read the transactions at the given offsets of a block, along with their position in it */
+bool ReadTransactionsAtOffsets(const CDiskBlockPos& pos, const std::set<unsigned int>& setTxOffsets, std::vector<std::pair<int, CTransactionRef>>& vtx, uint256& hashBlock);
 bool FindTransactionsByDestination(const CTxDestination &dest, std::set<CExtDiskTxPos> &setpos);
+/** Read a page of the transactions of an address in chain order, see CBlockTreeDB::ReadAddrIndex */
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<CExtDiskTxPos> &vPos, size_t nSkip = 0, size_t nCount = std::numeric_limits<size_t>::max(), const CExtDiskTxPos *pafter = nullptr, bool fReverse = false);
+/** Totals received and spent by an address, according to the address index */
+bool GetAddressBalance(const CTxDestination &dest, CAddrIndexBalance &balance);
+/** Unspent outputs of an address, according to the address index */
+bool GetAddressUnspent(const CTxDestination &dest, std::vector<std::pair<COutPoint, CAddrIndexUnspent> > &vUnspent);
+/** Look up a spent output and its spending transaction in the spent index */
+bool GetSpentIndex(const COutPoint &outpoint, CSpentIndexValue &value);
+/** Look up the output an input spends, in the spent index or else the UTXO set, when the spent index is enabled */
+bool GetSpentOutput(const COutPoint &outpoint, CTxOut &out);
+/** Find the transactions spending or creating outputs with the given script in the address index */
+bool FindTransactionsByScript(const CScript& script, std::set<CExtDiskTxPos>& setpos);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -552,6 +581,9 @@ struct CompareBlocksByHeight
 };
 
 /** Get the set of chain tips */
-std::set<CBlockIndex*, CompareBlocksByHeight> GetChainTips();
+/** Return the chain tips, i.e. the active tip and all blocks without successors.
+ *  If nMaxDepth is not negative, only the tips at most nMaxDepth blocks below
+ *  the active tip are returned. Requires cs_main. */
+std::set<CBlockIndex*, CompareBlocksByHeight> GetChainTips(int nMaxDepth = -1);
 
 #endif // BWSCOIN_VALIDATION_H
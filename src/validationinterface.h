@@ -6,6 +6,7 @@
 #ifndef BWSCOIN_VALIDATIONINTERFACE_H
 #define BWSCOIN_VALIDATIONINTERFACE_H
 
+#include <functional>
 #include <memory>
 
 #include "primitives/transaction.h" // CTransaction(Ref)
@@ -29,6 +30,12 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/**
+ * Pushes a function to the queue of the background validation callbacks, to
+ * run in order with them on the scheduler thread. Lets listeners move slow
+ * work out of the synchronous notifications.
+ */
+void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
 
 class CValidationInterface {
 protected:
@@ -77,6 +84,7 @@ private:
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
+    friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
 
 public:
     /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70015;
+static const int PROTOCOL_VERSION = 70017;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -42,4 +42,10 @@ static const int SHORT_IDS_BLOCKS_VERSION = 70014;
 //! not banning for invalid compact blocks starts with this version
 static const int INVALID_CB_NO_BAN_VERSION = 70015;
 
+//! announcing chain tips on handshake with "tipheaders" starts with this version
+static const int TIP_HEADERS_VERSION = 70016;
+
+//! "sendvotes" command and pushing votes with "vote" starts with this version
+static const int VOTE_RELAY_VERSION = 70017;
+
 #endif // BWSCOIN_VERSION_H
@@ -39,6 +39,10 @@ void CAutoVoter::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex
         return;
 
     DoVote(pindexNew);
+
+    // prepare the votes of the tickets that can be selected from now on
+    if (pwallet != nullptr && configured.load() && config.autoVote)
+        pwallet->UpdateVoteTemplates(pindexNew);
 }
 
 void CAutoVoter::DoVote(const CBlockIndex *pindexNew)
@@ -68,16 +72,10 @@ void CAutoVoter::DoVote(const CBlockIndex *pindexNew)
     std::string voteHash;
     CWalletError we;
 
-    // unlock wallet
-    bool shouldRelock = pwallet->IsLocked();
-    if (shouldRelock && ! pwallet->Unlock(config.passphrase)) {
-        LogPrintf("CAutoVoter: Unlocking wallet: Wrong passphrase\n");
-        return;
-    }
-
-    // send all possible votes for the block if this is at least at the
-    // same height with the chain tip.
-    auto voteForBlock = [&] (const CBlockIndex* block) {
+    // collect the winning tickets of the wallet in the block if this is at
+    // least at the same height with the chain tip.
+    std::vector<std::pair<const CBlockIndex*, uint256>> winners;
+    auto collectWinners = [&] (const CBlockIndex* block) {
         if (block->nStatus & BLOCK_FAILED_MASK)
             return;
 
@@ -92,34 +90,44 @@ void CAutoVoter::DoVote(const CBlockIndex *pindexNew)
         if (blockHeight < Params().GetConsensus().nStakeValidationHeight - 1)
             return;
 
-        const uint256& blockHash = block->GetBlockHash();
-        if (blockHash == uint256())
+        if (block->GetBlockHash() == uint256())
             return;
 
-        // verify each winning ticket in the previous block and
-        // if it belongs to the wallet, cast a vote according to the
-        // current settings
-
-        for (const uint256& ticketHash : block->pstakeNode->Winners()) {
-            if (!pwallet->IsMyTicket(ticketHash))
-                continue;
-
-            std::tie(voteHash, we) = pwallet->Vote(ticketHash, blockHash, blockHeight, config.voteBits, config.extendedVoteBits);
-
-            if (we.code == CWalletError::SUCCESSFUL && !voteHash.empty())
-                voteHashes.push_back(voteHash);
-            else
-                LogPrintf("CAutoVoter: Failed to vote: (%d) %s - (%s)\n", we.code, we.message.c_str(), voteHash.c_str());
-        }
+        // the tickets of the wallet have their vote prepared in advance,
+        // the ownership check is left for the ones bought meanwhile
+        for (const uint256& ticketHash : block->pstakeNode->Winners())
+            if (pwallet->HasVoteTemplate(ticketHash) || pwallet->IsMyTicket(ticketHash))
+                winners.emplace_back(block, ticketHash);
     };
 
     // according to the preference, send votes for each chain tip or
     // only for the specified block
     if (config.voteAllTips)
         for (const auto block : GetChainTips())
-            voteForBlock(block);
+            collectWinners(block);
     else
-        voteForBlock(pindexNew);
+        collectWinners(pindexNew);
+
+    if (winners.empty())
+        return;
+
+    // unlock wallet, only when there is something to sign
+    bool shouldRelock = pwallet->IsLocked();
+    if (shouldRelock && ! pwallet->Unlock(config.passphrase)) {
+        LogPrintf("CAutoVoter: Unlocking wallet: Wrong passphrase\n");
+        return;
+    }
+
+    // cast a vote according to the current settings for each winning ticket
+    for (const auto& winner : winners) {
+        const CBlockIndex* block = winner.first;
+        std::tie(voteHash, we) = pwallet->Vote(winner.second, block->GetBlockHash(), block->nHeight, config.voteBits, config.extendedVoteBits);
+
+        if (we.code == CWalletError::SUCCESSFUL && !voteHash.empty())
+            voteHashes.push_back(voteHash);
+        else
+            LogPrintf("CAutoVoter: Failed to vote: (%d) %s - (%s)\n", we.code, we.message.c_str(), voteHash.c_str());
+    }
 
     if (shouldRelock) pwallet->Lock();
 
@@ -203,6 +203,12 @@ bool CDB::Recover(const std::string& filename, void *callbackDataIn, bool (*reco
     // Rewrite salvaged data to fresh wallet file
     // Set -rescan so any missing transactions will be
     // found.
+    if (CWalletLog::IsLogFile(GetDataDir() / filename)) {
+        // Incomplete batches are dropped whenever a log is opened.
+        LogPrintf("%s is a wallet log, nothing to salvage\n", filename);
+        return true;
+    }
+
     int64_t now = GetTime();
     newFilename = strprintf("%s.%d.bak", filename, now);
 
@@ -296,7 +302,7 @@ bool CDB::VerifyEnvironment(const std::string& walletFile, const fs::path& dataD
 
 bool CDB::VerifyDatabaseFile(const std::string& walletFile, const fs::path& dataDir, std::string& warningStr, std::string& errorStr, CDBEnv::recoverFunc_type recoverFunc)
 {
-    if (fs::exists(dataDir / walletFile))
+    if (fs::exists(dataDir / walletFile) && !CWalletLog::IsLogFile(dataDir / walletFile))
     {
         std::string backup_filename;
         CDBEnv::VerifyResult r = bitdb.Verify(walletFile, recoverFunc, backup_filename);
@@ -393,7 +399,8 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
+CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) :
+    pdb(nullptr), activeTxn(nullptr), activeCursor(nullptr), plog(nullptr), fLogCursor(false), fLogCursorStarted(false)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -404,6 +411,20 @@ CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb
     const std::string &strFilename = dbw.strFile;
 
     bool fCreate = strchr(pszMode, 'c') != nullptr;
+    if (dbw.log) {
+        if (!dbw.log->Open())
+            throw std::runtime_error(strprintf("CDB: Can't open wallet log %s", strFilename));
+        plog = dbw.log.get();
+        strFile = strFilename;
+        if (fCreate && !Exists(std::string("version"))) {
+            bool fTmp = fReadOnly;
+            fReadOnly = false;
+            WriteVersion(CLIENT_VERSION);
+            fReadOnly = fTmp;
+        }
+        return;
+    }
+
     unsigned int nFlags = DB_THREAD;
     if (fCreate)
         nFlags |= DB_CREATE;
@@ -456,7 +477,9 @@ CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    // A log is synced by PeriodicFlush and on shutdown instead, so that
+    // closing a handle after each write does not cost an fsync.
+    if (activeTxn || plog)
         return;
 
     // Flush database activity from memory pool to disk log
@@ -467,6 +490,99 @@ void CDB::Flush()
     env->dbenv->txn_checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
 }
 
+bool CDB::LogRead(const CDataStream& ssKey, CSerializeData& value)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    if (logTxn) {
+        auto it = logTxn->find(key);
+        if (it != logTxn->end()) {
+            if (!it->second.first)
+                return false;
+            value = it->second.second;
+            return true;
+        }
+    }
+    return plog->Read(key, value);
+}
+
+bool CDB::LogWrite(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    CWalletLogKeySet setNew;
+    if (!fOverwrite)
+        setNew.insert(key);
+    if (logTxn) {
+        auto it = logTxn->find(key);
+        if (it == logTxn->end()) {
+            // Fail early like BerkeleyDB, and again on commit if the key
+            // was written by another handle in the meantime.
+            if (!fOverwrite && plog->Exists(key))
+                return false;
+            logTxnNew.insert(setNew.begin(), setNew.end());
+        } else if (!fOverwrite && it->second.first) {
+            return false;
+        }
+        (*logTxn)[key] = std::make_pair(true, CSerializeData(ssValue.begin(), ssValue.end()));
+        return true;
+    }
+    CWalletLogBatch batch;
+    batch[key] = std::make_pair(true, CSerializeData(ssValue.begin(), ssValue.end()));
+    return plog->Apply(batch, setNew);
+}
+
+bool CDB::LogErase(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    if (logTxn) {
+        (*logTxn)[key] = std::make_pair(false, CSerializeData());
+        return true;
+    }
+    if (!plog->Exists(key))
+        return true;
+    CWalletLogBatch batch;
+    batch[key] = std::make_pair(false, CSerializeData());
+    return plog->Apply(batch);
+}
+
+bool CDB::LogExists(const CDataStream& ssKey)
+{
+    CSerializeData key(ssKey.begin(), ssKey.end());
+    if (logTxn) {
+        auto it = logTxn->find(key);
+        if (it != logTxn->end())
+            return it->second.first;
+    }
+    return plog->Exists(key);
+}
+
+int CDB::LogReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool setRange)
+{
+    if (!fLogCursor)
+        return 99999;
+
+    // The cursor remembers its key rather than an iterator, so that it stays
+    // valid across writes. Like a BerkeleyDB cursor opened outside of the
+    // transaction, it only sees committed records.
+    CSerializeData key, value;
+    bool fFound;
+    if (setRange)
+        fFound = plog->Seek(CSerializeData(ssKey.begin(), ssKey.end()), true, key, value);
+    else
+        fFound = plog->Seek(logCursorKey, !fLogCursorStarted, key, value);
+    if (!fFound)
+        return DB_NOTFOUND;
+    fLogCursorStarted = true;
+    logCursorKey = key;
+
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write(key.data(), key.size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write(value.data(), value.size());
+    return 0;
+}
+
 void CWalletDBWrapper::IncrementUpdateCounter()
 {
     ++nUpdateCounter;
@@ -474,8 +590,15 @@ void CWalletDBWrapper::IncrementUpdateCounter()
 
 void CDB::Close()
 {
-    if (!pdb)
+    if (!pdb && !plog)
+        return;
+    CloseCursor();
+    if (plog) {
+        logTxn.reset();
+        logTxnNew.clear();
+        plog = nullptr;
         return;
+    }
     if (activeTxn)
         activeTxn->abort();
     activeTxn = nullptr;
@@ -509,6 +632,17 @@ bool CDB::Rewrite(CWalletDBWrapper& dbw, const char* pszSkip)
     if (dbw.IsDummy()) {
         return true;
     }
+    if (dbw.log) {
+        LogPrintf("CDB::Rewrite: Rewriting %s...\n", dbw.strFile);
+        bool fSuccess = dbw.log->Open() && dbw.log->Compact(pszSkip);
+        if (fSuccess) {
+            CDB db(dbw);
+            fSuccess = db.WriteVersion(CLIENT_VERSION);
+        }
+        if (!fSuccess)
+            LogPrintf("CDB::Rewrite: Failed to rewrite wallet log %s\n", dbw.strFile);
+        return fSuccess;
+    }
     CDBEnv *env = dbw.env;
     const std::string& strFile = dbw.strFile;
     while (true) {
@@ -538,17 +672,16 @@ bool CDB::Rewrite(CWalletDBWrapper& dbw, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
-                    if (pcursor)
+                    if (db.StartCursor())
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-                            int ret1 = db.ReadAtCursor(pcursor, ssKey, ssValue);
+                            int ret1 = db.ReadAtCursor(ssKey, ssValue);
                             if (ret1 == DB_NOTFOUND) {
-                                pcursor->close();
+                                db.CloseCursor();
                                 break;
                             } else if (ret1 != 0) {
-                                pcursor->close();
+                                db.CloseCursor();
                                 fSuccess = false;
                                 break;
                             }
@@ -639,6 +772,11 @@ bool CDB::PeriodicFlush(CWalletDBWrapper& dbw)
     if (dbw.IsDummy()) {
         return true;
     }
+    if (dbw.log) {
+        // Commits everything appended since the last flush at once
+        LogPrint(BCLog::DB, "Flushing %s\n", dbw.strFile);
+        return dbw.log->Flush(true);
+    }
     bool ret = false;
     CDBEnv *env = dbw.env;
     const std::string& strFile = dbw.strFile;
@@ -687,6 +825,19 @@ bool CWalletDBWrapper::Backup(const std::string& strDest)
     if (IsDummy()) {
         return false;
     }
+    if (log) {
+        fs::path pathDest(strDest);
+        if (fs::is_directory(pathDest))
+            pathDest /= strFile;
+        if (fs::exists(pathDest) && fs::equivalent(log->GetPath(), pathDest)) {
+            LogPrintf("cannot backup to wallet source file %s\n", pathDest.string());
+            return false;
+        }
+        if (!log->Backup(pathDest))
+            return false;
+        LogPrintf("copied %s to %s\n", strFile, pathDest.string());
+        return true;
+    }
     while (true)
     {
         {
@@ -725,7 +876,62 @@ bool CWalletDBWrapper::Backup(const std::string& strDest)
 
 void CWalletDBWrapper::Flush(bool shutdown)
 {
-    if (!IsDummy()) {
+    if (log) {
+        log->Flush(true);
+        if (shutdown)
+            log->Close();
+    } else if (!IsDummy()) {
         env->Flush(shutdown);
     }
 }
+
+bool CWalletDBWrapper::CopyTo(CWalletDBWrapper& dbwDest)
+{
+    // Records are committed in batches to bound the size of a BerkeleyDB
+    // transaction on large wallets.
+    static const unsigned int COPY_BATCH_SIZE = 1000;
+
+    bool fSuccess = true;
+    unsigned int nRecords = 0;
+    {
+        CDB src(*this, "r");
+        CDB dest(dbwDest, "cr+");
+        if (!src.StartCursor() || !dest.TxnBegin())
+            return error("%s: cannot copy %s to %s", __func__, strFile, dbwDest.strFile);
+        while (true) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            int ret = src.ReadAtCursor(ssKey, ssValue);
+            if (ret == DB_NOTFOUND)
+                break;
+            if (ret != 0 || !dest.Write(ssKey, ssValue)) {
+                fSuccess = false;
+                break;
+            }
+            if (++nRecords % COPY_BATCH_SIZE == 0)
+                fSuccess = dest.TxnCommit() && dest.TxnBegin();
+            if (!fSuccess)
+                break;
+        }
+        src.CloseCursor();
+        if (fSuccess)
+            fSuccess = dest.TxnCommit();
+        else
+            dest.TxnAbort();
+    }
+    dbwDest.Flush(false);
+    if (!fSuccess)
+        return error("%s: failed to copy %s to %s", __func__, strFile, dbwDest.strFile);
+    LogPrintf("Copied %u records from %s to %s\n", nRecords, strFile, dbwDest.strFile);
+    return true;
+}
+
+std::unique_ptr<CWalletDBWrapper> MakeWalletDBWrapper(const std::string& strFile)
+{
+    const fs::path path = GetDataDir() / strFile;
+    bool fLog = fs::exists(path) ? CWalletLog::IsLogFile(path) :
+                                   gArgs.GetArg("-walletbackend", DEFAULT_WALLET_BACKEND) == "log";
+    if (fLog)
+        return std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(path, strFile));
+    return std::unique_ptr<CWalletDBWrapper>(new CWalletDBWrapper(&bitdb, strFile));
+}
@@ -15,9 +15,11 @@
 #include "streams.h"
 #include "sync.h"
 #include "version.h"
+#include "wallet/logdb.h"
 
 #include <atomic>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,6 +27,12 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
+//! Seconds after which the periodic flush syncs a wallet log even while the
+//! wallet keeps changing, which bounds how long an appended batch stays
+//! unsynced. Writes and closes never sync a log, only PeriodicFlush and
+//! CWalletDBWrapper::Flush do.
+static const int64_t WALLET_LOG_SYNC_INTERVAL = 10;
 
 class CDBEnv
 {
@@ -91,20 +99,28 @@ public:
 extern CDBEnv bitdb;
 
 /** An instance of this class represents one database.
- * For BerkeleyDB this is just a (env, strFile) tuple.
+ * For BerkeleyDB this is just a (env, strFile) tuple, for the append-only
+ * log backend it owns the log.
  **/
 class CWalletDBWrapper
 {
     friend class CDB;
 public:
     /** Create dummy DB handle */
-    CWalletDBWrapper() : nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), env(nullptr)
+    CWalletDBWrapper() : nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), nLastFlushTime(0), env(nullptr)
+    {
+    }
+
+    /** Create DB handle to a log at pathLog, named strFile_in */
+    CWalletDBWrapper(const fs::path& pathLog, const std::string &strFile_in) :
+        nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), nLastFlushTime(0), env(nullptr), strFile(strFile_in),
+        log(new CWalletLog(pathLog))
     {
     }
 
     /** Create DB handle to real database */
     CWalletDBWrapper(CDBEnv *env_in, const std::string &strFile_in) :
-        nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), env(env_in), strFile(strFile_in)
+        nUpdateCounter(0), nLastSeen(0), nLastFlushed(0), nLastWalletUpdate(0), nLastFlushTime(0), env(env_in), strFile(strFile_in)
     {
     }
 
@@ -124,37 +140,72 @@ public:
      */
     void Flush(bool shutdown);
 
+    /** Copy every record into dbwDest, which should be empty, e.g. to
+     * migrate the database to another backend.
+     */
+    bool CopyTo(CWalletDBWrapper& dbwDest);
+
+    /** Whether this database is an append-only log rather than BerkeleyDB */
+    bool IsLog() const { return log != nullptr; }
+
     void IncrementUpdateCounter();
 
     std::atomic<unsigned int> nUpdateCounter;
     unsigned int nLastSeen;
     unsigned int nLastFlushed;
     int64_t nLastWalletUpdate;
+    int64_t nLastFlushTime;
 
 private:
     /** BerkeleyDB specific */
     CDBEnv *env;
     std::string strFile;
 
+    /** Append-only log specific */
+    std::unique_ptr<CWalletLog> log;
+
     /** Return whether this database handle is a dummy for testing.
      * Only to be used at a low level, application should ideally not care
      * about this.
      */
-    bool IsDummy() { return env == nullptr; }
+    bool IsDummy() { return env == nullptr && log == nullptr; }
 };
 
+/** Return the handle for wallet file strFile in the data directory, with the
+ * backend of the existing file, or the one selected by -walletbackend for a
+ * new one.
+ */
+std::unique_ptr<CWalletDBWrapper> MakeWalletDBWrapper(const std::string& strFile);
+
 
-/** RAII class that provides access to a Berkeley database */
+/** RAII class that provides access to a Berkeley database or a wallet log */
 class CDB
 {
 protected:
     Db* pdb;
     std::string strFile;
     DbTxn* activeTxn;
+    Dbc* activeCursor;
     bool fReadOnly;
     bool fFlushOnClose;
     CDBEnv *env;
 
+    CWalletLog* plog;
+    //! Writes and erases of the active transaction, applied to the log on commit
+    std::unique_ptr<CWalletLogBatch> logTxn;
+    //! Keys written by the active transaction that must not exist when it is committed
+    CWalletLogKeySet logTxnNew;
+    //! Whether a cursor is open on the log, whether it is past its start and the key it is at
+    bool fLogCursor;
+    bool fLogCursorStarted;
+    CSerializeData logCursorKey;
+
+    bool LogRead(const CDataStream& ssKey, CSerializeData& value);
+    bool LogWrite(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool LogErase(const CDataStream& ssKey);
+    bool LogExists(const CDataStream& ssKey);
+    int LogReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool setRange);
+
 public:
     explicit CDB(CWalletDBWrapper& dbw, const char* pszMode = "r+", bool fFlushOnCloseIn=true);
     ~CDB() { Close(); }
@@ -178,13 +229,26 @@ public:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog) {
+            CSerializeData data;
+            if (!LogRead(ssKey, data))
+                return false;
+            try {
+                CDataStream ssValue(data, SER_DISK, CLIENT_VERSION);
+                ssValue >> value;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Read
@@ -213,7 +277,7 @@ public:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return true;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -222,12 +286,15 @@ public:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(ssKey.data(), ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (plog)
+            return LogWrite(ssKey, ssValue, fOverwrite);
+        Dbt datKey(ssKey.data(), ssKey.size());
         Dbt datValue(ssValue.data(), ssValue.size());
 
         // Write
@@ -242,7 +309,7 @@ public:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -251,6 +318,9 @@ public:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog)
+            return LogErase(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Erase
@@ -264,13 +334,16 @@ public:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog)
+            return LogExists(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Exists
@@ -281,19 +354,31 @@ public:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    bool StartCursor()
     {
+        assert(!activeCursor && !fLogCursor);
+        if (plog) {
+            fLogCursor = true;
+            fLogCursorStarted = false;
+            return true;
+        }
         if (!pdb)
-            return nullptr;
-        Dbc* pcursor = nullptr;
-        int ret = pdb->cursor(nullptr, &pcursor, 0);
-        if (ret != 0)
-            return nullptr;
-        return pcursor;
+            return false;
+        int ret = pdb->cursor(nullptr, &activeCursor, 0);
+        if (ret != 0) {
+            activeCursor = nullptr;
+            return false;
+        }
+        return true;
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
+    int ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
     {
+        if (plog)
+            return LogReadAtCursor(ssKey, ssValue, setRange);
+        if (!activeCursor)
+            return 99999;
+
         // Read at cursor
         Dbt datKey;
         unsigned int fFlags = DB_NEXT;
@@ -305,7 +390,7 @@ public:
         Dbt datValue;
         datKey.set_flags(DB_DBT_MALLOC);
         datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
+        int ret = activeCursor->get(&datKey, &datValue, fFlags);
         if (ret != 0)
             return ret;
         else if (datKey.get_data() == nullptr || datValue.get_data() == nullptr)
@@ -327,9 +412,24 @@ public:
         return 0;
     }
 
+    void CloseCursor()
+    {
+        if (activeCursor)
+            activeCursor->close();
+        activeCursor = nullptr;
+        fLogCursor = false;
+        logCursorKey.clear();
+    }
+
 public:
     bool TxnBegin()
     {
+        if (plog) {
+            if (logTxn)
+                return false;
+            logTxn.reset(new CWalletLogBatch);
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -341,6 +441,14 @@ public:
 
     bool TxnCommit()
     {
+        if (plog) {
+            if (!logTxn)
+                return false;
+            bool ret = plog->Apply(*logTxn, logTxnNew);
+            logTxn.reset();
+            logTxnNew.clear();
+            return ret;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -350,6 +458,13 @@ public:
 
     bool TxnAbort()
     {
+        if (plog) {
+            if (!logTxn)
+                return false;
+            logTxn.reset();
+            logTxnNew.clear();
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
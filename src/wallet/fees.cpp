@@ -77,6 +77,32 @@ CAmount GetMinimumFee(unsigned int nTxBytes, const CCoinControl& coin_control, c
 }
 
 
+CFeeRate GetTicketPurchaseFeeRate(unsigned int confTarget, const CFeeRate& fallback, const CTxMemPool& pool, const CBlockPolicyEstimator& estimator, FeeCalculation *feeCalc)
+{
+    // a far away expiry does not need more than the longest tracked target
+    confTarget = std::min(std::max(confTarget, 1u), estimator.HighestStakeTargetTracked());
+    CFeeRate fee_rate = estimator.estimateSmartStakeFee(TX_BuyTicket, confTarget, feeCalc);
+    if (fee_rate == CFeeRate(0)) {
+        // if there are not enough ticket purchases to estimate from, use the user set ticket feerate
+        fee_rate = fallback;
+        if (feeCalc) feeCalc->reason = FeeReason::FALLBACK;
+    }
+    // Obey mempool min fee
+    CFeeRate min_mempool_fee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+    if (fee_rate < min_mempool_fee) {
+        fee_rate = min_mempool_fee;
+        if (feeCalc) feeCalc->reason = FeeReason::MEMPOOL_MIN;
+    }
+    // prevent user from paying a fee below minRelayTxFee or minTxFee
+    CFeeRate required_fee = std::max(CWallet::minTxFee, ::minRelayTxFee);
+    if (required_fee > fee_rate) {
+        fee_rate = required_fee;
+        if (feeCalc) feeCalc->reason = FeeReason::REQUIRED;
+    }
+    return fee_rate;
+}
+
+
 CFeeRate GetDiscardRate(const CBlockPolicyEstimator& estimator)
 {
     unsigned int highest_target = estimator.HighestTargetTracked(FeeEstimateHorizon::LONG_HALFLIFE);
@@ -26,6 +26,12 @@ CAmount GetRequiredFee(unsigned int nTxBytes);
  */
 CAmount GetMinimumFee(unsigned int nTxBytes, const CCoinControl& coin_control, const CTxMemPool& pool, const CBlockPolicyEstimator& estimator, FeeCalculation *feeCalc);
 
+/**
+ * Estimate the feerate for a ticket purchase to be mined within confTarget
+ * blocks, falling back to the user set ticket feerate without an estimate
+ */
+CFeeRate GetTicketPurchaseFeeRate(unsigned int confTarget, const CFeeRate& fallback, const CTxMemPool& pool, const CBlockPolicyEstimator& estimator, FeeCalculation *feeCalc);
+
 /**
  * Return the maximum feerate for discarding change.
  */
@@ -0,0 +1,371 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "util.h"
+
+#include <string.h>
+
+namespace {
+//! Start of every log file; the last byte is the format version.
+const char LOG_MAGIC[8] = {'b', 'w', 's', 'w', 'l', 'o', 'g', 1};
+//! Size and checksum in front of each batch
+const size_t BATCH_HEADER_SIZE = 8;
+//! Type, key size and value size of a record
+const size_t RECORD_OVERHEAD = 9;
+//! Logs smaller than this are never compacted
+const uint64_t COMPACT_MIN_BYTES = 1 << 20;
+
+uint32_t BatchChecksum(const char* data, size_t size)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)data, size).Finalize(hash);
+    return ReadLE32(hash);
+}
+
+void AppendRecord(CSerializeData& body, bool fWrite, const CSerializeData& key, const CSerializeData& value)
+{
+    char buf[4];
+    body.push_back(fWrite ? 1 : 0);
+    WriteLE32((unsigned char*)buf, key.size());
+    body.insert(body.end(), buf, buf + 4);
+    body.insert(body.end(), key.begin(), key.end());
+    if (fWrite) {
+        WriteLE32((unsigned char*)buf, value.size());
+        body.insert(body.end(), buf, buf + 4);
+        body.insert(body.end(), value.begin(), value.end());
+    }
+}
+
+bool AppendBatch(FILE* file, const CSerializeData& body)
+{
+    unsigned char header[BATCH_HEADER_SIZE];
+    WriteLE32(header, body.size());
+    WriteLE32(header + 4, BatchChecksum(body.data(), body.size()));
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+           fwrite(body.data(), 1, body.size(), file) == body.size() &&
+           fflush(file) == 0;
+}
+
+bool ReadSized(const char*& p, const char* end, CSerializeData& out)
+{
+    if (end - p < 4)
+        return false;
+    uint32_t nSize = ReadLE32((const unsigned char*)p);
+    p += 4;
+    if ((uint64_t)(end - p) < nSize)
+        return false;
+    out.assign(p, p + nSize);
+    p += nSize;
+    return true;
+}
+
+bool HasPrefix(const CSerializeData& key, const char* pszPrefix)
+{
+    // Same test as CDB::Rewrite
+    return strncmp(key.data(), pszPrefix, std::min(key.size(), strlen(pszPrefix))) == 0;
+}
+} // namespace
+
+bool CWalletLogKeyCompare::operator()(const CSerializeData& a, const CSerializeData& b) const
+{
+    int r = memcmp(a.data(), b.data(), std::min(a.size(), b.size()));
+    return r < 0 || (r == 0 && a.size() < b.size());
+}
+
+CWalletLog::CWalletLog(const fs::path& pathIn) : path(pathIn), file(nullptr), nFileBytes(0), nLiveBytes(0), fDirty(false)
+{
+}
+
+CWalletLog::~CWalletLog()
+{
+    Close();
+}
+
+bool CWalletLog::IsLogFile(const fs::path& path)
+{
+    FILE* f = fsbridge::fopen(path, "rb");
+    if (!f)
+        return false;
+    char magic[sizeof(LOG_MAGIC)];
+    bool fLog = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+    return fLog;
+}
+
+bool CWalletLog::Open()
+{
+    LOCK(cs_log);
+    if (file)
+        return true;
+
+    if (!fs::exists(path)) {
+        FILE* f = fsbridge::fopen(path, "wb");
+        if (!f)
+            return error("%s: cannot create %s", __func__, path.string());
+        bool fOk = fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), f) == sizeof(LOG_MAGIC) && fflush(f) == 0;
+        if (fOk)
+            FileCommit(f);
+        fclose(f);
+        if (!fOk)
+            return error("%s: cannot write %s", __func__, path.string());
+    }
+
+    file = fsbridge::fopen(path, "rb+");
+    if (!file)
+        return error("%s: cannot open %s", __func__, path.string());
+    if (!Replay()) {
+        fclose(file);
+        file = nullptr;
+        mapRecords.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CWalletLog::Replay()
+{
+    AssertLockHeld(cs_log);
+    int64_t nStart = GetTimeMillis();
+
+    // Read the whole file at once and parse it from memory.
+    CSerializeData buf;
+    if (fseek(file, 0, SEEK_END) != 0)
+        return error("%s: cannot seek %s", __func__, path.string());
+    long nSize = ftell(file);
+    if (nSize < (long)sizeof(LOG_MAGIC))
+        return error("%s: %s is not a wallet log", __func__, path.string());
+    buf.resize(nSize);
+    rewind(file);
+    if (fread(buf.data(), 1, buf.size(), file) != buf.size())
+        return error("%s: cannot read %s", __func__, path.string());
+    if (memcmp(buf.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+        return error("%s: %s is not a wallet log", __func__, path.string());
+
+    mapRecords.clear();
+    nLiveBytes = 0;
+    const char* const pbegin = buf.data();
+    const char* const pend = pbegin + buf.size();
+    const char* p = pbegin + sizeof(LOG_MAGIC);
+    unsigned int nBatches = 0;
+    while ((size_t)(pend - p) >= BATCH_HEADER_SIZE) {
+        uint32_t nBody = ReadLE32((const unsigned char*)p);
+        uint32_t nChecksum = ReadLE32((const unsigned char*)p + 4);
+        const char* pbody = p + BATCH_HEADER_SIZE;
+        if ((uint64_t)(pend - pbody) < nBody || BatchChecksum(pbody, nBody) != nChecksum)
+            break;
+
+        // The checksum matched, so the batch was written completely.
+        const char* q = pbody;
+        const char* qend = pbody + nBody;
+        while (q < qend) {
+            bool fWrite = *q++ != 0;
+            CSerializeData key, value;
+            if (!ReadSized(q, qend, key) || (fWrite && !ReadSized(q, qend, value)))
+                return error("%s: malformed batch at offset %d in %s", __func__, p - pbegin, path.string());
+            ApplyRecord(fWrite, key, value);
+        }
+        p = qend;
+        nBatches++;
+    }
+
+    // Anything after the last complete batch was torn by a crash.
+    nFileBytes = p - pbegin;
+    if (p != pend) {
+        LogPrintf("%s: dropping %d bytes of incomplete batch at the end of %s\n", __func__, pend - p, path.string());
+        if (!TruncateFile(file, nFileBytes))
+            return error("%s: cannot truncate %s", __func__, path.string());
+    }
+    if (fseek(file, 0, SEEK_END) != 0)
+        return error("%s: cannot seek %s", __func__, path.string());
+    fDirty = false;
+
+    LogPrint(BCLog::DB, "%s: replayed %u batches, %u records from %s in %dms\n", __func__,
+        nBatches, mapRecords.size(), path.string(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void CWalletLog::Close()
+{
+    LOCK(cs_log);
+    if (!file)
+        return;
+    if (fDirty)
+        FileCommit(file);
+    fclose(file);
+    file = nullptr;
+    fDirty = false;
+    mapRecords.clear();
+}
+
+bool CWalletLog::Read(const CSerializeData& key, CSerializeData& value) const
+{
+    LOCK(cs_log);
+    auto it = mapRecords.find(key);
+    if (it == mapRecords.end())
+        return false;
+    value = it->second;
+    return true;
+}
+
+bool CWalletLog::Exists(const CSerializeData& key) const
+{
+    LOCK(cs_log);
+    return mapRecords.count(key) > 0;
+}
+
+bool CWalletLog::Seek(const CSerializeData& key, bool fInclusive, CSerializeData& keyOut, CSerializeData& valueOut) const
+{
+    LOCK(cs_log);
+    auto it = fInclusive ? mapRecords.lower_bound(key) : mapRecords.upper_bound(key);
+    if (it == mapRecords.end())
+        return false;
+    keyOut = it->first;
+    valueOut = it->second;
+    return true;
+}
+
+void CWalletLog::ApplyRecord(bool fWrite, const CSerializeData& key, const CSerializeData& value)
+{
+    auto it = mapRecords.find(key);
+    if (it != mapRecords.end()) {
+        nLiveBytes -= RECORD_OVERHEAD + it->first.size() + it->second.size();
+        if (fWrite)
+            it->second = value;
+        else
+            mapRecords.erase(it);
+    } else if (fWrite) {
+        mapRecords.emplace(key, value);
+    }
+    if (fWrite)
+        nLiveBytes += RECORD_OVERHEAD + key.size() + value.size();
+}
+
+bool CWalletLog::Apply(const CWalletLogBatch& batch, const CWalletLogKeySet& setNew)
+{
+    LOCK(cs_log);
+    if (!file)
+        return false;
+    // Checked under the same lock as the append, as DB_NOOVERWRITE does
+    for (const CSerializeData& key : setNew) {
+        if (mapRecords.count(key))
+            return false;
+    }
+    if (batch.empty())
+        return true;
+    CSerializeData body;
+    for (const auto& op : batch)
+        AppendRecord(body, op.second.first, op.first, op.second.second);
+    if (!AppendBatch(file, body)) {
+        // Drop whatever part of the batch made it out, so the next one
+        // does not end up behind a torn batch.
+        LogPrintf("%s: error appending to %s\n", __func__, path.string());
+        TruncateFile(file, nFileBytes);
+        fseek(file, 0, SEEK_END);
+        return false;
+    }
+    nFileBytes += BATCH_HEADER_SIZE + body.size();
+    for (const auto& op : batch)
+        ApplyRecord(op.second.first, op.first, op.second.second);
+    fDirty = true;
+    return true;
+}
+
+bool CWalletLog::Flush(bool fCompact)
+{
+    LOCK(cs_log);
+    if (!file)
+        return true;
+    if (fDirty) {
+        FileCommit(file);
+        fDirty = false;
+    }
+    if (fCompact && nFileBytes > COMPACT_MIN_BYTES && nFileBytes > 2 * (nLiveBytes + sizeof(LOG_MAGIC) + BATCH_HEADER_SIZE))
+        return Compact();
+    return true;
+}
+
+bool CWalletLog::Compact(const char* pszSkip)
+{
+    LOCK(cs_log);
+    if (!file)
+        return false;
+    int64_t nStart = GetTimeMillis();
+
+    // Write the live records as a single batch to a new file, then swap it in.
+    const fs::path pathCompact = path.string() + ".compact";
+    FILE* fileCompact = fsbridge::fopen(pathCompact, "wb");
+    if (!fileCompact)
+        return error("%s: cannot create %s", __func__, pathCompact.string());
+    CSerializeData body;
+    body.reserve(nLiveBytes);
+    for (const auto& record : mapRecords) {
+        if (!pszSkip || !HasPrefix(record.first, pszSkip))
+            AppendRecord(body, true, record.first, record.second);
+    }
+    bool fOk = fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), fileCompact) == sizeof(LOG_MAGIC) &&
+               (body.empty() || AppendBatch(fileCompact, body));
+    if (fOk)
+        FileCommit(fileCompact);
+    fclose(fileCompact);
+    if (!fOk) {
+        fs::remove(pathCompact);
+        return error("%s: cannot write %s", __func__, pathCompact.string());
+    }
+
+    uint64_t nOldBytes = nFileBytes;
+    if (fDirty)
+        FileCommit(file);
+    fclose(file);
+    bool fRenamed = RenameOver(pathCompact, path);
+    file = fsbridge::fopen(path, "rb+");
+    if (!file || fseek(file, 0, SEEK_END) != 0)
+        return error("%s: cannot reopen %s", __func__, path.string());
+    nFileBytes = ftell(file);
+    fDirty = false;
+    if (!fRenamed) {
+        fs::remove(pathCompact);
+        return error("%s: cannot rename %s to %s", __func__, pathCompact.string(), path.string());
+    }
+
+    if (pszSkip) {
+        RecordMap::iterator it = mapRecords.begin();
+        while (it != mapRecords.end()) {
+            if (HasPrefix(it->first, pszSkip)) {
+                nLiveBytes -= RECORD_OVERHEAD + it->first.size() + it->second.size();
+                it = mapRecords.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    LogPrint(BCLog::DB, "%s: compacted %s from %u to %u bytes in %dms\n", __func__,
+        path.string(), nOldBytes, nFileBytes, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CWalletLog::Backup(const fs::path& pathDest)
+{
+    LOCK(cs_log);
+    if (file && fDirty) {
+        FileCommit(file);
+        fDirty = false;
+    }
+    try {
+        fs::copy_file(path, pathDest, fs::copy_option::overwrite_if_exists);
+    } catch (const fs::filesystem_error& e) {
+        return error("%s: error copying %s to %s - %s", __func__, path.string(), pathDest.string(), e.what());
+    }
+    return true;
+}
+
+size_t CWalletLog::GetRecordCount() const
+{
+    LOCK(cs_log);
+    return mapRecords.size();
+}
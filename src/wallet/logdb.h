@@ -0,0 +1,99 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BWSCOIN_WALLET_LOGDB_H
+#define BWSCOIN_WALLET_LOGDB_H
+
+#include "fs.h"
+#include "support/allocators/zeroafterfree.h"
+#include "sync.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <utility>
+
+/** Orders keys bytewise as unsigned values, like the BerkeleyDB btree. */
+struct CWalletLogKeyCompare
+{
+    bool operator()(const CSerializeData& a, const CSerializeData& b) const;
+};
+
+/** Writes (true, value) and erases (false, empty) applied to a log as one batch. */
+typedef std::map<CSerializeData, std::pair<bool, CSerializeData>, CWalletLogKeyCompare> CWalletLogBatch;
+/** Keys that a batch may only write if they do not exist yet */
+typedef std::set<CSerializeData, CWalletLogKeyCompare> CWalletLogKeySet;
+
+/**
+ * Append-only key/value store, an alternative to BerkeleyDB for wallet files.
+ *
+ * The file is a header followed by batches. A batch holds the records of one
+ * database transaction, or of a single write outside of one, together with
+ * its size and checksum, so that a batch torn by a crash is dropped as a
+ * whole when the file is replayed. Every live record is kept in memory and
+ * the file is read in one sequential pass on open. Appends are not synced:
+ * Flush commits all batches appended since the last one at once, and can
+ * compact the file down to the live records once the dead ones outweigh
+ * them. The wallet only flushes periodically and on shutdown, see
+ * WALLET_LOG_SYNC_INTERVAL.
+ */
+class CWalletLog
+{
+public:
+    typedef std::map<CSerializeData, CSerializeData, CWalletLogKeyCompare> RecordMap;
+
+    explicit CWalletLog(const fs::path& pathIn);
+    ~CWalletLog();
+
+    CWalletLog(const CWalletLog&) = delete;
+    CWalletLog& operator=(const CWalletLog&) = delete;
+
+    /** Whether path is a file in this format, rather than a BerkeleyDB one */
+    static bool IsLogFile(const fs::path& path);
+
+    /** Replay the file into memory, creating it if needed. Does nothing if already open. */
+    bool Open();
+    void Close();
+
+    bool Read(const CSerializeData& key, CSerializeData& value) const;
+    bool Exists(const CSerializeData& key) const;
+    /** Find the first record with a key after key, or not before it if fInclusive */
+    bool Seek(const CSerializeData& key, bool fInclusive, CSerializeData& keyOut, CSerializeData& valueOut) const;
+
+    /**
+     * Append batch to the file and apply it to the records in memory. Fails
+     * without changing anything if one of setNew already exists.
+     */
+    bool Apply(const CWalletLogBatch& batch, const CWalletLogKeySet& setNew = CWalletLogKeySet());
+
+    /** Commit appended batches to disk, and compact the file if fCompact and it is worth it */
+    bool Flush(bool fCompact = false);
+
+    /** Rewrite the file with just the live records, except for keys starting with pszSkip */
+    bool Compact(const char* pszSkip = nullptr);
+
+    /** Flush and copy the file to pathDest */
+    bool Backup(const fs::path& pathDest);
+
+    const fs::path& GetPath() const { return path; }
+    size_t GetRecordCount() const;
+
+private:
+    mutable CCriticalSection cs_log;
+    const fs::path path;
+    FILE* file;
+    RecordMap mapRecords;
+    //! Bytes of the file, and of the records in it that are still live
+    uint64_t nFileBytes;
+    uint64_t nLiveBytes;
+    //! Whether batches were appended since the last commit to disk
+    bool fDirty;
+
+    bool Replay();
+    void ApplyRecord(bool fWrite, const CSerializeData& key, const CSerializeData& value);
+};
+
+#endif // BWSCOIN_WALLET_LOGDB_H
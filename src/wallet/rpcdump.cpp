@@ -147,7 +147,8 @@ UniValue importprivkey(const JSONRPCRequest& request)
         pwallet->UpdateTimeFirstKey(1);
 
         if (fRescan) {
-            pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
+            const std::set<CScript> setScripts{GetScriptForDestination(vchAddress)};
+            pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */, &setScripts);
         }
     }
 
@@ -263,22 +264,28 @@ UniValue importaddress(const JSONRPCRequest& request)
 
     LOCK2(cs_main, pwallet->cs_wallet);
 
+    std::set<CScript> setScripts;
     const auto dest = DecodeDestination(request.params[0].get_str());
     if (IsValidDestination(dest)) {
         if (fP2SH) {
             throw JSONRPCError(RPCErrorCode::INVALID_ADDRESS_OR_KEY, "Cannot use the p2sh flag with an address - use a script instead");
         }
         ImportAddress(pwallet, dest, strLabel);
+        setScripts.insert(GetScriptForDestination(dest));
     } else if (IsHex(request.params[0].get_str())) {
         const auto data = ParseHex(request.params[0].get_str());
-        ImportScript(pwallet, CScript(std::begin(data), std::end(data)), strLabel, fP2SH);
+        const CScript script(std::begin(data), std::end(data));
+        ImportScript(pwallet, script, strLabel, fP2SH);
+        setScripts.insert(script);
+        if (fP2SH)
+            setScripts.insert(GetScriptForDestination(CScriptID(script)));
     } else {
         throw JSONRPCError(RPCErrorCode::INVALID_ADDRESS_OR_KEY, "Invalid BWS Coin address or script");
     }
 
     if (fRescan)
     {
-        pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
+        pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */, &setScripts);
         pwallet->ReacceptWalletTransactions();
     }
 
@@ -436,7 +443,8 @@ UniValue importpubkey(const JSONRPCRequest& request)
 
     if (fRescan)
     {
-        pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */);
+        const std::set<CScript> setScripts{GetScriptForDestination(pubKey.GetID()), GetScriptForRawPubKey(pubKey)};
+        pwallet->RescanFromTime(TIMESTAMP_MIN, true /* update */, &setScripts);
         pwallet->ReacceptWalletTransactions();
     }
 
@@ -694,6 +702,18 @@ UniValue dumpwallet(const JSONRPCRequest& request)
     return reply;
 }
 
+// The scriptPubKey of a successfully processed importmulti request, which
+// the imported keys or redeem script receive coins with.
+static CScript GetImportScriptPubKey(const UniValue& data)
+{
+    const UniValue& scriptPubKey = data["scriptPubKey"];
+    if (scriptPubKey.getType() == UniValue::VSTR) {
+        const auto vData = ParseHex(scriptPubKey.get_str());
+        return CScript(vData.begin(), vData.end());
+    }
+    return GetScriptForDestination(DecodeDestination(scriptPubKey["address"].get_str()));
+}
+
 UniValue ProcessImport(CWallet * const pwallet, const UniValue& data, const int64_t timestamp)
 {
     try {
@@ -1090,6 +1110,7 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
     }
 
     UniValue response{UniValue::VARR};
+    std::set<CScript> setScripts;
 
     for (const auto& data : requests.getValues()) {
         const auto timestamp = std::max(GetImportTimestamp(data, now), minimumTimestamp);
@@ -1103,6 +1124,7 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
         // If at least one request was successful then allow rescan.
         if (result["success"].get_bool()) {
             fRunScan = true;
+            setScripts.insert(GetImportScriptPubKey(data));
         }
 
         // Get the lowest timestamp.
@@ -1112,7 +1134,7 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
     }
 
     if (fRescan && fRunScan && requests.size()) {
-        const auto scannedTime = pwallet->RescanFromTime(nLowestTimestamp, true /* update */);
+        const auto scannedTime = pwallet->RescanFromTime(nLowestTimestamp, true /* update */, &setScripts);
         pwallet->ReacceptWalletTransactions();
 
         if (scannedTime > nLowestTimestamp) {
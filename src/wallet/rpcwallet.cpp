@@ -26,6 +26,7 @@
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utilstrencodings.h"
 #include "wallet/coincontrol.h"
 #include "wallet/feebumper.h"
 #include "wallet/wallet.h"
@@ -35,6 +36,7 @@
 
 #include <init.h>  // For StartShutdown
 
+#include <limits>
 #include <stdint.h>
 
 #include <univalue.h>
@@ -1877,15 +1879,18 @@ UniValue listtransactions(const JSONRPCRequest& request)
         return NullUniValue;
     }
 
-    if (request.fHelp || request.params.size() > 4)
+    if (request.fHelp || request.params.size() > 6)
         throw std::runtime_error{
-            "listtransactions ( \"account\" count skip include_watchonly)\n"
+            "listtransactions ( \"account\" count skip include_watchonly \"txtype\" \"cursor\")\n"
             "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions for account 'account'.\n"
             "\nArguments:\n"
             "1. \"account\"    (string, optional) DEPRECATED. The account name. Should be \"*\".\n"
             "2. count          (numeric, optional, default=10) The number of transactions to return\n"
             "3. skip           (numeric, optional, default=0) The number of transactions to skip\n"
             "4. include_watchonly (bool, optional, default=false) Include transactions to watch-only addresses (see 'importaddress')\n"
+            "5. \"txtype\"     (string, optional) Only list transactions of this type: standard, stake_purchase, vote or stake_revocation\n"
+            "6. \"cursor\"     (string, optional) Page through the transactions: \"\" for the most recent ones, then the cursor returned\n"
+            "                   with the previous page for older ones. 'count' then counts wallet transactions, and 'skip' must be 0.\n"
             "\nResult:\n"
             "[\n"
             "  {\n"
@@ -1927,12 +1932,19 @@ UniValue listtransactions(const JSONRPCRequest& request)
             "                                         'send' category of transactions.\n"
             "  }\n"
             "]\n"
+            "\nResult, with a cursor:\n"
+            "{\n"
+            "  \"transactions\": [ ... ],  (array) The entries as above, oldest first\n"
+            "  \"cursor\": \"xxx\"          (string) Where the next, older page starts, null after the last page\n"
+            "}\n"
 
             "\nExamples:\n"
             "\nList the most recent 10 transactions in the systems\n"
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nPage through the votes, 100 at a time\n"
+            + HelpExampleCli("listtransactions", "\"*\" 100 0 false vote \"\"") +
             "\nAs a json rpc call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
         };
@@ -1959,9 +1971,66 @@ UniValue listtransactions(const JSONRPCRequest& request)
     if (nFrom < 0)
         throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Negative from");
 
+    // The transactions of a type come from their own index, without the moves between accounts
+    const CWallet::TxItems* pTxOrdered = &pwallet->wtxOrdered;
+    if (!request.params[4].isNull()) {
+        const std::string strType = request.params[4].get_str();
+        pTxOrdered = nullptr;
+        for (ETxClass txClass : {TX_Regular, TX_BuyTicket, TX_Vote, TX_RevokeTicket}) {
+            if (strType == TxClassToString(txClass))
+                pTxOrdered = &pwallet->mapWtxOrderedByClass[txClass];
+        }
+        if (pTxOrdered == nullptr)
+            throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Invalid txtype: " + strType);
+    }
+    const auto& txOrdered = *pTxOrdered;
+
     UniValue ret{UniValue::VARR};
 
-    const auto& txOrdered = pwallet->wtxOrdered;
+    if (!request.params[5].isNull()) {
+        if (nFrom != 0)
+            throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Cannot skip with a cursor");
+
+        // The cursor is the order position of the oldest transaction of the
+        // previous page. A page never splits a transaction, and costs the
+        // number of transactions on it rather than the size of the wallet.
+        auto it = txOrdered.rbegin();
+        const std::string strCursor = request.params[5].get_str();
+        if (!strCursor.empty()) {
+            int64_t nCursor;
+            if (!ParseInt64(strCursor, &nCursor))
+                throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Invalid cursor");
+            it = CWallet::TxItems::const_reverse_iterator(txOrdered.lower_bound(nCursor));
+        }
+
+        std::string strNext = strCursor;
+        int nItems = 0;
+        for (; it != txOrdered.rend() && nItems < nCount; ++it) {
+            strNext = i64tostr(it->first);
+            const size_t nEntries = ret.size();
+            const auto * const pwtx = (*it).second.first;
+            if (pwtx != nullptr)
+                ListTransactions(pwallet, *pwtx, strAccount, 0, true, ret, filter);
+            const auto * const pacentry = (*it).second.second;
+            if (pacentry != nullptr)
+                AcentryToJSON(*pacentry, strAccount, ret);
+            if (ret.size() > nEntries)
+                nItems++;
+        }
+
+        auto arrTmp = ret.getValues();
+        std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
+        UniValue transactions{UniValue::VARR};
+        transactions.push_backV(arrTmp);
+
+        UniValue result{UniValue::VOBJ};
+        result.push_back(Pair("transactions", transactions));
+        if (it != txOrdered.rend())
+            result.push_back(Pair("cursor", strNext));
+        else
+            result.push_back(Pair("cursor", NullUniValue));
+        return result;
+    }
 
     // iterate backwards until we have nCount items to return:
     for (auto it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
@@ -2183,12 +2252,21 @@ UniValue listsinceblock(const JSONRPCRequest& request)
 
     UniValue transactions{UniValue::VARR};
 
-    for (const auto& pairWtx : pwallet->mapWallet) {
-        const auto& tx = pairWtx.second;
+    // Only the transactions in no block of the active chain, filed under -1,
+    // and the ones in blocks after the given one can have fewer confirmations.
+    const auto& txByHeight = pwallet->mapWtxByHeight;
+    auto it = txByHeight.begin();
+    while (it != txByHeight.end()) {
+        if (pindex && it->first.first >= 0 && it->first.first <= pindex->nHeight) {
+            it = txByHeight.upper_bound(std::make_pair(pindex->nHeight, std::numeric_limits<int64_t>::max()));
+            continue;
+        }
+        const auto& tx = *it->second;
 
         if (depth == -1 || tx.GetDepthInMainChain() < depth) {
             ListTransactions(pwallet, tx, "*", 0, true, transactions, filter);
         }
+        ++it;
     }
 
     // when a reorg'd block is requested, we also list any relevant transactions
@@ -2378,6 +2456,61 @@ UniValue backupwallet(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue migratewallet(const JSONRPCRequest& request)
+{
+    const auto pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error{
+            "migratewallet \"filename\" ( \"backend\" )\n"
+            "\nCopies the wallet to a new wallet file in the data directory, stored with the given backend.\n"
+            "The copy is loaded in place of the wallet by restarting with -wallet=<filename>.\n"
+            "\nArguments:\n"
+            "1. \"filename\"   (string, required) The name of the new wallet file, which must not exist yet\n"
+            "2. \"backend\"    (string, optional) \"bdb\" for BerkeleyDB or \"log\" for an append-only log\n"
+            "                 (default: the one the wallet is not stored with)\n"
+            "\nExamples:\n"
+            + HelpExampleCli("migratewallet", "\"wallet.log\"")
+            + HelpExampleCli("migratewallet", "\"wallet.log\" \"log\"")
+            + HelpExampleRpc("migratewallet", "\"wallet.log\", \"log\"")
+        };
+
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    const std::string strFile = request.params[0].get_str();
+    if (fs::path(strFile).filename() != strFile || SanitizeString(strFile, SAFE_CHARS_FILENAME) != strFile) {
+        throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Invalid filename, it must be a file name without a path");
+    }
+    if (fs::exists(GetDataDir() / strFile)) {
+        throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, strprintf("%s already exists", strFile));
+    }
+
+    CWalletDBWrapper& dbw = pwallet->GetDBHandle();
+    std::string strBackend = dbw.IsLog() ? "bdb" : "log";
+    if (!request.params[1].isNull()) {
+        strBackend = request.params[1].get_str();
+    }
+    std::unique_ptr<CWalletDBWrapper> dbwDest;
+    if (strBackend == "log") {
+        dbwDest.reset(new CWalletDBWrapper(GetDataDir() / strFile, strFile));
+    } else if (strBackend == "bdb") {
+        dbwDest.reset(new CWalletDBWrapper(&bitdb, strFile));
+    } else {
+        throw JSONRPCError(RPCErrorCode::INVALID_PARAMETER, "Unknown backend: " + strBackend);
+    }
+
+    if (!dbw.CopyTo(*dbwDest)) {
+        dbwDest.reset();
+        fs::remove(GetDataDir() / strFile);
+        throw JSONRPCError(RPCErrorCode::WALLET_ERROR, "Error: Wallet migration failed!");
+    }
+
+    return NullUniValue;
+}
+
 UniValue keypoolrefill(const JSONRPCRequest& request)
 {
     const auto pwallet = GetWalletForJSONRPCRequest(request);
@@ -3371,7 +3504,7 @@ UniValue purchaseticket(const JSONRPCRequest& request)
             "8.  poolfees           (numeric, optional)            The amount of fees to pay to the stake pool\n"
             "9.  expiry             (numeric, optional)            Height at which the purchase tickets expire\n"
             "10.  \"comment\"         (string, optional)             Unused\n"
-            "11. ticketfee          (numeric, optional)            The transaction fee rate (BWS/kB) to use (overrides fees set by the wallet config or settxfee RPC)\n"
+            "11. ticketfee          (numeric, optional)            The transaction fee rate (BWS/kB) to use (default: estimated to be mined before expiry, see estimatesmartticketfee, or the setticketfee rate without an estimate)\n"
 
             "\nResult:\n"
             "\"value\"              (string) Hashes of resulting ticket transactions\n"
@@ -3695,6 +3828,52 @@ UniValue ticketbuyerconfig(const JSONRPCRequest& request)
     return result;
 }
 
+UniValue getticketbuyerstats(const JSONRPCRequest& request)
+{
+    const auto pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error{
+            "getticketbuyerstats\n"
+            "\nReturns the activity of the automatic ticket buyer since startup.\n"
+            "\nResult\n"
+            "{\n"
+            "  \"decisions\" : n,                    (numeric) number of blocks a purchase was decided for\n"
+            "  \"lastdecisionmicros\" : n,           (numeric) microseconds from the last block notification to its purchase decision\n"
+            "  \"maxdecisionmicros\" : n,            (numeric) longest time to a purchase decision, in microseconds\n"
+            "  \"avgdecisionmicros\" : n,            (numeric) average time to a purchase decision, in microseconds\n"
+            "  \"interval\" : n,                     (numeric) stake difficulty interval of the last purchase\n"
+            "  \"ticketsininterval\" : n,            (numeric) number of tickets purchased for that interval\n"
+            "  \"ticketsinpreviousinterval\" : n,    (numeric) number of tickets purchased for the interval before\n"
+            "  \"tickets\" : n                       (numeric) number of tickets purchased in total\n"
+            "}\n"
+            "\nExample:\n"
+            + HelpExampleCli("getticketbuyerstats", "")
+            + HelpExampleRpc("getticketbuyerstats", "")
+        };
+
+    CTicketBuyer *tb = pwallet->GetTicketBuyer();
+    if (tb == nullptr)
+        throw JSONRPCError(RPCErrorCode::INTERNAL_ERROR, "Ticket buyer not found.");
+
+    const CTicketBuyerStats stats = tb->GetStats();
+
+    UniValue result{UniValue::VOBJ};
+    result.push_back(Pair("decisions", stats.decisions));
+    result.push_back(Pair("lastdecisionmicros", stats.lastDecisionMicros));
+    result.push_back(Pair("maxdecisionmicros", stats.maxDecisionMicros));
+    result.push_back(Pair("avgdecisionmicros", stats.decisions > 0 ? stats.totalDecisionMicros / stats.decisions : 0));
+    result.push_back(Pair("interval", stats.currentInterval));
+    result.push_back(Pair("ticketsininterval", stats.ticketsInCurrentInterval));
+    result.push_back(Pair("ticketsinpreviousinterval", stats.ticketsInPreviousInterval));
+    result.push_back(Pair("tickets", stats.ticketsTotal));
+
+    return result;
+}
+
 UniValue setticketbuyeraccount(const JSONRPCRequest& request)
 {
     const auto pwallet = GetWalletForJSONRPCRequest(request);
@@ -4864,6 +5043,7 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
         throw std::runtime_error(
             "rescanblockchain (\"start_height\") (\"stop_height\")\n"
             "\nRescan the local blockchain for wallet related transactions.\n"
+            "With -addrindex, only the transactions the address index lists for the wallet scripts are read.\n"
             "\nArguments:\n"
             "1. \"start_height\"    (numeric, optional) block height where the rescan should start\n"
             "2. \"stop_height\"     (numeric, optional) the last block height that should be scanned\n"
@@ -4910,7 +5090,13 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
         }
     }
 
-    CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, true);
+    // With the address index, only the transactions touching the wallet scripts are read
+    std::set<CScript> setScripts;
+    if (fAddrIndex)
+        pwallet->GetScriptsForRescan(setScripts);
+    CBlockIndex *stopBlock = nullptr;
+    if (!fAddrIndex || !pwallet->ScanForWalletTransactionsByAddrIndex(setScripts, pindexStart, pindexStop, true))
+        stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, true);
     if (!stopBlock) {
         if (pwallet->IsAbortingRescan()) {
             throw JSONRPCError(RPCErrorCode::MISC_ERROR, "Rescan aborted.");
@@ -5520,12 +5706,13 @@ static const CRPCCommand commands[] =
     { "wallet",             "listreceivedbyaccount",            &listreceivedbyaccount,             {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listreceivedbyaddress",            &listreceivedbyaddress,             {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listsinceblock",                   &listsinceblock,                    {"blockhash","target_confirmations","include_watchonly","include_removed"} },
-    { "wallet",             "listtransactions",                 &listtransactions,                  {"account","count","skip","include_watchonly"} },
+    { "wallet",             "listtransactions",                 &listtransactions,                  {"account","count","skip","include_watchonly","txtype","cursor"} },
     { "wallet",             "listunspent",                      &listunspent,                       {"minconf","maxconf","addresses","include_unsafe","query_options"} },
     { "wallet",             "purchaseticket",                   &purchaseticket,                    {"fromaccount","spendlimit","minconf","ticketaddress","rewardaddress","numtickets","pooladdress","poolfees","expiry","comment","ticketfee"} },
     { "wallet",             "startticketbuyer",                 &startticketbuyer,                  {"fromaccount","maintain","passphrase","votingaccount","votingaddress","rewardaddress","poolfeeaddress","poolfees","limit","expiry"} },
     { "wallet",             "stopticketbuyer",                  &stopticketbuyer,                   {} },
     { "wallet",             "ticketbuyerconfig",                &ticketbuyerconfig,                 {} },
+    { "wallet",             "getticketbuyerstats",              &getticketbuyerstats,               {} },
     { "wallet",             "setticketbuyeraccount",            &setticketbuyeraccount,             {"fromaccount"} },
     { "wallet",             "setticketbuyerbalancetomaintain",  &setticketbuyerbalancetomaintain,   {"maintain"} },
     { "wallet",             "setticketbuyervotingaddress",      &setticketbuyervotingaddress,       {"votingaddress"} },
@@ -5548,6 +5735,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "listwallets",                      &listwallets,                       {} },
     { "wallet",             "listscripts",                      &listscripts,                       {} },
     { "wallet",             "lockunspent",                      &lockunspent,                       {"unlock","transactions"} },
+    { "wallet",             "migratewallet",                    &migratewallet,                     {"filename","backend"} },
     { "wallet",             "move",                             &movecmd,                           {"fromaccount","toaccount","amount","minconf","comment"} },
     { "wallet",             "sendfrom",                         &sendfrom,                          {"fromaccount","toaddress","amount","minconf","comment","comment_to"} },
     { "wallet",             "sendmany",                         &sendmany,                          {"fromaccount","amounts","minconf","comment","subtractfeefrom","replaceable","conf_target","estimate_mode"} },
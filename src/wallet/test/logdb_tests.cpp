@@ -0,0 +1,160 @@
+// Copyright (c) 2017-2020 Project PAI Foundation
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/db.h"
+#include "wallet/logdb.h"
+#include "wallet/wallet.h"
+#include "wallet/test/wallet_test_fixture.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern CWallet* pwalletMain;
+
+BOOST_FIXTURE_TEST_SUITE(logdb_tests, WalletTestingSetup)
+
+BOOST_AUTO_TEST_CASE(log_batches_replay)
+{
+    const fs::path path = pathTemp / "replay.log";
+    {
+        CWalletDBWrapper dbw(path, "replay.log");
+        CDB db(dbw, "cr+");
+        BOOST_CHECK(db.Write(std::string("a"), 1));
+        BOOST_CHECK(db.Write(std::string("b"), 2));
+        BOOST_CHECK(!db.Write(std::string("b"), 3, false));
+        BOOST_CHECK(db.Erase(std::string("a")));
+
+        // A transaction is seen by its own handle, and only committed as a whole.
+        int n = 0;
+        BOOST_CHECK(db.TxnBegin());
+        BOOST_CHECK(db.Write(std::string("c"), 3));
+        BOOST_CHECK(db.Read(std::string("c"), n));
+        BOOST_CHECK_EQUAL(n, 3);
+        BOOST_CHECK(db.TxnAbort());
+        BOOST_CHECK(!db.Exists(std::string("c")));
+
+        BOOST_CHECK(db.TxnBegin());
+        BOOST_CHECK(db.Write(std::string("c"), 3));
+        BOOST_CHECK(db.Erase(std::string("b")));
+        BOOST_CHECK(!db.Exists(std::string("b")));
+        BOOST_CHECK(db.TxnCommit());
+    }
+    BOOST_CHECK(CWalletLog::IsLogFile(path));
+
+    // Garbage after the last batch, as left by a torn write, is dropped.
+    const uintmax_t nSize = fs::file_size(path);
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file);
+    fwrite("\x20\x00\x00\x00\xff", 1, 5, file);
+    fclose(file);
+
+    CWalletDBWrapper dbw(path, "replay.log");
+    {
+        CDB db(dbw, "r");
+        int n = 0, nVersion = 0;
+        BOOST_CHECK(!db.Exists(std::string("a")));
+        BOOST_CHECK(!db.Exists(std::string("b")));
+        BOOST_CHECK(db.Read(std::string("c"), n));
+        BOOST_CHECK_EQUAL(n, 3);
+        BOOST_CHECK(db.ReadVersion(nVersion));
+        BOOST_CHECK_EQUAL(nVersion, CLIENT_VERSION);
+
+        // The cursor walks the keys in order and can start at any of them.
+        BOOST_CHECK(db.StartCursor());
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssKey << std::string("c");
+        BOOST_CHECK_EQUAL(db.ReadAtCursor(ssKey, ssValue, true), 0);
+        std::string strKey;
+        ssKey >> strKey;
+        BOOST_CHECK_EQUAL(strKey, "c");
+        BOOST_CHECK_EQUAL(db.ReadAtCursor(ssKey, ssValue), 0);
+        ssKey >> strKey;
+        BOOST_CHECK_EQUAL(strKey, "version");
+        BOOST_CHECK_EQUAL(db.ReadAtCursor(ssKey, ssValue), DB_NOTFOUND);
+        db.CloseCursor();
+    }
+    BOOST_CHECK_EQUAL(fs::file_size(path), nSize);
+}
+
+BOOST_AUTO_TEST_CASE(log_no_overwrite)
+{
+    const fs::path path = pathTemp / "nooverwrite.log";
+    CWalletDBWrapper dbw(path, "nooverwrite.log");
+    CDB db(dbw, "cr+");
+    CDB db2(dbw, "r+");
+
+    // A key created by another handle before the commit fails the whole transaction.
+    int n = 0;
+    BOOST_CHECK(db.TxnBegin());
+    BOOST_CHECK(db.Write(std::string("a"), 1, false));
+    BOOST_CHECK(db.Write(std::string("b"), 1));
+    BOOST_CHECK(db2.Write(std::string("a"), 2, false));
+    BOOST_CHECK(!db.TxnCommit());
+    BOOST_CHECK(!db2.Exists(std::string("b")));
+    BOOST_CHECK(db.Read(std::string("a"), n));
+    BOOST_CHECK_EQUAL(n, 2);
+
+    // A key erased by the transaction itself can be created again.
+    BOOST_CHECK(db.TxnBegin());
+    BOOST_CHECK(db.Erase(std::string("a")));
+    BOOST_CHECK(db.Write(std::string("a"), 3, false));
+    BOOST_CHECK(!db.Write(std::string("a"), 4, false));
+    BOOST_CHECK(db.TxnCommit());
+    BOOST_CHECK(db2.Read(std::string("a"), n));
+    BOOST_CHECK_EQUAL(n, 3);
+}
+
+BOOST_AUTO_TEST_CASE(log_compaction)
+{
+    const fs::path path = pathTemp / "compact.log";
+    CWalletDBWrapper dbw(path, "compact.log");
+    const std::vector<unsigned char> vch(10000, 0x42);
+    {
+        CDB db(dbw, "cr+", false);
+        for (int i = 0; i < 200; i++)
+            BOOST_CHECK(db.Write(std::make_pair(std::string("blob"), i % 2), vch));
+        BOOST_CHECK(db.Write(std::make_pair(std::string("pool"), 0), vch));
+    }
+    BOOST_CHECK(fs::file_size(path) > 200 * vch.size());
+
+    // Flushing compacts the log down to its live records.
+    dbw.Flush(false);
+    BOOST_CHECK(fs::file_size(path) < 4 * vch.size());
+
+    // A rewrite drops the skipped keys.
+    BOOST_CHECK(dbw.Rewrite("\x04pool"));
+    BOOST_CHECK(fs::file_size(path) < 3 * vch.size());
+    CDB db(dbw, "r");
+    std::vector<unsigned char> vchRead;
+    BOOST_CHECK(db.Read(std::make_pair(std::string("blob"), 1), vchRead));
+    BOOST_CHECK(vchRead == vch);
+    BOOST_CHECK(!db.Exists(std::make_pair(std::string("pool"), 0)));
+}
+
+BOOST_AUTO_TEST_CASE(log_migration)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+
+    // BerkeleyDB to log and back, loading the wallet from each copy.
+    std::unique_ptr<CWalletDBWrapper> dbwLog(new CWalletDBWrapper(pathTemp / "migrated.log", "migrated.log"));
+    BOOST_CHECK(pwalletMain->GetDBHandle().CopyTo(*dbwLog));
+    std::unique_ptr<CWalletDBWrapper> dbwBack(new CWalletDBWrapper(&bitdb, "migrated.dat"));
+    BOOST_CHECK(dbwLog->CopyTo(*dbwBack));
+
+    for (auto* dbw : {&dbwLog, &dbwBack}) {
+        CWallet wallet(std::move(*dbw));
+        bool fFirstRun;
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(!fFirstRun);
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.HaveKey(key.GetPubKey().GetID()));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1463,6 +1463,14 @@ BOOST_FIXTURE_TEST_CASE(ticket_buyer, WalletStakeTestingSetup)
     for (size_t i = 0; static_cast<int>(i) < cfg.limit; ++i)
         CheckTicket(*txsInMempoolBeforeLastBlock[1 + i].get(), {TicketContribData(1, vspKeyId, 0, 0, TicketContribData::DefaultFeeLimit), TicketContribData(1, ticketKeyId, 0, 0, TicketContribData::DefaultFeeLimit)});
 
+    // Statistics
+
+    const CTicketBuyerStats stats = tb->GetStats();
+    BOOST_CHECK_GE(stats.decisions, 4);
+    BOOST_CHECK_GE(stats.maxDecisionMicros, stats.lastDecisionMicros);
+    BOOST_CHECK_GE(stats.ticketsTotal, 1 + 1 + 2 * cfg.limit);
+    BOOST_CHECK_GE(stats.ticketsInCurrentInterval, cfg.limit);
+
     tb->stop();
 }
 
@@ -1643,6 +1651,11 @@ BOOST_FIXTURE_TEST_CASE(ticket_buyer_rpc, WalletStakeTestingSetup)
     BOOST_CHECK_EQUAL(find_value(r.get_obj(), "minConf").get_int(), 1);
     BOOST_CHECK_EQUAL(find_value(r.get_obj(), "expiry").get_int(), 100);
 
+    BOOST_CHECK_THROW(CallRpc("getticketbuyerstats 1"), std::runtime_error);
+    BOOST_CHECK_NO_THROW(r = CallRpc("getticketbuyerstats"));
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "decisions").get_int64(), 0);
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "tickets").get_int64(), 0);
+
     // Start (with minimal settings)
 
     BOOST_CHECK_THROW(CallRpc("startticketbuyer"), std::runtime_error);
@@ -723,6 +723,65 @@ BOOST_FIXTURE_TEST_CASE(vote_transaction_vsp, WalletStakeTestingSetup)
         BOOST_CHECK(std::find_if(votesInLastBlock.begin(), votesInLastBlock.end(), [&voteHash](const CTransactionRef tx) { return tx->GetHash() == voteHash; }) != votesInLastBlock.end());
 }
 
+// test the votes prepared for the tickets of the wallet
+BOOST_FIXTURE_TEST_CASE(vote_templates, WalletStakeTestingSetup)
+{
+    std::string voteHashStr;
+    CWalletError we;
+
+    LOCK2(cs_main, wallet->cs_wallet);
+
+    ExtendChain(consensus.nStakeValidationHeight - chainActive.Height());
+
+    wallet->UpdateVoteTemplates(chainActive.Tip());
+
+    BOOST_CHECK(chainActive.Tip()->pstakeNode->Winners().size() > 1);
+
+    // every live ticket of the wallet has its vote prepared
+
+    for (const uint256& ticketHash : chainActive.Tip()->pstakeNode->LiveTickets())
+        BOOST_CHECK_EQUAL(wallet->HasVoteTemplate(ticketHash), wallet->GetWalletTx(ticketHash) != nullptr);
+
+    // the prepared vote is used, then dropped with the spent ticket
+
+    {
+        const uint256 ticketHash = chainActive.Tip()->pstakeNode->Winners()[0];
+        BOOST_CHECK(wallet->HasVoteTemplate(ticketHash));
+
+        std::tie(voteHashStr, we) = wallet->Vote(ticketHash, chainActive.Tip()->GetBlockHash(), chainActive.Tip()->nHeight, VoteBits::rttAccepted, extendedVoteBitsData.empty);
+        BOOST_CHECK_EQUAL(we.code, CWalletError::SUCCESSFUL);
+        BOOST_CHECK(!wallet->HasVoteTemplate(ticketHash));
+
+        const CWalletTx* ticket = wallet->GetWalletTx(ticketHash);
+        BOOST_CHECK(ticket != nullptr);
+        const CWalletTx* vote = wallet->GetWalletTx(uint256S(voteHashStr));
+        BOOST_CHECK(vote != nullptr);
+        CheckVote(*vote->tx, *ticket->tx);
+
+        ExtendChain(1);
+        wallet->UpdateVoteTemplates(chainActive.Tip());
+        BOOST_CHECK(!wallet->HasVoteTemplate(ticketHash));
+    }
+
+    // a zapped ticket loses its prepared vote
+
+    {
+        const uint256 ticketHash = chainActive.Tip()->pstakeNode->Winners()[0];
+        BOOST_CHECK(wallet->HasVoteTemplate(ticketHash));
+
+        std::vector<uint256> vHashIn{ticketHash};
+        std::vector<uint256> vHashOut;
+        BOOST_CHECK_EQUAL(wallet->ZapSelectTx(vHashIn, vHashOut), DB_LOAD_OK);
+        BOOST_CHECK(!wallet->HasVoteTemplate(ticketHash));
+
+        wallet->UpdateVoteTemplates(chainActive.Tip());
+        BOOST_CHECK(!wallet->HasVoteTemplate(ticketHash));
+
+        std::tie(voteHashStr, we) = wallet->Vote(ticketHash, chainActive.Tip()->GetBlockHash(), chainActive.Tip()->nHeight, VoteBits::rttAccepted, extendedVoteBitsData.empty);
+        BOOST_CHECK_EQUAL(we.code, CWalletError::INVALID_ADDRESS_OR_KEY);
+    }
+}
+
 // test the failing transaction for votes that spend ticket not belonging to the wallet
 BOOST_FIXTURE_TEST_CASE(foreign_ticket_vote_transaction, WalletStakeTestingSetup)
 {
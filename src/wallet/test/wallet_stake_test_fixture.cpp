@@ -8,6 +8,7 @@
 #include "wallet/test/wallet_stake_test_fixture.h"
 #include "script/script.h"
 #include "validation.h"
+#include "validationinterface.h"
 #include "wallet/coincontrol.h"
 #include "wallet/fees.h"
 #include "net.h"
@@ -683,6 +684,10 @@ bool WalletStakeTestingSetup::ExtendChain(int blockCount, bool withImplicitVotes
         }
     }
 
+    // there is no scheduler thread in the tests, run what the listeners
+    // queued for the new tips, such as the ticket purchases, here
+    GetMainSignals().FlushBackgroundCallbacks();
+
     return result;
 }
 
@@ -14,11 +14,14 @@
 #include <vector>
 
 #include "consensus/validation.h"
+#include "policy/policy.h"
 #include "rpc/server.h"
+#include "script/interpreter.h"
 #include "test/test_bwscoin.h"
 #include "validation.h"
 #include "wallet/coincontrol.h"
 #include "wallet/test/wallet_test_fixture.h"
+#include "wallet/walletdb.h"
 
 #include <boost/test/unit_test.hpp>
 #include <univalue.h>
@@ -374,6 +377,43 @@ static void AddKey(CWallet& wallet, const CKey& key)
     wallet.AddKeyPubKey(key, key.GetPubKey());
 }
 
+BOOST_FIXTURE_TEST_CASE(rescan_with_addrindex, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        BOOST_CHECK(!wallet.ScanForWalletTransactionsByAddrIndex({GetScriptForDestination(coinbaseKey.GetPubKey().GetID())}, chainActive.Genesis(), nullptr));
+    }
+
+    // Only the blocks connected with the address index enabled are listed in it.
+    fAddrIndex = true;
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        std::set<CScript> setScripts;
+        wallet.GetScriptsForRescan(setScripts);
+        BOOST_CHECK(setScripts.count(GetScriptForDestination(coinbaseKey.GetPubKey().GetID())));
+        BOOST_CHECK(wallet.ScanForWalletTransactionsByAddrIndex(setScripts, chainActive.Genesis(), nullptr));
+        // BWSCOIN Note: If the initial block subsidy has been changed,
+        // update the subsidy with the correct value
+        BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 2 * 1500 * COIN);
+    }
+
+    // The scan stops at the requested block.
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        BOOST_CHECK(wallet.ScanForWalletTransactionsByAddrIndex({GetScriptForDestination(coinbaseKey.GetPubKey().GetID())}, chainActive.Genesis(), chainActive.Tip()->pprev));
+        BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 1500 * COIN);
+    }
+    fAddrIndex = false;
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
 {
     LOCK(cs_main);
@@ -451,6 +491,81 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// Check that the blocks read ahead on the rescan threads are applied in chain
+// order, that blocks read before the keypool got topped up are matched again,
+// and that a scan stops at the first block which left the active chain.
+BOOST_FIXTURE_TEST_CASE(rescan_reader, TestChain100Setup)
+{
+    LOCK(cs_main);
+
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        BOOST_CHECK(wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr) == nullptr);
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), coinbaseTxns.size());
+        for (size_t i = 0; i < coinbaseTxns.size(); i++)
+            BOOST_CHECK_EQUAL(wallet.mapWallet.at(coinbaseTxns[i].GetHash()).nOrderPos, static_cast<int64_t>(i));
+    }
+
+    // Mine to HD keys which only enter a keypool of one key as the scan finds
+    // the block paying to the previous one.
+    CKey masterKey;
+    CBlockIndex* pindexFirst = nullptr;
+    const unsigned int nKeys = 5;
+    {
+        CWallet walletGen;
+        LOCK(walletGen.cs_wallet);
+        CPubKey masterPubKey = walletGen.GenerateNewHDMasterKey();
+        BOOST_CHECK(walletGen.SetHDMasterKey(masterPubKey));
+        BOOST_CHECK(walletGen.GetKey(masterPubKey.GetID(), masterKey));
+        CWalletDB walletdb(walletGen.GetDBHandle());
+        for (unsigned int i = 0; i < nKeys; i++) {
+            CreateAndProcessBlock({}, GetScriptForDestination(walletGen.GenerateNewKey(walletdb).GetID()));
+            if (!pindexFirst)
+                pindexFirst = chainActive.Tip();
+        }
+    }
+
+    gArgs.ForceSetArg("-keypool", "1");
+    {
+        CWallet wallet;
+        {
+            LOCK(wallet.cs_wallet);
+            BOOST_CHECK(wallet.AddKeyPubKey(masterKey, masterKey.GetPubKey()));
+            BOOST_CHECK(wallet.SetHDMasterKey(masterKey.GetPubKey()));
+            BOOST_CHECK(wallet.TopUpKeyPool());
+        }
+        BOOST_CHECK(wallet.ScanForWalletTransactions(pindexFirst, nullptr) == nullptr);
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), nKeys);
+    }
+    gArgs.ForceSetArg("-keypool", std::to_string(DEFAULT_KEYPOOL_SIZE));
+
+    // Invalidate a block once the scan has started.
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        CBlockIndex* const pindexInvalid = chainActive[50];
+        bool fInvalidated = false;
+        wallet.NotifyTransactionChanged.connect([&](CWallet*, const uint256&, ChangeType) {
+            if (fInvalidated)
+                return;
+            fInvalidated = true;
+            CValidationState state;
+            BOOST_CHECK(InvalidateBlock(state, Params(), pindexInvalid));
+        });
+        BOOST_CHECK(wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr) == pindexInvalid);
+        BOOST_CHECK(fInvalidated);
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), static_cast<size_t>(pindexInvalid->nHeight - 1));
+
+        CValidationState state;
+        ResetBlockFailureFlags(pindexInvalid);
+        BOOST_CHECK(ActivateBestChain(state, Params()));
+    }
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -693,4 +808,160 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+// Check that the balances kept over the unspent outputs of the wallet follow
+// spends and abandoned spends, and agree with summing up all of mapWallet.
+BOOST_FIXTURE_TEST_CASE(unspent_balances, ListCoinsTestingSetup)
+{
+    LOCK2(cs_main, wallet->cs_wallet);
+
+    auto checkBalances = [&](CAmount nExpected) {
+        CAmount nBalance = 0, nImmature = 0;
+        for (const auto& entry : wallet->mapWallet) {
+            if (entry.second.IsTrusted())
+                nBalance += entry.second.GetAvailableCredit();
+            nImmature += entry.second.GetImmatureCredit();
+        }
+        BOOST_CHECK_EQUAL(wallet->GetBalance(), nExpected);
+        BOOST_CHECK_EQUAL(wallet->GetBalance(), nBalance);
+        BOOST_CHECK_EQUAL(wallet->GetImmatureBalance(), nImmature);
+        BOOST_CHECK_EQUAL(wallet->GetAvailableBalance(), nExpected);
+        std::vector<COutput> available;
+        wallet->AvailableCoins(available);
+        BOOST_CHECK_EQUAL(available.size(), nExpected > 0 ? 1U : 0U);
+    };
+
+    // BWSCOIN Note: If the initial block subsidy has been changed,
+    // update the subsidy with the correct value
+    checkBalances(1500 * COIN);
+
+    // Spend the only mature coin without relaying the spend. Neither the coin
+    // nor the change of the untrusted spend are available then.
+    CWalletTx wtx;
+    CReserveKey reservekey(wallet.get());
+    CAmount fee;
+    int changePos = -1;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransaction({CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false}}, wtx, reservekey, fee, changePos, error, dummy));
+    CValidationState state;
+    BOOST_CHECK(wallet->CommitTransaction(wtx, reservekey, nullptr, state));
+    checkBalances(0);
+
+    // Abandoning the spend makes the coin available again.
+    BOOST_CHECK(wallet->AbandonTransaction(wtx.GetHash()));
+    checkBalances(1500 * COIN);
+
+    // So does a bulk recomputation after MarkDirty.
+    wallet->MarkDirty();
+    checkBalances(1500 * COIN);
+}
+
+// Check that the transactions are filed by class and by the height of their
+// block, and move when they get confirmed.
+BOOST_FIXTURE_TEST_CASE(wallet_tx_indexes, ListCoinsTestingSetup)
+{
+    LOCK2(cs_main, wallet->cs_wallet);
+
+    // Only the coinbases of the chain so far, each at its height
+    BOOST_CHECK_EQUAL(wallet->mapWtxByHeight.size(), wallet->mapWallet.size());
+    BOOST_CHECK_EQUAL(wallet->mapWtxOrderedByClass[TX_Regular].size(), wallet->mapWallet.size());
+    for (const auto& entry : wallet->mapWtxByHeight) {
+        BOOST_CHECK_EQUAL(entry.first.first, entry.second->GetDepthInMainChain() > 0 ? chainActive.Height() + 1 - entry.second->GetDepthInMainChain() : -1);
+        BOOST_CHECK_EQUAL(entry.first.second, entry.second->nOrderPos);
+    }
+
+    CWalletTx wtx;
+    CReserveKey reservekey(wallet.get());
+    CAmount fee;
+    int changePos = -1;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransaction({CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false}}, wtx, reservekey, fee, changePos, error, dummy));
+    CValidationState state;
+    BOOST_CHECK(wallet->CommitTransaction(wtx, reservekey, nullptr, state));
+    const CWalletTx& wtxSpend = wallet->mapWallet.at(wtx.GetHash());
+    BOOST_CHECK_EQUAL(wtxSpend.nIndexedHeight, -1);
+    BOOST_CHECK(wallet->mapWtxByHeight.begin()->second == &wtxSpend);
+
+    // Confirming it files it under the height of its block.
+    CreateAndProcessBlock({CMutableTransaction(*wtxSpend.tx)}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    CWalletTx wtxConfirmed(wallet.get(), wtxSpend.tx);
+    wtxConfirmed.SetMerkleBranch(chainActive.Tip(), 1);
+    BOOST_CHECK(wallet->AddToWallet(wtxConfirmed));
+    BOOST_CHECK_EQUAL(wtxSpend.nIndexedHeight, chainActive.Height());
+    BOOST_CHECK(wallet->mapWtxByHeight.rbegin()->second == &wtxSpend);
+    BOOST_CHECK_EQUAL(wallet->mapWtxByHeight.size(), wallet->mapWallet.size());
+}
+
+// Check that a batch of transactions is signed in one go and written to the
+// wallet database in a single transaction.
+BOOST_FIXTURE_TEST_CASE(batch_sign_commit, ListCoinsTestingSetup)
+{
+    LOCK2(cs_main, wallet->cs_wallet);
+
+    // Split the mature coin into outputs of our own, one for each transaction of the batch.
+    const CScript scriptMine = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    const unsigned int nTxs = 8;
+    const CAmount nValue = 10 * COIN;
+    CWalletTx wtx;
+    CReserveKey reservekey(wallet.get());
+    CAmount fee;
+    int changePos = -1;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransaction(std::vector<CRecipient>(nTxs, CRecipient{scriptMine, nValue, false}), wtx, reservekey, fee, changePos, error, dummy));
+    CValidationState state;
+    BOOST_CHECK(wallet->CommitTransaction(wtx, reservekey, nullptr, state));
+    CreateAndProcessBlock({CMutableTransaction(*wtx.tx)}, scriptMine);
+    wallet->mapWallet.at(wtx.GetHash()).SetMerkleBranch(chainActive.Tip(), 1);
+
+    std::vector<CMutableTransaction> vtx;
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (static_cast<int>(i) == changePos)
+            continue;
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(wtx.GetHash(), i));
+        mtx.vout.emplace_back(nValue - 1000, GetScriptForRawPubKey({}));
+        vtx.push_back(mtx);
+    }
+    BOOST_REQUIRE_EQUAL(vtx.size(), nTxs);
+
+    // Every input is signed, whichever thread signed it.
+    BOOST_CHECK(wallet->SignTransactions(vtx));
+    for (const CMutableTransaction& mtx : vtx) {
+        BOOST_CHECK(VerifyScript(mtx.vin[0].scriptSig, scriptMine, &mtx.vin[0].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS,
+            MutableTransactionSignatureChecker(&mtx, 0, nValue)));
+    }
+
+    // A transaction spending an unknown output fails the whole batch.
+    std::vector<CMutableTransaction> vtxUnknown(1);
+    vtxUnknown[0].vin.emplace_back(COutPoint(uint256S("01"), 0));
+    BOOST_CHECK(!wallet->SignTransactions(vtxUnknown));
+
+    // The batch is committed with consecutive order positions, and all of it
+    // can be read back from the database.
+    std::vector<CWalletTx> vwtx;
+    for (const CMutableTransaction& mtx : vtx)
+        vwtx.emplace_back(wallet.get(), MakeTransactionRef(mtx));
+    const int64_t nOrderPos = wallet->nOrderPosNext;
+    std::vector<CValidationState> vState;
+    BOOST_CHECK(wallet->CommitTransactions(vwtx, nullptr, vState));
+    BOOST_CHECK_EQUAL(vState.size(), nTxs);
+    BOOST_CHECK_EQUAL(wallet->nOrderPosNext, nOrderPos + nTxs);
+    for (unsigned int i = 0; i < nTxs; i++)
+        BOOST_CHECK_EQUAL(wallet->mapWallet.at(vwtx[i].GetHash()).nOrderPos, nOrderPos + i);
+
+    std::vector<uint256> vHash;
+    std::vector<CWalletTx> vWtxRead;
+    BOOST_CHECK_EQUAL(CWalletDB(wallet->GetDBHandle()).FindWalletTx(vHash, vWtxRead), DB_LOAD_OK);
+    for (const CWalletTx& wtxNew : vwtx)
+        BOOST_CHECK(std::count(vHash.begin(), vHash.end(), wtxNew.GetHash()) == 1);
+
+    // The spent coins are no longer available.
+    std::vector<COutput> available;
+    wallet->AvailableCoins(available);
+    for (const COutput& out : available)
+        BOOST_CHECK(out.tx->GetHash() != wtx.GetHash() || out.i == changePos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
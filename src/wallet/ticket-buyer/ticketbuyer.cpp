@@ -8,29 +8,28 @@
 #include "ticketbuyer.h"
 #include "wallet/wallet.h"
 #include "validation.h"
+#include "pow.h"
+#include "utiltime.h"
+
+#include <algorithm>
 #include <numeric>
 
 CTicketBuyer::CTicketBuyer(CWallet* wallet) :
     configured(false),
-    shouldRun(true),
-    thread(&CTicketBuyer::mainLoop, this)
+    guard(std::make_shared<Guard>())
 {
     pwallet = wallet;
+    guard->buyer = this;
 }
 
 CTicketBuyer::~CTicketBuyer()
 {
     stop();
-    shouldRun.store(false);
-
-    // make sure that the thead doesn't remain
-    // stucked waiting the condition variable
-    mtx.lock();
-    cv.notify_one();
-    mtx.unlock();
 
-    if (thread.joinable())
-        thread.join();
+    // a purchase still in the queue must not reach the buyer,
+    // wait for the one in progress if any
+    std::lock_guard<std::mutex> lck{guard->mtx};
+    guard->buyer = nullptr;
 }
 
 void CTicketBuyer::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *, bool fInitialDownload)
@@ -39,21 +38,37 @@ void CTicketBuyer::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     if (fInitialDownload)
         return;
 
-    LOCK(cs_main);
-
-    const CBlockIndex* tip = chainActive.Tip();
-
-    // check if the new tip is indeed on chain active
-    if (pindexNew == nullptr || tip == nullptr || pindexNew->GetBlockHash() != tip->GetBlockHash())
+    if (pindexNew == nullptr || !config.buyTickets)
         return;
 
-    std::unique_lock<std::mutex> lck{mtx};
-    cv.notify_one();
+    // the notified tip replaces the one waiting, if any, so a burst of
+    // blocks is bought on once, on top of the last one
+    std::lock_guard<std::mutex> lck{mtx};
+    pendingTip = pindexNew;
+    pendingSince = GetTimeMicros();
+    if (buyQueued)
+        return;
+    buyQueued = true;
+
+    std::shared_ptr<Guard> g = guard;
+    CallFunctionInValidationInterfaceQueue([g] {
+        std::lock_guard<std::mutex> lck{g->mtx};
+        if (g->buyer != nullptr)
+            g->buyer->Buy();
+    });
 }
 
 void CTicketBuyer::start()
 {
     config.buyTickets = true;
+
+    // late initialization, just to ensure that the global are initialized and configured
+    if (!configured.load()) {
+        intervalSize = Params().GetConsensus().nStakeDiffWindowSize;
+        config.ParseCommandline();
+        ::RegisterValidationInterface(this);
+        configured.store(true);
+    }
 }
 
 void CTicketBuyer::stop()
@@ -66,150 +81,157 @@ bool CTicketBuyer::isStarted() const
     return config.buyTickets;
 }
 
-void CTicketBuyer::mainLoop()
+CTicketBuyerStats CTicketBuyer::GetStats() const
 {
-    int64_t height{0};
-    int64_t nextIntervalStart{0}, currentInterval{0}, intervalSize{-1};
-    int64_t expiry{0};
-    CAmount spendable{0};
-    CAmount sdiff{0};
-    int64_t buy{0};
-    int max{0};
-    bool shouldRelock{false};
-
-    while (shouldRun.load()) {
-        // wait until activated
-        if (! config.buyTickets) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            continue;
-        }
-
-        // late initialization, just to ensure that the global are initialized and configured
-        if (!configured.load()) {
-            intervalSize = Params().GetConsensus().nStakeDiffWindowSize;
-            config.ParseCommandline();
-            ::RegisterValidationInterface(this);
-            configured.store(true);
-        }
-
-        // wait until new block is received
-        std::unique_lock<std::mutex> lck{mtx};
-        cv.wait(lck);
-        lck.unlock();
-
-        // check if the thread was instructed to stop while
-        // waiting for the condition variable and stop
-        if (! shouldRun.load())
-            break;
-
-        if (!config.buyTickets)
-            return;
+    std::lock_guard<std::mutex> lck{mtx};
+    return stats;
+}
 
-        if (pwallet == nullptr)
-            continue;
+void CTicketBuyer::Buy()
+{
+    const CBlockIndex* tip{nullptr};
+    int64_t since{0};
+    {
+        std::lock_guard<std::mutex> lck{mtx};
+        std::swap(tip, pendingTip);
+        since = pendingSince;
+        buyQueued = false;
+    }
 
-        LOCK2(cs_main, pwallet->cs_wallet);
+    if (tip == nullptr || pwallet == nullptr || !config.buyTickets)
+        return;
 
-        if (chainActive.Tip() == nullptr)
-            continue;
+    PurchasePlan plan;
+    const bool shouldBuy = MakePlan(tip, plan);
 
-        height = chainActive.Height();
+    {
+        std::lock_guard<std::mutex> lck{mtx};
+        const int64_t latency = GetTimeMicros() - since;
+        ++stats.decisions;
+        stats.lastDecisionMicros = latency;
+        stats.maxDecisionMicros = std::max(stats.maxDecisionMicros, latency);
+        stats.totalDecisionMicros += latency;
+    }
 
-        // do not try to purchase tickets before the stake enabling height - ticket maturity,
-        // so they are mature at stake enabling height
-        if (height < Params().GetConsensus().nStakeEnabledHeight - Params().GetConsensus().nTicketMaturity)
-            continue;
+    if (shouldBuy)
+        Purchase(plan);
+}
 
-        // unlock wallet
-        shouldRelock = pwallet->IsLocked();
-        if (shouldRelock && ! pwallet->Unlock(config.passphrase)) {
-            LogPrintf("CTicketBuyer: Purchased tickets: Wrong passphrase\n");
-            continue;
+bool CTicketBuyer::MakePlan(const CBlockIndex* tip, PurchasePlan& plan)
+{
+    // The block index entries up to the notified tip do not change, so the
+    // plan is made from them without cs_main. The wallet balance is read
+    // from its cache.
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    plan.height = tip->nHeight;
+
+    // do not try to purchase tickets before the stake enabling height - ticket maturity,
+    // so they are mature at stake enabling height
+    if (plan.height < consensus.nStakeEnabledHeight - consensus.nTicketMaturity)
+        return false;
+
+    // calculate the height of the first block in the
+    // next stake difficulty interval:
+    if (plan.height + 2 >= nextIntervalStart) {
+        currentInterval = plan.height / intervalSize + 1;
+        nextIntervalStart = currentInterval * intervalSize;
+
+        // Skip this purchase when no more tickets may be purchased in the interval and
+        // the next sdiff is unknown. The earliest any ticket may be mined is two
+        // blocks from now, with the next block containing the split transaction
+        // that the ticket purchase spends.
+        if (plan.height + 2 == nextIntervalStart) {
+            LogPrintf("CTicketBuyer: Skipping purchase: next sdiff interval starts soon\n");
+            return false;
         }
 
-        // calculate the height of the first block in the
-        // next stake difficulty interval:
-        if (height + 2 >= nextIntervalStart) {
-            currentInterval = height / intervalSize + 1;
-            nextIntervalStart = currentInterval * intervalSize;
-
-            // Skip this purchase when no more tickets may be purchased in the interval and
-            // the next sdiff is unknown. The earliest any ticket may be mined is two
-            // blocks from now, with the next block containing the split transaction
-            // that the ticket purchase spends.
-            if (height + 2 == nextIntervalStart) {
-                LogPrintf("CTicketBuyer: Skipping purchase: next sdiff interval starts soon\n");
-                if (shouldRelock) pwallet->Lock();
-                continue;
-            }
-
-            // Set expiry to prevent tickets from being mined in the next
-            // sdiff interval. When the next block begins the new interval,
-            // the ticket is being purchased for the next interval; therefore
-            // increment expiry by a full sdiff window size to prevent it
-            // being mined in the interval after the next.
-            expiry = nextIntervalStart;
-            if (height + 1 == nextIntervalStart) {
-                expiry += intervalSize;
-            }
-
-            // Make sure to use the specified value if that is within the limits
-            // of the stake difficulty window.
-            if (height + config.txExpiry < expiry)
-                expiry = height + config.txExpiry;
+        // Set expiry to prevent tickets from being mined in the next
+        // sdiff interval. When the next block begins the new interval,
+        // the ticket is being purchased for the next interval; therefore
+        // increment expiry by a full sdiff window size to prevent it
+        // being mined in the interval after the next.
+        expiry = nextIntervalStart;
+        if (plan.height + 1 == nextIntervalStart) {
+            expiry += intervalSize;
         }
 
-        // TODO check rescan point
-        // Don't buy tickets for this attached block when transactions are not
-        // synced through the tip block.
+        // Make sure to use the specified value if that is within the limits
+        // of the stake difficulty window.
+        if (plan.height + config.txExpiry < expiry)
+            expiry = plan.height + config.txExpiry;
+    }
+    plan.interval = currentInterval;
+    plan.expiry = expiry;
+
+    // TODO check rescan point
+    // Don't buy tickets for this attached block when transactions are not
+    // synced through the tip block.
+
+    // Cannot purchase tickets if not broadcasting
+    if (! pwallet->GetBroadcastTransactions())
+        return false;
+
+    // Determine how many tickets to buy
+    plan.spendable = pwallet->GetAvailableBalance();
+    if (plan.spendable < config.maintain) {
+        LogPrintf("CTicketBuyer: Skipping purchase: low available balance\n");
+        return false;
+    }
+    plan.spendable -= config.maintain;
 
-        // Cannot purchase tickets if not broadcasting
-        if (! pwallet->GetBroadcastTransactions()) {
-            if (shouldRelock) pwallet->Lock();
-            continue;
-        }
+    plan.sdiff = CalculateNextRequiredStakeDifficulty(tip, consensus);
 
-        // Determine how many tickets to buy
-        spendable = pwallet->GetAvailableBalance();
-        if (spendable < config.maintain) {
-            LogPrintf("CTicketBuyer: Skipping purchase: low available balance\n");
-            if (shouldRelock) pwallet->Lock();
-            continue;
-        }
-        spendable -= config.maintain;
+    plan.buy = plan.spendable / plan.sdiff;
+    if (plan.buy <= 0) {
+        LogPrintf("CTicketBuyer: Skipping purchase: low available balance\n");
+        return false;
+    }
 
-        sdiff = CalculateNextRequiredStakeDifficulty(chainActive.Tip(), Params().GetConsensus());
+    const int max = consensus.nMaxFreshStakePerBlock;
+    if (plan.buy > max)
+        plan.buy = max;
 
-        buy = spendable / sdiff;
-        if (buy <= 0) {
-            LogPrintf("CTicketBuyer: Skipping purchase: low available balance\n");
-            if (shouldRelock) pwallet->Lock();
-            continue;
-        }
+    if (config.limit > 0 && plan.buy > config.limit)
+        plan.buy = config.limit;
 
-        max = Params().GetConsensus().nMaxFreshStakePerBlock;
-        if (buy > max)
-            buy = max;
+    return true;
+}
 
-        if (config.limit > 0 && buy > config.limit)
-            buy = config.limit;
+void CTicketBuyer::Purchase(const PurchasePlan& plan)
+{
+    // unlock wallet
+    bool shouldRelock = pwallet->IsLocked();
+    if (shouldRelock && ! pwallet->Unlock(config.passphrase)) {
+        LogPrintf("CTicketBuyer: Purchased tickets: Wrong passphrase\n");
+        return;
+    }
 
-        const auto&& r = pwallet->PurchaseTicket(config.account, spendable, config.minConf, config.votingAddress, config.rewardAddress, static_cast<unsigned int>(buy), config.poolFeeAddress, config.poolFees, expiry, 0 /*TODO Make sure this is handled correctly*/);
+    const auto&& r = pwallet->PurchaseTicket(config.account, plan.spendable, config.minConf, config.votingAddress, config.rewardAddress, static_cast<unsigned int>(plan.buy), config.poolFeeAddress, config.poolFees, plan.expiry, 0 /*estimated feerate*/);
 
-        if (r.second.code != CWalletError::SUCCESSFUL)
-            LogPrintf("CTicketBuyer: Failed to purchase tickets: (%d) %s\n", r.second.code, r.second.message.c_str());
+    if (shouldRelock) pwallet->Lock();
 
-        if (r.first.size() > 0) {
-            std::string hashes;
-            for (const auto& h : r.first) {
-                if (hashes.length() > 0)
-                    hashes += ", ";
-                hashes += h;
-            }
-            LogPrintf("CTicketBuyer: Purchased tickets: %s\n", hashes.c_str());
-        } else
-            LogPrintf("CTicketBuyer: Successful, but not ticket hashes are available\n");
+    if (r.second.code != CWalletError::SUCCESSFUL)
+        LogPrintf("CTicketBuyer: Failed to purchase tickets: (%d) %s\n", r.second.code, r.second.message.c_str());
 
-        if (shouldRelock) pwallet->Lock();
+    if (r.first.size() > 0) {
+        std::string hashes;
+        for (const auto& h : r.first) {
+            if (hashes.length() > 0)
+                hashes += ", ";
+            hashes += h;
+        }
+        LogPrintf("CTicketBuyer: Purchased tickets: %s\n", hashes.c_str());
+    } else
+        LogPrintf("CTicketBuyer: Successful, but not ticket hashes are available\n");
+
+    std::lock_guard<std::mutex> lck{mtx};
+    if (plan.interval != stats.currentInterval) {
+        stats.ticketsInPreviousInterval = plan.interval == stats.currentInterval + 1 ? stats.ticketsInCurrentInterval : 0;
+        stats.ticketsInCurrentInterval = 0;
+        stats.currentInterval = plan.interval;
     }
+    stats.ticketsInCurrentInterval += r.first.size();
+    stats.ticketsTotal += r.first.size();
 }
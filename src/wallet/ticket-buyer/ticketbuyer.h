@@ -11,16 +11,35 @@
 #include "validationinterface.h"
 
 #include <atomic>
-#include <thread>
-#include <condition_variable>
+#include <memory>
 #include <mutex>
 
 class CWallet;
 
+// Counters of the ticket buyer since startup.
+// The decision latency runs from the notification of a new tip until the
+// purchase for it is decided, including the time waiting in the queue.
+// The purchases are counted per stake difficulty interval.
+struct CTicketBuyerStats {
+    int64_t decisions{0};
+    int64_t lastDecisionMicros{0};
+    int64_t maxDecisionMicros{0};
+    int64_t totalDecisionMicros{0};
+
+    int64_t currentInterval{-1};
+    int64_t ticketsInCurrentInterval{0};
+    int64_t ticketsInPreviousInterval{0};
+    int64_t ticketsTotal{0};
+};
+
 // The Automatic Ticket Buyer (TB)
 // This is responsible with monitoring the blockchain advance
 // and automatically generate and publish any ticket purchase transaction
 // on behalf of the user.
+// The purchases are not made on the notifying thread: each new tip is
+// handed to the validation interface queue, where the purchase is decided
+// from a snapshot of the tip and the wallet balance and only its commit
+// takes the wallet locks. Tips arriving while one is pending replace it.
 
 class CTicketBuyer : public CValidationInterface {
 public:
@@ -33,11 +52,25 @@ public:
     CTicketBuyerConfig& GetConfig() { return config; }
 
     void start();
-    void stop();    // does not stop immediately, but only after the current iteration
+    void stop();    // does not stop immediately, but only after the current purchase
     bool isStarted() const;
 
+    CTicketBuyerStats GetStats() const;
+
 private:
-    void mainLoop();
+    // What to buy on top of a tip
+    struct PurchasePlan {
+        int64_t height{0};
+        int64_t interval{0};
+        int64_t expiry{0};
+        CAmount spendable{0};
+        CAmount sdiff{0};
+        int64_t buy{0};
+    };
+
+    void Buy();
+    bool MakePlan(const CBlockIndex* tip, PurchasePlan& plan);
+    void Purchase(const PurchasePlan& plan);
 
     CTicketBuyerConfig config;
 
@@ -45,12 +78,26 @@ private:
 
     std::atomic<bool> configured;
 
-    std::atomic<bool> shouldRun;
-
-    std::thread thread;
-
-    std::condition_variable cv;
-    std::mutex mtx;
+    // the state of the stake difficulty interval, only used from the queue
+    int64_t nextIntervalStart{0};
+    int64_t currentInterval{0};
+    int64_t intervalSize{-1};
+    int64_t expiry{0};
+
+    // Lets the queued purchases find out that the buyer is gone
+    struct Guard {
+        std::mutex mtx;
+        CTicketBuyer* buyer;
+    };
+    std::shared_ptr<Guard> guard;
+
+    // the tip waiting for a purchase and when it was notified
+    mutable std::mutex mtx;
+    const CBlockIndex* pendingTip{nullptr};
+    int64_t pendingSince{0};
+    bool buyQueued{false};
+
+    CTicketBuyerStats stats;
 };
 
 #endif // BWSCOIN_WALLET_TICKETBUYER_TICKETBUYER_H
@@ -22,6 +22,7 @@
 #include "keystore.h"
 #include "validation.h"
 #include "net.h"
+#include "net_processing.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "policy/rbf.h"
@@ -39,6 +40,12 @@
 #include "stake/stakepoolfee.h"
 
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -185,6 +192,60 @@ void CWallet::RemoveFromWtxOrdered(std::vector<uint256> hashes)
 //    CWalletDB(*dbw).WriteOrderPosNext(nOrderPosNext);
 }
 
+// The height of the active chain block a wallet transaction is in, -1 if none
+static int GetWalletTxHeight(const CWalletTx& wtx)
+{
+    if (wtx.hashUnset() || wtx.nIndex == -1)
+        return -1;
+    auto mi = mapBlockIndex.find(wtx.hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return -1;
+    return mi->second->nHeight;
+}
+
+void CWallet::IndexWalletTx(CWalletTx& wtx)
+{
+    mapWtxOrderedByClass[ParseTxClass(*wtx.tx)].insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
+    wtx.nIndexedHeight = GetWalletTxHeight(wtx);
+    mapWtxByHeight.insert(std::make_pair(std::make_pair(wtx.nIndexedHeight, wtx.nOrderPos), &wtx));
+}
+
+void CWallet::UnindexWalletTx(const CWalletTx& wtx)
+{
+    TxItems& txOrdered = mapWtxOrderedByClass[ParseTxClass(*wtx.tx)];
+    for (auto it = txOrdered.lower_bound(wtx.nOrderPos); it != txOrdered.end() && it->first == wtx.nOrderPos; ++it) {
+        if (it->second.first == &wtx) {
+            txOrdered.erase(it);
+            break;
+        }
+    }
+
+    auto range = mapWtxByHeight.equal_range(std::make_pair(wtx.nIndexedHeight, wtx.nOrderPos));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == &wtx) {
+            mapWtxByHeight.erase(it);
+            break;
+        }
+    }
+}
+
+void CWallet::ReindexWalletTxHeight(CWalletTx& wtx)
+{
+    const int nHeight = GetWalletTxHeight(wtx);
+    if (nHeight == wtx.nIndexedHeight)
+        return;
+
+    auto range = mapWtxByHeight.equal_range(std::make_pair(wtx.nIndexedHeight, wtx.nOrderPos));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == &wtx) {
+            mapWtxByHeight.erase(it);
+            break;
+        }
+    }
+    wtx.nIndexedHeight = nHeight;
+    mapWtxByHeight.insert(std::make_pair(std::make_pair(nHeight, wtx.nOrderPos), &wtx));
+}
+
 const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
 {
     LOCK(cs_wallet);
@@ -782,6 +843,57 @@ void CWallet::AddToSpends(const uint256& wtxid)
     }
 }
 
+void CWallet::UpdateWalletUnspent(const COutPoint& outpoint)
+{
+    if (fWalletUnspentDirty)
+        return;
+
+    auto it = mapWallet.find(outpoint.hash);
+    if (it != mapWallet.end() && outpoint.n < it->second.tx->vout.size()) {
+        const CTxOut& txout = it->second.tx->vout[outpoint.n];
+        if (txout.nValue > 0 && IsMine(txout) != ISMINE_NO && !IsSpent(outpoint.hash, outpoint.n)) {
+            setWalletUnspent.insert(outpoint);
+            return;
+        }
+    }
+    setWalletUnspent.erase(outpoint);
+}
+
+void CWallet::UpdateWalletUnspent(const CWalletTx& wtx)
+{
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++)
+        UpdateWalletUnspent(COutPoint(hash, i));
+
+    // Stakebase and coinbase inputs have a null prevout, which is never in mapWallet
+    for (const CTxIn& txin : wtx.tx->vin) {
+        if (mapWallet.count(txin.prevout.hash))
+            UpdateWalletUnspent(txin.prevout);
+    }
+
+    cachedBalances.fValid = false;
+}
+
+const std::set<COutPoint>& CWallet::GetWalletUnspent() const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (fWalletUnspentDirty) {
+        setWalletUnspent.clear();
+        for (const auto& entry : mapWallet) {
+            const uint256& hash = entry.first;
+            const CTransaction& tx = *entry.second.tx;
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                if (tx.vout[i].nValue > 0 && IsMine(tx.vout[i]) != ISMINE_NO && !IsSpent(hash, i))
+                    setWalletUnspent.insert(COutPoint(hash, i));
+            }
+        }
+        fWalletUnspentDirty = false;
+    }
+
+    return setWalletUnspent;
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -1040,6 +1152,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        fWalletUnspentDirty = true;
+        cachedBalances.fValid = false;
     }
 }
 
@@ -1058,6 +1172,7 @@ bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
     assert(wtx.mapValue.count("replaced_by_txid") == 0);
 
     wtx.mapValue["replaced_by_txid"] = newHash.ToString();
+    cachedBalances.fValid = false;
 
     CWalletDB walletdb(*dbw, "r+");
 
@@ -1074,9 +1189,13 @@ bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 {
-    LOCK(cs_wallet);
-
     CWalletDB walletdb(*dbw, "r+", fFlushOnClose);
+    return AddToWallet(wtxIn, walletdb);
+}
+
+bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB& walletdb)
+{
+    LOCK(cs_wallet);
 
     uint256 hash = wtxIn.GetHash();
 
@@ -1092,6 +1211,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
         AddToSpends(hash);
+        IndexWalletTx(wtx);
     }
 
     bool fUpdated = false;
@@ -1119,6 +1239,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
             wtx.fFromMe = wtxIn.fFromMe;
             fUpdated = true;
         }
+        // Also after the block of the transaction got disconnected
+        ReindexWalletTxHeight(wtx);
     }
 
     //// debug print
@@ -1131,6 +1253,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
+    UpdateWalletUnspent(wtx);
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -1151,11 +1274,16 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
 {
     uint256 hash = wtxIn.GetHash();
 
+    auto mi = mapWallet.find(hash);
+    if (mi != mapWallet.end())
+        UnindexWalletTx(mi->second);
+
     mapWallet[hash] = wtxIn;
     CWalletTx& wtx = mapWallet[hash];
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
     AddToSpends(hash);
+    IndexWalletTx(wtx);
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
@@ -1165,6 +1293,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
             }
         }
     }
+    UpdateWalletUnspent(wtx);
 
     return true;
 }
@@ -1284,6 +1413,9 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            UpdateWalletUnspent(wtx);
+            ReindexWalletTxHeight(wtx);
+            mapVoteTemplates.erase(wtx.GetHash());
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1349,6 +1481,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            UpdateWalletUnspent(wtx);
+            ReindexWalletTxHeight(wtx);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1665,72 +1799,22 @@ bool CWallet::IsMyTicket(const uint256& ticketHash) const
 
 bool CWallet::IsTicketInMempool(const CTransaction& ticket) const
 {
-    std::string reason;
-
-    LOCK(mempool.cs);
-    auto& txClassIndex = mempool.mapTx.get<tx_class>();
-    auto tickets = txClassIndex.equal_range(ETxClass::TX_BuyTicket);
-
-    for (auto ticketTxIter = tickets.first; ticketTxIter != tickets.second; ++ticketTxIter) {
-        const CTransaction& tx = ticketTxIter->GetTx();
-
-        if (!ValidateBuyTicketStructure(tx, reason))
-            continue;
-
-        // same ticket?
-        if (ticket.GetHash() == tx.GetHash())
-            return true;
-
-        // spend same funding transaction?
-        for (auto& ticketIn: ticket.vin)
-            for (auto& txIn: tx.vin)
-                if (ticketIn.prevout == txIn.prevout)
-                    return true;
-    }
-
-    return false;
+    return mempool.existsTicketOrConflict(ticket);
 }
 
 bool CWallet::IsTicketVotedInMempool(const uint256& ticketHash) const
 {
-    std::string reason;
-
-    LOCK(mempool.cs);
-    auto& txClassIndex = mempool.mapTx.get<tx_class>();
-    auto votes = txClassIndex.equal_range(ETxClass::TX_Vote);
-
-    for (auto voteTxIter = votes.first; voteTxIter != votes.second; ++voteTxIter) {
-        const CTransaction& tx = voteTxIter->GetTx();
-
-        if (!ValidateVoteStructure(tx, reason))
-            continue;
-
-        if (ticketHash == tx.vin[voteStakeInputIndex].prevout.hash)
-            return true;
-    }
-
-    return false;
+    return mempool.existsTicketSpender(ticketHash, TX_Vote);
 }
 
 bool CWallet::IsTicketRevokedInMempool(const uint256& ticketHash) const
 {
-    std::string reason;
-
-    LOCK(mempool.cs);
-    auto& txClassIndex = mempool.mapTx.get<tx_class>();
-    auto revocations = txClassIndex.equal_range(ETxClass::TX_RevokeTicket);
-
-    for (auto revocationTxIter = revocations.first; revocationTxIter != revocations.second; ++revocationTxIter) {
-        const CTransaction& tx = revocationTxIter->GetTx();
-
-        if (!ValidateRevokeTicketStructure(tx, reason))
-            continue;
-
-        if (ticketHash == tx.vin[revocationStakeInputIndex].prevout.hash)
-            return true;
-    }
+    return mempool.existsTicketSpender(ticketHash, TX_RevokeTicket);
+}
 
-    return false;
+CFeeRate CWallet::GetTicketFeeRateEstimate(unsigned int confTarget)
+{
+    return GetTicketPurchaseFeeRate(confTarget, GetTicketFeeRate(), ::mempool, ::feeEstimator, nullptr);
 }
 
 std::pair<uint256, CWalletError> CWallet::CreateTicketPurchaseSplitTx(std::string fromAccount, CAmount ticketPrice, CAmount ticketFee, CAmount vspFee, int numTickets, CAmount feeRate)
@@ -1779,7 +1863,7 @@ std::pair<uint256, CWalletError> CWallet::CreateTicketPurchaseSplitTx(std::strin
 
     CFeeRate txFeeRate{feeRate};
     if (feeRate <= 0) {
-        txFeeRate = GetTicketFeeRate();
+        txFeeRate = GetTicketFeeRateEstimate(DEFAULT_TICKET_CONFIRM_TARGET);
     }
 
     if (GetBroadcastTransactions() && !g_connman) {
@@ -2033,10 +2117,16 @@ std::pair<std::vector<std::string>, CWalletError> CWallet::PurchaseTicket(std::s
     // check ticketAddress type, only P2PKH and P2SH are accepted
     // seems to always be the case while the address is valid
 
-    // TODO Make sure this is handled correctly
+    // without an explicit feerate, aim for inclusion before the ticket expires
     CFeeRate txFeeRate{feeRate};
     if (feeRate <= 0) {
-        txFeeRate = GetTicketFeeRate();
+        unsigned int confTarget = DEFAULT_TICKET_CONFIRM_TARGET;
+        if (expiry > 0) {
+            // clamp before the cast, so that an expiry at or below the tip cannot wrap around
+            const int64_t nBlocksToExpiry = expiry - chainActive.Height();
+            confTarget = static_cast<unsigned int>(std::min<int64_t>(std::max<int64_t>(nBlocksToExpiry, 1), ::feeEstimator.HighestStakeTargetTracked()));
+        }
+        txFeeRate = GetTicketFeeRateEstimate(confTarget);
     }
 
     // calculate the ticket fee based on transaction size estimation
@@ -2085,15 +2175,16 @@ std::pair<std::vector<std::string>, CWalletError> CWallet::PurchaseTicket(std::s
         return std::make_pair(results, error);
     }
 
+    if (GetBroadcastTransactions() && !g_connman) {
+        error.Load(CWalletError::CLIENT_P2P_DISABLED, "Peer-to-peer functionality missing or disabled");
+        return std::make_pair(results, error);
+    }
+
     // create ticket purchase transactions using the corresponding inputs of the split transaction
     // and having the dedicated output structure for ticket purchase
+    std::vector<CMutableTransaction> vTicketTx(numTickets);
     for (unsigned int i = 0; i < numTickets; ++i) {
-        if (GetBroadcastTransactions() && !g_connman) {
-            error.Load(CWalletError::CLIENT_P2P_DISABLED, "Peer-to-peer functionality missing or disabled");
-            return std::make_pair(results, error);
-        }
-
-        CMutableTransaction mTicketTx;
+        CMutableTransaction& mTicketTx = vTicketTx[i];
 
         mTicketTx.nExpiry = static_cast<uint32_t>(expiry);
 
@@ -2197,137 +2288,102 @@ std::pair<std::vector<std::string>, CWalletError> CWallet::PurchaseTicket(std::s
             error.Load(CWalletError::TRANSACTION_ERROR, "Error while constructing buy ticket transaction :" + reason);
             return std::make_pair(results, error);
         }
+    }
 
-        if (!SignTransaction(mTicketTx)) {
-            error.Load(CWalletError::TRANSACTION_ERROR, "Signing transaction failed");
-            return std::make_pair(results, error);
-        }
+    // sign the whole batch at once, in parallel
+    if (!SignTransactions(vTicketTx)) {
+        error.Load(CWalletError::TRANSACTION_ERROR, "Signing transaction failed");
+        return std::make_pair(results, error);
+    }
 
+    std::vector<CWalletTx> vwtx;
+    for (CMutableTransaction& mTicketTx : vTicketTx) {
         // Uncommenting the following lines will disable replacing-by-fee of this ticket transaction
         // This might be undesirable, so caution must be taken if uncommenting these lines
         if (IsTicketInMempool(mTicketTx))
            continue;
 
-        CValidationState state;
         CWalletTx wtx;
         wtx.fTimeReceivedIsTxTime = true;
         wtx.BindWallet(this);
         wtx.SetTx(MakeTransactionRef(std::move(mTicketTx)));
-        CReserveKey reservekey{this};
-        if (!CommitTransaction(wtx, reservekey, g_connman.get(), state)) {
-            error.Load(CWalletError::TRANSACTION_ERROR, "Committing transaction failed");
-            return std::make_pair(results, error);
-        }
+        vwtx.push_back(std::move(wtx));
+    }
 
-        results.push_back(wtx.GetHash().GetHex());
+    // write all tickets to the wallet in one database transaction and relay them together
+    std::vector<CValidationState> vState;
+    if (!CommitTransactions(vwtx, g_connman.get(), vState)) {
+        error.Load(CWalletError::TRANSACTION_ERROR, "Committing transaction failed");
+        return std::make_pair(results, error);
     }
 
+    for (const CWalletTx& wtx : vwtx)
+        results.push_back(wtx.GetHash().GetHex());
+
     return std::make_pair(results, error);
 }
 
-std::pair<std::string, CWalletError> CWallet::Vote(const uint256& ticketHash, const uint256& blockHash, const int blockHeight, const VoteBits voteBits, const ExtendedVoteBits& extendedVoteBits)
+// Sets the amounts of the reward outputs of a vote, which follow its declaration
+static bool SetVoteRewards(CMutableTransaction& mVoteTx, const std::vector<TicketContribData>& contributions, const CAmount ticketPrice, const CAmount voteSubsidy, CWalletError& error)
 {
-    std::string voteHash;
-    CWalletError error;
-
-    // Validations
-
-    if (ticketHash == uint256()) {
-        error.Load(CWalletError::INVALID_PARAMETER, "Invalid ticket hash");
-        return std::make_pair(voteHash, error);
-    }
-
-    const Consensus::Params& consensus = Params().GetConsensus();
-
-    if (blockHeight < consensus.nStakeValidationHeight - 1) {
-        error.Load(CWalletError::INVALID_PARAMETER, "Height is lower than expected (below the stake validation height)");
-        return std::make_pair(voteHash, error);
+    std::vector<CAmount> rewards = CalculateNetRemunerations(contributions, ticketPrice, voteSubsidy /*no fee for votes*/);
+    if (rewards.size() != contributions.size() || mVoteTx.vout.size() != contributions.size() + 1) {
+        error.Load(CWalletError::TRANSACTION_ERROR, "Could not retrive correct rewards");
+        return false;
     }
 
-    LOCK2(cs_main, cs_wallet);
-
-    if (IsLocked()) {
-        error.Load(CWalletError::WALLET_UNLOCK_NEEDED, "Please enter the wallet passphrase with walletpassphrase first");
-        return std::make_pair(voteHash, error);
-    }
+    for (unsigned i = 0; i < contributions.size(); ++i) {
+        const CAmount& reward = rewards[i];
+        if (!MoneyRange(reward)) {
+            error.Load(CWalletError::TRANSACTION_ERROR, "Incorrect reward");
+            return false;
+        }
 
-    if (!extendedVoteBits.isValid()) {
-        error.Load(CWalletError::INVALID_PARAMETER, "Invalid extended vote bits");
-        return std::make_pair(voteHash, error);
+        mVoteTx.vout[i + 1].nValue = reward;
     }
 
-    if (IsTicketVotedInMempool(ticketHash)) {
-       error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Ticket is already used for a vote in mempool");
-       return std::make_pair(voteHash, error);
-    }
+    return true;
+}
 
-    if (IsTicketRevokedInMempool(ticketHash)) {
-       error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Ticket is already used for a revocation in mempool");
-       return std::make_pair(voteHash, error);
-    }
+bool CWallet::BuildVoteTemplate(const uint256& ticketHash, int nHeight, CVoteTemplate& vt, CWalletError& error) const
+{
+    AssertLockHeld(cs_wallet);
 
     const CWalletTx* ticketWtx = GetWalletTx(ticketHash);
     if (ticketWtx == nullptr) {
         error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Ticket is invalid or does not belong to the wallet");
-        return std::make_pair(voteHash, error);
+        return false;
     }
 
     const CTransactionRef& ticket = ticketWtx->tx;
     if (ticket == nullptr) {
         error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Ticket is invalid or does not belong to the wallet");
-        return std::make_pair(voteHash, error);
+        return false;
     }
 
     std::string reason;
 
     if (ParseTxClass(*ticket) != TX_BuyTicket || !ValidateBuyTicketStructure(*ticket, reason) ) {
         error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Invalid ticket hash, must be hash of a ticket purchase transaction");
-        return std::make_pair(voteHash, error);
+        return false;
     }
 
-    // verify the voted block and it's winners
-    if (mapBlockIndex.count(blockHash) == 0) {
-        error.Load(CWalletError::INVALID_PARAMETER, "Block not found");
-        return std::make_pair(voteHash, error);
-    }
-    const CBlockIndex* const blockIndex = mapBlockIndex[blockHash];
-    if (blockHeight != blockIndex->nHeight) {
-        error.Load(CWalletError::INVALID_PARAMETER, "Invalid block height (different than the actual height of the specified block)");
-        return std::make_pair(voteHash, error);
-    }
-    if (blockIndex->pstakeNode != nullptr
-            && std::find(blockIndex->pstakeNode->Winners().begin(), blockIndex->pstakeNode->Winners().end(), ticket->GetHash()) == blockIndex->pstakeNode->Winners().end()) {
-        error.Load(CWalletError::INVALID_PARAMETER, "Ticket is not selected to vote in this block");
-        return std::make_pair(voteHash, error);
-    }
+    const Consensus::Params& consensus = Params().GetConsensus();
 
     // ticket contributions
 
-    std::vector<TicketContribData> contributions;
     CAmount totalContribution{0};
     CAmount totalVoteFeeLimit{0};
     CAmount totalRevocationFeeLimit{0};
-    if (!ParseTicketContribs(*ticket, contributions, totalContribution, totalVoteFeeLimit, totalRevocationFeeLimit)) {
+    if (!ParseTicketContribs(*ticket, vt.contributions, totalContribution, totalVoteFeeLimit, totalRevocationFeeLimit)) {
         error.Load(CWalletError::TRANSACTION_ERROR, "Specified ticket has invalid contributions");
-        return std::make_pair(voteHash, error);
-    }
-
-    // funds
-
-    const CAmount& ticketPrice = ticket->vout[ticketStakeOutputIndex].nValue;
-    const CAmount& voteSubsidy = GetVoterSubsidy(blockHeight + 1, consensus);
-
-    // rewards
-
-    std::vector<CAmount> rewards = CalculateNetRemunerations(contributions, ticketPrice, voteSubsidy /*no fee for votes*/);
-    if (rewards.size() != contributions.size()) {
-        error.Load(CWalletError::TRANSACTION_ERROR, "Could not retrive correct rewards");
-        return std::make_pair(voteHash, error);
+        return false;
     }
 
     // vote transaction
 
-    CMutableTransaction mVoteTx;
+    CMutableTransaction& mVoteTx = vt.voteTx;
+    mVoteTx = CMutableTransaction();
 
     // inputs
 
@@ -2339,73 +2395,223 @@ std::pair<std::string, CWalletError> CWallet::Vote(const uint256& ticketHash, co
 
     // outputs
 
-    // transaction declaration (block being voted, the vote and stake version)
-    VoteData voteData{1, blockHash, static_cast<uint32_t>(blockHeight), voteBits, defaultVoterStakeVersion, extendedVoteBits};
-    CScript declScript = GetScriptForVoteDecl(voteData);
-    mVoteTx.vout.push_back(CTxOut(0, declScript));
+    // transaction declaration, filled in with the voted block
+    mVoteTx.vout.push_back(CTxOut());
 
     // payment outputs containing the proportional rewards
-    for (unsigned i = 0; i < contributions.size(); ++i) {
-        const TicketContribData& contrib = contributions[i];
-
-        const CAmount& reward = rewards[i];
-        if (!MoneyRange(reward)) {
-            error.Load(CWalletError::TRANSACTION_ERROR, "Incorrect reward");
-            return std::make_pair(voteHash, error);
-        }
-
+    for (const TicketContribData& contrib : vt.contributions) {
         CScript script;
         if (contrib.whichAddr == 0) {
             error.Load(CWalletError::TRANSACTION_ERROR, "The reward address type is not correct");
-            return std::make_pair(voteHash, error);
+            return false;
         } else if (contrib.whichAddr == 1) {
             script = GetScriptForDestination(CKeyID(contrib.rewardAddr));
         } else {
             script = GetScriptForDestination(CScriptID(contrib.rewardAddr));
         }
 
-        mVoteTx.vout.push_back(CTxOut(reward, script));
+        mVoteTx.vout.push_back(CTxOut(0, script));
     }
 
-    // structural validation
+    // rewards
 
-    if (!ValidateVoteStructure(mVoteTx, reason)) {
-        error.Load(CWalletError::TRANSACTION_ERROR, "Failed to build the vote transaction: " + reason);
-        return std::make_pair(voteHash, error);
-    }
+    vt.voteSubsidy = GetVoterSubsidy(nHeight + 1, consensus);
+    if (!SetVoteRewards(mVoteTx, vt.contributions, ticket->vout[ticketStakeOutputIndex].nValue, vt.voteSubsidy, error))
+        return false;
 
-    // signature (for stake input only)
+    vt.ticket = ticket;
+    return true;
+}
 
-    {
-        CTransaction tx(mVoteTx);
-        const CScript& scriptPubKey = ticket->vout[ticketStakeOutputIndex].scriptPubKey;
-        SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &tx, 1, ticketPrice, SIGHASH_ALL), scriptPubKey, sigdata)) {
-            error.Load(CWalletError::TRANSACTION_ERROR, "Could not sign the vote transaction");
-            return std::make_pair(voteHash, error);
-        }
-        UpdateTransaction(mVoteTx, 1, sigdata);
-    }
+void CWallet::UpdateVoteTemplates(const CBlockIndex* pindex)
+{
+    if (pindex == nullptr)
+        return;
 
-    // commitment
+    const Consensus::Params& consensus = Params().GetConsensus();
 
-    CValidationState state;
-    CWalletTx wtx;
-    wtx.fTimeReceivedIsTxTime = true;
-    wtx.BindWallet(this);
-    wtx.SetTx(MakeTransactionRef(std::move(mVoteTx)));
-    CReserveKey reservekey{this};
-    if (!CommitTransaction(wtx, reservekey, g_connman.get(), state)) {
-        error.Load(CWalletError::TRANSACTION_ERROR, "Committing transaction failed");
-        return std::make_pair(voteHash, error);
+    LOCK2(cs_main, cs_wallet);
+
+    // A ticket can be selected once it is live, so also keep the ones still
+    // maturing; once neither, it voted, missed or got abandoned.
+    auto IsLiveOrImmature = [&](const CWalletTx& wtx) {
+        if (wtx.isAbandoned())
+            return false;
+        if (pindex->pstakeNode != nullptr && pindex->pstakeNode->ExistsLiveTicket(wtx.GetHash()))
+            return true;
+        const int nDepth = wtx.GetDepthInMainChain();
+        return nDepth > 0 && nDepth <= consensus.nTicketMaturity;
+    };
+
+    for (auto it = mapVoteTemplates.begin(); it != mapVoteTemplates.end(); ) {
+        const auto mi = mapWallet.find(it->first);
+        if (mi == mapWallet.end() || !IsLiveOrImmature(mi->second))
+            it = mapVoteTemplates.erase(it);
+        else
+            ++it;
     }
 
-    voteHash = wtx.GetHash().GetHex();
+    // The votes are expected on the blocks following pindex
+    auto AddTemplate = [&](const CWalletTx& wtx) {
+        const uint256& ticketHash = wtx.GetHash();
+        if (mapVoteTemplates.count(ticketHash) > 0 || ParseTxClass(*wtx.tx) != TX_BuyTicket
+                || !IsLiveOrImmature(wtx) || !IsMyTicket(*wtx.tx))
+            return;
 
-    return std::make_pair(voteHash, error);
-}
+        CVoteTemplate vt;
+        CWalletError error;
+        if (BuildVoteTemplate(ticketHash, pindex->nHeight + 1, vt, error))
+            mapVoteTemplates.emplace(ticketHash, std::move(vt));
+        else
+            LogPrintf("%s: cannot prepare the vote of %s: %s\n", __func__, ticketHash.GetHex(), error.message);
+    };
 
-std::pair<std::string, CWalletError> CWallet::Revoke(const uint256& ticketHash)
+    // The tickets that were live before the wallet started are only in the
+    // stake node; afterwards, new tickets are among the recent transactions.
+    if (!fVoteTemplatesLoaded && pindex->pstakeNode != nullptr) {
+        for (const uint256& ticketHash : pindex->pstakeNode->LiveTickets()) {
+            const auto mi = mapWallet.find(ticketHash);
+            if (mi != mapWallet.end())
+                AddTemplate(mi->second);
+        }
+        fVoteTemplatesLoaded = true;
+    }
+
+    const int nMinHeight = std::max(0, pindex->nHeight - static_cast<int>(consensus.nTicketMaturity));
+    for (auto it = mapWtxByHeight.lower_bound(std::make_pair(nMinHeight, std::numeric_limits<int64_t>::min())); it != mapWtxByHeight.end(); ++it)
+        AddTemplate(*it->second);
+}
+
+bool CWallet::HasVoteTemplate(const uint256& ticketHash) const
+{
+    LOCK(cs_wallet);
+    return mapVoteTemplates.count(ticketHash) > 0;
+}
+
+std::pair<std::string, CWalletError> CWallet::Vote(const uint256& ticketHash, const uint256& blockHash, const int blockHeight, const VoteBits voteBits, const ExtendedVoteBits& extendedVoteBits)
+{
+    std::string voteHash;
+    CWalletError error;
+
+    // Validations
+
+    if (ticketHash == uint256()) {
+        error.Load(CWalletError::INVALID_PARAMETER, "Invalid ticket hash");
+        return std::make_pair(voteHash, error);
+    }
+
+    const Consensus::Params& consensus = Params().GetConsensus();
+
+    if (blockHeight < consensus.nStakeValidationHeight - 1) {
+        error.Load(CWalletError::INVALID_PARAMETER, "Height is lower than expected (below the stake validation height)");
+        return std::make_pair(voteHash, error);
+    }
+
+    LOCK2(cs_main, cs_wallet);
+
+    if (IsLocked()) {
+        error.Load(CWalletError::WALLET_UNLOCK_NEEDED, "Please enter the wallet passphrase with walletpassphrase first");
+        return std::make_pair(voteHash, error);
+    }
+
+    if (!extendedVoteBits.isValid()) {
+        error.Load(CWalletError::INVALID_PARAMETER, "Invalid extended vote bits");
+        return std::make_pair(voteHash, error);
+    }
+
+    if (IsTicketVotedInMempool(ticketHash)) {
+       error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Ticket is already used for a vote in mempool");
+       return std::make_pair(voteHash, error);
+    }
+
+    if (IsTicketRevokedInMempool(ticketHash)) {
+       error.Load(CWalletError::INVALID_ADDRESS_OR_KEY, "Ticket is already used for a revocation in mempool");
+       return std::make_pair(voteHash, error);
+    }
+
+    CVoteTemplate vtBuilt;
+    const CVoteTemplate* vt = &vtBuilt;
+    const auto itTemplate = mapVoteTemplates.find(ticketHash);
+    if (itTemplate != mapVoteTemplates.end())
+        vt = &itTemplate->second;
+    else if (!BuildVoteTemplate(ticketHash, blockHeight, vtBuilt, error))
+        return std::make_pair(voteHash, error);
+    const CTransactionRef& ticket = vt->ticket;
+
+    // verify the voted block and it's winners
+    if (mapBlockIndex.count(blockHash) == 0) {
+        error.Load(CWalletError::INVALID_PARAMETER, "Block not found");
+        return std::make_pair(voteHash, error);
+    }
+    const CBlockIndex* const blockIndex = mapBlockIndex[blockHash];
+    if (blockHeight != blockIndex->nHeight) {
+        error.Load(CWalletError::INVALID_PARAMETER, "Invalid block height (different than the actual height of the specified block)");
+        return std::make_pair(voteHash, error);
+    }
+    if (blockIndex->pstakeNode != nullptr
+            && !blockIndex->pstakeNode->ExistsWinner(ticket->GetHash())) {
+        error.Load(CWalletError::INVALID_PARAMETER, "Ticket is not selected to vote in this block");
+        return std::make_pair(voteHash, error);
+    }
+
+    // funds
+
+    const CAmount& ticketPrice = ticket->vout[ticketStakeOutputIndex].nValue;
+    const CAmount& voteSubsidy = GetVoterSubsidy(blockHeight + 1, consensus);
+
+    // vote transaction, with the rewards of the actual subsidy
+
+    CMutableTransaction mVoteTx = vt->voteTx;
+    if (voteSubsidy != vt->voteSubsidy && !SetVoteRewards(mVoteTx, vt->contributions, ticketPrice, voteSubsidy, error))
+        return std::make_pair(voteHash, error);
+
+    // transaction declaration (block being voted, the vote and stake version)
+    VoteData voteData{1, blockHash, static_cast<uint32_t>(blockHeight), voteBits, defaultVoterStakeVersion, extendedVoteBits};
+    mVoteTx.vout[0] = CTxOut(0, GetScriptForVoteDecl(voteData));
+
+    // structural validation
+
+    std::string reason;
+    if (!ValidateVoteStructure(mVoteTx, reason)) {
+        error.Load(CWalletError::TRANSACTION_ERROR, "Failed to build the vote transaction: " + reason);
+        return std::make_pair(voteHash, error);
+    }
+
+    // signature (for stake input only)
+
+    {
+        CTransaction tx(mVoteTx);
+        const CScript& scriptPubKey = ticket->vout[ticketStakeOutputIndex].scriptPubKey;
+        SignatureData sigdata;
+        if (!ProduceSignature(TransactionSignatureCreator(this, &tx, 1, ticketPrice, SIGHASH_ALL), scriptPubKey, sigdata)) {
+            error.Load(CWalletError::TRANSACTION_ERROR, "Could not sign the vote transaction");
+            return std::make_pair(voteHash, error);
+        }
+        UpdateTransaction(mVoteTx, 1, sigdata);
+    }
+
+    // commitment
+
+    CValidationState state;
+    CWalletTx wtx;
+    wtx.fTimeReceivedIsTxTime = true;
+    wtx.BindWallet(this);
+    wtx.SetTx(MakeTransactionRef(std::move(mVoteTx)));
+    CReserveKey reservekey{this};
+    if (!CommitTransaction(wtx, reservekey, g_connman.get(), state)) {
+        error.Load(CWalletError::TRANSACTION_ERROR, "Committing transaction failed");
+        return std::make_pair(voteHash, error);
+    }
+
+    voteHash = wtx.GetHash().GetHex();
+
+    // the ticket is spent now
+    mapVoteTemplates.erase(ticketHash);
+
+    return std::make_pair(voteHash, error);
+}
+
+std::pair<std::string, CWalletError> CWallet::Revoke(const uint256& ticketHash)
 {
     std::string revocationHash;
     CWalletError error;
@@ -2731,10 +2937,13 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
  * be called whenever new keys are added to the wallet, with the oldest key
  * creation time.
  *
+ * If pscripts is set, it holds the scripts the new keys pay to and, when the
+ * address index is enabled, only the transactions it lists for them are read.
+ *
  * @return Earliest timestamp that could be successfully scanned from. Timestamp
  * returned will be higher than startTime if relevant blocks could not be read.
  */
-int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
+int64_t CWallet::RescanFromTime(int64_t startTime, bool update, const std::set<CScript>* pscripts)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(cs_wallet);
@@ -2745,6 +2954,9 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
     CBlockIndex* const startBlock = chainActive.FindEarliestAtLeast(startTime - TIMESTAMP_WINDOW);
     LogPrintf("%s: Rescanning last %i blocks\n", __func__, startBlock ? chainActive.Height() - startBlock->nHeight + 1 : 0);
 
+    if (startBlock && pscripts != nullptr && ScanForWalletTransactionsByAddrIndex(*pscripts, startBlock, nullptr, update)) {
+        return startTime;
+    }
     if (startBlock) {
         const CBlockIndex* const failedBlock = ScanForWalletTransactions(startBlock, nullptr, update);
         if (failedBlock) {
@@ -2754,6 +2966,94 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
     return startTime;
 }
 
+/**
+ * Reads the blocks of a rescan ahead of the wallet on a few threads and tests
+ * their transactions against the wallet scripts, which only takes the key
+ * store lock. The blocks are handed out in chain order, at most
+ * RESCAN_READ_AHEAD of them being held at a time.
+ */
+class CRescanBlockReader
+{
+public:
+    struct Entry {
+        bool fRead = false;
+        CBlock block;
+        //! Whether an output of each transaction of the block is the wallet's
+        std::vector<bool> vMine;
+    };
+
+private:
+    const CWallet& wallet;
+    const std::vector<CBlockIndex*>& vIndex;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Entry> vEntries;
+    std::vector<bool> vReady;
+    size_t nNextRead;
+    size_t nNextTake;
+    bool fStop;
+    std::vector<std::thread> vThreads;
+
+    void Thread()
+    {
+        while (true) {
+            size_t nIndex;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return fStop || nNextRead >= vIndex.size() || nNextRead < nNextTake + RESCAN_READ_AHEAD; });
+                if (fStop || nNextRead >= vIndex.size())
+                    return;
+                nIndex = nNextRead++;
+            }
+
+            Entry entry;
+            entry.fRead = ReadBlockFromDisk(entry.block, vIndex[nIndex], Params().GetConsensus());
+            if (entry.fRead) {
+                entry.vMine.reserve(entry.block.vtx.size());
+                for (const auto& tx : entry.block.vtx)
+                    entry.vMine.push_back(wallet.IsMine(*tx));
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            vEntries[nIndex % RESCAN_READ_AHEAD] = std::move(entry);
+            vReady[nIndex % RESCAN_READ_AHEAD] = true;
+            cond.notify_all();
+        }
+    }
+
+public:
+    CRescanBlockReader(const CWallet& walletIn, const std::vector<CBlockIndex*>& vIndexIn, int nThreads) :
+        wallet(walletIn), vIndex(vIndexIn), vEntries(RESCAN_READ_AHEAD), vReady(RESCAN_READ_AHEAD, false), nNextRead(0), nNextTake(0), fStop(false)
+    {
+        for (int i = 0; i < nThreads; i++)
+            vThreads.emplace_back(&TraceThread<std::function<void()>>, "rescan", std::function<void()>(std::bind(&CRescanBlockReader::Thread, this)));
+    }
+
+    ~CRescanBlockReader()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+            cond.notify_all();
+        }
+        for (auto& thread : vThreads)
+            thread.join();
+    }
+
+    //! Wait for the next block of the rescan
+    Entry Take()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return vReady[nNextTake % RESCAN_READ_AHEAD]; });
+        Entry entry = std::move(vEntries[nNextTake % RESCAN_READ_AHEAD]);
+        vReady[nNextTake % RESCAN_READ_AHEAD] = false;
+        nNextTake++;
+        cond.notify_all();
+        return entry;
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -2765,6 +3065,10 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
  *
  * If pindexStop is not a nullptr, the scan will stop at the block-index
  * defined by pindexStop
+ *
+ * The blocks are read and matched against the wallet scripts by a
+ * CRescanBlockReader, the matches are then applied in chain order. A scan
+ * stops early if it reaches a block which is no longer in the active chain.
  */
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, bool fUpdate)
 {
@@ -2775,18 +3079,44 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
         assert(pindexStop->nHeight >= pindexStart->nHeight);
     }
 
-    CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
+    fAbortRescan = false;
+    fScanningWallet = true;
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    std::vector<CBlockIndex*> vIndex;
+    double dProgressStart;
+    double dProgressTip;
+    int64_t nKeyPoolIndex;
     {
         LOCK2(cs_main, cs_wallet);
-        fAbortRescan = false;
-        fScanningWallet = true;
+        for (CBlockIndex* pindex = pindexStart; pindex; pindex = chainActive.Next(pindex)) {
+            vIndex.push_back(pindex);
+            if (pindex == pindexStop)
+                break;
+        }
+        dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindexStart);
+        dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+        nKeyPoolIndex = m_max_keypool_index;
+    }
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
-        double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
-        while (pindex && !fAbortRescan)
+    {
+        CRescanBlockReader reader(*this, vIndex, std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS)));
+
+        // Blocks before this one may have been matched before keys were added
+        // to the keypool, their outputs are tested again under the lock.
+        size_t nRecheckEnd = 0;
+        size_t nPos = 0;
+        for (; nPos < vIndex.size() && !fAbortRescan; nPos++)
         {
+            CBlockIndex* pindex = vIndex[nPos];
+            const CRescanBlockReader::Entry entry = reader.Take();
+
+            LOCK2(cs_main, cs_wallet);
+            if (!chainActive.Contains(pindex)) {
+                ret = pindex;
+                break;
+            }
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
             if (GetTime() >= nNow + 60) {
@@ -2794,27 +3124,130 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-            } else {
+            if (!entry.fRead) {
                 ret = pindex;
+                continue;
+            }
+            for (size_t posInBlock = 0; posInBlock < entry.block.vtx.size(); ++posInBlock) {
+                const CTransactionRef& ptx = entry.block.vtx[posInBlock];
+                if (entry.vMine[posInBlock] || nPos < nRecheckEnd || IsRelatedToWallet(*ptx))
+                    AddToWalletIfInvolvingMe(ptx, pindex, posInBlock, fUpdate);
+            }
+            if (nKeyPoolIndex != m_max_keypool_index) {
+                nKeyPoolIndex = m_max_keypool_index;
+                nRecheckEnd = nPos + 1 + RESCAN_READ_AHEAD;
+            }
+        }
+        if (nPos < vIndex.size() && fAbortRescan) {
+            LogPrintf("Rescan aborted at block %d. Progress=%f\n", vIndex[nPos]->nHeight, GuessVerificationProgress(chainParams.TxData(), vIndex[nPos]));
+        }
+    }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+    fScanningWallet = false;
+    return ret;
+}
+
+/**
+ * Scan the transactions which the address index lists for the given scripts
+ * between pindexStart and pindexStop (or the tip), instead of every block.
+ * The keys drawn from the keypool while adding them are looked up as well.
+ *
+ * Returns false when the address index is not enabled or a transaction could
+ * not be read, in which case the caller should fall back to
+ * ScanForWalletTransactions.
+ */
+bool CWallet::ScanForWalletTransactionsByAddrIndex(const std::set<CScript>& setScripts, const CBlockIndex* pindexStart, const CBlockIndex* pindexStop, bool fUpdate)
+{
+    LOCK2(cs_main, cs_wallet);
+    if (!fAddrIndex)
+        return false;
+
+    const int nStopHeight = pindexStop ? pindexStop->nHeight : chainActive.Height();
+    std::set<CScript> setToFind = setScripts;
+    bool fResult = true;
+
+    fAbortRescan = false;
+    fScanningWallet = true;
+    ShowProgress(_("Rescanning..."), 0);
+    while (fResult && !setToFind.empty() && !fAbortRescan) {
+        const int64_t nKeyPoolIndex = m_max_keypool_index;
+
+        // Group the listed transactions by block, in chain order
+        std::map<std::tuple<unsigned int, int, unsigned int>, std::set<unsigned int>> mapBlockTxs;
+        for (const CScript& script : setToFind) {
+            std::set<CExtDiskTxPos> setPos;
+            if (!FindTransactionsByScript(script, setPos)) {
+                fResult = false;
+                break;
             }
-            if (pindex == pindexStop) {
+            for (const CExtDiskTxPos& pos : setPos) {
+                if ((int)pos.nHeight >= pindexStart->nHeight && (int)pos.nHeight <= nStopHeight)
+                    mapBlockTxs[std::make_tuple(pos.nHeight, pos.nFile, pos.nPos)].insert(pos.nTxOffset);
+            }
+        }
+        LogPrintf("%s: Reading transactions of %u blocks for %u scripts\n", __func__, mapBlockTxs.size(), setToFind.size());
+
+        size_t nBlocks = 0;
+        for (const auto& item : mapBlockTxs) {
+            if (!fResult || fAbortRescan)
+                break;
+            if (++nBlocks % 100 == 0)
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(nBlocks * 100 / mapBlockTxs.size()))));
+
+            std::vector<std::pair<int, CTransactionRef>> vtx;
+            uint256 hashBlock;
+            if (!ReadTransactionsAtOffsets(CDiskBlockPos(std::get<1>(item.first), std::get<2>(item.first)), item.second, vtx, hashBlock)) {
+                fResult = false;
                 break;
             }
-            pindex = chainActive.Next(pindex);
+
+            // The index keeps listing the transactions of blocks which left the active chain
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+                continue;
+            for (const auto& tx : vtx)
+                AddToWalletIfInvolvingMe(tx.second, mi->second, tx.first, fUpdate);
         }
-        if (pindex && fAbortRescan) {
-            LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+
+        setToFind.clear();
+        for (const auto& entry : m_pool_key_to_index) {
+            if (entry.second > nKeyPoolIndex)
+                setToFind.insert(GetScriptForDestination(entry.first));
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    }
+    if (fAbortRescan) {
+        LogPrintf("Rescan aborted\n");
+    }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
 
-        fScanningWallet = false;
+    fScanningWallet = false;
+    return fResult;
+}
+
+void CWallet::GetScriptsForRescan(std::set<CScript>& setScripts) const
+{
+    for (const CKeyID& keyid : GetKeys())
+        setScripts.insert(GetScriptForDestination(keyid));
+
+    LOCK(cs_KeyStore);
+    for (const auto& entry : mapScripts) {
+        setScripts.insert(entry.second);
+        setScripts.insert(GetScriptForDestination(CScriptID(entry.second)));
     }
-    return ret;
+    setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+}
+
+bool CWallet::IsRelatedToWallet(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet); // mapWallet, mapTxSpends
+    if (mapWallet.count(tx.GetHash()))
+        return true;
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout))
+            return true;
+    }
+    return false;
 }
 
 void CWallet::ReacceptWalletTransactions()
@@ -2861,9 +3294,14 @@ bool CWalletTx::RelayWalletTransaction(CConnman* connman)
             LogPrintf("Relaying wtx %s\n", GetHash().ToString());
             if (connman) {
                 CInv inv(MSG_TX, GetHash());
-                connman->ForEachNode([&inv](CNode* pnode)
+                // Only the votes still needed to extend a chain tip skip the trickle
+                const bool fVote = IsVoteOnChainTip(*tx);
+                connman->ForEachNode([&inv, fVote](CNode* pnode)
                 {
-                    pnode->PushInventory(inv);
+                    if (fVote)
+                        pnode->PushVoteInventory(inv);
+                    else
+                        pnode->PushInventory(inv);
                 });
                 return true;
             }
@@ -3147,7 +3585,7 @@ std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CCon
 {
     std::vector<uint256> result;
 
-    LOCK(cs_wallet);
+    LOCK2(cs_main, cs_wallet);
 
     // Sort them in chronological order
     std::multimap<unsigned int, CWalletTx*> mapSorted;
@@ -3202,20 +3640,62 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+const CWallet::CWalletBalances& CWallet::GetCachedBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Depth, maturity and trust change with the tip and the mempool, anything
+    // else with the wallet transactions, which invalidate the cache.
+    const uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (cachedBalances.fValid && cachedBalances.hashTip == hashTip && cachedBalances.nMempoolUpdated == nMempoolUpdated)
+        return cachedBalances;
+
+    CWalletBalances balances;
+    balances.hashTip = hashTip;
+    balances.nMempoolUpdated = nMempoolUpdated;
+
+    // The credits are per transaction, whose outputs are next to each other in the set
+    uint256 hashPrev;
+    for (const COutPoint& outpoint : GetWalletUnspent()) {
+        if (outpoint.hash == hashPrev)
+            continue;
+        hashPrev = outpoint.hash;
+
+        auto it = mapWallet.find(outpoint.hash);
+        if (it == mapWallet.end())
+            continue;
+        const CWalletTx* pcoin = &it->second;
+
+        if (pcoin->IsTrusted()) {
+            balances.nBalance += pcoin->GetAvailableCredit();
+            balances.nWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
+        } else if (pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool()) {
+            balances.nUnconfirmed += pcoin->GetAvailableCredit();
+            balances.nUnconfirmedWatchOnly += pcoin->GetAvailableWatchOnlyCredit();
         }
+        balances.nImmature += pcoin->GetImmatureCredit();
+        balances.nImmatureWatchOnly += pcoin->GetImmatureWatchOnlyCredit();
     }
 
-    return nTotal;
+    std::vector<COutput> vCoins;
+    AvailableCoins(vCoins, true);
+    for (const COutput& out : vCoins) {
+        if (out.fSpendable) {
+            balances.nAvailable += out.tx->tx->vout[out.i].nValue;
+        }
+    }
+
+    balances.fValid = true;
+    cachedBalances = balances;
+    return cachedBalances;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nBalance;
 }
 
 void CWallet::GetStakedBalances(CAmount& total, CAmount& mempool, CAmount& immature, CAmount& live, CAmount& voted, CAmount& missed, CAmount& expired, CAmount& revoked) const
@@ -3285,76 +3765,32 @@ void CWallet::GetStakedBalances(CAmount& total, CAmount& mempool, CAmount& immat
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx* pcoin = &entry.second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nImmatureWatchOnly;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -3404,6 +3840,9 @@ CAmount CWallet::GetAvailableBalance(const CCoinControl* coinControl) const
 {
     LOCK2(cs_main, cs_wallet);
 
+    if (!coinControl)
+        return GetCachedBalances().nAvailable;
+
     CAmount balance = 0;
     std::vector<COutput> vCoins;
     AvailableCoins(vCoins, true, coinControl);
@@ -3500,10 +3939,19 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
 
         CAmount nTotal = 0;
 
-        for (const auto& entry : mapWallet)
+        const std::set<COutPoint>& setUnspent = GetWalletUnspent();
+        for (auto it = setUnspent.begin(); it != setUnspent.end(); )
         {
-            const uint256& wtxid = entry.first;
-            const CWalletTx* pcoin = &entry.second;
+            // The unspent outputs of a transaction are next to each other
+            const uint256 wtxid = it->hash;
+            const auto itFirst = it;
+            while (it != setUnspent.end() && it->hash == wtxid)
+                ++it;
+
+            auto mi = mapWallet.find(wtxid);
+            if (mi == mapWallet.end())
+                continue;
+            const CWalletTx* pcoin = &mi->second;
 
             if (!CheckFinalTx(*pcoin->tx))
                 continue;
@@ -3560,7 +4008,9 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
             if (nDepth < nMinDepth || nDepth > nMaxDepth)
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
+            for (auto itOut = itFirst; itOut != it; ++itOut) {
+                const unsigned int i = itOut->n;
+
                 // Outputs with a value of zero are not useful for spending, being
                 // either a nulldata (OP_RETURN) or the change output of ticket purchase
                 if (pcoin->tx->vout[i].nValue == 0)
@@ -3569,10 +4019,10 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
                 if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                     continue;
 
-                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+                if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(*itOut))
                     continue;
 
-                if (IsLockedCoin(entry.first, i))
+                if (IsLockedCoin(wtxid, i))
                     continue;
 
                 if (IsSpent(wtxid, i))
@@ -3896,30 +4346,73 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     return res;
 }
 
-bool CWallet::SignTransaction(CMutableTransaction &tx)
+static bool SignTransactionInputs(const CKeyStore& keystore, CMutableTransaction& tx, const std::vector<CTxOut>& vSpent)
 {
-    AssertLockHeld(cs_wallet); // mapWallet
-
-    // sign the new tx
     CTransaction txNewConst(tx);
-    int nIn = 0;
+    for (size_t nIn = 0; nIn < tx.vin.size(); nIn++) {
+        SignatureData sigdata;
+        if (!ProduceSignature(TransactionSignatureCreator(&keystore, &txNewConst, nIn, vSpent[nIn].nValue, SIGHASH_ALL), vSpent[nIn].scriptPubKey, sigdata)) {
+            return false;
+        }
+        UpdateTransaction(tx, nIn, sigdata);
+    }
+    return true;
+}
+
+static bool GetSpentOutputs(const std::map<uint256, CWalletTx>& mapWallet, const CMutableTransaction& tx, std::vector<CTxOut>& vSpent)
+{
+    vSpent.clear();
     for (const auto& input : tx.vin) {
         std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(input.prevout.hash);
         if(mi == mapWallet.end() || input.prevout.n >= mi->second.tx->vout.size()) {
             return false;
         }
-        const CScript& scriptPubKey = mi->second.tx->vout[input.prevout.n].scriptPubKey;
-        const CAmount& amount = mi->second.tx->vout[input.prevout.n].nValue;
-        SignatureData sigdata;
-        if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, amount, SIGHASH_ALL), scriptPubKey, sigdata)) {
-            return false;
-        }
-        UpdateTransaction(tx, nIn, sigdata);
-        nIn++;
+        vSpent.push_back(mi->second.tx->vout[input.prevout.n]);
     }
     return true;
 }
 
+bool CWallet::SignTransaction(CMutableTransaction &tx)
+{
+    AssertLockHeld(cs_wallet); // mapWallet
+
+    // sign the new tx
+    std::vector<CTxOut> vSpent;
+    return GetSpentOutputs(mapWallet, tx, vSpent) && SignTransactionInputs(*this, tx, vSpent);
+}
+
+bool CWallet::SignTransactions(std::vector<CMutableTransaction>& vtx)
+{
+    AssertLockHeld(cs_wallet); // mapWallet
+
+    std::vector<std::vector<CTxOut>> vSpent(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (!GetSpentOutputs(mapWallet, vtx[i], vSpent[i]))
+            return false;
+    }
+
+    // The worker threads only take the key store lock, so they do not
+    // contend with the wallet lock held by the caller.
+    std::atomic<size_t> nNext{0};
+    std::atomic<bool> fSigned{true};
+    auto signer = [&]() {
+        for (size_t i = nNext++; i < vtx.size() && fSigned; i = nNext++) {
+            if (!SignTransactionInputs(*this, vtx[i], vSpent[i]))
+                fSigned = false;
+        }
+    };
+
+    const size_t nThreads = std::min<size_t>(std::max(GetNumCores(), 1), vtx.size());
+    std::vector<std::thread> vThreads;
+    for (size_t i = 1; i < nThreads; i++)
+        vThreads.emplace_back(signer);
+    signer();
+    for (auto& thread : vThreads)
+        thread.join();
+
+    return fSigned;
+}
+
 bool CWallet::FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl coinControl)
 {
     std::vector<CRecipient> vecSend;
@@ -4373,6 +4866,97 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CCon
     return true;
 }
 
+bool CWallet::CommitTransactions(std::vector<CWalletTx>& vwtxNew, CConnman* connman, std::vector<CValidationState>& vState)
+{
+    LOCK2(cs_main, cs_wallet);
+    vState.assign(vwtxNew.size(), CValidationState());
+
+    {
+        // Without a transaction, as for a dummy database, the records are written one by one.
+        CWalletDB walletdb(*dbw);
+        const bool fTxn = walletdb.TxnBegin();
+        const int64_t nOrderPosNextPrev = nOrderPosNext;
+        std::vector<uint256> vAdded;
+        bool fWritten = true;
+        for (CWalletTx& wtxNew : vwtxNew) {
+            LogPrintf("CommitTransaction:\n%s", wtxNew.tx->ToString());
+
+            // Add tx to wallet, because if it has change it's also ours,
+            // otherwise just for transaction history.
+            if (!mapWallet.count(wtxNew.GetHash()))
+                vAdded.push_back(wtxNew.GetHash());
+            if (!AddToWallet(wtxNew, walletdb)) {
+                fWritten = false;
+                break;
+            }
+        }
+        if (fTxn) {
+            if (fWritten)
+                fWritten = walletdb.TxnCommit();
+            else
+                walletdb.TxnAbort();
+        }
+
+        if (!fWritten) {
+            // None of the batch reached the database, so drop it from memory too.
+            if (fTxn) {
+                RemoveFromWtxOrdered(vAdded);
+                for (const uint256& hash : vAdded) {
+                    auto it = mapWallet.find(hash);
+                    UnindexWalletTx(it->second);
+                    mapWallet.erase(it);
+                    NotifyTransactionChanged(this, hash, CT_DELETED);
+                }
+                RemoveFromSpends(vAdded);
+                nOrderPosNext = nOrderPosNextPrev;
+                MarkDirty();
+            }
+            return false;
+        }
+    }
+
+    for (const CWalletTx& wtxNew : vwtxNew) {
+        // Notify that old coins are spent
+        for (const CTxIn& txin : wtxNew.tx->vin)
+        {
+            CWalletTx &coin = mapWallet[txin.prevout.hash];
+            coin.BindWallet(this);
+            NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
+        }
+
+        // Track how many getdata requests our transaction gets
+        mapRequestCount[wtxNew.GetHash()] = 0;
+    }
+
+    if (fBroadcastTransactions)
+    {
+        std::vector<std::pair<CInv, bool>> vInv;
+        for (size_t i = 0; i < vwtxNew.size(); i++) {
+            CWalletTx& wtxNew = mapWallet[vwtxNew[i].GetHash()];
+            if (!wtxNew.AcceptToMemoryPool(maxTxFee, vState[i])) {
+                LogPrintf("CommitTransactions(): Transaction cannot be broadcast immediately, %s\n", vState[i].GetRejectReason());
+                continue;
+            }
+            LogPrintf("Relaying wtx %s\n", wtxNew.GetHash().ToString());
+            vInv.emplace_back(CInv(MSG_TX, wtxNew.GetHash()), ParseTxClass(*wtxNew.tx) == TX_Vote);
+        }
+
+        // Broadcast
+        if (connman && !vInv.empty()) {
+            connman->ForEachNode([&vInv](CNode* pnode)
+            {
+                for (const auto& inv : vInv) {
+                    if (inv.second)
+                        pnode->PushVoteInventory(inv.first);
+                    else
+                        pnode->PushInventory(inv.first);
+                }
+            });
+        }
+    }
+    return true;
+}
+
 void CWallet::ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& entries) {
     CWalletDB walletdb(*dbw);
     return walletdb.ListAccountCreditDebit(strAccount, entries);
@@ -4423,6 +5007,16 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
 
+    // Transactions may be read before the keys paying to them
+    fWalletUnspentDirty = true;
+    cachedBalances.fValid = false;
+
+    // Transactions may have been given new order positions
+    mapWtxOrderedByClass.clear();
+    mapWtxByHeight.clear();
+    for (auto& entry : mapWallet)
+        IndexWalletTx(entry.second);
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -4432,8 +5026,16 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
 {
     AssertLockHeld(cs_wallet); // mapWallet
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
-    for (uint256 hash : vHashOut)
-        mapWallet.erase(hash);
+    for (uint256 hash : vHashOut) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            UnindexWalletTx(it->second);
+            mapWallet.erase(it);
+        }
+        mapVoteTemplates.erase(hash);
+    }
+    fWalletUnspentDirty = true;
+    cachedBalances.fValid = false;
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -5009,18 +5611,21 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    cachedBalances.fValid = false;
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    cachedBalances.fValid = false;
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    cachedBalances.fValid = false;
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -5218,7 +5823,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
     if (gArgs.GetBoolArg("-zapwallettxes", false)) {
         uiInterface.InitMessage(_("Zapping all transactions from wallet..."));
 
-        std::unique_ptr<CWalletDBWrapper> dbw(new CWalletDBWrapper(&bitdb, walletFile));
+        std::unique_ptr<CWalletDBWrapper> dbw = MakeWalletDBWrapper(walletFile);
         std::unique_ptr<CWallet> tempWallet(new CWallet(std::move(dbw)));
         DBErrors nZapWalletRet = tempWallet->ZapWalletTx(vWtx);
         if (nZapWalletRet != DB_LOAD_OK) {
@@ -5231,7 +5836,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
 
     int64_t nStart = GetTimeMillis();
     bool fFirstRun = true;
-    std::unique_ptr<CWalletDBWrapper> dbw(new CWalletDBWrapper(&bitdb, walletFile));
+    std::unique_ptr<CWalletDBWrapper> dbw = MakeWalletDBWrapper(walletFile);
     CWallet *walletInstance = new CWallet(std::move(dbw));
     DBErrors nLoadWalletRet = walletInstance->LoadWallet(fFirstRun);
     if (nLoadWalletRet != DB_LOAD_OK)
@@ -74,6 +74,8 @@ static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 static const bool DEFAULT_WALLET_REJECT_LONG_CHAINS = false;
 //! -txconfirmtarget default
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
+//! Confirmation target of ticket purchases without an expiry
+static const unsigned int DEFAULT_TICKET_CONFIRM_TARGET = 2;
 //! -walletrbf default
 static const bool DEFAULT_WALLET_RBF = false;
 //! -autobuy default
@@ -86,6 +88,10 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! Maximum number of threads reading and matching blocks during a rescan
+static const int MAX_RESCAN_THREADS = 8;
+//! Number of blocks a rescan reads ahead of the ones applied to the wallet
+static const unsigned int RESCAN_READ_AHEAD = 32;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -336,6 +342,7 @@ public:
     int64_t nOrderPos; //!< position in ordered transaction list
 
     // memory only
+    int nIndexedHeight; //!< height the transaction is filed under in CWallet::mapWtxByHeight
     mutable bool fDebitCached;
     mutable bool fCreditCached;
     mutable bool fStakedCreditCached;
@@ -377,6 +384,7 @@ public:
         nTimeSmart = 0;
         fFromMe = false;
         strFromAccount.clear();
+        nIndexedHeight = -1;
         fDebitCached = false;
         fCreditCached = false;
         fStakedCreditCached = false;
@@ -791,6 +799,58 @@ private:
      * Should be called with pindexBlock and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, const CBlockIndex *pindex = nullptr, int posInBlock = 0);
 
+    /**
+     * Outputs of ours with a value, which no wallet transaction spends. Coin
+     * selection and the balances visit only the transactions in here instead
+     * of all of mapWallet. It may hold outputs spent again after a conflict
+     * got reorganized away, so maturity, depth, trust and IsSpent are still
+     * checked by the readers.
+     */
+    mutable std::set<COutPoint> setWalletUnspent;
+    //! Set when keys or transactions came or went in bulk, setWalletUnspent is then recomputed on its next use
+    mutable bool fWalletUnspentDirty;
+    /* Update setWalletUnspent for an output, or for the outputs of a transaction and the outputs it spends */
+    void UpdateWalletUnspent(const COutPoint& outpoint);
+    void UpdateWalletUnspent(const CWalletTx& wtx);
+    const std::set<COutPoint>& GetWalletUnspent() const;
+
+    /** The balances over setWalletUnspent, for the tip and mempool they were summed at */
+    struct CWalletBalances
+    {
+        bool fValid = false;
+        uint256 hashTip;
+        unsigned int nMempoolUpdated = 0;
+        CAmount nBalance = 0;
+        CAmount nUnconfirmed = 0;
+        CAmount nImmature = 0;
+        CAmount nWatchOnly = 0;
+        CAmount nUnconfirmedWatchOnly = 0;
+        CAmount nImmatureWatchOnly = 0;
+        CAmount nAvailable = 0;
+    };
+    mutable CWalletBalances cachedBalances;
+    const CWalletBalances& GetCachedBalances() const;
+
+    /**
+     * The unsigned vote of a ticket, built before the ticket is selected so
+     * that voting only has to fill in the declaration of the voted block,
+     * sign and commit. The rewards are those of the subsidy at the height
+     * the template was built for. No private key is kept: the signature
+     * fetches it from the keystore as usual.
+     */
+    struct CVoteTemplate
+    {
+        CTransactionRef ticket;
+        std::vector<TicketContribData> contributions;
+        CMutableTransaction voteTx; //!< vout[0] is left empty for the vote declaration
+        CAmount voteSubsidy;
+    };
+    //! Templates of the live and immature tickets of the wallet, by ticket hash
+    std::map<uint256, CVoteTemplate> mapVoteTemplates;
+    //! Whether the live tickets the wallet owned before the first update got their templates
+    bool fVoteTemplatesLoaded;
+    bool BuildVoteTemplate(const uint256& ticketHash, int nHeight, CVoteTemplate& vt, CWalletError& error) const;
+
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
@@ -872,7 +932,7 @@ public:
         autoRevoker = MakeUnique<CAutoRevoker>(this);
         if (autoRevoke) autoRevoker->start();
         ticketBuyer = MakeUnique<CTicketBuyer>(this);
-        ticketBuyer->GetConfig().buyTickets = fAutoBuy;
+        if (fAutoBuy) ticketBuyer->start();
         SetNull();
     }
 
@@ -886,7 +946,7 @@ public:
         autoRevoker = MakeUnique<CAutoRevoker>(this);
         if (autoRevoke) autoRevoker->start();
         ticketBuyer = MakeUnique<CTicketBuyer>(this);
-        ticketBuyer->GetConfig().buyTickets = fAutoBuy;
+        if (fAutoBuy) ticketBuyer->start();
         SetNull();
     }
 
@@ -927,6 +987,8 @@ public:
         nRelockTime = 0;
         fAbortRescan = false;
         fScanningWallet = false;
+        fWalletUnspentDirty = false;
+        fVoteTemplatesLoaded = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -938,6 +1000,20 @@ public:
 
     void RemoveFromWtxOrdered(std::vector<uint256> hashes);
 
+    //! The transactions of wtxOrdered by their class, to page through tickets, votes or revocations alone
+    std::map<ETxClass, TxItems> mapWtxOrderedByClass;
+    /**
+     * The wallet transactions by the height of the active chain block they
+     * are in, or -1 when they are unconfirmed, conflicted or abandoned, then
+     * by order position. listsinceblock reads it from the given block on.
+     */
+    std::multimap<std::pair<int, int64_t>, CWalletTx*> mapWtxByHeight;
+    /* Add a transaction to or remove it from mapWtxOrderedByClass and mapWtxByHeight */
+    void IndexWalletTx(CWalletTx& wtx);
+    void UnindexWalletTx(const CWalletTx& wtx);
+    /* File a transaction in mapWtxByHeight again after its block changed, or the chain under it */
+    void ReindexWalletTxHeight(CWalletTx& wtx);
+
     int64_t nOrderPosNext;
     uint64_t nAccountingEntryNumber;
     std::map<uint256, int> mapRequestCount;
@@ -1051,13 +1127,19 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
+    bool AddToWallet(const CWalletTx& wtxIn, CWalletDB& walletdb);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) override;
     bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
-    int64_t RescanFromTime(int64_t startTime, bool update);
+    int64_t RescanFromTime(int64_t startTime, bool update, const std::set<CScript>* pscripts = nullptr);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, bool fUpdate = false);
+    bool ScanForWalletTransactionsByAddrIndex(const std::set<CScript>& setScripts, const CBlockIndex* pindexStart, const CBlockIndex* pindexStop, bool fUpdate = false);
+    //! Scripts paying to the keys, scripts and watch-only entries of the wallet
+    void GetScriptsForRescan(std::set<CScript>& setScripts) const;
+    //! Whether the transaction is in the wallet, spends from it or conflicts with it
+    bool IsRelatedToWallet(const CTransaction& tx) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
@@ -1083,6 +1165,13 @@ public:
     bool FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl);
     bool SignTransaction(CMutableTransaction& tx);
 
+    /**
+     * Sign a batch of transactions spending wallet outputs. The spent outputs
+     * are looked up under cs_wallet and the transactions are then signed in
+     * parallel, as signing only needs the key store.
+     */
+    bool SignTransactions(std::vector<CMutableTransaction>& vtx);
+
     /**
      * Create a new transaction paying the recipients with a set of coins
      * selected by SelectCoins(); Also create the change output, when needed
@@ -1092,6 +1181,17 @@ public:
                            std::string& strFailReason, const CCoinControl& coin_control, bool sign = true);
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CConnman* connman, CValidationState& state);
 
+    /**
+     * Commit a batch of transactions which do not use reserved keys: their
+     * wallet records are written in a single database transaction, they are
+     * submitted to the memory pool one after the other under a single lock
+     * and the accepted ones are announced to each peer in one go.
+     * When the database transaction fails, the batch is removed from the
+     * wallet again and false is returned.
+     * vState receives the memory pool validation state of each transaction.
+     */
+    bool CommitTransactions(std::vector<CWalletTx>& vwtxNew, CConnman* connman, std::vector<CValidationState>& vState);
+
     void ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& entries);
     bool AddAccountingEntry(const CAccountingEntry&);
     bool AddAccountingEntry(const CAccountingEntry&, CWalletDB *pwalletdb);
@@ -1112,6 +1212,9 @@ public:
         ticketFeeRate.store(newTicketFeeRate);
     }
 
+    /** Estimated ticket purchase feerate for confTarget blocks, or the set ticket feerate without an estimate */
+    CFeeRate GetTicketFeeRateEstimate(unsigned int confTarget);
+
     bool NewKeyPool();
     size_t KeypoolCountExternalKeys();
     bool TopUpKeyPool(unsigned int kpSize = 0);
@@ -1320,6 +1423,7 @@ public:
 
     /* Initiates the purchase of tickets
        It funds and creates the corresponding transactions, as well as it sends them to the memory pool.
+       The tickets are signed in parallel and committed as one batch, see CommitTransactions.
        - fromAccount: account to use for purchase
        - spendlimit: limit on the amount to spend on ticket
        - minConf: minimum number of block confirmations required
@@ -1362,6 +1466,15 @@ public:
          const VoteBits voteBits,
          const ExtendedVoteBits& extendedVoteBits);
 
+    /* Prepares the votes of the tickets of the wallet that are live or about to be at pindex,
+       and forgets those of the tickets that cannot vote anymore or that were abandoned or zapped.
+       Only the tickets mined in the last nTicketMaturity blocks are looked up in the wallet, so
+       Vote builds on its own the votes of older tickets found later by a rescan. */
+    void UpdateVoteTemplates(const CBlockIndex* pindex);
+
+    /* Whether a vote is prepared for the ticket, which implies that it is a ticket of the wallet */
+    bool HasVoteTemplate(const uint256& ticketHash) const;
+
     /* Creates a revocation
        It funds and creates the revocation transaction for the specified ticket and sends it to the memory pool.
        This transaction must have a fee for encouragig miners to add it in a block. This fee will be spent from the stake,
@@ -186,8 +186,7 @@ void CWalletDB::ListAccountCreditDebit(const std::string& strAccount, std::list<
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = batch.GetCursor();
-    if (!pcursor)
+    if (!batch.StartCursor())
         throw std::runtime_error(std::string(__func__) + ": cannot create DB cursor");
     bool setRange = true;
     while (true)
@@ -197,13 +196,13 @@ void CWalletDB::ListAccountCreditDebit(const std::string& strAccount, std::list<
         if (setRange)
             ssKey << std::make_pair(std::string("acentry"), std::make_pair((fAllAccounts ? std::string("") : strAccount), uint64_t(0)));
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        int ret = batch.ReadAtCursor(pcursor, ssKey, ssValue, setRange);
+        int ret = batch.ReadAtCursor(ssKey, ssValue, setRange);
         setRange = false;
         if (ret == DB_NOTFOUND)
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            batch.CloseCursor();
             throw std::runtime_error(std::string(__func__) + ": error scanning DB");
         }
 
@@ -222,7 +221,7 @@ void CWalletDB::ListAccountCreditDebit(const std::string& strAccount, std::list<
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    batch.CloseCursor();
 }
 
 class CWalletScanState {
@@ -543,8 +542,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = batch.GetCursor();
-        if (!pcursor)
+        if (!batch.StartCursor())
         {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
@@ -555,12 +553,13 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = batch.ReadAtCursor(pcursor, ssKey, ssValue);
+            int ret = batch.ReadAtCursor(ssKey, ssValue);
             if (ret == DB_NOTFOUND)
                 break;
             else if (ret != 0)
             {
                 LogPrintf("Error reading next record from wallet database\n");
+                batch.CloseCursor();
                 return DB_CORRUPT;
             }
 
@@ -584,7 +583,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 LogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        batch.CloseCursor();
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -646,8 +645,7 @@ DBErrors CWalletDB::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CWal
         }
 
         // Get cursor
-        Dbc* pcursor = batch.GetCursor();
-        if (!pcursor)
+        if (!batch.StartCursor())
         {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
@@ -658,12 +656,13 @@ DBErrors CWalletDB::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CWal
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = batch.ReadAtCursor(pcursor, ssKey, ssValue);
+            int ret = batch.ReadAtCursor(ssKey, ssValue);
             if (ret == DB_NOTFOUND)
                 break;
             else if (ret != 0)
             {
                 LogPrintf("Error reading next record from wallet database\n");
+                batch.CloseCursor();
                 return DB_CORRUPT;
             }
 
@@ -680,7 +679,7 @@ DBErrors CWalletDB::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CWal
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        batch.CloseCursor();
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -770,9 +769,12 @@ void MaybeCompactWalletDB()
             dbh.nLastWalletUpdate = GetTime();
         }
 
-        if (dbh.nLastFlushed != nUpdateCounter && GetTime() - dbh.nLastWalletUpdate >= 2) {
+        // A log is also synced while the wallet keeps changing, see WALLET_LOG_SYNC_INTERVAL
+        if (dbh.nLastFlushed != nUpdateCounter && (GetTime() - dbh.nLastWalletUpdate >= 2 ||
+                (dbh.IsLog() && GetTime() - dbh.nLastFlushTime >= WALLET_LOG_SYNC_INTERVAL))) {
             if (CDB::PeriodicFlush(dbh)) {
                 dbh.nLastFlushed = nUpdateCounter;
+                dbh.nLastFlushTime = GetTime();
             }
         }
     }